@@ -18,6 +18,12 @@
 /************************************************************************/
 
 #include "ai.h"
+#include "parallel_task.h"
+#include "profiler.h"
+#include "framearena.h"
+#include "physics/cardynamics.h"
+#include "tobullet.h"
+#include "minmax.h"
 #include <cassert>
 // AI implementations:
 #include "ai_car_standard.h"
@@ -25,7 +31,39 @@
 
 const std::string Ai::default_type = "aistd";
 
-Ai::Ai()
+// minimum number of ai cars per worker thread
+static const unsigned cars_per_worker = 4;
+
+class AiWorker : public Parallel::Task
+{
+public:
+	AiWorker(Ai & ai) : ai(ai)
+	{
+		// wait for the worker thread to be ready
+		Init();
+		End();
+	}
+
+	void Setup() override
+	{
+		Profiler::SetThreadName("ai worker");
+	}
+
+	void Execute() override
+	{
+		// one update per frame
+		FrameArena::Get().Reset();
+		ai.UpdateCars();
+	}
+
+private:
+	Ai & ai;
+};
+
+Ai::Ai() :
+	job_next(0),
+	job_cars(0),
+	job_dt(0)
 {
 	AddFactory("aistd", new AiCarStandardFactory());
 	AddFactory("aiexp", new AiCarExperimentalFactory());
@@ -33,6 +71,8 @@ Ai::Ai()
 
 Ai::~Ai()
 {
+	workers.clear();
+
 	Ai::ClearCars();
 
 	for (auto & factory : ai_factories)
@@ -65,9 +105,79 @@ void Ai::ClearCars()
 
 void Ai::Update(float dt, const CarDynamics cars[], const int cars_num)
 {
+	if (ai_cars.empty())
+		return;
+
+	car_states.Update(cars, cars_num);
+
+	job_next = 0;
+	job_cars = cars;
+	job_dt = dt;
+
+	// spawn workers on demand, the calling thread is doing its share
+	unsigned workers_num = (ai_cars.size() - 1) / cars_per_worker;
+	workers_num = Min(workers_num, unsigned(Max(SDL_GetCPUCount() - 1, 0)));
+	while (workers.size() < workers_num)
+		workers.emplace_back(new AiWorker(*this));
+
+	for (unsigned i = 0; i < workers_num; ++i)
+		workers[i]->Start();
+
+	UpdateCars();
+
+	for (unsigned i = 0; i < workers_num; ++i)
+		workers[i]->End();
+
+	// ai cars that can't run concurrently
+	for (auto ai_car : ai_cars)
+	{
+		if (!ai_car->GetConcurrent())
+			ai_car->Update(dt, cars, car_states);
+	}
+
+	CastRays(cars);
+}
+
+void Ai::CastRays(const CarDynamics cars[])
+{
+	rays.clear();
+	for (auto ai_car : ai_cars)
+	{
+		const btCollisionObject * caster = &cars[ai_car->GetCarId()].getCollisionObject();
+		for (const auto & raycast : ai_car->GetRayCasts())
+		{
+			DynamicsWorld::RayQuery ray;
+			ray.origin = ToBulletVector(raycast.origin);
+			ray.direction = ToBulletVector(raycast.direction);
+			ray.length = raycast.length;
+			ray.caster = caster;
+			rays.push_back(ray);
+		}
+	}
+	if (rays.empty())
+		return;
+
+	// bullet ray tests are not thread safe, cast all rays in one batch
+	ray_distances.resize(rays.size());
+	cars[0].getDynamicsWorld()->castRays(&rays[0], &ray_distances[0], rays.size());
+
+	unsigned n = 0;
 	for (auto ai_car : ai_cars)
 	{
-		ai_car->Update(dt, cars, cars_num);
+		for (auto & raycast : ai_car->GetRayCasts())
+			raycast.distance = ray_distances[n++];
+	}
+}
+
+void Ai::UpdateCars()
+{
+	PROFILE_SCOPE("ai cars");
+	unsigned i;
+	while ((i = job_next++) < ai_cars.size())
+	{
+		AiCar * ai_car = ai_cars[i];
+		if (ai_car->GetConcurrent())
+			ai_car->Update(job_dt, job_cars, car_states);
 	}
 }
 
@@ -21,11 +21,16 @@
 #define _AI_H
 
 #include "ai_car.h"
+#include "ai_car_states.h"
+#include "physics/dynamicsworld.h"
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 #include <map>
 
 class AiFactory;
+class AiWorker;
 
 /// Manages all Ai cars.
 class Ai
@@ -39,6 +44,8 @@ public:
 
 	void ClearCars();
 
+	/// Snapshot car states and update Ai cars concurrently on worker threads.
+	/// Ray casts queued by the Ai cars are cast afterwards in one batch.
 	void Update(float dt, const CarDynamics cars[], const int cars_num);
 
 	const std::vector<float> & GetInputs(unsigned id) const;
@@ -52,8 +59,25 @@ public:
 	static const std::string default_type;
 
 private:
+	friend class AiWorker;
+
 	std::vector <AiCar*> ai_cars;
 	std::map <std::string, AiFactory*> ai_factories;
+	AiCarStates car_states;
+	std::vector <std::unique_ptr<AiWorker> > workers;
+
+	// current update job, ai cars are claimed by index
+	std::atomic<unsigned> job_next;
+	const CarDynamics * job_cars;
+	float job_dt;
+
+	// batched ai car ray casts
+	std::vector <DynamicsWorld::RayQuery> rays;
+	std::vector <btScalar> ray_distances;
+
+	void UpdateCars();
+
+	void CastRays(const CarDynamics cars[]);
 };
 
 #endif //_AI_H
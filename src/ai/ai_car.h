@@ -21,9 +21,20 @@
 #define _AI_CAR_H
 
 #include "physics/carinput.h"
+#include "mathvector.h"
 #include <vector>
 
 class CarDynamics;
+class AiCarStates;
+
+/// Distance only ray cast, queued by Update and cast by Ai in one batch.
+struct AiRayCast
+{
+	Vec3 origin;	///< world space
+	Vec3 direction;	///< world space
+	float length;
+	float distance;	///< distance to the first hit or length, set after the batch is cast
+};
 
 /// AI Car controller interface.
 class AiCar
@@ -37,7 +48,15 @@ public:
 
 	const std::vector<float> & GetInputs() const;
 
-	virtual void Update(float dt, const CarDynamics cars[], const unsigned cars_num) = 0;
+	/// Update runs concurrently for all Ai cars. Other cars have to be
+	/// accessed through their state snapshot, the car dynamics are read-only.
+	virtual void Update(float dt, const CarDynamics cars[], const AiCarStates & states) = 0;
+
+	/// Returns false if Update accesses shared state and has to run serially.
+	virtual bool GetConcurrent() const;
+
+	/// Ray casts queued by the last Update, results are available to the next Update.
+	std::vector<AiRayCast> & GetRayCasts();
 
 	/// This is optional for drawing debug stuff.
 	/// It will only be called, when VISUALIZE_AI_DEBUG macro is defined.
@@ -50,6 +69,9 @@ protected:
 	/// Contains the car inputs, which is the output of the AI.
 	/// The vector is indexed by CARINPUT values.
 	std::vector <float> inputs;
+
+	/// Ray casts of the current Update.
+	std::vector <AiRayCast> raycasts;
 };
 
 
@@ -76,6 +98,16 @@ inline const std::vector<float> & AiCar::GetInputs() const
 	return inputs;
 }
 
+inline bool AiCar::GetConcurrent() const
+{
+	return true;
+}
+
+inline std::vector<AiRayCast> & AiCar::GetRayCasts()
+{
+	return raycasts;
+}
+
 inline void AiCar::Visualize()
 {
 	// optional
@@ -18,6 +18,7 @@
 /************************************************************************/
 
 #include "ai_car_experimental.h"
+#include "ai_car_states.h"
 #include "physics/cardynamics.h"
 #include "physics/dynamicsworld.h"
 #include "minmax.h"
@@ -95,13 +96,16 @@ float AiCarExperimental::RateLimit(float old_value, float new_value, float rate_
 		return new_value;
 }
 
-void AiCarExperimental::Update(float dt, const CarDynamics cars[], const unsigned cars_num)
+void AiCarExperimental::Update(float dt, const CarDynamics cars[], const AiCarStates & states)
 {
 	float lastThrottle = inputs[CarInput::THROTTLE];
 	float lastBreak = inputs[CarInput::BRAKE];
 	fill(inputs.begin(), inputs.end(), 0);
 
-	AnalyzeOthers(dt, cars, cars_num);
+	raycasts_last.swap(raycasts);
+	raycasts.clear();
+
+	AnalyzeOthers(dt, cars[carid], states);
 	UpdateGasBrake(cars[carid]);
 	UpdateSteer(cars[carid], dt);
 	float rateLimit = THROTTLE_RATE_LIMIT * dt;
@@ -424,54 +428,38 @@ float AiCarExperimental::CalcSpeedLimit(
 	return car.GetMaxSpeed(radius, FRICTION_FACTOR_LAT);
 }
 
-float AiCarExperimental::RayCastDistance(const CarDynamics & car, Vec3 direction, float max_length)
+bool AiCarExperimental::RayCastDistance(const CarDynamics & car, Vec3 direction, float max_length, float & distance)
 {
 	btVector3 pos = car.GetPosition();
 	btVector3 dir = car.LocalToWorld(ToBulletVector(direction)) - pos;
 
-	CollisionContact contact;
-	car.getDynamicsWorld()->castRay(
-		pos, dir, max_length,
-		&car.getCollisionObject(),
-		contact);
+	// rays are matched with the previous update by call order
+	const unsigned id = raycasts.size();
+	const bool valid = id < raycasts_last.size();
+	distance = valid ? Min(max_length, raycasts_last[id].distance) : max_length;
 
-	float depth = contact.GetDepth();
-	float dist = Min(max_length, depth);
+	AiRayCast raycast;
+	raycast.origin = ToMathVector<float>(pos);
+	raycast.direction = ToMathVector<float>(dir);
+	raycast.length = max_length;
+	raycast.distance = max_length;
+	raycasts.push_back(raycast);
 
 #ifdef VISUALIZE_AI_DEBUG
 	Vec3 pos_start(ToMathVector<float>(pos));
-	Vec3 pos_end = pos_start + (ToMathVector<float>(dir) * dist);
+	Vec3 pos_end = pos_start + (ToMathVector<float>(dir) * distance);
 	AddLinePoint(raycastshape, pos_start);
 	AddLinePoint(raycastshape, pos_end);
 #endif
 
-	return dist;
+	return valid;
 }
 
-const RoadPatch * AiCarExperimental::GetNearestPatch(const CarDynamics & car, const RoadPatch * /*helper*/)
+const RoadPatch * AiCarExperimental::GetNearestPatch(const CarDynamics & car, const RoadPatch * helper)
 {
-	// At the moment this is very slow!
-	// TODO: Implement backward chaining for BEZIER, to just look around the helper if passed.
- 	const btVector3 c = car.GetPosition();
-	const RoadPatch * p_end = car.getDynamicsWorld()->GetSectorPatch(0);
-	const RoadPatch * p = p_end->GetNextPatch();
-	const RoadPatch * p_nearest = 0;
-	float v_nearDist = 1000000.0f;
-	while(p != 0 && p != p_end)
-	{
-		Vec3 v(p->GetPoint(2,2));
-		v[0] -= c[1];
-		v[2] -= c[0];
-		float dist = v[0]*v[0]+v[2]*v[2];
-		if(dist < v_nearDist){
-			v_nearDist = dist;
-			p_nearest = p;
-
-		}
-		p = p->GetNextPatch();
-	}
-	assert(p_nearest);
-	return p_nearest;
+	// track road index lookup, keep the helper patch if there is no road
+	const RoadPatch * nearest = car.getDynamicsWorld()->GetNearestPatch(car.GetPosition());
+	return nearest ? nearest : helper;
 }
 
 bool AiCarExperimental::Recover(const CarDynamics & car, float dt, const RoadPatch * /*patch*/)
@@ -484,9 +472,12 @@ bool AiCarExperimental::Recover(const CarDynamics & car, float dt, const RoadPat
 	{
 		//If the car is not moving, there may be a wall in the front.
 
-		//Cast ray towards front-middle
+		//Cast ray towards front-middle, keep recover state until the ray has been cast
 		const float max_dist = 3;
-		float dist = RayCastDistance(car, Vec3(0, 1, 0), max_dist);
+		float dist;
+		if (!RayCastDistance(car, Vec3(0, 1, 0), max_dist, dist))
+			return is_recovering;
+
 		if (dist < max_dist * 0.99f)
 		{
 			// Collision detected: we are probably trying to cross a wall.
@@ -623,14 +614,6 @@ void AiCarExperimental::UpdateSteer(const CarDynamics & car, float dt)
 	inputs[CarInput::STEER_RIGHT] = steer_value;
 }
 
-float AiCarExperimental::GetHorizontalDistanceAlongPatch(const RoadPatch & patch, Vec3 carposition)
-{
-	Vec3 leftside = (patch.GetPoint(0,0) + patch.GetPoint(3,0))*0.5f;
-	Vec3 rightside = (patch.GetPoint(0,3) + patch.GetPoint(3,3))*0.5f;
-	Vec3 patchwidthvector = rightside - leftside;
-	return patchwidthvector.Normalize().dot(carposition-leftside);
-}
-
 float AiCarExperimental::RampBetween(float val, float startat, float endat)
 {
 	assert(endat > startat);
@@ -652,7 +635,7 @@ float AiCarExperimental::BrakeFromOthers(float speed_diff)
 
 	for (const auto & car : othercars)
 	{
-		if (car.active && std::abs(car.horizontal_distance) < horizontal_care)
+		if (std::abs(car.horizontal_distance) < horizontal_care)
 		{
 			if (car.fore_distance < mindistance)
 			{
@@ -690,67 +673,58 @@ float AiCarExperimental::BrakeFromOthers(float speed_diff)
 	return bias;
 }
 
-void AiCarExperimental::AnalyzeOthers(float dt, const CarDynamics cars[], const unsigned cars_num)
+void AiCarExperimental::AnalyzeOthers(float dt, const CarDynamics & dynamics, const AiCarStates & states)
 {
 	const float half_carlength = 1.25;
 	const btVector3 throttle_axis = Direction::forward;
-	const CarDynamics & car = cars[carid];
+	const AiCarState & car = states[carid];
+
+	// only consider cars within our reaction and brake distance
+	const float reaction_time = 1.0;
+	const float speed = car.velocity.length();
+	const float awareness_radius = 30.0 + speed * reaction_time +
+		dynamics.GetBrakeDistance(speed, 0, FRICTION_FACTOR_LONG);
+	states.Query(car.position, awareness_radius, neighbours);
 
-	if (othercars.size() < cars_num)
-		othercars.resize(cars_num);
+	// keep last infos for eta rate limiting, both lists are sorted by id
+	othercars_last.swap(othercars);
+	othercars.clear();
+	auto last = othercars_last.begin();
 
-	for (unsigned i = 0; i < cars_num; ++i)
+	for (unsigned i : neighbours)
 	{
 		if (i == carid)
 			continue;
 
-		const CarDynamics & icar = cars[i];
-		OtherCarInfo & info = othercars[i];
+		const AiCarState & icar = states[i];
 
 		// find direction of other cars in our frame
-		btVector3 relative_position = icar.GetCenterOfMass() - car.GetCenterOfMass();
-		relative_position = quatRotate(car.GetOrientation().inverse(), relative_position);
+		btVector3 relative_position = quatRotate(car.orientation_inverse, icar.position - car.position);
 
 		// only make a move if the other car is within our distance limit
 		float fore_position = relative_position.dot(throttle_axis);
 
-		btVector3 myvel = quatRotate(car.GetOrientation().inverse(), car.GetVelocity());
-		btVector3 othervel = quatRotate(icar.GetOrientation().inverse(), icar.GetVelocity());
-		float speed_diff = othervel.dot(throttle_axis) - myvel.dot(throttle_axis);
+		float speed_diff = icar.velocity.dot(throttle_axis) - car.velocity.dot(throttle_axis);
 
 		const float fore_position_offset = -half_carlength;
-		if (fore_position > fore_position_offset)
+		if (fore_position > fore_position_offset && icar.patch && car.patch)
 		{
-			const RoadPatch * othercarpatch = GetCurrentPatch(icar);
-			const RoadPatch * mycarpatch = GetCurrentPatch(car);
+			float speed_diff_denom = Clamp(speed_diff, -100.f, -0.01f);
+			float eta = (fore_position - fore_position_offset) / -speed_diff_denom;
 
-			if (othercarpatch && mycarpatch)
-			{
-				Vec3 mypos = ToMathVector<float>(car.GetCenterOfMass());
-				Vec3 otpos = ToMathVector<float>(icar.GetCenterOfMass());
-				float my_track_placement = GetHorizontalDistanceAlongPatch(*mycarpatch, mypos);
-				float their_track_placement = GetHorizontalDistanceAlongPatch(*othercarpatch, otpos);
-
-				float speed_diff_denom = Clamp(speed_diff, -100.f, -0.01f);
-				float eta = (fore_position - fore_position_offset) / -speed_diff_denom;
-
-				if (!info.active)
-					info.eta = eta;
-				else
-					info.eta = RateLimit(info.eta, eta, 10.f*dt, 10000.f*dt);
-
-				info.horizontal_distance = their_track_placement - my_track_placement;
-				info.fore_distance = fore_position;
-				info.active = true;
-			}
+			while (last != othercars_last.end() && last->id < i)
+				++last;
+
+			OtherCarInfo info;
+			info.id = i;
+			if (last == othercars_last.end() || last->id != i)
+				info.eta = eta;
 			else
-			{
-				info.active = false;
-			}
-		}
-		else
-		{
-			info.active = false;
+				info.eta = RateLimit(last->eta, eta, 10.f*dt, 10000.f*dt);
+
+			info.horizontal_distance = icar.track_placement - car.track_placement;
+			info.fore_distance = fore_position;
+			othercars.push_back(info);
 		}
 	}
 }
@@ -770,7 +744,7 @@ float AiCarExperimental::SteerAwayFromOthers(float carspeed)
 
 	for (const auto & car : othercars)
 	{
-		if (car.active && std::abs(car.horizontal_distance) < std::abs(min_horizontal_distance))
+		if (std::abs(car.horizontal_distance) < std::abs(min_horizontal_distance))
 		{
 			min_horizontal_distance = car.horizontal_distance;
 			eta = car.eta;
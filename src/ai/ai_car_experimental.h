@@ -42,7 +42,7 @@ public:
 
 	~AiCarExperimental();
 
-	void Update(float dt, const CarDynamics cars[], const unsigned cars_num) override;
+	void Update(float dt, const CarDynamics cars[], const AiCarStates & states) override;
 
 #ifdef VISUALIZE_AI_DEBUG
 	void Visualize() override;
@@ -53,16 +53,20 @@ private:
 	bool is_recovering;			///< tries to get back to the road.
 	float recover_time;
 
+	/// Cars within awareness radius, sorted by car id.
 	struct OtherCarInfo
 	{
-		OtherCarInfo() : active(false) {}
-
+		unsigned id;
 		float horizontal_distance;
 		float fore_distance;
 		float eta;
-		bool active;
 	};
 	std::vector <OtherCarInfo> othercars;
+	std::vector <OtherCarInfo> othercars_last;
+	std::vector <unsigned> neighbours;
+
+	/// Ray casts of the previous Update with their distances.
+	std::vector <AiRayCast> raycasts_last;
 
 	void UpdateGasBrake(const CarDynamics & car);
 
@@ -76,7 +80,7 @@ private:
 
 	void UpdateSteer(const CarDynamics & car, float dt);
 
-	void AnalyzeOthers(float dt, const CarDynamics cars[], const unsigned cars_num);
+	void AnalyzeOthers(float dt, const CarDynamics & dynamics, const AiCarStates & states);
 
 	///< returns a float that should be added into the steering wheel command
 	float SteerAwayFromOthers(float carspeed);
@@ -102,8 +106,6 @@ private:
 
 	static void TrimPatch(RoadPatch & patch, float trimleft_front, float trimright_front, float trimleft_back, float trimright_back);
 
-	static float GetHorizontalDistanceAlongPatch(const RoadPatch & patch, Vec3 carposition);
-
 	static float RampBetween(float val, float startat, float endat);
 
 	/// This will return the nearest patch to the car.
@@ -113,8 +115,9 @@ private:
 
 	bool Recover(const CarDynamics & car, float dt, const RoadPatch * patch);
 
-	/// Creates a ray from the middle of the car. Returns the distance to the first colliding object or max_length.
-	float RayCastDistance(const CarDynamics & car, Vec3 direction, float max_length);
+	/// Queues a ray from the middle of the car. Outputs the distance to the first colliding object or max_length
+	/// of the matching ray cast in the previous update. Returns false if there is none.
+	bool RayCastDistance(const CarDynamics & car, Vec3 direction, float max_length, float & distance);
 
 #ifdef VISUALIZE_AI_DEBUG
 	VertexArray brakeshape;
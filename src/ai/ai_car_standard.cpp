@@ -18,6 +18,7 @@
 /************************************************************************/
 
 #include "ai_car_standard.h"
+#include "ai_car_states.h"
 #include "physics/cardynamics.h"
 #include "physics/dynamicsworld.h"
 #include "minmax.h"
@@ -51,13 +52,151 @@
 
 static const float rad2deg = 180 / M_PI;
 
+int AiStandardPatches::GetIndex(const RoadPatch * patch) const
+{
+	for (const auto & road : roads)
+	{
+		if (patch >= road.begin && patch < road.begin + road.count)
+			return road.offset + (patch - road.begin);
+	}
+	return -1;
+}
+
+bool AiStandardPatches::Matches(const std::vector<RoadStrip> & strips) const
+{
+	if (strips.size() != roads.size())
+		return false;
+
+	for (size_t i = 0; i < roads.size(); ++i)
+	{
+		const std::vector<RoadPatch> & road_patches = strips[i].GetPatches();
+		if (road_patches.size() != roads[i].count ||
+			(!road_patches.empty() && &road_patches[0] != roads[i].begin))
+			return false;
+	}
+	return true;
+}
+
 AiCar * AiCarStandardFactory::Create(unsigned carid, float difficulty)
 {
-	return new AiCarStandard(carid, difficulty);
+	return new AiCarStandard(carid, difficulty, *this);
+}
+
+std::shared_ptr<const AiStandardSpeeds> AiCarStandardFactory::GetSpeeds(const CarDynamics & car)
+{
+	const Track * track = car.getDynamicsWorld()->GetTrack();
+	if (!track)
+		return std::shared_ptr<const AiStandardSpeeds>();
+
+	// the speed and brake curves depend on two car constants each,
+	// cars with equal samples share a table
+	const std::array<float, 4> key = {{
+		float(car.GetMaxSpeed(10, FRICTION_FACTOR_LAT)),
+		float(car.GetMaxSpeed(1000, FRICTION_FACTOR_LAT)),
+		float(car.GetBrakeDistance(50, 0, FRICTION_FACTOR_LONG)),
+		float(car.GetBrakeDistance(100, 0, FRICTION_FACTOR_LONG))}};
+
+	// called concurrently by the ai cars on their first update
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::shared_ptr<const AiStandardPatches> track_patches = patches.lock();
+	if (!track_patches || !track_patches->Matches(track->GetRoadList()))
+	{
+		track_patches = BuildPatches(track->GetRoadList());
+		patches = track_patches;
+	}
+
+	std::shared_ptr<const AiStandardSpeeds> car_speeds = speeds[key].lock();
+	if (!car_speeds || car_speeds->patches != track_patches)
+	{
+		car_speeds = BuildSpeeds(car, track_patches);
+		speeds[key] = car_speeds;
+	}
+
+	// drop tables of cars that are gone
+	for (auto i = speeds.begin(); i != speeds.end();)
+	{
+		if (i->second.expired())
+			i = speeds.erase(i);
+		else
+			++i;
+	}
+
+	return car_speeds;
+}
+
+std::shared_ptr<const AiStandardPatches> AiCarStandardFactory::BuildPatches(
+	const std::vector<RoadStrip> & roads)
+{
+	std::shared_ptr<AiStandardPatches> table(new AiStandardPatches());
+	for (const auto & road : roads)
+	{
+		const std::vector<RoadPatch> & road_patches = road.GetPatches();
+
+		AiStandardPatches::Road r;
+		r.begin = road_patches.empty() ? 0 : &road_patches[0];
+		r.count = road_patches.size();
+		r.offset = table->patches.size();
+		table->roads.push_back(r);
+
+		for (const auto & patch : road_patches)
+		{
+			const RoadPatch revised = AiCarStandard::RevisePatch(&patch);
+			const Vec3 direction = AiCarStandard::GetPatchDirection(revised);
+
+			AiStandardPatches::Patch p;
+			p.patch = &patch;
+			p.forward = direction.Normalize();
+			p.front_center = AiCarStandard::GetPatchFrontCenter(revised);
+			p.length = direction.Magnitude();
+			p.radius = AiCarStandard::GetPatchRadius(patch);
+			p.speed_radius = p.radius;
+			p.next = -1;
+			table->patches.push_back(p);
+		}
+	}
+
+	for (auto & p : table->patches)
+	{
+		if (p.patch->GetNextPatch())
+			p.next = table->GetIndex(p.patch->GetNextPatch());
+	}
+
+	// adjust the radius at corner exit to allow a higher speed.
+	// this will get the car to accelerate out of corner
+	for (auto & p : table->patches)
+	{
+		if (p.next >= 0 &&
+			table->patches[p.next].radius > p.radius &&
+			p.radius > LOOKAHEAD_MIN_RADIUS)
+		{
+			p.speed_radius += AiCarStandard::GetPatchWidthVector(*p.patch).Magnitude();
+		}
+	}
+
+	return table;
+}
+
+std::shared_ptr<const AiStandardSpeeds> AiCarStandardFactory::BuildSpeeds(
+	const CarDynamics & car,
+	const std::shared_ptr<const AiStandardPatches> & patches)
+{
+	std::shared_ptr<AiStandardSpeeds> table(new AiStandardSpeeds());
+	table->patches = patches;
+	table->speed_limit.reserve(patches->patches.size());
+	table->brake_distance.reserve(patches->patches.size());
+	for (const auto & p : patches->patches)
+	{
+		const float speed = car.GetMaxSpeed(p.speed_radius, FRICTION_FACTOR_LAT);
+		table->speed_limit.push_back(speed);
+		table->brake_distance.push_back(car.GetBrakeDistance(speed, 0, FRICTION_FACTOR_LONG));
+	}
+	return table;
 }
 
-AiCarStandard::AiCarStandard(unsigned new_carid, float new_difficulty) :
+AiCarStandard::AiCarStandard(unsigned new_carid, float new_difficulty, AiCarStandardFactory & factory) :
 	AiCar(new_carid, new_difficulty),
+	factory(factory),
 	last_patch(NULL)
 {
 	// ctor
@@ -89,9 +228,12 @@ float AiCarStandard::RateLimit(float old_value, float new_value, float rate_limi
 		return new_value;
 }
 
-void AiCarStandard::Update(float dt, const CarDynamics cars[], const unsigned cars_num)
+void AiCarStandard::Update(float dt, const CarDynamics cars[], const AiCarStates & states)
 {
-	AnalyzeOthers(dt, cars, cars_num);
+	if (!speeds)
+		speeds = factory.GetSpeeds(cars[carid]);
+
+	AnalyzeOthers(dt, cars[carid], states);
 	UpdateGasBrake(cars[carid]);
 	UpdateSteer(cars[carid]);
 }
@@ -108,6 +250,11 @@ const RoadPatch * AiCarStandard::GetCurrentPatch(const CarDynamics & car)
 	return curr_patch;
 }
 
+int AiCarStandard::GetPatchIndex(const RoadPatch * patch) const
+{
+	return speeds ? speeds->patches->GetIndex(patch) : -1;
+}
+
 Vec3 AiCarStandard::GetPatchFrontCenter(const RoadPatch & patch)
 {
 	return (patch.GetPoint(0,0) + patch.GetPoint(0,3)) * 0.5;
@@ -278,8 +425,8 @@ void AiCarStandard::UpdateGasBrake(const CarDynamics & car)
 	else
 		inputs[CarInput::START_ENGINE] = 0.0;
 
-	const RoadPatch * curr_patch_ptr = GetCurrentPatch(car);
-	if (!curr_patch_ptr)
+	const int curr_index = GetPatchIndex(GetCurrentPatch(car));
+	if (curr_index < 0)
 	{
 		// if car is not on track, just let it roll
 		inputs[CarInput::THROTTLE] = 0.8;
@@ -287,25 +434,14 @@ void AiCarStandard::UpdateGasBrake(const CarDynamics & car)
 		return;
 	}
 
-	RoadPatch curr_patch = RevisePatch(curr_patch_ptr);
+	const std::vector<AiStandardPatches::Patch> & patches = speeds->patches->patches;
+	const AiStandardPatches::Patch & curr_patch = patches[curr_index];
 
-	const Vec3 patch_direction = GetPatchDirection(curr_patch).Normalize();
 	const Vec3 car_velocity = ToMathVector<float>(car.GetVelocity());
-	float currentspeed = car_velocity.dot(patch_direction);
+	float currentspeed = car_velocity.dot(curr_patch.forward);
 
 	// check speed against speed limit of current patch
-	float speed_limit = 0;
-	if (!curr_patch.GetNextPatch())
-	{
-		speed_limit = CalcSpeedLimit(car, &curr_patch, 0, 0);
-	}
-	else
-	{
-		RoadPatch next_patch = RevisePatch(curr_patch.GetNextPatch());
-		float width = GetPatchWidthVector(*curr_patch_ptr).Magnitude();
-		speed_limit = CalcSpeedLimit(car, &curr_patch, &next_patch, width);
-	}
-	speed_limit *= difficulty;
+	float speed_limit = speeds->speed_limit[curr_index] * difficulty;
 
 	float speed_diff = speed_limit - currentspeed;
 	if (speed_diff < 0)
@@ -332,49 +468,39 @@ void AiCarStandard::UpdateGasBrake(const CarDynamics & car)
 		brake_value = 0.;
 	}
 
+	// brake distance from current speed to a patch speed limit is the difference
+	// of their brake distances to standstill
+	const float brake_dist_curr = car.GetBrakeDistance(currentspeed, 0, FRICTION_FACTOR_LONG);
+
 	// check upto maxlookahead distance
-	float maxlookahead = car.GetBrakeDistance(currentspeed, 0, FRICTION_FACTOR_LONG) + 10;
+	float maxlookahead = brake_dist_curr + 10;
 	float dist_checked = 0;
 	float brake_dist = 0;
-	RoadPatch patch_to_check = curr_patch;
+	int index = curr_index;
 
 #ifdef VISUALIZE_AI_DEBUG
-	brakelook.push_back(patch_to_check);
+	brakelook.push_back(RevisePatch(curr_patch.patch));
 #endif
 
 	while (dist_checked < maxlookahead)
 	{
-		RoadPatch * unmodified_patch_to_check = patch_to_check.GetNextPatch();
-
-		if (!patch_to_check.GetNextPatch())
+		if (patches[index].next < 0)
 		{
 			// if there is no next patch(probably a non-closed track, just let it roll
 			brake_value = 0;
 			dist_checked = maxlookahead;
 			break;
 		}
-		else
-		{
-			patch_to_check = RevisePatch(patch_to_check.GetNextPatch());
-		}
+		index = patches[index].next;
 
 #ifdef VISUALIZE_AI_DEBUG
-		brakelook.push_back(patch_to_check);
+		brakelook.push_back(RevisePatch(patches[index].patch));
 #endif
 
-		if (!patch_to_check.GetNextPatch())
-		{
-			speed_limit = CalcSpeedLimit(car, &patch_to_check, 0, 0);
-		}
-		else
-		{
-			RoadPatch next_patch = RevisePatch(patch_to_check.GetNextPatch());
-			float width = GetPatchWidthVector(*unmodified_patch_to_check).Magnitude();
-			speed_limit = CalcSpeedLimit(car, &patch_to_check, &next_patch, width);
-		}
+		speed_limit = speeds->speed_limit[index];
 
-		dist_checked += GetPatchDirection(patch_to_check).Magnitude();
-		brake_dist = car.GetBrakeDistance(currentspeed, speed_limit, FRICTION_FACTOR_LONG);
+		dist_checked += patches[index].length;
+		brake_dist = (currentspeed > speed_limit) ? brake_dist_curr - speeds->brake_distance[index] : 0;
 		if (brake_dist > dist_checked)
 		{
 			brake_value = 1;
@@ -390,26 +516,6 @@ void AiCarStandard::UpdateGasBrake(const CarDynamics & car)
 	inputs[CarInput::BRAKE] = brake_value;
 }
 
-float AiCarStandard::CalcSpeedLimit(
-	const CarDynamics & car,
-	const RoadPatch * patch,
-	const RoadPatch * nextpatch,
-	float extraradius)
-{
-	assert(patch);
-
-	// adjust the radius at corner exit to allow a higher speed.
-	// this will get the car to accelerate out of corner
-	float radius = GetPatchRadius(*patch);
-	if (nextpatch &&
-		GetPatchRadius(*nextpatch) > radius &&
-		radius > LOOKAHEAD_MIN_RADIUS)
-	{
-		radius += extraradius;
-	}
-	return car.GetMaxSpeed(radius, FRICTION_FACTOR_LAT);
-}
-
 void AiCarStandard::UpdateSteer(const CarDynamics & car)
 {
 #ifdef VISUALIZE_AI_DEBUG
@@ -421,50 +527,55 @@ void AiCarStandard::UpdateSteer(const CarDynamics & car)
 	//if car has no contact with track, just let it roll
 	if (!curr_patch_ptr)
 	{
-		if (!last_patch) return;
 		//if car is off track, steer the car towards the last patch it was on
+		//or the nearest patch if it has not been on track yet
 		//this should get the car back on track
-		else curr_patch_ptr = last_patch;
+		if (!last_patch)
+			last_patch = car.getDynamicsWorld()->GetNearestPatch(car.GetPosition());
+		if (!last_patch) return;
+		curr_patch_ptr = last_patch;
 	}
 
 	last_patch = curr_patch_ptr; //store the last patch car was on
 
-	RoadPatch curr_patch = RevisePatch(curr_patch_ptr);
+	const int curr_index = GetPatchIndex(curr_patch_ptr);
+	if (curr_index < 0) return;
+
+	const std::vector<AiStandardPatches::Patch> & patches = speeds->patches->patches;
 
 #ifdef VISUALIZE_AI_DEBUG
-	steerlook.push_back(curr_patch);
+	steerlook.push_back(RevisePatch(curr_patch_ptr));
 #endif
 
 	// if there is no next patch (probably a non-closed track), let it roll
-	if (!curr_patch.GetNextPatch()) return;
-
-	RoadPatch next_patch = RevisePatch(curr_patch.GetNextPatch());
+	int index = patches[curr_index].next;
+	if (index < 0) return;
 
 	// find the point to steer towards
 	float lookahead = 1;
 	float length = 0;
-	Vec3 dest_point = GetPatchFrontCenter(next_patch);
+	Vec3 dest_point = patches[index].front_center;
 
 	while (length < lookahead)
 	{
 #ifdef VISUALIZE_AI_DEBUG
-		steerlook.push_back(next_patch);
+		steerlook.push_back(RevisePatch(patches[index].patch));
 #endif
 
-		length += GetPatchDirection(next_patch).Magnitude()*2;
-		dest_point = GetPatchFrontCenter(next_patch);
+		length += patches[index].length * 2;
+		dest_point = patches[index].front_center;
 
 		// if there is no next patch for whatever reason, stop lookahead
-		if (!next_patch.GetNextPatch())
+		if (patches[index].next < 0)
 		{
 			length = lookahead;
 			break;
 		}
 
-		next_patch = RevisePatch(next_patch.GetNextPatch());
+		index = patches[index].next;
 
 		// if next patch is a very sharp corner, stop lookahead
-		if (GetPatchRadius(next_patch) < LOOKAHEAD_MIN_RADIUS)
+		if (patches[index].radius < LOOKAHEAD_MIN_RADIUS)
 		{
 			length = lookahead;
 			break;
@@ -508,14 +619,6 @@ void AiCarStandard::UpdateSteer(const CarDynamics & car)
 	inputs[CarInput::STEER_RIGHT] = steer_value;
 }
 
-float AiCarStandard::GetHorizontalDistanceAlongPatch(const RoadPatch & patch, Vec3 carposition)
-{
-	Vec3 leftside = (patch.GetPoint(0,0) + patch.GetPoint(3,0))*0.5f;
-	Vec3 rightside = (patch.GetPoint(0,3) + patch.GetPoint(3,3))*0.5f;
-	Vec3 patchwidthvector = rightside - leftside;
-	return patchwidthvector.Normalize().dot(carposition-leftside);
-}
-
 float AiCarStandard::RampBetween(float val, float startat, float endat)
 {
 	assert(endat > startat);
@@ -537,7 +640,7 @@ float AiCarStandard::BrakeFromOthers(float speed_diff)
 
 	for (const auto & car : othercars)
 	{
-		if (car.active && std::abs(car.horizontal_distance) < horizontal_care)
+		if (std::abs(car.horizontal_distance) < horizontal_care)
 		{
 			if (car.fore_distance < mindistance)
 			{
@@ -575,67 +678,58 @@ float AiCarStandard::BrakeFromOthers(float speed_diff)
 	return bias;
 }
 
-void AiCarStandard::AnalyzeOthers(float dt, const CarDynamics cars[], const unsigned cars_num)
+void AiCarStandard::AnalyzeOthers(float dt, const CarDynamics & dynamics, const AiCarStates & states)
 {
 	const float half_carlength = 1.25;
 	const btVector3 throttle_axis = Direction::forward;
-	const CarDynamics & car = cars[carid];
+	const AiCarState & car = states[carid];
+
+	// only consider cars within our reaction and brake distance
+	const float reaction_time = 1.0;
+	const float speed = car.velocity.length();
+	const float awareness_radius = 30.0 + speed * reaction_time +
+		dynamics.GetBrakeDistance(speed, 0, FRICTION_FACTOR_LONG);
+	states.Query(car.position, awareness_radius, neighbours);
 
-	if (othercars.size() < cars_num)
-		othercars.resize(cars_num);
+	// keep last infos for eta rate limiting, both lists are sorted by id
+	othercars_last.swap(othercars);
+	othercars.clear();
+	auto last = othercars_last.begin();
 
-	for (unsigned i = 0; i != cars_num; ++i)
+	for (unsigned i : neighbours)
 	{
 		if (i == carid)
 			continue;
 
-		const CarDynamics & icar = cars[i];
-		OtherCarInfo & info = othercars[i];
+		const AiCarState & icar = states[i];
 
 		// find direction of other cars in our frame
-		btVector3 relative_position = icar.GetCenterOfMass() - car.GetCenterOfMass();
-		relative_position = quatRotate(car.GetOrientation().inverse(), relative_position);
+		btVector3 relative_position = quatRotate(car.orientation_inverse, icar.position - car.position);
 
 		// only make a move if the other car is within our distance limit
 		float fore_position = relative_position.dot(throttle_axis);
 
-		btVector3 myvel = quatRotate(car.GetOrientation().inverse(), car.GetVelocity());
-		btVector3 othervel = quatRotate(icar.GetOrientation().inverse(), icar.GetVelocity());
-		float speed_diff = othervel.dot(throttle_axis) - myvel.dot(throttle_axis);
+		float speed_diff = icar.velocity.dot(throttle_axis) - car.velocity.dot(throttle_axis);
 
 		const float fore_position_offset = -half_carlength;
-		if (fore_position > fore_position_offset)
+		if (fore_position > fore_position_offset && icar.patch && car.patch)
 		{
-			const RoadPatch * othercarpatch = GetCurrentPatch(icar);
-			const RoadPatch * mycarpatch = GetCurrentPatch(car);
+			float speed_diff_denom = Clamp(speed_diff, -100.f, -0.01f);
+			float eta = (fore_position - fore_position_offset) / -speed_diff_denom;
 
-			if (othercarpatch && mycarpatch)
-			{
-				Vec3 mypos = ToMathVector<float>(car.GetCenterOfMass());
-				Vec3 otpos = ToMathVector<float>(icar.GetCenterOfMass());
-				float my_track_placement = GetHorizontalDistanceAlongPatch(*mycarpatch, mypos);
-				float their_track_placement = GetHorizontalDistanceAlongPatch(*othercarpatch, otpos);
-
-				float speed_diff_denom = Clamp(speed_diff, -100.f, -0.01f);
-				float eta = (fore_position - fore_position_offset) / -speed_diff_denom;
-
-				if (!info.active)
-					info.eta = eta;
-				else
-					info.eta = RateLimit(info.eta, eta, 10.f*dt, 10000.f*dt);
-
-				info.horizontal_distance = their_track_placement - my_track_placement;
-				info.fore_distance = fore_position;
-				info.active = true;
-			}
+			while (last != othercars_last.end() && last->id < i)
+				++last;
+
+			OtherCarInfo info;
+			info.id = i;
+			if (last == othercars_last.end() || last->id != i)
+				info.eta = eta;
 			else
-			{
-				info.active = false;
-			}
-		}
-		else
-		{
-			info.active = false;
+				info.eta = RateLimit(last->eta, eta, 10.f*dt, 10000.f*dt);
+
+			info.horizontal_distance = icar.track_placement - car.track_placement;
+			info.fore_distance = fore_position;
+			othercars.push_back(info);
 		}
 	}
 }
@@ -655,7 +749,7 @@ float AiCarStandard::SteerAwayFromOthers(float carspeed)
 
 	for (const auto & car : othercars)
 	{
-		if (car.active && std::abs(car.horizontal_distance) < std::abs(min_horizontal_distance))
+		if (std::abs(car.horizontal_distance) < std::abs(min_horizontal_distance))
 		{
 			min_horizontal_distance = car.horizontal_distance;
 			eta = car.eta;
@@ -26,53 +26,112 @@
 #include "graphics/scenenode.h"
 #include "roadpatch.h"
 
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 class CarDynamics;
+class RoadStrip;
+
+/// Revised racing line patches of a track, shared by all AiCarStandard cars.
+struct AiStandardPatches
+{
+	struct Patch
+	{
+		const RoadPatch * patch;
+		Vec3 forward;		///< normalized direction of the revised patch
+		Vec3 front_center;	///< front center of the revised patch
+		float length;		///< direction length of the revised patch
+		float radius;		///< racing line radius
+		float speed_radius;	///< radius used for the speed limit, widened at corner exits
+		int next;			///< next patch index, -1 if there is none
+	};
+	std::vector<Patch> patches;
+
+	struct Road
+	{
+		const RoadPatch * begin;
+		unsigned count;
+		unsigned offset;
+	};
+	std::vector<Road> roads;
+
+	/// Returns patch index, -1 if the patch is not in the table.
+	int GetIndex(const RoadPatch * patch) const;
+
+	/// Returns true if the table has been built from these roads.
+	bool Matches(const std::vector<RoadStrip> & roads) const;
+};
+
+/// Speed limits and brake distances along a track for one car type.
+struct AiStandardSpeeds
+{
+	std::shared_ptr<const AiStandardPatches> patches;
+	std::vector<float> speed_limit;		///< max cornering speed
+	std::vector<float> brake_distance;	///< brake distance from speed limit to standstill
+};
 
 class AiCarStandardFactory : public AiFactory
 {
+public:
 	AiCar * Create(unsigned carid, float difficulty) override;
+
+	/// Returns the tables for the car, built on first use and shared
+	/// by all cars with the same speed and brake characteristics.
+	std::shared_ptr<const AiStandardSpeeds> GetSpeeds(const CarDynamics & car);
+
+private:
+	std::mutex mutex;
+	std::weak_ptr<const AiStandardPatches> patches;
+	std::map<std::array<float, 4>, std::weak_ptr<const AiStandardSpeeds> > speeds;
+
+	static std::shared_ptr<const AiStandardPatches> BuildPatches(
+		const std::vector<RoadStrip> & roads);
+
+	static std::shared_ptr<const AiStandardSpeeds> BuildSpeeds(
+		const CarDynamics & car,
+		const std::shared_ptr<const AiStandardPatches> & patches);
 };
 
 class AiCarStandard : public AiCar
 {
 public:
-	AiCarStandard(unsigned carid, float new_difficulty);
+	AiCarStandard(unsigned carid, float new_difficulty, AiCarStandardFactory & factory);
 
 	~AiCarStandard();
 
-	void Update(float dt, const CarDynamics cars[], const unsigned cars_num) override;
+	void Update(float dt, const CarDynamics cars[], const AiCarStates & states) override;
 
 #ifdef VISUALIZE_AI_DEBUG
 	void Visualize() override;
 #endif
 
 private:
+	friend class AiCarStandardFactory;
+
+	AiCarStandardFactory & factory;
+	std::shared_ptr<const AiStandardSpeeds> speeds;	///< shared track and car tables
 	const RoadPatch * last_patch;	///< last patch the car was on, used in case car is off track
 
+	/// Cars within awareness radius, sorted by car id.
 	struct OtherCarInfo
 	{
-		OtherCarInfo() : active(false) {}
-
+		unsigned id;
 		float horizontal_distance;
 		float fore_distance;
 		float eta;
-		bool active;
 	};
 	std::vector <OtherCarInfo> othercars;
+	std::vector <OtherCarInfo> othercars_last;
+	std::vector <unsigned> neighbours;
 
 	void UpdateGasBrake(const CarDynamics & car);
 
-	static float CalcSpeedLimit(
-		const CarDynamics & car,
-		const RoadPatch * patch,
-		const RoadPatch * nextpatch,
-		float extraradius = 0);
-
 	void UpdateSteer(const CarDynamics & car);
 
-	void AnalyzeOthers(float dt, const CarDynamics cars[], const unsigned cars_num);
+	void AnalyzeOthers(float dt, const CarDynamics & dynamics, const AiCarStates & states);
 
 	///< returns a float that should be added into the steering wheel command
 	float SteerAwayFromOthers(float carspeed);
@@ -80,7 +139,10 @@ private:
 	///< returns a float that should be added into the brake command. speed_diff is the difference between the desired speed and speed limit of this area of the track
 	float BrakeFromOthers(float speed_diff);
 
-	RoadPatch RevisePatch(const RoadPatch * origpatch);
+	static RoadPatch RevisePatch(const RoadPatch * origpatch);
+
+	/// Returns the patch table index, -1 if there is none.
+	int GetPatchIndex(const RoadPatch * patch) const;
 
 	static float RateLimit(float old_value, float new_value, float rate_limit_pos, float rate_limit_neg);
 
@@ -98,8 +160,6 @@ private:
 
 	static void TrimPatch(RoadPatch & patch, float trimleft_front, float trimright_front, float trimleft_back, float trimright_back);
 
-	static float GetHorizontalDistanceAlongPatch(const RoadPatch & patch, Vec3 carposition);
-
 	static float RampBetween(float val, float startat, float endat);
 
 #ifdef VISUALIZE_AI_DEBUG
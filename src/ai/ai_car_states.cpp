@@ -0,0 +1,177 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "ai_car_states.h"
+#include "physics/cardynamics.h"
+#include "roadpatch.h"
+#include "tobullet.h"
+#include "unittest.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const RoadPatch * GetCurrentPatch(const CarDynamics & car)
+{
+	const RoadPatch * curr_patch = car.GetWheelContact(WheelPosition(0)).GetPatch();
+	if (!curr_patch)
+	{
+		// let's try the other wheel
+		curr_patch = car.GetWheelContact(WheelPosition(1)).GetPatch();
+	}
+	return curr_patch;
+}
+
+static float GetHorizontalDistanceAlongPatch(const RoadPatch & patch, Vec3 carposition)
+{
+	Vec3 leftside = (patch.GetPoint(0,0) + patch.GetPoint(3,0))*0.5f;
+	Vec3 rightside = (patch.GetPoint(0,3) + patch.GetPoint(3,3))*0.5f;
+	Vec3 patchwidthvector = rightside - leftside;
+	return patchwidthvector.Normalize().dot(carposition-leftside);
+}
+
+// grid cell edge length in meters
+static const float cell_size = 64;
+
+static int GetCell(float x)
+{
+	return int(std::floor(x * (1 / cell_size)));
+}
+
+// cells sorted by row, then column
+static unsigned long long GetCellKey(int x, int y)
+{
+	return ((unsigned long long)(unsigned(y) ^ 0x80000000u) << 32) | (unsigned(x) ^ 0x80000000u);
+}
+
+void AiCarStates::Update(const CarDynamics cars[], const unsigned cars_num)
+{
+	states.resize(cars_num);
+	for (unsigned i = 0; i < cars_num; ++i)
+	{
+		const CarDynamics & car = cars[i];
+		AiCarState & state = states[i];
+		state.orientation_inverse = car.GetOrientation().inverse();
+		state.position = car.GetCenterOfMass();
+		state.velocity = quatRotate(state.orientation_inverse, car.GetVelocity());
+		state.patch = GetCurrentPatch(car);
+		state.track_placement = 0;
+		if (state.patch)
+			state.track_placement = GetHorizontalDistanceAlongPatch(*state.patch, ToMathVector<float>(state.position));
+	}
+	UpdateIndex();
+}
+
+void AiCarStates::Update(const AiCarState nstates[], const unsigned cars_num)
+{
+	states.assign(nstates, nstates + cars_num);
+	UpdateIndex();
+}
+
+void AiCarStates::UpdateIndex()
+{
+	keys.resize(states.size());
+	for (unsigned i = 0; i < states.size(); ++i)
+	{
+		keys[i].cell = GetCellKey(GetCell(states[i].position.x()), GetCell(states[i].position.y()));
+		keys[i].id = i;
+	}
+	std::sort(keys.begin(), keys.end());
+}
+
+void AiCarStates::Query(const btVector3 & position, float radius, std::vector<unsigned> & ids) const
+{
+	ids.clear();
+
+	const float radius2 = radius * radius;
+	const int x_min = GetCell(position.x() - radius);
+	const int x_max = GetCell(position.x() + radius);
+	const int y_min = GetCell(position.y() - radius);
+	const int y_max = GetCell(position.y() + radius);
+
+	// test all cars if there are more grid rows than cars
+	if ((long long)y_max - y_min >= (long long)keys.size())
+	{
+		for (unsigned i = 0; i < states.size(); ++i)
+		{
+			if (states[i].position.distance2(position) <= radius2)
+				ids.push_back(i);
+		}
+		return;
+	}
+
+	for (int y = y_min; y <= y_max; ++y)
+	{
+		Key key_min;
+		key_min.cell = GetCellKey(x_min, y);
+		key_min.id = 0;
+		const unsigned long long cell_max = GetCellKey(x_max, y);
+		for (auto i = std::lower_bound(keys.begin(), keys.end(), key_min); i != keys.end() && i->cell <= cell_max; ++i)
+		{
+			if (states[i->id].position.distance2(position) <= radius2)
+				ids.push_back(i->id);
+		}
+	}
+
+	std::sort(ids.begin(), ids.end());
+}
+
+QT_TEST(ai_car_states_test)
+{
+	// cars spread over a 1 km square around the origin
+	std::vector<AiCarState> cars(200);
+	for (unsigned i = 0; i < cars.size(); ++i)
+	{
+		cars[i].orientation_inverse = btQuaternion::getIdentity();
+		cars[i].position = btVector3((i * 37 % 200) * 5.0f - 500, (i * 91 % 200) * 5.0f - 500, 0);
+		cars[i].velocity = btVector3(0, 0, 0);
+		cars[i].patch = 0;
+		cars[i].track_placement = 0;
+	}
+	AiCarStates states;
+	states.Update(cars.data(), cars.size());
+	QT_CHECK_EQUAL(states.size(), cars.size());
+
+	// queries match a brute force distance test
+	std::vector<unsigned> ids;
+	const float radii[] = {0, 10, 63, 64, 150, 400, 1E9f};
+	for (unsigned i = 0; i < cars.size(); i += 7)
+	{
+		for (float radius : radii)
+		{
+			const btVector3 position = cars[i].position + btVector3(3, -2, 0);
+			states.Query(position, radius, ids);
+
+			std::vector<unsigned> expected;
+			for (unsigned j = 0; j < cars.size(); ++j)
+			{
+				if (cars[j].position.distance2(position) <= radius * radius)
+					expected.push_back(j);
+			}
+			QT_CHECK(ids == expected);
+		}
+	}
+
+	// car on a cell border is found from both sides
+	cars[0].position = btVector3(128, -64, 0);
+	states.Update(cars.data(), cars.size());
+	states.Query(btVector3(127.5f, -64.5f, 0), 1, ids);
+	QT_CHECK(std::find(ids.begin(), ids.end(), 0u) != ids.end());
+	states.Query(btVector3(128.5f, -63.5f, 0), 1, ids);
+	QT_CHECK(std::find(ids.begin(), ids.end(), 0u) != ids.end());
+}
@@ -0,0 +1,82 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _AI_CAR_STATES_H
+#define _AI_CAR_STATES_H
+
+#include "LinearMath/btQuaternion.h"
+#include <vector>
+
+class CarDynamics;
+class RoadPatch;
+
+/// Read-only car state snapshot, taken once per tick for all Ai cars.
+struct AiCarState
+{
+	btQuaternion orientation_inverse;	///< world to car frame rotation
+	btVector3 position;	///< center of mass
+	btVector3 velocity;	///< velocity in car frame
+	const RoadPatch * patch;	///< current patch, null if car is off track
+	float track_placement;	///< horizontal distance along current patch
+};
+
+/// Car state snapshots of all cars with a spatial index for neighbour queries.
+/// Cars are sorted by the cell of a uniform grid in the ground plane, a query
+/// is a binary search for the cell range of each grid row the search sphere
+/// covers, followed by a distance test per car in range.
+class AiCarStates
+{
+public:
+	/// Take car state snapshots and rebuild the index.
+	void Update(const CarDynamics cars[], const unsigned cars_num);
+
+	/// Set car state snapshots and rebuild the index.
+	void Update(const AiCarState nstates[], const unsigned cars_num);
+
+	const AiCarState & operator[](unsigned id) const;
+
+	unsigned size() const;
+
+	/// Get ids of the cars within radius of position, sorted by id.
+	void Query(const btVector3 & position, float radius, std::vector<unsigned> & ids) const;
+
+private:
+	struct Key
+	{
+		unsigned long long cell;
+		unsigned id;
+		bool operator<(const Key & other) const { return cell < other.cell; }
+	};
+	std::vector<AiCarState> states;
+	std::vector<Key> keys;
+
+	void UpdateIndex();
+};
+
+inline const AiCarState & AiCarStates::operator[](unsigned id) const
+{
+	return states[id];
+}
+
+inline unsigned AiCarStates::size() const
+{
+	return states.size();
+}
+
+#endif // _AI_CAR_STATES_H
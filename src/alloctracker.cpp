@@ -0,0 +1,333 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "alloctracker.h"
+#include "profiler.h"
+#include "unittest.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <ostream>
+#include <string>
+
+// tracked zones, zones beyond are counted as untracked
+static const unsigned max_zones = 256;
+
+// smoothing factor of the average frame statistics
+static const double avg_smoothing = 1.0 / 20;
+
+// updated by allocating threads, zero initialized before any allocation
+struct AllocCounter
+{
+	std::atomic<unsigned long long> allocs;
+	std::atomic<unsigned long long> bytes;
+	std::atomic<unsigned long long> violations;
+	std::atomic<bool> no_alloc;
+};
+
+// collected by the main thread
+struct AllocStats
+{
+	unsigned long long last_allocs;
+	unsigned long long last_bytes;
+	double avg_allocs;
+	double avg_bytes;
+	unsigned long long total_allocs;
+	unsigned long long total_bytes;
+};
+
+// last slot counts allocations outside of tracked zones
+static AllocCounter alloc_counters[max_zones + 1];
+static AllocStats alloc_stats[max_zones + 1];
+
+std::atomic<bool> AllocTracker::enabled(false);
+
+static const char * GetName(unsigned zone)
+{
+	return zone < max_zones ? Profiler::GetZoneName(zone) : "(untracked)";
+}
+
+void AllocTracker::Init()
+{
+	enabled.store(true, std::memory_order_relaxed);
+}
+
+void AllocTracker::Shutdown()
+{
+	enabled.store(false, std::memory_order_relaxed);
+}
+
+void AllocTracker::SetNoAlloc(unsigned zone, bool value)
+{
+	if (zone < max_zones)
+		alloc_counters[zone].no_alloc.store(value, std::memory_order_relaxed);
+}
+
+unsigned long long AllocTracker::GetViolations()
+{
+	unsigned long long violations = 0;
+	for (const auto & counter : alloc_counters)
+		violations += counter.violations.load(std::memory_order_relaxed);
+	return violations;
+}
+
+void AllocTracker::Record(std::size_t size)
+{
+	// must not allocate
+	unsigned zone = Profiler::GetCurrentZone();
+	if (zone >= max_zones)
+		zone = max_zones;
+
+	AllocCounter & counter = alloc_counters[zone];
+	counter.allocs.fetch_add(1, std::memory_order_relaxed);
+	counter.bytes.fetch_add(size, std::memory_order_relaxed);
+	if (counter.no_alloc.load(std::memory_order_relaxed))
+		counter.violations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AllocTracker::EndFrame()
+{
+	if (!Enabled())
+		return;
+
+	for (unsigned i = 0; i <= max_zones; ++i)
+	{
+		AllocCounter & counter = alloc_counters[i];
+		AllocStats & stats = alloc_stats[i];
+		stats.last_allocs = counter.allocs.exchange(0, std::memory_order_relaxed);
+		stats.last_bytes = counter.bytes.exchange(0, std::memory_order_relaxed);
+		stats.avg_allocs += (stats.last_allocs - stats.avg_allocs) * avg_smoothing;
+		stats.avg_bytes += (stats.last_bytes - stats.avg_bytes) * avg_smoothing;
+		stats.total_allocs += stats.last_allocs;
+		stats.total_bytes += stats.last_bytes;
+	}
+}
+
+void AllocTracker::GetFrameAllocs(std::vector<ZoneAllocs> & zones)
+{
+	zones.clear();
+	for (unsigned i = 0; i <= max_zones; ++i)
+	{
+		const AllocStats & stats = alloc_stats[i];
+		if (!stats.last_allocs)
+			continue;
+
+		ZoneAllocs zone;
+		zone.name = GetName(i);
+		zone.allocs = stats.last_allocs;
+		zone.bytes = stats.last_bytes;
+		zones.push_back(zone);
+	}
+	std::sort(zones.begin(), zones.end(), [](const ZoneAllocs & a, const ZoneAllocs & b) {
+		return a.allocs > b.allocs;
+	});
+}
+
+void AllocTracker::PrintAvgSummary(std::ostream & out)
+{
+	std::vector<unsigned> zones;
+	for (unsigned i = 0; i <= max_zones; ++i)
+	{
+		if (alloc_stats[i].avg_allocs >= 0.05)
+			zones.push_back(i);
+	}
+	std::sort(zones.begin(), zones.end(), [](unsigned a, unsigned b) {
+		return alloc_stats[a].avg_allocs > alloc_stats[b].avg_allocs;
+	});
+
+	const std::ios::fmtflags flags = out.flags();
+	out << "allocs per frame, bytes\n" << std::fixed << std::setprecision(1);
+	for (unsigned zone : zones)
+	{
+		const AllocStats & stats = alloc_stats[zone];
+		out << GetName(zone) << ": " << stats.avg_allocs
+			<< " (" << std::setprecision(0) << stats.avg_bytes << ")\n"
+			<< std::setprecision(1);
+	}
+	out.flags(flags);
+}
+
+void AllocTracker::PrintSummary(std::ostream & out)
+{
+	std::vector<unsigned> zones;
+	for (unsigned i = 0; i <= max_zones; ++i)
+	{
+		if (alloc_stats[i].total_allocs || alloc_counters[i].violations)
+			zones.push_back(i);
+	}
+	std::sort(zones.begin(), zones.end(), [](unsigned a, unsigned b) {
+		return alloc_stats[a].total_allocs > alloc_stats[b].total_allocs;
+	});
+
+	out << "allocs, bytes\n";
+	for (unsigned zone : zones)
+	{
+		const AllocStats & stats = alloc_stats[zone];
+		out << GetName(zone) << ": " << stats.total_allocs << " (" << stats.total_bytes << ")";
+		const unsigned long long violations = alloc_counters[zone].violations;
+		if (violations)
+			out << " " << violations << " in no alloc zone";
+		out << "\n";
+	}
+}
+
+static void * Allocate(std::size_t size)
+{
+	if (AllocTracker::Enabled())
+		AllocTracker::Record(size);
+
+	if (size == 0)
+		size = 1;
+
+	void * p;
+	while (!(p = std::malloc(size)))
+	{
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+		handler();
+	}
+	return p;
+}
+
+void * operator new(std::size_t size)
+{
+	return Allocate(size);
+}
+
+void * operator new[](std::size_t size)
+{
+	return Allocate(size);
+}
+
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	try
+	{
+		return Allocate(size);
+	}
+	catch (...)
+	{
+		return 0;
+	}
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+	try
+	{
+		return Allocate(size);
+	}
+	catch (...)
+	{
+		return 0;
+	}
+}
+
+void operator delete(void * p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void * p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void * p, const std::nothrow_t &) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void * p, const std::nothrow_t &) noexcept
+{
+	std::free(p);
+}
+
+static unsigned NoAllocWork(unsigned n)
+{
+	unsigned sum = 0;
+	for (unsigned i = 0; i < n; ++i)
+		sum += i * i;
+	return sum;
+}
+
+QT_TEST(alloctracker_test)
+{
+	// restored at the end, so later tests run unaffected
+	const bool profiling = Profiler::Enabled();
+	const bool tracking = AllocTracker::Enabled();
+	if (!profiling)
+		Profiler::Init();
+	AllocTracker::Init();
+
+	static const unsigned zone = Profiler::RegisterZone("alloctracker test");
+	AllocTracker::SetNoAlloc(zone);
+	const unsigned long long violations = AllocTracker::GetViolations();
+
+	// zero allocation zone passes
+	{
+		ProfileScope scope(zone);
+		QT_CHECK_EQUAL(Profiler::GetCurrentZone(), zone);
+		QT_CHECK(NoAllocWork(100) > 0);
+	}
+	QT_CHECK_EQUAL(AllocTracker::GetViolations(), violations);
+
+	// allocation is attributed to the zone and flagged
+	AllocTracker::EndFrame();
+	{
+		ProfileScope scope(zone);
+		std::vector<int> v(100);
+		QT_CHECK_EQUAL(v.size(), 100);
+	}
+	AllocTracker::EndFrame();
+	QT_CHECK_EQUAL(AllocTracker::GetViolations(), violations + 1);
+
+	std::vector<AllocTracker::ZoneAllocs> zones;
+	AllocTracker::GetFrameAllocs(zones);
+	auto it = std::find_if(zones.begin(), zones.end(), [](const AllocTracker::ZoneAllocs & z) {
+		return std::string(z.name) == "alloctracker test";
+	});
+	QT_CHECK(it != zones.end());
+	if (it != zones.end())
+	{
+		QT_CHECK_EQUAL(it->allocs, 1);
+		QT_CHECK_EQUAL(it->bytes, 100 * sizeof(int));
+	}
+
+	AllocTracker::SetNoAlloc(zone, false);
+	if (!tracking)
+		AllocTracker::Shutdown();
+	if (!profiling)
+		Profiler::Shutdown();
+	QT_CHECK_EQUAL(Profiler::Enabled(), profiling);
+	QT_CHECK_EQUAL(AllocTracker::Enabled(), tracking);
+}
@@ -0,0 +1,81 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _ALLOCTRACKER_H
+#define _ALLOCTRACKER_H
+
+#include <atomic>
+#include <cstddef>
+#include <iosfwd>
+#include <vector>
+
+/// Counts heap allocations per profiler zone.
+/// The global operator new reports each allocation to the innermost open
+/// profiler zone of the calling thread, so zones need the profiler enabled.
+/// Allocations outside of zones are counted separately. Zones can be flagged
+/// as allocation free, allocations in them are counted as violations.
+class AllocTracker
+{
+public:
+	struct ZoneAllocs
+	{
+		const char * name;
+		unsigned long long allocs;
+		unsigned long long bytes;
+	};
+
+	/// Start counting allocations.
+	static void Init();
+
+	/// Stop counting allocations, collected statistics are kept.
+	static void Shutdown();
+
+	static bool Enabled();
+
+	/// Count allocations in zone as violations.
+	static void SetNoAlloc(unsigned zone, bool value = true);
+
+	/// Violations since Init.
+	static unsigned long long GetViolations();
+
+	/// Called by operator new.
+	static void Record(std::size_t size);
+
+	/// Collect the frame counters, called by the main thread once per frame.
+	static void EndFrame();
+
+	/// Allocating zones of the last collected frame, most allocations first.
+	static void GetFrameAllocs(std::vector<ZoneAllocs> & zones);
+
+	/// Smoothed allocations and bytes per frame and zone.
+	static void PrintAvgSummary(std::ostream & out);
+
+	/// Total allocations, bytes and violations per zone since Init.
+	static void PrintSummary(std::ostream & out);
+
+private:
+	static std::atomic<bool> enabled;
+};
+
+inline bool AllocTracker::Enabled()
+{
+	return enabled.load(std::memory_order_relaxed);
+}
+
+#endif // _ALLOCTRACKER_H
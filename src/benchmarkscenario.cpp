@@ -0,0 +1,148 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "benchmarkscenario.h"
+#include "cfg/ptree.h"
+#include "unittest.h"
+
+#include <algorithm>
+#include <sstream>
+
+BenchmarkScenario::BenchmarkScenario() :
+	ai_level(1),
+	timeout(0),
+	opponents(0),
+	laps(1),
+	seed(0),
+	reverse(false)
+{
+	// ctor
+}
+
+const BenchmarkScenario::CameraKey * BenchmarkScenario::GetCameraKey(float time) const
+{
+	auto it = std::upper_bound(camera_path.begin(), camera_path.end(), time,
+		[](float t, const CameraKey & key) { return t < key.time; });
+	if (it == camera_path.begin())
+		return 0;
+	return &*(it - 1);
+}
+
+bool BenchmarkScenario::Load(
+	std::istream & in,
+	std::vector<BenchmarkScenario> & scenarios,
+	std::ostream & error_output)
+{
+	PTree cfg;
+	read_ini(in, cfg);
+
+	for (const auto & section : cfg)
+	{
+		const PTree & sec = section.second;
+		BenchmarkScenario scenario;
+		scenario.name = section.first;
+		sec.get("track", scenario.track);
+		sec.get("reverse", scenario.reverse);
+		sec.get("car", scenario.car);
+		sec.get("variant", scenario.variant);
+		sec.get("paint", scenario.paint);
+		sec.get("opponents", scenario.opponents);
+		sec.get("opponent car", scenario.opponent_car);
+		sec.get("opponent variant", scenario.opponent_variant);
+		sec.get("ai level", scenario.ai_level);
+		sec.get("laps", scenario.laps);
+		sec.get("seed", scenario.seed);
+		sec.get("timeout", scenario.timeout);
+		sec.get("render", scenario.render);
+
+		const PTree * path;
+		if (sec.get("camera path", path))
+		{
+			for (const auto & node : *path)
+			{
+				std::vector<unsigned> value(2, 0);
+				std::istringstream vs(node.second.value());
+				vs >> value;
+
+				CameraKey key;
+				std::istringstream ts(node.first);
+				if (!(ts >> key.time) || node.second.size())
+				{
+					error_output << "Invalid camera key " << node.second.fullname() << std::endl;
+					return false;
+				}
+				key.camera = value[0];
+				key.car = value[1];
+				scenario.camera_path.push_back(key);
+			}
+			std::sort(scenario.camera_path.begin(), scenario.camera_path.end(),
+				[](const CameraKey & a, const CameraKey & b) { return a.time < b.time; });
+		}
+
+		scenarios.push_back(scenario);
+	}
+
+	if (scenarios.empty())
+	{
+		error_output << "No benchmark scenarios found" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+QT_TEST(benchmarkscenario_test)
+{
+	std::istringstream in(
+		"[b]\n"
+		"track = t2\n"
+		"[b.camera path]\n"
+		"20 = 0, 1\n"
+		"5 = 3, 0\n"
+		"[a]\n"
+		"track = t1\n"
+		"opponents = 3\n"
+		"laps = 2\n"
+		"seed = 7\n"
+		"[c]\n"
+		"laps = 3\n");
+	std::ostringstream error;
+	std::vector<BenchmarkScenario> scenarios;
+	QT_CHECK(BenchmarkScenario::Load(in, scenarios, error));
+	QT_CHECK_EQUAL(scenarios.size(), 3);
+	if (scenarios.size() != 3)
+		return;
+
+	QT_CHECK_EQUAL(scenarios[0].name, "a");
+	QT_CHECK_EQUAL(scenarios[0].opponents, 3);
+	QT_CHECK_EQUAL(scenarios[0].laps, 2);
+	QT_CHECK_EQUAL(scenarios[0].seed, 7);
+	QT_CHECK(!scenarios[0].GetCameraKey(10));
+
+	const BenchmarkScenario & b = scenarios[1];
+	QT_CHECK_EQUAL(b.track, "t2");
+	QT_CHECK_EQUAL(b.camera_path.size(), 2);
+	QT_CHECK(!b.GetCameraKey(1));
+	QT_CHECK(b.GetCameraKey(10) && b.GetCameraKey(10)->camera == 3);
+	QT_CHECK(b.GetCameraKey(25) && b.GetCameraKey(25)->car == 1);
+
+	// track is optional like the other strings, empty keeps the user setting
+	QT_CHECK_EQUAL(scenarios[2].name, "c");
+	QT_CHECK(scenarios[2].track.empty());
+	QT_CHECK_EQUAL(scenarios[2].laps, 3);
+}
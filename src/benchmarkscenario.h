@@ -0,0 +1,85 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _BENCHMARKSCENARIO_H
+#define _BENCHMARKSCENARIO_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/// Reproducible benchmark race setup, empty strings keep the user settings.
+///
+/// Scenario file, one ini section per scenario, run in section name order:
+///
+/// [01-ruudskogen]
+/// track = ruudskogen
+/// reverse = false
+/// car = XS
+/// variant = XS
+/// opponents = 3
+/// opponent car = 360
+/// ai level = 1
+/// laps = 1
+/// seed = 1
+/// timeout = 300
+/// render = gl3/deferred.conf
+///
+/// [01-ruudskogen.camera path]
+/// # simulation time = camera id, car id
+/// 0 = 3, 0
+/// 20 = 0, 1
+struct BenchmarkScenario
+{
+	struct CameraKey
+	{
+		float time;
+		unsigned camera;
+		unsigned car;
+	};
+
+	std::string name;
+	std::string track;
+	std::string car;
+	std::string variant;
+	std::string paint;
+	std::string opponent_car;
+	std::string opponent_variant;
+	std::string render;
+	std::vector<CameraKey> camera_path; ///< sorted by time
+	float ai_level;
+	float timeout; ///< simulation time limit in seconds, 0 for none
+	unsigned opponents;
+	unsigned laps;
+	unsigned seed;
+	bool reverse;
+
+	BenchmarkScenario();
+
+	/// camera key active at simulation time, null if there is none
+	const CameraKey * GetCameraKey(float time) const;
+
+	/// read scenarios, return false on error
+	static bool Load(
+		std::istream & in,
+		std::vector<BenchmarkScenario> & scenarios,
+		std::ostream & error_output);
+};
+
+#endif // _BENCHMARKSCENARIO_H
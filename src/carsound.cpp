@@ -33,7 +33,8 @@ CarSound::CarSound() :
 	gearsound_check(0),
 	brakesound_check(false),
 	handbrakesound_check(false),
-	interior(false)
+	interior(false),
+	audible(false)
 {
 	// ctor
 }
@@ -43,7 +44,8 @@ CarSound::CarSound(const CarSound & other) :
 	gearsound_check(0),
 	brakesound_check(false),
 	handbrakesound_check(false),
-	interior(false)
+	interior(false),
+	audible(false)
 {
 	// we don't really support copying of these suckers
 	assert(!other.psound);
@@ -167,6 +169,8 @@ bool CarSound::Load(
 		enginesounds.push_back(EngineSoundInfo());
 		enginesounds.back().sound_source = sound.AddSource(soundptr, 0, true, true);
 	}
+	enginetable.Init(enginesounds);
+	enginegains.resize(enginesounds.size(), 0.0f);
 
 	//set up tire squeal sounds
 	for (int i = 0; i < 4; ++i)
@@ -246,10 +250,47 @@ bool CarSound::Load(
 	return true;
 }
 
+void CarSound::Update(CarSound sounds[], const CarDynamics dynamics[], size_t count, float dt)
+{
+	// cull cars and look up engine layer gains in one pass
+	for (size_t i = 0; i < count; ++i)
+	{
+		CarSound & cs = sounds[i];
+		if (!cs.psound) continue;
+
+		// cars out of audible range are bookkeeping only, their sources stay silent
+		const float car_radius = 5.0f;
+		btVector3 pos = dynamics[i].GetPosition();
+		if (!cs.psound->GetAudible(pos[0], pos[1], pos[2], car_radius))
+		{
+			if (cs.audible)
+				cs.Mute();
+			cs.audible = false;
+			continue;
+		}
+		cs.audible = true;
+
+		const float rpm = dynamics[i].GetTachoRPM();
+		const float throttle = dynamics[i].GetEngine().GetThrottle();
+		cs.enginetable.GetGains(rpm, throttle, cs.enginegains.data());
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		sounds[i].Update(dynamics[i], dt);
+	}
+}
+
 void CarSound::Update(const CarDynamics & dynamics, float dt)
 {
 	if (!psound) return;
 
+	if (!audible)
+	{
+		crashdetection.Update(dynamics.GetSpeed(), dt);
+		return;
+	}
+
 	Vec3 pos_car = ToMathVector<float>(dynamics.GetPosition());
 	Vec3 pos_eng = ToMathVector<float>(dynamics.GetEnginePosition());
 
@@ -259,75 +300,19 @@ void CarSound::Update(const CarDynamics & dynamics, float dt)
 	psound->SetSourcePosition(brakesound, pos_car[0], pos_car[1], pos_car[2]);
 	psound->SetSourcePosition(handbrakesound, pos_car[0], pos_car[1], pos_car[2]);
 
-	// update engine sounds
+	// update engine sounds, silent layers skip position and pitch updates
 	const float rpm = dynamics.GetTachoRPM();
-	const float throttle = dynamics.GetEngine().GetThrottle();
-	float total_gain = 0.0;
-
-	std::vector<std::pair<size_t, float> > gainlist;
-	gainlist.reserve(enginesounds.size());
-	for (auto & info : enginesounds)
-	{
-		float gain = 1;
-
-		if (rpm < info.minrpm)
-		{
-			gain = 0;
-		}
-		else if (rpm < info.fullgainrpmstart && info.fullgainrpmstart > info.minrpm)
-		{
-			gain *= (rpm - info.minrpm) / (info.fullgainrpmstart - info.minrpm);
-		}
-
-		if (rpm > info.maxrpm)
-		{
-			gain = 0;
-		}
-		else if (rpm > info.fullgainrpmend && info.fullgainrpmend < info.maxrpm)
-		{
-			gain *= 1 - (rpm - info.fullgainrpmend) / (info.maxrpm - info.fullgainrpmend);
-		}
-
-		if (info.power == EngineSoundInfo::BOTH)
-		{
-			gain *= (throttle + 1) * 0.5f;
-		}
-		else if (info.power == EngineSoundInfo::POWERON)
-		{
-			gain *= throttle;
-		}
-		else if (info.power == EngineSoundInfo::POWEROFF)
-		{
-			gain *= (1 - throttle);
-		}
-
-		total_gain += gain;
-		gainlist.push_back(std::make_pair(info.sound_source, gain));
-
-		float pitch = rpm / info.naturalrpm;
-
-		psound->SetSourcePosition(info.sound_source, pos_eng[0], pos_eng[1], pos_eng[2]);
-		psound->SetSourcePitch(info.sound_source, pitch);
-	}
-
-	// normalize gains
-	assert(total_gain >= 0);
-	for (const auto & sound_gain : gainlist)
+	for (size_t n = 0; n < enginesounds.size(); ++n)
 	{
-		float gain;
-		if (total_gain == 0)
-		{
-			gain = 0;
-		}
-		else if (enginesounds.size() == 1 && enginesounds.back().power == EngineSoundInfo::BOTH)
+		const EngineSoundInfo & info = enginesounds[n];
+		const float gain = enginegains[n];
+		psound->SetSourceGain(info.sound_source, gain);
+		if (gain > 0)
 		{
-			gain = sound_gain.second;
+			float pitch = rpm / info.naturalrpm;
+			psound->SetSourcePosition(info.sound_source, pos_eng[0], pos_eng[1], pos_eng[2]);
+			psound->SetSourcePitch(info.sound_source, pitch);
 		}
-		else
-		{
-			gain = sound_gain.second / total_gain;
-		}
-		psound->SetSourceGain(sound_gain.first, gain);
 	}
 
 	// update tire squeal sounds
@@ -488,6 +473,21 @@ void CarSound::EnableInteriorSound(bool value)
 	interior = value;
 }
 
+void CarSound::Mute()
+{
+	for (const auto & info : enginesounds)
+		psound->SetSourceGain(info.sound_source, 0);
+
+	for (int i = 0; i < WHEEL_COUNT; ++i)
+	{
+		psound->SetSourceGain(tiresqueal[i], 0);
+		psound->SetSourceGain(grasssound[i], 0);
+		psound->SetSourceGain(gravelsound[i], 0);
+	}
+
+	psound->SetSourceGain(roadnoise, 0);
+}
+
 void CarSound::Clear()
 {
 	if (!psound) return;
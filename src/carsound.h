@@ -23,6 +23,7 @@
 #include "physics/carwheelposition.h"
 #include "crashdetection.h"
 #include "enginesoundinfo.h"
+#include "enginesoundtable.h"
 
 #include <iosfwd>
 #include <string>
@@ -50,13 +51,16 @@ public:
 		ContentManager & content,
 		std::ostream & error_output);
 
-	void Update(const CarDynamics & dynamics, float dt);
+	// update sounds of all cars, engine layer gains are looked up in batch
+	static void Update(CarSound sounds[], const CarDynamics dynamics[], size_t count, float dt);
 
 	void EnableInteriorSound(bool value);
 
 private:
 	CrashDetection crashdetection;
 	std::vector<EngineSoundInfo> enginesounds;
+	std::vector<float> enginegains;
+	EngineSoundTable enginetable;
 	unsigned tiresqueal[WHEEL_COUNT];
 	unsigned tirebump[WHEEL_COUNT];
 	unsigned grasssound[WHEEL_COUNT];
@@ -72,6 +76,12 @@ private:
 	bool brakesound_check;
 	bool handbrakesound_check;
 	bool interior;
+	bool audible;
+
+	void Update(const CarDynamics & dynamics, float dt);
+
+	// silence looping sources while car is out of audible range
+	void Mute();
 
 	void Clear();
 };
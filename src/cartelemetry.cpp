@@ -0,0 +1,270 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "cartelemetry.h"
+#include "physics/cardynamics.h"
+#include "tokenize.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+
+#include <cassert>
+#include <ostream>
+
+static const char magic[4] = {'V', 'D', 'T', 'L'};
+static const unsigned version = 1;
+
+// about 45 seconds of samples at 90 Hz
+static const unsigned ring_rows = 1 << 12;
+
+// rows per file block
+static const unsigned block_rows = 1 << 9;
+
+static const char * wheel_names[WHEEL_COUNT] = {"fl", "fr", "rl", "rr"};
+
+static void AddWheelColumns(
+	std::vector<std::string> & names,
+	const std::string & car,
+	const char * const channel_names[],
+	unsigned count)
+{
+	for (int w = 0; w < WHEEL_COUNT; ++w)
+	{
+		for (unsigned i = 0; i < count; ++i)
+			names.push_back(car + wheel_names[w] + "." + channel_names[i]);
+	}
+}
+
+static void GetColumnNames(unsigned channels, unsigned cars, std::vector<std::string> & names)
+{
+	static const char * slip[] = {"slip", "slip_angle"};
+	static const char * force[] = {"fx", "fy", "mz"};
+	static const char * suspension[] = {"displacement"};
+
+	names.push_back("time");
+	for (unsigned c = 0; c < cars; ++c)
+	{
+		const std::string car = "car" + std::to_string(c) + ".";
+		if (channels & CarTelemetry::SLIP)
+			AddWheelColumns(names, car, slip, 2);
+		if (channels & CarTelemetry::FORCE)
+			AddWheelColumns(names, car, force, 3);
+		if (channels & CarTelemetry::SUSPENSION)
+			AddWheelColumns(names, car, suspension, 1);
+		if (channels & CarTelemetry::ENGINE)
+		{
+			names.push_back(car + "rpm");
+			names.push_back(car + "gear");
+		}
+	}
+}
+
+template <typename T>
+static void Write(std::ostream & out, const T & value)
+{
+	out.write((const char *)&value, sizeof(T));
+}
+
+CarTelemetry::CarTelemetry() :
+	columns(0),
+	channels(0),
+	cars(0),
+	mask(0),
+	dropped(0),
+	head(0),
+	tail(0),
+	quit(false),
+	thread(0)
+{
+	// ctor
+}
+
+CarTelemetry::~CarTelemetry()
+{
+	Stop();
+}
+
+unsigned CarTelemetry::ParseChannels(const std::string & names)
+{
+	unsigned channels = 0;
+	for (const auto & name : Tokenize(names, ","))
+	{
+		if (name == "slip")
+			channels |= SLIP;
+		else if (name == "force")
+			channels |= FORCE;
+		else if (name == "suspension")
+			channels |= SUSPENSION;
+		else if (name == "engine")
+			channels |= ENGINE;
+		else if (name == "all")
+			channels |= ALL;
+		else
+			return 0;
+	}
+	return channels;
+}
+
+bool CarTelemetry::Start(
+	const std::string & filename,
+	unsigned nchannels,
+	unsigned car_count,
+	std::ostream & error_output)
+{
+	Stop();
+
+	file.open(filename.c_str(), std::ios::binary);
+	if (!file)
+	{
+		error_output << "Failed to create telemetry file " << filename << std::endl;
+		return false;
+	}
+
+	std::vector<std::string> names;
+	GetColumnNames(nchannels, car_count, names);
+
+	file.write(magic, sizeof(magic));
+	Write(file, version);
+	Write(file, unsigned(names.size()));
+	for (const auto & name : names)
+	{
+		Write(file, unsigned(name.size()));
+		file.write(name.data(), name.size());
+	}
+
+	channels = nchannels;
+	cars = car_count;
+	columns = names.size();
+	mask = ring_rows - 1;
+	dropped = 0;
+	ring.resize(ring_rows * columns);
+	block.resize(block_rows * columns);
+	head.store(0, std::memory_order_relaxed);
+	tail.store(0, std::memory_order_relaxed);
+	quit = false;
+	thread = SDL_CreateThread(Dispatch, "CarTelemetry", this);
+	return thread != 0;
+}
+
+void CarTelemetry::Stop()
+{
+	if (!thread)
+		return;
+
+	quit = true;
+	SDL_WaitThread(thread, NULL);
+	thread = 0;
+	file.close();
+}
+
+void CarTelemetry::Sample(float time, const CarDynamics cars_state[], unsigned car_count)
+{
+	assert(car_count == cars);
+
+	const unsigned row = tail.load(std::memory_order_relaxed);
+	if (row - head.load(std::memory_order_acquire) > mask)
+	{
+		dropped++;
+		return;
+	}
+
+	float * v = &ring[(row & mask) * columns];
+	*v++ = time;
+	for (unsigned c = 0; c < car_count; ++c)
+	{
+		const CarDynamics & car = cars_state[c];
+		if (channels & SLIP)
+		{
+			for (int w = 0; w < WHEEL_COUNT; ++w)
+			{
+				const CarTireState & t = car.GetTireState(WheelPosition(w));
+				*v++ = t.slip;
+				*v++ = t.slip_angle;
+			}
+		}
+		if (channels & FORCE)
+		{
+			for (int w = 0; w < WHEEL_COUNT; ++w)
+			{
+				const CarTireState & t = car.GetTireState(WheelPosition(w));
+				*v++ = t.fx;
+				*v++ = t.fy;
+				*v++ = t.mz;
+			}
+		}
+		if (channels & SUSPENSION)
+		{
+			for (int w = 0; w < WHEEL_COUNT; ++w)
+				*v++ = car.GetSuspension(WheelPosition(w)).GetDisplacement();
+		}
+		if (channels & ENGINE)
+		{
+			*v++ = car.GetEngine().GetRPM();
+			*v++ = car.GetTransmission().GetGear();
+		}
+	}
+	assert(v == &ring[(row & mask) * columns] + columns);
+
+	tail.store(row + 1, std::memory_order_release);
+}
+
+void CarTelemetry::WriteBlock(unsigned begin, unsigned rows)
+{
+	// transpose rows into columns
+	for (unsigned r = 0; r < rows; ++r)
+	{
+		const float * row = &ring[((begin + r) & mask) * columns];
+		for (unsigned c = 0; c < columns; ++c)
+			block[c * rows + r] = row[c];
+	}
+
+	Write(file, rows);
+	file.write((const char *)&block[0], sizeof(float) * rows * columns);
+}
+
+void CarTelemetry::Run()
+{
+	bool done = false;
+	while (!done)
+	{
+		// drain remaining rows after quit
+		done = quit;
+
+		unsigned begin = head.load(std::memory_order_relaxed);
+		unsigned available = tail.load(std::memory_order_acquire) - begin;
+		while (available >= block_rows || (done && available > 0))
+		{
+			const unsigned rows = available < block_rows ? available : block_rows;
+			WriteBlock(begin, rows);
+			begin += rows;
+			available -= rows;
+			head.store(begin, std::memory_order_release);
+		}
+
+		if (!done)
+			SDL_Delay(50);
+	}
+	file.flush();
+}
+
+int CarTelemetry::Dispatch(void * data)
+{
+	static_cast<CarTelemetry*>(data)->Run();
+	return 0;
+}
@@ -20,73 +20,89 @@
 #ifndef _CARTELEMETRY_H
 #define _CARTELEMETRY_H
 
+#include <atomic>
 #include <fstream>
+#include <iosfwd>
+#include <string>
+#include <vector>
 
+class CarDynamics;
+struct SDL_Thread;
+
+/// Captures car dynamics channels at physics rate.
+/// Samples are stored as rows in a preallocated ring buffer. A writer thread
+/// transposes them into column blocks and appends those to the output file.
+///
+/// File layout, native byte order:
+/// "VDTL", uint32 version, uint32 column count,
+/// column count names as uint32 length and chars,
+/// blocks of uint32 row count followed by row count floats per column.
 class CarTelemetry
 {
-	private:
-		typedef double T;
-
-		std::vector <std::pair <std::string, T> > variable_names;
-		T time;
-		bool wroteheader;
-		const std::string telemetryname;
-		std::ofstream file;
-
-		void WriteHeader(const std::string & filename)
-		{
-			std::ofstream f((filename+".plt").c_str());
-			if (f)
-			{
-				f << "plot ";
-				unsigned int count = 0;
-				for (const auto & nv : variable_names)
-				{
-					f << "\\" << std::endl << "\"" << filename+".dat" << "\" u 1:" << count+2 << " t '" << nv.first << "' w lines";
-					if (count < variable_names.size()-1)
-						f << ",";
-					f << " ";
-					count++;
-				}
-				f << std::endl;
-			}
-			wroteheader = true;
-		}
-
-	public:
-		CarTelemetry(const std::string & name) : time(0), wroteheader(false), telemetryname(name), file((name+".dat").c_str()) {}
-		CarTelemetry(const CarTelemetry & other) : variable_names(other.variable_names), time(other.time), wroteheader(other.wroteheader), telemetryname(other.telemetryname), file((telemetryname+".dat").c_str()) {}
-
-		void AddRecord(const std::string & name, T value)
-		{
-			bool found = false;
-			for (auto & nv : variable_names)
-			{
-				if (name == nv.first)
-				{
-					nv.second = value;
-					found = true;
-					break;
-				}
-			}
-			if (!found)
-				variable_names.push_back(std::make_pair(name, value));
-		}
-
-		void Update(T dt)
-		{
-			if (time != 0 && !wroteheader)
-				WriteHeader(telemetryname);
-			time += dt;
-
-			if (file)
-			{
-				file << time << " ";
-				for (const auto & nv : variable_names)
-					file << nv.second << " ";
-				file << "\n";
-			}
-		}
+public:
+	enum Channel
+	{
+		SLIP = 1 << 0, ///< slip ratio and slip angle per wheel
+		FORCE = 1 << 1, ///< tire fx, fy and mz per wheel
+		SUSPENSION = 1 << 2, ///< suspension displacement per wheel
+		ENGINE = 1 << 3, ///< engine rpm and gear
+		ALL = SLIP | FORCE | SUSPENSION | ENGINE
+	};
+
+	CarTelemetry();
+
+	~CarTelemetry();
+
+	/// comma separated channel names: slip, force, suspension, engine, all
+	/// return 0 on unknown names
+	static unsigned ParseChannels(const std::string & names);
+
+	/// start capturing channels of car_count cars
+	bool Start(
+		const std::string & filename,
+		unsigned channels,
+		unsigned car_count,
+		std::ostream & error_output);
+
+	/// write pending samples and close file
+	void Stop();
+
+	bool Enabled() const
+	{
+		return thread != 0;
+	}
+
+	/// append a row, dropped if the writer fell behind
+	void Sample(float time, const CarDynamics cars[], unsigned car_count);
+
+	/// number of dropped rows
+	unsigned GetDropped() const
+	{
+		return dropped;
+	}
+
+private:
+	std::ofstream file;
+	std::vector<float> ring; ///< ring rows of column count floats
+	std::vector<float> block; ///< writer column block
+	unsigned columns;
+	unsigned channels;
+	unsigned cars;
+	unsigned mask;
+	unsigned dropped;
+
+	// writer advances head, sampler advances tail
+	alignas(64) std::atomic<unsigned> head;
+	alignas(64) std::atomic<unsigned> tail;
+
+	std::atomic<bool> quit;
+	SDL_Thread * thread;
+
+	void WriteBlock(unsigned begin, unsigned rows);
+
+	void Run();
+
+	static int Dispatch(void * data);
 };
 
-#endif //_CARTELEMETRY_H
+#endif // _CARTELEMETRY_H
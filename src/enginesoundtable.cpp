@@ -0,0 +1,198 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "enginesoundtable.h"
+#include "minmax.h"
+
+#include <cassert>
+#include <cstddef>
+
+EngineSoundTable::EngineSoundTable() :
+	rpm_scale(0),
+	layer_count(0)
+{
+	// ctor
+}
+
+void EngineSoundTable::Init(const std::vector<EngineSoundInfo> & layers)
+{
+	// table spans zero to the highest layer rpm, capped for open ended layers
+	// plus one row past it, where layers ending at the highest rpm are silent
+	float rpm_max = 0;
+	for (const auto & info : layers)
+		rpm_max = Max(rpm_max, info.maxrpm);
+	rpm_max = Clamp(rpm_max, 1.0f, 20000.0f);
+
+	rpm_scale = rpm_cells / rpm_max;
+	layer_count = layers.size();
+	table.resize((rpm_cells + 2) * (throttle_cells + 1) * layer_count);
+
+	float * gains = table.data();
+	for (int r = 0; r <= rpm_cells + 1; ++r)
+	{
+		for (int t = 0; t <= throttle_cells; ++t)
+		{
+			float rpm = r / rpm_scale;
+			float throttle = t / float(throttle_cells);
+			ComputeGains(layers, rpm, throttle, gains);
+			gains += layer_count;
+		}
+	}
+}
+
+void EngineSoundTable::GetGains(float rpm, float throttle, float gains[]) const
+{
+	assert(!table.empty());
+
+	// cell coordinates, clamped to the table edges
+	float r = Clamp(rpm * rpm_scale, 0.0f, float(rpm_cells + 1));
+	float t = Clamp(throttle * throttle_cells, 0.0f, float(throttle_cells));
+	int ri = Min(int(r), rpm_cells);
+	int ti = Min(int(t), throttle_cells - 1);
+	float rf = r - ri;
+	float tf = t - ti;
+
+	const int row = (throttle_cells + 1) * layer_count;
+	const float * g00 = table.data() + ri * row + ti * layer_count;
+	const float * g01 = g00 + layer_count;
+	const float * g10 = g00 + row;
+	const float * g11 = g10 + layer_count;
+	for (unsigned n = 0; n < layer_count; ++n)
+	{
+		float g0 = g00[n] + (g01[n] - g00[n]) * tf;
+		float g1 = g10[n] + (g11[n] - g10[n]) * tf;
+		gains[n] = g0 + (g1 - g0) * rf;
+	}
+}
+
+void EngineSoundTable::ComputeGains(const std::vector<EngineSoundInfo> & layers, float rpm, float throttle, float gains[])
+{
+	float total_gain = 0.0;
+	for (size_t n = 0; n < layers.size(); ++n)
+	{
+		const EngineSoundInfo & info = layers[n];
+		float gain = 1;
+
+		if (rpm < info.minrpm)
+		{
+			gain = 0;
+		}
+		else if (rpm < info.fullgainrpmstart && info.fullgainrpmstart > info.minrpm)
+		{
+			gain *= (rpm - info.minrpm) / (info.fullgainrpmstart - info.minrpm);
+		}
+
+		if (rpm > info.maxrpm)
+		{
+			gain = 0;
+		}
+		else if (rpm > info.fullgainrpmend && info.fullgainrpmend < info.maxrpm)
+		{
+			gain *= 1 - (rpm - info.fullgainrpmend) / (info.maxrpm - info.fullgainrpmend);
+		}
+
+		if (info.power == EngineSoundInfo::BOTH)
+		{
+			gain *= (throttle + 1) * 0.5f;
+		}
+		else if (info.power == EngineSoundInfo::POWERON)
+		{
+			gain *= throttle;
+		}
+		else if (info.power == EngineSoundInfo::POWEROFF)
+		{
+			gain *= (1 - throttle);
+		}
+
+		total_gain += gain;
+		gains[n] = gain;
+	}
+
+	// normalize gains
+	assert(total_gain >= 0);
+	for (size_t n = 0; n < layers.size(); ++n)
+	{
+		if (total_gain == 0)
+		{
+			gains[n] = 0;
+		}
+		else if (layers.size() == 1 && layers.back().power == EngineSoundInfo::BOTH)
+		{
+			// single layer keeps its throttle gain
+		}
+		else
+		{
+			gains[n] = gains[n] / total_gain;
+		}
+	}
+}
+
+#include "unittest.h"
+#include <cmath>
+
+QT_TEST(enginesoundtable_test)
+{
+	// power on and off layers over three overlapping rpm ranges, blended like CarSound does
+	const float ranges[3][2] = {{800, 3500}, {3000, 6000}, {5500, 8000}};
+	std::vector<EngineSoundInfo> layers;
+	for (int p = 0; p < 2; ++p)
+	{
+		for (int n = 0; n < 3; ++n)
+		{
+			EngineSoundInfo info;
+			info.power = p ? EngineSoundInfo::POWEROFF : EngineSoundInfo::POWERON;
+			info.minrpm = ranges[n][0];
+			info.maxrpm = ranges[n][1];
+			info.fullgainrpmstart = (n > 0) ? ranges[n - 1][1] : info.minrpm;
+			info.fullgainrpmend = (n < 2) ? ranges[n + 1][0] : info.maxrpm;
+			layers.push_back(info);
+		}
+	}
+
+	EngineSoundTable table;
+	table.Init(layers);
+
+	// lookup matches direct computation, apart from the gain steps
+	// at the lowest and highest layer rpm, which are blurred over one cell
+	const float rpm_cell = 8000.0f / 128;
+	float max_error = 0;
+	float gains[6], expected[6];
+	for (float rpm = 0; rpm <= 10000; rpm += 7.3f)
+	{
+		for (float throttle = 0; throttle <= 1; throttle += 0.05f)
+		{
+			table.GetGains(rpm, throttle, gains);
+			EngineSoundTable::ComputeGains(layers, rpm, throttle, expected);
+			if (std::abs(rpm - 800) <= rpm_cell || std::abs(rpm - 8000) <= rpm_cell)
+				continue;
+
+			for (int n = 0; n < 6; ++n)
+				max_error = Max(max_error, std::abs(gains[n] - expected[n]));
+		}
+	}
+	QT_CHECK_LESS(max_error, 0.02f);
+
+	// layers are silent past the highest rpm
+	table.GetGains(8000 + rpm_cell, 1, gains);
+	for (int n = 0; n < 6; ++n)
+		QT_CHECK_EQUAL(gains[n], 0);
+	table.GetGains(20000, 0.5f, gains);
+	for (int n = 0; n < 6; ++n)
+		QT_CHECK_EQUAL(gains[n], 0);
+}
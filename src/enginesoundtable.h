@@ -0,0 +1,52 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _ENGINESOUNDTABLE_H
+#define _ENGINESOUNDTABLE_H
+
+#include "enginesoundinfo.h"
+
+#include <vector>
+
+/// Engine sound layer gains baked over rpm x throttle.
+/// Gains are normalized across layers, lookup is a bilinear interpolation.
+class EngineSoundTable
+{
+public:
+	EngineSoundTable();
+
+	/// Bake gains of the engine sound layers, blend ranges have to be set.
+	void Init(const std::vector<EngineSoundInfo> & layers);
+
+	/// Get gain of each layer at rpm and throttle in [0, 1].
+	void GetGains(float rpm, float throttle, float gains[]) const;
+
+	/// Gains as computed per layer and normalized, used to bake the table.
+	static void ComputeGains(const std::vector<EngineSoundInfo> & layers, float rpm, float throttle, float gains[]);
+
+private:
+	static const int rpm_cells = 128;
+	static const int throttle_cells = 8;
+
+	std::vector<float> table; // [rpm][throttle][layer]
+	float rpm_scale;
+	unsigned layer_count;
+};
+
+#endif // _ENGINESOUNDTABLE_H
@@ -0,0 +1,157 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "framearena.h"
+#include "unittest.h"
+
+#include <cassert>
+#include <cstdint>
+
+// first block size
+static const std::size_t min_block_size = 1 << 16;
+
+static std::size_t GetBlockSize(std::size_t size)
+{
+	std::size_t block_size = min_block_size;
+	while (block_size < size)
+		block_size *= 2;
+	return block_size;
+}
+
+FrameArena::FrameArena() :
+	begin(0),
+	pos(0),
+	end(0),
+	overflow_used(0)
+{
+	// ctor
+}
+
+FrameArena::~FrameArena()
+{
+	for (char * block : overflow)
+		delete [] block;
+	delete [] begin;
+}
+
+FrameArena & FrameArena::Get()
+{
+	thread_local FrameArena arena;
+	return arena;
+}
+
+void * FrameArena::Allocate(std::size_t size, std::size_t align)
+{
+	assert(align && !(align & (align - 1)));
+
+	std::uintptr_t p = (std::uintptr_t(pos) + align - 1) & ~std::uintptr_t(align - 1);
+	if (!pos || p + size > std::uintptr_t(end))
+	{
+		Grow(size + align);
+		p = (std::uintptr_t(pos) + align - 1) & ~std::uintptr_t(align - 1);
+	}
+	pos = (char *)(p + size);
+	return (void *)p;
+}
+
+void FrameArena::Deallocate(void * p, std::size_t size)
+{
+	// reclaim the last allocation, the common case of a growing vector
+	if ((char *)p + size == pos)
+		pos = (char *)p;
+}
+
+void FrameArena::Reset()
+{
+	if (!overflow.empty())
+	{
+		// replace all blocks by one that fits the whole frame
+		const std::size_t used = GetUsed();
+		for (char * block : overflow)
+			delete [] block;
+		overflow.clear();
+		overflow_used = 0;
+
+		const std::size_t size = GetBlockSize(used);
+		delete [] begin;
+		begin = new char[size];
+		end = begin + size;
+	}
+	pos = begin;
+}
+
+std::size_t FrameArena::GetUsed() const
+{
+	return overflow_used + (pos - begin);
+}
+
+void FrameArena::Grow(std::size_t size)
+{
+	if (begin)
+	{
+		overflow.push_back(begin);
+		overflow_used += pos - begin;
+	}
+
+	const std::size_t block_size = GetBlockSize(size > GetCapacity() ? size : GetCapacity());
+	begin = pos = new char[block_size];
+	end = begin + block_size;
+}
+
+QT_TEST(framearena_test)
+{
+	FrameArena arena;
+
+	// aligned, non overlapping allocations
+	char * a = (char *)arena.Allocate(3, 1);
+	double * b = (double *)arena.Allocate(sizeof(double), alignof(double));
+	QT_CHECK(std::uintptr_t(b) % alignof(double) == 0);
+	QT_CHECK((char *)b >= a + 3);
+
+	// last allocation is reclaimed
+	const std::size_t used = arena.GetUsed();
+	void * c = arena.Allocate(64, 16);
+	arena.Deallocate(c, 64);
+	QT_CHECK(arena.GetUsed() <= used + 16);
+
+	// overflow is merged into one block on reset
+	arena.Reset();
+	QT_CHECK_EQUAL(arena.GetUsed(), 0);
+	for (unsigned i = 0; i < 10; ++i)
+		arena.Allocate(min_block_size / 2, 16);
+	const std::size_t frame_used = arena.GetUsed();
+	arena.Reset();
+	QT_CHECK(arena.GetCapacity() >= frame_used);
+
+	// the same frame fits without growing
+	const std::size_t capacity = arena.GetCapacity();
+	for (unsigned i = 0; i < 10; ++i)
+		arena.Allocate(min_block_size / 2, 16);
+	QT_CHECK_EQUAL(arena.GetCapacity(), capacity);
+
+	// containers
+	arena.Reset();
+	{
+		FrameVector<int> v{FrameAllocator<int>(arena)};
+		for (int i = 0; i < 1000; ++i)
+			v.push_back(i);
+		QT_CHECK_EQUAL(v[999], 999);
+		QT_CHECK(arena.GetUsed() >= 1000 * sizeof(int));
+	}
+}
@@ -0,0 +1,135 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _FRAMEARENA_H
+#define _FRAMEARENA_H
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// Linear allocator for temporaries that don't outlive the current frame.
+/// Every thread has its own arena and resets it once per frame, the main
+/// thread in Game::Advance, the ai workers per update. Allocation bumps a
+/// pointer, deallocation only reclaims the most recent allocation. When a frame
+/// overflows the block, extra blocks are taken from the heap and the next
+/// Reset replaces them with one block large enough for the whole frame, so
+/// steady state frames don't touch the heap.
+class FrameArena
+{
+public:
+	FrameArena();
+
+	~FrameArena();
+
+	/// arena of the calling thread
+	static FrameArena & Get();
+
+	void * Allocate(std::size_t size, std::size_t align);
+
+	void Deallocate(void * p, std::size_t size);
+
+	/// release all allocations, invalidates all memory handed out since the last reset
+	void Reset();
+
+	/// bytes allocated since the last reset
+	std::size_t GetUsed() const;
+
+	/// size of the current block
+	std::size_t GetCapacity() const
+	{
+		return end - begin;
+	}
+
+private:
+	char * begin;
+	char * pos;
+	char * end;
+	std::vector<char *> overflow; ///< blocks filled this frame
+	std::size_t overflow_used;
+
+	FrameArena(const FrameArena &) = delete;
+	FrameArena & operator=(const FrameArena &) = delete;
+
+	void Grow(std::size_t size);
+};
+
+/// Standard allocator adaptor of the frame arena.
+/// Containers using it must not outlive the frame.
+template <typename T>
+class FrameAllocator
+{
+public:
+	typedef T value_type;
+
+	/// use the arena of the calling thread
+	FrameAllocator() : arena(&FrameArena::Get())
+	{
+		// ctor
+	}
+
+	FrameAllocator(FrameArena & arena) : arena(&arena)
+	{
+		// ctor
+	}
+
+	template <typename U>
+	FrameAllocator(const FrameAllocator<U> & other) : arena(other.arena)
+	{
+		// ctor
+	}
+
+	T * allocate(std::size_t n)
+	{
+		return static_cast<T *>(arena->Allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T * p, std::size_t n)
+	{
+		arena->Deallocate(p, n * sizeof(T));
+	}
+
+	template <typename U>
+	bool operator==(const FrameAllocator<U> & other) const
+	{
+		return arena == other.arena;
+	}
+
+	template <typename U>
+	bool operator!=(const FrameAllocator<U> & other) const
+	{
+		return arena != other.arena;
+	}
+
+private:
+	template <typename U> friend class FrameAllocator;
+	FrameArena * arena;
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+typedef std::basic_string<char, std::char_traits<char>, FrameAllocator<char>> FrameString;
+
+typedef std::basic_ostringstream<char, std::char_traits<char>, FrameAllocator<char>> FrameOutputStream;
+
+typedef std::basic_istringstream<char, std::char_traits<char>, FrameAllocator<char>> FrameInputStream;
+
+#endif // _FRAMEARENA_H
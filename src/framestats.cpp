@@ -0,0 +1,346 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "framestats.h"
+#include "utils.h"
+#include "unittest.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+
+// sub buckets per power of two are 2^(sub_bits - 1)
+static const unsigned sub_bits = 8;
+static const unsigned sub_half = 1 << (sub_bits - 1);
+
+// microsecond buckets up to 2^32 us
+static const unsigned bucket_count = (32 - sub_bits + 2) * sub_half;
+
+// frames with zone breakdown
+static const unsigned worst_count = 10;
+
+// zone breakdown depth
+static const unsigned zone_depth = 3;
+
+static unsigned GetBucket(unsigned long long value)
+{
+	if (value < 2 * sub_half)
+		return value;
+
+	unsigned msb = 0;
+	while (value >> (msb + 1))
+		msb++;
+
+	const unsigned shift = msb - sub_bits + 1;
+	const unsigned sub = value >> shift;
+	return std::min((shift + 1) * sub_half + sub - sub_half, bucket_count - 1);
+}
+
+// largest value of the bucket
+static unsigned long long GetBucketValue(unsigned bucket)
+{
+	if (bucket < 2 * sub_half)
+		return bucket;
+
+	const unsigned shift = bucket / sub_half - 1;
+	const unsigned long long sub = bucket % sub_half + sub_half;
+	return ((sub + 1) << shift) - 1;
+}
+
+FrameStats::Histogram::Histogram() :
+	counts(bucket_count, 0),
+	max_time(0),
+	count(0)
+{
+	// ctor
+}
+
+void FrameStats::Histogram::Clear()
+{
+	std::fill(counts.begin(), counts.end(), 0);
+	max_time = 0;
+	count = 0;
+}
+
+void FrameStats::Histogram::Add(double seconds)
+{
+	counts[GetBucket(std::llround(seconds * 1E6))]++;
+	max_time = std::max(max_time, seconds);
+	count++;
+}
+
+double FrameStats::Histogram::GetPercentile(double p) const
+{
+	if (!count)
+		return 0;
+
+	const unsigned long long rank = std::max(1.0, std::ceil(p * 0.01 * count));
+	unsigned long long sum = 0;
+	for (unsigned i = 0; i < counts.size(); ++i)
+	{
+		sum += counts[i];
+		if (sum >= rank)
+			return std::min(GetBucketValue(i) * 1E-6, max_time);
+	}
+	return max_time;
+}
+
+FrameStats::FrameStats() :
+	started(false),
+	budget(1.0 / 60),
+	total_time(0),
+	min_time(0),
+	max_time(0),
+	total_ticks(0),
+	count(0),
+	over_budget(0)
+{
+	// ctor
+}
+
+void FrameStats::SetBudget(double seconds)
+{
+	budget = seconds;
+}
+
+void FrameStats::Reset()
+{
+	histogram.Clear();
+	zones.clear();
+	worst.clear();
+	started = false;
+	total_time = 0;
+	min_time = 0;
+	max_time = 0;
+	total_ticks = 0;
+	count = 0;
+	over_budget = 0;
+}
+
+void FrameStats::EndFrame(unsigned ticks)
+{
+	const auto now = std::chrono::steady_clock::now();
+	if (started)
+		AddFrame(std::chrono::duration<double>(now - last_frame).count(), ticks);
+	last_frame = now;
+	started = true;
+}
+
+void FrameStats::AddFrame(double seconds, unsigned ticks)
+{
+	histogram.Add(seconds);
+
+	min_time = count ? std::min(min_time, seconds) : seconds;
+	max_time = std::max(max_time, seconds);
+	total_time += seconds;
+	total_ticks += ticks;
+	if (seconds > budget)
+		over_budget++;
+	count++;
+
+	// top level zones of the main thread
+	Profiler::GetFrameZones(frame_zones, 0);
+	for (const auto & frame_zone : frame_zones)
+	{
+		auto it = std::find_if(zones.begin(), zones.end(), [&](const Zone & zone) {
+			return std::strcmp(zone.name, frame_zone.name) == 0;
+		});
+		if (it == zones.end())
+		{
+			zones.push_back(Zone());
+			zones.back().name = frame_zone.name;
+			it = zones.end() - 1;
+		}
+		it->histogram.Add(frame_zone.seconds);
+	}
+
+	// only worst frames fetch their zones
+	if (worst.size() < worst_count || seconds > worst.back().time)
+	{
+		if (worst.size() == worst_count)
+			worst.pop_back();
+
+		Frame frame;
+		frame.index = count - 1;
+		frame.ticks = ticks;
+		frame.time = seconds;
+		Profiler::GetFrameZones(frame.zones, zone_depth);
+
+		auto it = std::upper_bound(worst.begin(), worst.end(), seconds,
+			[](double t, const Frame & f) { return t > f.time; });
+		worst.insert(it, std::move(frame));
+	}
+}
+
+double FrameStats::GetPercentile(double p) const
+{
+	return histogram.GetPercentile(p);
+}
+
+double FrameStats::GetZonePercentile(const std::string & name, double p) const
+{
+	for (const auto & zone : zones)
+	{
+		if (name == zone.name)
+			return zone.histogram.GetPercentile(p);
+	}
+	return 0;
+}
+
+static const struct
+{
+	double value;
+	const char * name;
+} percentiles[] = {{50, "p50"}, {95, "p95"}, {99, "p99"}, {99.9, "p99.9"}};
+
+void FrameStats::PrintSummary(std::ostream & out) const
+{
+	const std::ios::fmtflags flags = out.flags();
+	out << std::fixed << std::setprecision(2);
+	out << "Frames: " << count << ", over " << budget * 1E3 << " ms budget: " << over_budget << "\n";
+	out << "Frame time ms:";
+	for (const auto & p : percentiles)
+		out << " " << p.name << " " << GetPercentile(p.value) * 1E3;
+	out << " max " << max_time * 1E3 << "\n";
+	for (const auto & zone : zones)
+	{
+		out << "  " << zone.name << " ms:";
+		for (const auto & p : percentiles)
+			out << " " << p.name << " " << zone.histogram.GetPercentile(p.value) * 1E3;
+		out << " max " << zone.histogram.max_time * 1E3 << "\n";
+	}
+	out << "Worst frames:\n";
+	for (const auto & frame : worst)
+	{
+		out << "  frame " << frame.index << ": " << frame.time * 1E3 << " ms, " << frame.ticks << " ticks\n";
+		for (const auto & zone : frame.zones)
+		{
+			out << "    " << std::string(zone.depth * 2, ' ') << zone.name << ": "
+				<< zone.seconds * 1E3 << " ms\n";
+		}
+	}
+	out.flags(flags);
+}
+
+void FrameStats::WriteJson(std::ostream & out, const std::string & indent) const
+{
+	const std::string nl = "\n" + indent;
+	const std::ios::fmtflags flags = out.flags();
+	out << std::fixed << std::setprecision(3);
+	out << "{";
+	out << nl << "\t\"frames\": " << count << ",";
+	out << nl << "\t\"ticks\": " << total_ticks << ",";
+	out << nl << "\t\"elapsed_s\": " << total_time << ",";
+	out << nl << "\t\"budget_ms\": " << budget * 1E3 << ",";
+	out << nl << "\t\"over_budget\": " << over_budget << ",";
+	out << nl << "\t\"frame_time_ms\": {";
+	out << "\"mean\": " << (count ? total_time / count : 0) * 1E3;
+	out << ", \"min\": " << min_time * 1E3;
+	out << ", \"max\": " << max_time * 1E3;
+	for (const auto & p : percentiles)
+		out << ", \"" << p.name << "\": " << GetPercentile(p.value) * 1E3;
+	out << "},";
+	out << nl << "\t\"zone_time_ms\": {";
+	for (unsigned i = 0; i < zones.size(); ++i)
+	{
+		const Histogram & zone = zones[i].histogram;
+		out << (i ? "," : "") << nl << "\t\t" << Utils::jsonstr(zones[i].name) << ": {";
+		out << "\"frames\": " << zone.count;
+		for (const auto & p : percentiles)
+			out << ", \"" << p.name << "\": " << zone.GetPercentile(p.value) * 1E3;
+		out << ", \"max\": " << zone.max_time * 1E3 << "}";
+	}
+	out << (zones.empty() ? "}," : nl + "\t},");
+	out << nl << "\t\"worst_frames\": [";
+	for (unsigned i = 0; i < worst.size(); ++i)
+	{
+		const Frame & frame = worst[i];
+		out << (i ? "," : "") << nl << "\t\t{\"frame\": " << frame.index
+			<< ", \"time_ms\": " << frame.time * 1E3
+			<< ", \"ticks\": " << frame.ticks
+			<< ", \"zones_ms\": {";
+
+		// zones are keyed by their path
+		std::vector<const char *> path;
+		for (unsigned j = 0; j < frame.zones.size(); ++j)
+		{
+			const auto & zone = frame.zones[j];
+			path.resize(zone.depth);
+			path.push_back(zone.name);
+
+			std::string key;
+			for (unsigned k = 0; k < path.size(); ++k)
+				key.append(k ? "/" : "").append(path[k]);
+			out << (j ? ", " : "") << Utils::jsonstr(key) << ": " << zone.seconds * 1E3;
+		}
+		out << "}}";
+	}
+	out << nl << "\t]";
+	out << nl << "}";
+	out.flags(flags);
+}
+
+QT_TEST(framestats_test)
+{
+	// bucket bounds enclose their values
+	for (unsigned long long v : {0ull, 1ull, 255ull, 256ull, 257ull, 1000ull, 16667ull, 123456789ull})
+	{
+		const unsigned b = GetBucket(v);
+		QT_CHECK(GetBucketValue(b) >= v);
+		QT_CHECK(b == 0 || GetBucketValue(b - 1) < v);
+	}
+
+	// frame times 1 to 1000 ms
+	FrameStats stats;
+	for (unsigned i = 1; i <= 1000; ++i)
+		stats.AddFrame(i * 1E-3, 1);
+
+	QT_CHECK_EQUAL(stats.GetCount(), 1000);
+	QT_CHECK_CLOSE(stats.GetPercentile(50), 0.5, 0.005);
+	QT_CHECK_CLOSE(stats.GetPercentile(99), 0.99, 0.01);
+	QT_CHECK_CLOSE(stats.GetPercentile(100), 1.0, 1E-9);
+
+	// top level zones get a histogram each, restore the profiler state at the end
+	const bool profiling = Profiler::Enabled();
+	if (!profiling)
+		Profiler::Init();
+
+	static const unsigned zone = Profiler::RegisterZone("framestats test");
+	stats.Reset();
+	for (unsigned i = 0; i < 10; ++i)
+	{
+		{
+			ProfileScope scope(zone);
+		}
+		Profiler::EndFrame();
+		stats.AddFrame(1E-3, 1);
+	}
+	QT_CHECK(stats.GetZonePercentile("framestats test", 99) < 1E-3);
+	QT_CHECK_EQUAL(stats.GetZonePercentile("unknown zone", 50), 0);
+
+	std::ostringstream json;
+	stats.WriteJson(json);
+	QT_CHECK(json.str().find("\"framestats test\": {\"frames\": 10") != std::string::npos);
+
+	if (!profiling)
+		Profiler::Shutdown();
+}
@@ -0,0 +1,107 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _FRAMESTATS_H
+#define _FRAMESTATS_H
+
+#include "profiler.h"
+
+#include <chrono>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/// Frame time statistics of a benchmark run.
+/// Frame times go into a log-linear histogram with microsecond resolution and
+/// under 1% relative error, so percentiles come from the histogram alone. Top
+/// level profiler zones get a histogram each, the worst frames keep their
+/// profiler zone breakdown.
+class FrameStats
+{
+public:
+	FrameStats();
+
+	/// frames longer than budget are counted as over budget
+	void SetBudget(double seconds);
+
+	/// clear recorded frames, keeps the budget
+	void Reset();
+
+	/// record the wall time since the previous call, ticks is the simulation tick count
+	void EndFrame(unsigned ticks);
+
+	/// record a frame
+	void AddFrame(double seconds, unsigned ticks);
+
+	unsigned GetCount() const
+	{
+		return count;
+	}
+
+	/// frame time in seconds at percentile p in [0, 100]
+	double GetPercentile(double p) const;
+
+	/// time of top level zone name in seconds at percentile p, 0 if not recorded
+	double GetZonePercentile(const std::string & name, double p) const;
+
+	void PrintSummary(std::ostream & out) const;
+
+	/// write statistics as a json object, lines after the first are prefixed by indent
+	void WriteJson(std::ostream & out, const std::string & indent = std::string()) const;
+
+private:
+	struct Histogram
+	{
+		std::vector<unsigned> counts; ///< counts per microsecond bucket
+		double max_time;
+		unsigned count;
+
+		Histogram();
+		void Clear();
+		void Add(double seconds);
+		double GetPercentile(double p) const;
+	};
+	struct Zone
+	{
+		const char * name;
+		Histogram histogram;
+	};
+	struct Frame
+	{
+		unsigned index;
+		unsigned ticks;
+		double time;
+		std::vector<Profiler::ZoneTime> zones;
+	};
+	Histogram histogram;
+	std::vector<Zone> zones; ///< top level zones in order of appearance
+	std::vector<Profiler::ZoneTime> frame_zones; ///< reused to fetch zones
+	std::vector<Frame> worst; ///< worst frames, longest first
+	std::chrono::steady_clock::time_point last_frame;
+	bool started;
+	double budget;
+	double total_time;
+	double min_time;
+	double max_time;
+	unsigned long long total_ticks;
+	unsigned count;
+	unsigned over_budget;
+};
+
+#endif // _FRAMESTATS_H
@@ -53,3 +53,31 @@ QT_TEST(frustum_cull_test)
 	QT_CHECK(!FrustumCull(frustum.frustum, Vec3(12, 0, 1), Vec3(3, 2, 1)));
 	QT_CHECK(!FrustumCull(frustum.frustum, Vec3(-12, 0, 1), Vec3(3, 2, 1)));
 }
+
+QT_TEST(lod_select_test)
+{
+	// 1 unit radius sphere, transitions at 64 and 16 pixels on a 1024 pixel screen
+	const float thresholds[2] = {
+		ContributionCullThreshold(1024.0f, float(M_PI_2), 64.0f),
+		ContributionCullThreshold(1024.0f, float(M_PI_2), 16.0f)};
+	const Vec3 campos(0, 0, 0);
+
+	// close objects use the full model
+	QT_CHECK_EQUAL(LodSelect(campos, Vec3(0, 10, 0), 1.0f, thresholds, 3, 0), 0u);
+	QT_CHECK_EQUAL(LodSelect(campos, Vec3(0, 10, 0), 1.0f, thresholds, 3, 2), 0u);
+
+	// distant objects switch to coarser levels
+	QT_CHECK_EQUAL(LodSelect(campos, Vec3(0, 50, 0), 1.0f, thresholds, 3, 0), 1u);
+	QT_CHECK_EQUAL(LodSelect(campos, Vec3(0, 1000, 0), 1.0f, thresholds, 3, 0), 2u);
+
+	// no more levels than available
+	QT_CHECK_EQUAL(LodSelect(campos, Vec3(0, 1000, 0), 1.0f, thresholds, 2, 0), 1u);
+	QT_CHECK_EQUAL(LodSelect(campos, Vec3(0, 1000, 0), 1.0f, thresholds, 1, 0), 0u);
+
+	// hysteresis keeps the current level close to the transition distance
+	// 64 pixel transition of a 1 unit radius sphere is at about 20 units distance
+	QT_CHECK_EQUAL(LodSelect(campos, Vec3(0, 21.5f, 0), 1.0f, thresholds, 3, 0), 0u);
+	QT_CHECK_EQUAL(LodSelect(campos, Vec3(0, 19.5f, 0), 1.0f, thresholds, 3, 1), 1u);
+	QT_CHECK_EQUAL(LodSelect(campos, Vec3(0, 25.0f, 0), 1.0f, thresholds, 3, 0), 1u);
+	QT_CHECK_EQUAL(LodSelect(campos, Vec3(0, 17.0f, 0), 1.0f, thresholds, 3, 1), 0u);
+}
@@ -106,6 +106,28 @@ static inline bool ContributionCull2(T3 campos, T cull_threshold, T3 center, T r
 }
 
 
+// Select level of detail by projected sphere size, using the contribution cull metric
+// lod_thresholds = ContributionCullThreshold for each level transition, descending
+// hysteresis = relative threshold band to avoid popping between levels
+// returns the new level in [0, lod_count - 1]
+
+template <typename T3, typename T>
+static inline unsigned LodSelect(T3 campos, T3 center, T radius,
+	const T lod_thresholds[], unsigned lod_count, unsigned lod, T hysteresis = T(0.2))
+{
+	T3 d = center - campos;
+	T size2 = radius * radius;
+	T dist2 = d.dot(d);
+	if (lod >= lod_count)
+		lod = lod_count - 1;
+	while (lod + 1 < lod_count && size2 < dist2 * lod_thresholds[lod] * (1 - hysteresis))
+		lod++;
+	while (lod > 0 && size2 > dist2 * lod_thresholds[lod - 1] * (1 + hysteresis))
+		lod--;
+	return lod;
+}
+
+
 // Frustum cull functors
 
 template <typename T4>
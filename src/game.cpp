@@ -25,7 +25,10 @@
 #include "physics/tracksurface.h"
 #include "numprocessors.h"
 #include "performance_testing.h"
-#include "quickprof.h"
+#include "sound/soundbenchmark.h"
+#include "profiler.h"
+#include "alloctracker.h"
+#include "framearena.h"
 #include "utils.h"
 #include "graphics/graphics_gl2.h"
 #include "graphics/graphics_gl3v.h"
@@ -47,6 +50,7 @@
 #include <sstream>
 #include <algorithm>
 #include <cstdio>
+#include <cstdlib>
 
 #ifdef _WIN32
 	#define OS_NAME "Windows"
@@ -86,6 +90,12 @@ static std::string GetTimeString(float time)
 	return "--:--.---";
 }
 
+// zones kept free of heap allocations, checked by -alloctrack
+static const char * const noalloc_zones[] = {"draw node list", "road collide"};
+
+// frames until arenas and containers reached their steady state size
+static const unsigned noalloc_warmup_frames = 30;
+
 Game::Game(std::ostream & info_out, std::ostream & error_out) :
 	info_output(info_out),
 	error_output(error_out),
@@ -102,6 +112,13 @@ Game::Game(std::ostream & info_out, std::ostream & error_out) :
 	fps_position(0),
 	fps_min(0),
 	fps_max(0),
+	benchmark_id(0),
+	benchmark_frame(0),
+	benchmark_done(false),
+	telemetry_channels(CarTelemetry::ALL),
+	telemetry_count(0),
+	noalloc_frame(noalloc_warmup_frames),
+	benchmark_violations(0),
 	multithreaded(false),
 	profilingmode(false),
 	benchmode(false),
@@ -231,10 +248,18 @@ void Game::Start(std::list <std::string> & args)
 
 	if (benchmode)
 	{
-		assert(!car_info.empty());
-		car_info[player_car_id].driver = Ai::default_type;
+		// without scenario file run a lap with the user settings
+		if (benchmarks.empty())
+		{
+			BenchmarkScenario scenario;
+			scenario.name = "default";
+			scenario.reverse = settings.GetTrackReverse();
+			scenario.ai_level = settings.GetAILevel();
+			benchmarks.push_back(scenario);
+		}
 
-		if (!NewGame(false, false, 1))
+		settings.Get(benchmark_settings);
+		if (!StartBenchmark())
 		{
 			error_output << "Error loading benchmark" << std::endl;
 			return;
@@ -261,10 +286,42 @@ void Game::End()
 		info_output << "Elapsed time: " << clocktime << " seconds\n";
 		info_output << "Average frame-rate: " << mean_fps << " frames per second\n";
 		info_output << "Min / Max frame-rate: " << fps_min << " / " << fps_max << " frames per second" << std::endl;
+
+		if (benchmark_id < benchmarks.size())
+			EndBenchmark("aborted");
+
+		// don't save benchmark scenario settings
+		settings.Set(benchmark_settings);
+
+		if (!statsfile.empty())
+		{
+			std::ofstream stats(statsfile.c_str());
+			stats << "{\n\t\"scenarios\": [" << benchmark_results << "\n\t]\n}\n";
+			if (stats)
+				info_output << "Wrote benchmark results to " << statsfile << std::endl;
+			else
+				error_output << "Failed to write benchmark results to " << statsfile << std::endl;
+		}
 	}
 
 	if (profilingmode)
-		info_output << "Profiling summary:\n" << PROFILER.getSummary(quickprof::PERCENT) << std::endl;
+	{
+		info_output << "Profiling summary:\n";
+		Profiler::PrintSummary(info_output);
+		info_output << std::endl;
+		Profiler::EndTrace();
+
+		if (AllocTracker::Enabled())
+		{
+			info_output << "Allocation summary:\n";
+			AllocTracker::PrintSummary(info_output);
+			info_output << std::endl;
+
+			const unsigned long long violations = AllocTracker::GetViolations();
+			if (violations)
+				error_output << violations << " heap allocations in zero allocation zones" << std::endl;
+		}
+	}
 
 	info_output << "Shutting down..." << std::endl;
 
@@ -494,7 +551,20 @@ bool Game::InitGUI()
 
 bool Game::InitSound()
 {
-	if (sound.Init(1<<settings.GetSoundBufferSizeLog2(), info_output, error_output))
+	bool initialized = false;
+	unsigned short buffersize = 1<<settings.GetSoundBufferSizeLog2();
+	if (!soundfile.empty())
+	{
+		// record sound to file instead of playing it
+		std::unique_ptr<SoundOutput> output(new SoundOutputFile(soundfile, SoundOutputFile::REALTIME));
+		initialized = sound.Init(std::move(output), buffersize, info_output, error_output);
+	}
+	else
+	{
+		initialized = sound.Init(buffersize, info_output, error_output);
+	}
+
+	if (initialized)
 	{
 		sound.SetVolume(settings.GetSoundVolume());
 		content.getFactory<SoundBuffer>().init(sound.GetDeviceInfo());
@@ -567,11 +637,33 @@ bool Game::ParseArguments(std::list <std::string> & args)
 
 	if (argmap.find("-profiling") != argmap.end() || argmap.find("-benchmark") != argmap.end())
 	{
-		PROFILER.init(20);
+		Profiler::Init();
 		profilingmode = true;
 	}
 	arghelp["-profiling"] = "Display game performance data.";
 
+	if (!argmap["-trace"].empty())
+	{
+		if (!profilingmode)
+			Profiler::Init();
+		profilingmode = true;
+
+		if (Profiler::BeginTrace(argmap["-trace"]))
+			info_output << "Writing profiling trace to " << argmap["-trace"] << std::endl;
+		else
+			error_output << "Failed to create profiling trace " << argmap["-trace"] << std::endl;
+	}
+	arghelp["-trace FILE"] = "Record profiled zones to FILE in Chrome trace event format.";
+
+	if (argmap.find("-alloctrack") != argmap.end())
+	{
+		if (!profilingmode)
+			Profiler::Init();
+		profilingmode = true;
+		AllocTracker::Init();
+	}
+	arghelp["-alloctrack"] = "Count heap allocations per profiled zone.";
+
 	if (argmap.find("-dumpfps") != argmap.end())
 	{
 		info_output << "Dumping the frame-rate to log." << std::endl;
@@ -627,12 +719,69 @@ bool Game::ParseArguments(std::list <std::string> & args)
 		sound.Disable();
 	arghelp["-nosound"] = "Disable all sound.";
 
+	if (!argmap["-soundfile"].empty())
+		soundfile = argmap["-soundfile"];
+	arghelp["-soundfile FILE"] = "Write sound output into the specified WAV file instead of playing it.";
+
+	if (argmap.find("-soundtest") != argmap.end())
+	{
+		SoundBenchmark(info_output, error_output);
+		continue_game = false;
+	}
+	arghelp["-soundtest"] = "Run sound mixer throughput benchmark.";
+
 	if (argmap.find("-benchmark") != argmap.end())
 	{
 		info_output << "Entering benchmark mode." << std::endl;
 		benchmode = true;
+
+		const std::string & scenariofile = argmap["-benchmark"];
+		if (!scenariofile.empty())
+		{
+			std::ifstream scenarios(scenariofile.c_str());
+			if (!scenarios || !BenchmarkScenario::Load(scenarios, benchmarks, error_output))
+			{
+				error_output << "Failed to load benchmark scenarios from " << scenariofile << std::endl;
+				continue_game = false;
+			}
+			else
+			{
+				// graphics are initialized once, the first render config applies to all scenarios
+				for (const auto & scenario : benchmarks)
+				{
+					if (!scenario.render.empty())
+					{
+						renderconfigfile = scenario.render;
+						break;
+					}
+				}
+			}
+		}
+	}
+	arghelp["-benchmark [FILE]"] = "Run in benchmark mode, run the scenarios in FILE if specified.";
+
+	if (!argmap["-benchmarkstats"].empty())
+		statsfile = argmap["-benchmarkstats"];
+	arghelp["-benchmarkstats FILE"] = "Write benchmark results into the specified JSON file.";
+
+	if (!argmap["-framebudget"].empty())
+		framestats.SetBudget(cast<float>(argmap["-framebudget"]) * 1E-3);
+	arghelp["-framebudget MS"] = "Frame time budget of the benchmark statistics, default 16.67 ms.";
+
+	if (!argmap["-telemetry"].empty())
+		telemetry_file = argmap["-telemetry"];
+	arghelp["-telemetry FILE"] = "Capture car telemetry of each race into FILE, FILE.1, FILE.2 ...";
+
+	if (!argmap["-telemetrychannels"].empty())
+	{
+		telemetry_channels = CarTelemetry::ParseChannels(argmap["-telemetrychannels"]);
+		if (!telemetry_channels)
+		{
+			error_output << "Unknown telemetry channels " << argmap["-telemetrychannels"] << ", capturing all" << std::endl;
+			telemetry_channels = CarTelemetry::ALL;
+		}
 	}
-	arghelp["-benchmark"] = "Run in benchmark mode.";
+	arghelp["-telemetrychannels LIST"] = "Comma separated telemetry channels: slip, force, suspension, engine, all (default).";
 
 	arghelp["-render FILE"] = "Load the specified render configuration file instead of the default gl3/deferred.conf.";
 	if (!argmap["-render"].empty())
@@ -692,84 +841,94 @@ void Game::Test()
 
 void Game::Draw(float dt)
 {
-	PROFILER.beginBlock("scenegraph");
+	PROFILE_SCOPE("draw");
 
-	std::vector<SceneNode*> nodes;
-	nodes.reserve(6);
-
-	nodes.push_back(&dynamicsdraw.getNode());
-	nodes.push_back(&trackmap.GetNode());
-	nodes.push_back(&skid_marks.GetNode());
-	nodes.push_back(&tire_smoke.GetNode());
-
-	if (gui.GetNodes().first)
-		nodes.push_back(gui.GetNodes().first);
+	{
+		PROFILE_SCOPE("scenegraph");
 
-	if (gui.GetNodes().second)
-		nodes.push_back(gui.GetNodes().second);
+		FrameVector<SceneNode*> nodes;
+		{
+			// zero allocation zone
+			PROFILE_SCOPE("draw node list");
 
-	graphics->BindDynamicVertexData(nodes);
+			nodes.reserve(6);
 
-	graphics->ClearDynamicDrawables();
-	graphics->AddDynamicNode(dynamicsdraw.getNode());
-	graphics->AddDynamicNode(track.GetBodyNode());
-	graphics->AddDynamicNode(track.GetRacinglineNode());
-	graphics->AddDynamicNode(trackmap.GetNode());
-	graphics->AddDynamicNode(skid_marks.GetNode());
-	graphics->AddDynamicNode(tire_smoke.GetNode());
+			nodes.push_back(&dynamicsdraw.getNode());
+			nodes.push_back(&trackmap.GetNode());
+			nodes.push_back(&skid_marks.GetNode());
+			nodes.push_back(&tire_smoke.GetNode());
 
-	for (auto & car : car_graphics)
-		graphics->AddDynamicNode(car.GetNode());
+			if (gui.GetNodes().first)
+				nodes.push_back(gui.GetNodes().first);
 
-	if (gui.GetNodes().first)
-		graphics->AddDynamicNode(*gui.GetNodes().first);
+			if (gui.GetNodes().second)
+				nodes.push_back(gui.GetNodes().second);
+		}
 
-	if (gui.GetNodes().second)
-		graphics->AddDynamicNode(*gui.GetNodes().second);
+		graphics->BindDynamicVertexData(nodes.data(), nodes.size());
 
-	PROFILER.endBlock("scenegraph");
+		graphics->ClearDynamicDrawables();
+		graphics->AddDynamicNode(dynamicsdraw.getNode());
+		graphics->AddDynamicNode(track.GetBodyNode());
+		graphics->AddDynamicNode(track.GetRacinglineNode());
+		graphics->AddDynamicNode(trackmap.GetNode());
+		graphics->AddDynamicNode(skid_marks.GetNode());
+		graphics->AddDynamicNode(tire_smoke.GetNode());
 
-	// Send scene information to the graphics subsystem.
-	PROFILER.beginBlock("render setup");
-	graphics->SetContrast(settings.GetContrast());
-	graphics->SetSunDirection(track.GetSunDirection());
-	if (active_camera)
-	{
-		float fov = active_camera->GetFOV() > 0 ? active_camera->GetFOV() : settings.GetFOV();
+		for (auto & car : car_graphics)
+			graphics->AddDynamicNode(car.GetNode());
 
-		Vec3 reflection_location = active_camera->GetPosition();
-		if (camera_car_id < unsigned(car_dynamics.size()))
-			reflection_location = ToMathVector<float>(car_dynamics[camera_car_id].GetCenterOfMass());
+		if (gui.GetNodes().first)
+			graphics->AddDynamicNode(*gui.GetNodes().first);
 
-		Quat camlook;
-		camlook.Rotate(M_PI_2, 1, 0, 0);
-		Quat cam_orientation = -(active_camera->GetOrientation() * camlook);
-
-		graphics->SetupScene(
-			fov, settings.GetViewDistance(),
-			active_camera->GetPosition(),
-			cam_orientation,
-			reflection_location,
-			error_output);
+		if (gui.GetNodes().second)
+			graphics->AddDynamicNode(*gui.GetNodes().second);
 	}
-	else
+
+	// Send scene information to the graphics subsystem.
 	{
-		graphics->SetupScene(
-			settings.GetFOV(), settings.GetViewDistance(),
-			Vec3(), Quat(), Vec3(),
-			error_output);
+		PROFILE_SCOPE("render setup");
+		graphics->SetContrast(settings.GetContrast());
+		graphics->SetSunDirection(track.GetSunDirection());
+		if (active_camera)
+		{
+			float fov = active_camera->GetFOV() > 0 ? active_camera->GetFOV() : settings.GetFOV();
+
+			Vec3 reflection_location = active_camera->GetPosition();
+			if (camera_car_id < unsigned(car_dynamics.size()))
+				reflection_location = ToMathVector<float>(car_dynamics[camera_car_id].GetCenterOfMass());
+
+			Quat camlook;
+			camlook.Rotate(M_PI_2, 1, 0, 0);
+			Quat cam_orientation = -(active_camera->GetOrientation() * camlook);
+
+			graphics->SetupScene(
+				fov, settings.GetViewDistance(),
+				active_camera->GetPosition(),
+				cam_orientation,
+				reflection_location,
+				error_output);
+		}
+		else
+		{
+			graphics->SetupScene(
+				settings.GetFOV(), settings.GetViewDistance(),
+				Vec3(), Quat(), Vec3(),
+				error_output);
+		}
+		graphics->UpdateScene(dt);
 	}
-	graphics->UpdateScene(dt);
-	PROFILER.endBlock("render setup");
 
 	// Sync CPU and GPU (flip the page).
-	PROFILER.beginBlock("render sync");
-	window.SwapBuffers();
-	PROFILER.endBlock("render sync");
+	{
+		PROFILE_SCOPE("render sync");
+		window.SwapBuffers();
+	}
 
-	PROFILER.beginBlock("render draw");
-	graphics->DrawScene(error_output);
-	PROFILER.endBlock("render draw");
+	{
+		PROFILE_SCOPE("render draw");
+		graphics->DrawScene(error_output);
+	}
 }
 
 void Game::Run()
@@ -786,6 +945,8 @@ void Game::Advance()
 
 	eventsystem.BeginFrame();
 
+	const unsigned frame_begin = frame;
+
 	// Do CPU intensive stuff in parallel with the GPU...
 	Tick(eventsystem.Get_dt());
 
@@ -793,7 +954,29 @@ void Game::Advance()
 
 	eventsystem.EndFrame();
 
-	PROFILER.endCycle();
+	Profiler::EndFrame();
+	AllocTracker::EndFrame();
+
+	if (AllocTracker::Enabled() && displayframe == noalloc_frame)
+		SetNoAllocZones(true);
+
+	// release frame temporaries of the main thread
+	FrameArena::Get().Reset();
+
+	if (benchmode && benchmark_id < benchmarks.size())
+	{
+		framestats.EndFrame(frame - frame_begin);
+
+		const float timeout = benchmarks[benchmark_id].timeout;
+		const bool timedout = timeout > 0 && (frame - benchmark_frame) * timestep > timeout;
+		if (benchmark_done || timedout)
+		{
+			EndBenchmark(benchmark_done ? "completed" : "timeout");
+			benchmark_id++;
+			if (!StartBenchmark())
+				eventsystem.Quit();
+		}
+	}
 
 	displayframe++;
 }
@@ -801,6 +984,8 @@ void Game::Advance()
 /* Deltat is in seconds... */
 void Game::Tick(float deltat)
 {
+	PROFILE_SCOPE("tick");
+
 	// This is the minimum fps the game will run at before it starts slowing down time.
 	const float minfps = 10;
 	// Slow the game down if we can't process fast enough.
@@ -845,68 +1030,80 @@ void Game::Tick(float deltat)
 /* Increment game logic by one frame... */
 void Game::AdvanceGameLogic()
 {
-	//PROFILER.beginBlock("input-processing");
+	PROFILE_SCOPE("game logic");
 
-	eventsystem.ProcessEvents();
+	{
+		PROFILE_SCOPE("input processing");
 
-	float car_speed = !pause ? car_dynamics[player_car_id].GetSpeed() : 0;
-	car_controls_local.ProcessInput(
-			settings.GetJoyType(),
-			eventsystem,
-			timestep,
-			settings.GetJoy200(),
-			car_speed,
-			settings.GetSpeedSensitivity(),
-			window.GetW(),
-			window.GetH(),
-			settings.GetButtonRamp(),
-			settings.GetHGateShifter());
+		eventsystem.ProcessEvents();
 
-	ProcessGUIInputs();
+		float car_speed = !pause ? car_dynamics[player_car_id].GetSpeed() : 0;
+		car_controls_local.ProcessInput(
+				settings.GetJoyType(),
+				eventsystem,
+				timestep,
+				settings.GetJoy200(),
+				car_speed,
+				settings.GetSpeedSensitivity(),
+				window.GetW(),
+				window.GetH(),
+				settings.GetButtonRamp(),
+				settings.GetHGateShifter());
 
-	ProcessGameInputs();
+		ProcessGUIInputs();
 
-	//PROFILER.endBlock("input-processing");
+		ProcessGameInputs();
+	}
 
 	if (!pause)
 	{
-		PROFILER.beginBlock("ai");
-		ai.Visualize();
-		ai.Update(timestep, &car_dynamics[0], car_dynamics.size());
-		PROFILER.endBlock("ai");
+		{
+			PROFILE_SCOPE("ai");
+			ai.Visualize();
+			ai.Update(timestep, &car_dynamics[0], car_dynamics.size());
+		}
 
-		//PROFILER.beginBlock("input");
-		ProcessCarInputs();
-		//PROFILER.endBlock("input");
+		{
+			PROFILE_SCOPE("input");
+			ProcessCarInputs();
+		}
 
-		PROFILER.beginBlock("physics");
-		dynamics.update(timestep);
-		PROFILER.endBlock("physics");
+		{
+			PROFILE_SCOPE("physics");
+			dynamics.update(timestep);
 
-		PROFILER.beginBlock("car");
-		ProcessCameraInputs();
-		UpdateCars(timestep);
-		PROFILER.endBlock("car");
+			if (telemetry.Enabled())
+				telemetry.Sample(frame * timestep, &car_dynamics[0], car_dynamics.size());
+		}
+
+		{
+			PROFILE_SCOPE("car");
+			ProcessCameraInputs();
+			UpdateCars(timestep);
+		}
 
 		// Update dynamic track objects.
 		track.Update();
 
-		//PROFILER.beginBlock("timer");
-		UpdateTimer();
-		//PROFILER.endBlock("timer");
+		{
+			PROFILE_SCOPE("timer");
+			UpdateTimer();
+		}
 
-		//PROFILER.beginBlock("particles");
-		UpdateParticles(timestep);
-		//PROFILER.endBlock("particles");
+		{
+			PROFILE_SCOPE("particles");
+			UpdateParticles(timestep);
+		}
 
-		//PROFILER.beginBlock("trackmap-update");
-		UpdateTrackMap();
-		//PROFILER.endBlock("trackmap-update");
+		{
+			PROFILE_SCOPE("trackmap update");
+			UpdateTrackMap();
+		}
 	}
 
 	if (sound.Enabled())
 	{
-		PROFILER.beginBlock("sound");
+		PROFILE_SCOPE("sound");
 		Vec3 pos;
 		Quat rot;
 		if (active_camera)
@@ -917,12 +1114,12 @@ void Game::AdvanceGameLogic()
 		sound.SetListenerPosition(pos[0], pos[1], pos[2]);
 		sound.SetListenerRotation(rot[0], rot[1], rot[2], rot[3]);
 		sound.Update(pause);
-		PROFILER.endBlock("sound");
 	}
 
-	//PROFILER.beginBlock("force-feedback");
-	UpdateForceFeedback(timestep);
-	//PROFILER.endBlock("force-feedback");
+	{
+		PROFILE_SCOPE("force feedback");
+		UpdateForceFeedback(timestep);
+	}
 }
 
 /* Process inputs used only for higher level game functions... */
@@ -1287,10 +1484,12 @@ void Game::UpdateCars(float dt)
 	for (int i = 0; i < car_dynamics.size(); ++i)
 	{
 		car_graphics[i].Update(car_dynamics[i]);
-		car_sounds[i].Update(car_dynamics[i], dt);
 		UpdateDriftScore(i, dt);
 	}
 
+	if (car_dynamics.size() > 0)
+		CarSound::Update(&car_sounds[0], &car_dynamics[0], car_dynamics.size(), dt);
+
 	if (settings.GetParticles())
 		for (int i = 0; i < car_dynamics.size(); ++i)
 			AddTireSmokeParticles(car_dynamics[i], dt);
@@ -1354,8 +1553,8 @@ void Game::ProcessCarInputs()
 			carinputs[CarInput::CLUTCH] = 1.0;
 			carinputs[CarInput::THROTTLE] = 0.0;
 
-			if (benchmode)
-				eventsystem.Quit();
+			if (benchmode && carid == player_car_id)
+				benchmark_done = true;
 		}
 
 		car.Update(carinputs);
@@ -1381,12 +1580,24 @@ void Game::ProcessCameraInputs()
 	else if (carcontrol.GetInput(GameInput::FOCUS_PREV))
 		camera_car_id = (camera_car_id > 0) ? camera_car_id - 1 : car_count - 1;
 
+	// Follow the benchmark camera path.
+	unsigned camera_id = settings.GetCamera();
+	if (benchmode && benchmark_id < benchmarks.size())
+	{
+		const float time = (frame - benchmark_frame) * timestep;
+		const BenchmarkScenario::CameraKey * key = benchmarks[benchmark_id].GetCameraKey(time);
+		if (key)
+		{
+			camera_id = key->camera;
+			camera_car_id = Min(key->car, car_count - 1);
+		}
+	}
+
 	CarDynamics & car = car_dynamics[camera_car_id];
 	CarGraphics & car_gfx = car_graphics[camera_car_id];
 	CarSound & car_snd = car_sounds[camera_car_id];
 
 	// Handle camera mode change inputs.
-	unsigned camera_id = settings.GetCamera();
 	if (carcontrol.GetInput(GameInput::VIEW_HOOD))
 		camera_id = 0;
 	else if (carcontrol.GetInput(GameInput::VIEW_INCAR))
@@ -1475,8 +1686,22 @@ void Game::UpdateHUD(const size_t carid, const std::vector<float> & carinputs)
 			std::ostringstream gpu_profile;
 			graphics->printProfilingInfo(gpu_profile);
 
-			signals[DEBUG0](PROFILER.getAvgSummary(quickprof::MICROSECONDS));
+			std::ostringstream sound_profile;
+			sound.PrintProfilingInfo(sound_profile);
+
+			std::ostringstream cpu_profile;
+			Profiler::PrintAvgSummary(cpu_profile);
+
+			signals[DEBUG0](cpu_profile.str());
 			signals[DEBUG1](gpu_profile.str());
+			signals[DEBUG2](sound_profile.str());
+
+			if (AllocTracker::Enabled())
+			{
+				std::ostringstream alloc_profile;
+				AllocTracker::PrintAvgSummary(alloc_profile);
+				signals[DEBUG3](alloc_profile.str());
+			}
 		}
 	}
 
@@ -1592,6 +1817,13 @@ bool Game::NewGame(bool playreplay, bool addopponents, int num_laps)
 	// This should clear out all data.
 	LeaveGame();
 
+	// loading a race grows arenas and containers, check again after the warm up
+	if (AllocTracker::Enabled())
+	{
+		SetNoAllocZones(false);
+		noalloc_frame = displayframe + noalloc_warmup_frames;
+	}
+
 	// Cache number of laps for gui.
 	race_laps = num_laps;
 
@@ -1707,12 +1939,132 @@ bool Game::NewGame(bool playreplay, bool addopponents, int num_laps)
 	gui.SetInGame(true);
 	gui.ActivatePage(settings.GetHUD(), 0.25, error_output);
 
+	// Start telemetry capture.
+	if (!telemetry_file.empty() && !playreplay)
+	{
+		std::string filename = telemetry_file;
+		if (telemetry_count > 0)
+			filename += "." + std::to_string(telemetry_count);
+		if (telemetry.Start(filename, telemetry_channels, car_dynamics.size(), error_output))
+			info_output << "Capturing telemetry to " << filename << std::endl;
+		telemetry_count++;
+	}
+
 	// not strictly needed, is expected to be called by Hud page onfocus event
 	ContinueGame();
 
 	return true;
 }
 
+bool Game::StartBenchmark()
+{
+	for (; benchmark_id < benchmarks.size(); ++benchmark_id)
+	{
+		BenchmarkScenario & scenario = benchmarks[benchmark_id];
+		info_output << "Starting benchmark scenario: " << scenario.name << std::endl;
+		framestats.Reset();
+
+		// resolve user settings to record what has been run
+		if (scenario.track.empty())
+			scenario.track = settings.GetTrack();
+		if (scenario.car.empty())
+		{
+			scenario.car = settings.GetCar();
+			if (scenario.variant.empty())
+				scenario.variant = settings.GetCarVariant();
+			if (scenario.paint.empty())
+				scenario.paint = settings.GetCarPaint();
+		}
+		if (scenario.variant.empty())
+			scenario.variant = scenario.car;
+		if (scenario.paint.empty())
+			scenario.paint = "default";
+		if (scenario.opponent_car.empty())
+		{
+			scenario.opponent_car = scenario.car;
+			if (scenario.opponent_variant.empty())
+				scenario.opponent_variant = scenario.variant;
+		}
+		if (scenario.opponent_variant.empty())
+			scenario.opponent_variant = scenario.opponent_car;
+
+		const std::string renderer = renderconfigfile.empty() ? settings.GetRenderer() : renderconfigfile;
+		if (!scenario.render.empty() && scenario.render != renderer)
+		{
+			error_output << "Benchmark render config " << scenario.render
+				<< " differs from the active " << renderer << ", skipping" << std::endl;
+			EndBenchmark("skipped");
+			continue;
+		}
+		scenario.render = renderer;
+
+		std::map<std::string, std::string> options;
+		options["game.track"] = scenario.track;
+		options["game.reverse"] = scenario.reverse ? "true" : "false";
+		options["game.record"] = "false";
+		settings.Set(options);
+
+		InitPlayerCar();
+		const CarInfo player_info = car_info[0];
+		car_info.assign(1 + scenario.opponents, player_info);
+		for (size_t i = 0; i < car_info.size(); ++i)
+		{
+			CarInfo & info = car_info[i];
+			info.driver = Ai::default_type;
+			info.name = i ? scenario.opponent_car : scenario.car;
+			info.variant = i ? scenario.opponent_variant : scenario.variant;
+			info.paint = i ? "default" : scenario.paint;
+			info.ailevel = scenario.ai_level;
+		}
+
+		std::srand(scenario.seed);
+		benchmark_frame = frame;
+		benchmark_violations = AllocTracker::GetViolations();
+		benchmark_done = false;
+
+		if (NewGame(false, scenario.opponents > 0, scenario.laps))
+			return true;
+
+		EndBenchmark("failed");
+	}
+	return false;
+}
+
+void Game::EndBenchmark(const std::string & status)
+{
+	const BenchmarkScenario & scenario = benchmarks[benchmark_id];
+	info_output << "Benchmark scenario " << scenario.name << " " << status << "\n";
+	framestats.PrintSummary(info_output);
+	info_output << std::flush;
+
+	std::ostringstream result;
+	result << (benchmark_results.empty() ? "\n" : ",\n");
+	result << "\t\t{\n";
+	result << "\t\t\t\"name\": " << Utils::jsonstr(scenario.name) << ",\n";
+	result << "\t\t\t\"status\": " << Utils::jsonstr(status) << ",\n";
+	result << "\t\t\t\"track\": " << Utils::jsonstr(scenario.track) << ",\n";
+	result << "\t\t\t\"reverse\": " << (scenario.reverse ? "true" : "false") << ",\n";
+	result << "\t\t\t\"car\": " << Utils::jsonstr(scenario.car + "/" + scenario.variant) << ",\n";
+	result << "\t\t\t\"opponents\": " << scenario.opponents << ",\n";
+	result << "\t\t\t\"opponent_car\": " << Utils::jsonstr(scenario.opponent_car + "/" + scenario.opponent_variant) << ",\n";
+	result << "\t\t\t\"ai_level\": " << scenario.ai_level << ",\n";
+	result << "\t\t\t\"laps\": " << scenario.laps << ",\n";
+	result << "\t\t\t\"seed\": " << scenario.seed << ",\n";
+	result << "\t\t\t\"render\": " << Utils::jsonstr(scenario.render) << ",\n";
+	if (AllocTracker::Enabled())
+		result << "\t\t\t\"alloc_violations\": " << AllocTracker::GetViolations() - benchmark_violations << ",\n";
+	result << "\t\t\t\"stats\": ";
+	framestats.WriteJson(result, "\t\t\t");
+	result << "\n\t\t}";
+	benchmark_results += result.str();
+}
+
+void Game::SetNoAllocZones(bool value)
+{
+	for (const char * name : noalloc_zones)
+		AllocTracker::SetNoAlloc(Profiler::RegisterZone(name), value);
+}
+
 std::string Game::GetReplayRecordingFilename()
 {
 	// Get time.
@@ -1833,6 +2185,7 @@ bool Game::LoadTrack(const std::string & trackname)
 		pathmanager.GetTracksDir()+"/"+trackname,
 		pathmanager.GetEffectsTextureDir(),
 		pathmanager.GetTrackPartsPath(),
+		pathmanager.GetTrackCachePath(),
 		settings.GetAnisotropy(),
 		settings.GetTrackReverse(),
 		settings.GetTrackDynamic(),
@@ -1892,6 +2245,7 @@ bool Game::LoadTrack(const std::string & trackname)
 	// Build static drawlist.
 	graphics->ClearStaticDrawables();
 	graphics->AddStaticNode(track.GetTrackNode());
+	graphics->SetOccluders(track.GetOccluders());
 	graphics->SetFixedSkybox(track.IsFixedSkybox());
 
 	return true;
@@ -1915,6 +2269,7 @@ void Game::LoadGarage()
 		pathmanager.GetTracksDir()+"/"+settings.GetMenuRoom(),
 		pathmanager.GetEffectsTextureDir(),
 		pathmanager.GetTrackPartsPath(),
+		pathmanager.GetTrackCachePath(),
 		settings.GetAnisotropy(),
 		track_reverse, track_dynamic,
 		graphics->GetShadows()))
@@ -1945,6 +2300,7 @@ void Game::LoadGarage()
 	// Build static drawlist.
 	graphics->ClearStaticDrawables();
 	graphics->AddStaticNode(track.GetTrackNode());
+	graphics->SetOccluders(track.GetOccluders());
 	graphics->SetFixedSkybox(track.IsFixedSkybox());
 
 	// Load car.
@@ -2380,7 +2736,7 @@ void Game::ShowLoadingScreen(float progress, float progress_max, const std::stri
 		nodes.push_back(gui.GetNodes().first);
 	if (gui.GetNodes().second)
 		nodes.push_back(gui.GetNodes().second);
-	graphics->BindDynamicVertexData(nodes);
+	graphics->BindDynamicVertexData(nodes.data(), nodes.size());
 
 	graphics->ClearDynamicDrawables();
 	if (gui.GetNodes().first)
@@ -2567,7 +2923,7 @@ void Game::UpdateParticleGraphics()
 		float rx2 = rx * rx;
 		float ry2 = ry * ry;
 		float s = sy * std::sqrt((rx2 + ry2) / (sy * sy * rx2 + ry2));
-		tire_smoke.UpdateGraphics(camorient, campos, znear, zfar);
+		tire_smoke.UpdateGraphics(camorient, campos, znear, zfar, fovy, rx / ry);
 		skid_marks.UpdateGraphics(active_camera->GetOrientation(), campos, znear, zfar, s);
 	}
 }
@@ -2661,6 +3017,13 @@ void Game::LeaveGame()
 
 	ai.ClearCars();
 
+	if (telemetry.Enabled())
+	{
+		telemetry.Stop();
+		if (telemetry.GetDropped())
+			error_output << "Dropped " << telemetry.GetDropped() << " telemetry samples" << std::endl;
+	}
+
 	if (replay.GetRecording())
 	{
 		std::string replayname = GetReplayRecordingFilename();
@@ -53,6 +53,9 @@
 #include "content/contentmanager.h"
 #include "updatemanager.h"
 #include "game_downloader.h"
+#include "framestats.h"
+#include "benchmarkscenario.h"
+#include "cartelemetry.h"
 
 #include "BulletCollision/CollisionDispatch/btDefaultCollisionConfiguration.h"
 #include "BulletCollision/BroadphaseCollision/btDbvtBroadphase.h"
@@ -132,6 +135,16 @@ private:
 
 	bool NewGame(bool playreplay=false, bool opponents=false, int num_laps=0);
 
+	/// Start the current benchmark scenario, skip to the next one on failure.
+	/// Return false if no scenario is left.
+	bool StartBenchmark();
+
+	/// Record the result of the current benchmark scenario.
+	void EndBenchmark(const std::string & status);
+
+	/// Count heap allocations in the zero allocation zones as violations.
+	void SetNoAllocZones(bool value);
+
 	bool LoadCar(
 		const CarInfo & carinfo,
 		const Vec3 & position,
@@ -326,11 +339,26 @@ private:
 	UpdateManager trackupdater;
 	std::map <std::string, Font> fonts;
 	std::string renderconfigfile;
+	std::string soundfile;
+	std::string statsfile;
 
 	std::vector <float> fps_track;
 	int fps_position;
 	float fps_min;
 	float fps_max;
+	FrameStats framestats;
+	std::vector<BenchmarkScenario> benchmarks;
+	std::map<std::string, std::string> benchmark_settings; ///< user settings, restored at exit
+	std::string benchmark_results; ///< json results of finished scenarios
+	unsigned benchmark_id; ///< running scenario
+	unsigned benchmark_frame; ///< physics frame at scenario start
+	bool benchmark_done;
+	CarTelemetry telemetry;
+	std::string telemetry_file;
+	unsigned telemetry_channels; ///< CarTelemetry::Channel mask
+	unsigned telemetry_count; ///< captured races
+	unsigned noalloc_frame; ///< display frame the zero allocation zones are checked from
+	unsigned long long benchmark_violations; ///< allocation violations at scenario start
 
 	bool multithreaded;
 	bool profilingmode;
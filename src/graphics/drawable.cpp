@@ -20,11 +20,24 @@
 #include "drawable.h"
 #include "texture.h"
 #include "model.h"
+#include "frustumcull.h"
 #include <cmath>
 
+const float Drawable::lod_pixel_size[Drawable::max_lods - 1] = {96, 24};
+
+void Drawable::GetLodThresholds(float resy, float fovy, float lod_thresholds[max_lods - 1])
+{
+	for (unsigned i = 0; i < max_lods - 1; ++i)
+	{
+		lod_thresholds[i] = ContributionCullThreshold(resy, fovy, lod_pixel_size[i]);
+	}
+}
+
 Drawable::Drawable() :
 	vert_array(NULL),
 	model(NULL),
+	lod_count(0),
+	lod(0),
 	center(0),
 	radius(1E6),
 	color(1),
@@ -38,6 +51,10 @@ Drawable::Drawable() :
 	tex_id[0] = 0;
 	tex_id[1] = 0;
 	tex_id[2] = 0;
+	for (unsigned i = 0; i < max_lods; ++i)
+	{
+		lod_model[i] = NULL;
+	}
 }
 
 void Drawable::SetTextures(unsigned id0, unsigned id1, unsigned id2)
@@ -154,7 +171,8 @@ RenderModelExt & Drawable::GenRenderModelData(const DrawableAttributes & draw_at
 		uniforms_changed = false;
 	}
 
-	render_model.SetVertData(vsegment);
+	render_model.SetVertData(vsegment[lod]);
+	render_model.setCenter(center[0], center[1], center[2]);
 
 	return render_model;
 }
@@ -162,7 +180,22 @@ RenderModelExt & Drawable::GenRenderModelData(const DrawableAttributes & draw_at
 void Drawable::SetModel(Model & newmodel)
 {
 	model = &newmodel;
+	lod_model[0] = model;
+	lod_count = 1;
+	lod = 0;
 	radius = newmodel.GetAabb().GetRadius();
 	center = newmodel.GetAabb().GetCenter();
 	transform.TransformVectorOut(center[0], center[1], center[2]);
 }
+
+void Drawable::AddLodModel(Model & lodmodel)
+{
+	assert(model && lod_count < max_lods);
+	lod_model[lod_count++] = &lodmodel;
+}
+
+void Drawable::SelectLod(const Vec3 & campos, const float lod_thresholds[max_lods - 1])
+{
+	if (lod_count > 1)
+		lod = LodSelect(campos, center, radius, lod_thresholds, lod_count, lod);
+}
@@ -32,6 +32,15 @@ class StringIdMap;
 class Drawable
 {
 public:
+	/// maximum number of detail levels, level 0 is the full detail model
+	static const unsigned max_lods = 3;
+
+	/// projected diameter in pixels below which the next detail level is used
+	static const float lod_pixel_size[max_lods - 1];
+
+	/// level of detail transition thresholds for screen height and vertical fov
+	static void GetLodThresholds(float resy, float fovy, float lod_thresholds[max_lods - 1]);
+
 	Drawable();
 
 	bool operator < (const Drawable & other) const;
@@ -76,15 +85,31 @@ public:
 	Model * GetModel() const;
 	void SetModel(Model & newmodel);
 
-	/// vertex buffer interface
+	/// level of detail interface, level 0 is the model set by SetModel
+	unsigned GetLodCount() const;
+	Model * GetLodModel(unsigned level) const;
+	void AddLodModel(Model & lodmodel);
+
+	/// active level of detail
+	unsigned GetLod() const;
+	void SetLod(unsigned level);
+
+	/// select level of detail by projected size, lod_thresholds from GetLodThresholds
+	void SelectLod(const Vec3 & campos, const float lod_thresholds[max_lods - 1]);
+
+	/// vertex buffer interface, segment of the active detail level
 	const VertexBuffer::Segment & GetVertexBufferSegment() const;
 	void SetVertexBufferSegment(const VertexBuffer::Segment & segment);
+	void SetVertexBufferSegment(unsigned level, const VertexBuffer::Segment & segment);
 
 private:
 	unsigned tex_id[3];
-	VertexBuffer::Segment vsegment;
+	VertexBuffer::Segment vsegment[max_lods];
 	const VertexArray * vert_array;
 	Model * model;
+	Model * lod_model[max_lods];
+	unsigned char lod_count;
+	unsigned char lod;
 
 	Mat4 transform;
 	Vec3 center;
@@ -180,14 +205,42 @@ inline Model * Drawable::GetModel() const
 	return model;
 }
 
+inline unsigned Drawable::GetLodCount() const
+{
+	return lod_count;
+}
+
+inline Model * Drawable::GetLodModel(unsigned level) const
+{
+	assert(level < lod_count);
+	return lod_model[level];
+}
+
+inline unsigned Drawable::GetLod() const
+{
+	return lod;
+}
+
+inline void Drawable::SetLod(unsigned level)
+{
+	assert(level < lod_count || level == 0);
+	lod = level;
+}
+
 inline const VertexBuffer::Segment & Drawable::GetVertexBufferSegment() const
 {
-	return vsegment;
+	return vsegment[lod];
 }
 
 inline void Drawable::SetVertexBufferSegment(const VertexBuffer::Segment & segment)
 {
-	vsegment = segment;
+	vsegment[0] = segment;
+}
+
+inline void Drawable::SetVertexBufferSegment(unsigned level, const VertexBuffer::Segment & segment)
+{
+	assert(level < max_lods);
+	vsegment[level] = segment;
 }
 
 #endif // _DRAWABLE_H
@@ -306,21 +306,29 @@ void GLWrapper::UseProgram(GLuint program)
 
 void GLWrapper::Enable(GLenum cap)
 {
+	if (cap == GL_BLEND)
+		blendEnabled = true;
 	GLLOG(glEnable(cap));ERROR_CHECK;
 }
 
 void GLWrapper::Disable(GLenum cap)
 {
+	if (cap == GL_BLEND)
+		blendEnabled = false;
 	GLLOG(glDisable(cap));ERROR_CHECK;
 }
 
 void GLWrapper::Enablei(GLenum cap, GLuint index)
 {
+	if (cap == GL_BLEND && index == 0)
+		blendEnabled = true;
 	GLLOG(glEnablei(cap,index));ERROR_CHECK;
 }
 
 void GLWrapper::Disablei(GLenum cap, GLuint index)
 {
+	if (cap == GL_BLEND && index == 0)
+		blendEnabled = false;
 	GLLOG(glDisablei(cap,index));ERROR_CHECK;
 }
 
@@ -759,6 +767,8 @@ void GLWrapper::clearCaches()
 	blend_dst_rgb = GL_ZERO;
 	blend_src_alpha = GL_ONE;
 	blend_dst_alpha = GL_ZERO;
+
+	blendEnabled = false;
 }
 
 template <typename T>
@@ -162,6 +162,9 @@ public:
 	void ClearDepth(GLfloat d);
 	void ClearStencil(GLint s);
 
+	/// Returns true if blending is enabled for the first draw buffer.
+	bool getBlendEnabled() const { return blendEnabled; }
+
 	VertexBuffer & GetVertexBuffer() { return vertexBuffer; }
 	unsigned int & GetActiveVertexArray() { return curActiveVertexArray; }
 
@@ -195,6 +198,7 @@ private:
 	GLenum blend_dst_rgb;
 	GLenum blend_src_alpha;
 	GLenum blend_dst_alpha;
+	bool blendEnabled;
 
 	void clearCaches();
 
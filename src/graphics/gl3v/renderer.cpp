@@ -455,7 +455,13 @@ void Renderer::printRendererStatus(RendererStatusVerbosity verbosity, const Stri
 void Renderer::printProfilingInfo(std::ostream & out) const
 {
 	for (const auto & pass : passes)
-		out << pass.getName() << ": " << pass.getLastTime() * 1E6f << " us" << std::endl;
+	{
+		const RenderPassSortStats & stats = pass.getSortStats();
+		out << pass.getName() << ": " << pass.getLastTime() * 1E6f << " us, "
+			<< stats.draws << " draws, "
+			<< stats.textureChanges << " texture changes (" << stats.textureChangesSaved << " saved), "
+			<< stats.vaoChanges << " vao changes (" << stats.vaoChangesSaved << " saved)" << std::endl;
+	}
 }
 
 bool Renderer::loadShader(const std::string & path, const std::string & name, const std::set <std::string> & defines, GLenum shaderType, std::ostream & errorOutput)
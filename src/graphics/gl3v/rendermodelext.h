@@ -45,10 +45,18 @@ public:
 	bool drawEnabled() const;
 	void setVertexArrayObject(GLuint newVao, unsigned int newElementCount);
 
+	/// Vertex array object used to draw the model, used as draw call sort key.
+	virtual GLuint getVertexArrayObject() const;
+
+	/// World space center of the model, used for depth sorting.
+	void setCenter(float x, float y, float z);
+	const float * getCenter() const;
+
 protected:
 	GLuint vao;
 	int elementCount;
 	bool enabled;
+	float center[3];
 
 	std::vector <RenderTextureEntry> textures;
 	std::vector <RenderUniformEntry> uniforms;
@@ -64,13 +72,13 @@ private:
 
 
 inline RenderModelExt::RenderModelExt() :
-	vao(0), elementCount(0), enabled(false)
+	vao(0), elementCount(0), enabled(false), center{0, 0, 0}
 {
 	// ctor
 }
 
 inline RenderModelExt::RenderModelExt(const RenderModelEntry & m) :
-	vao(m.vao), elementCount(m.elementCount), enabled(m.elementCount > 0)
+	vao(m.vao), elementCount(m.elementCount), enabled(m.elementCount > 0), center{0, 0, 0}
 {
 	// ctor
 }
@@ -97,6 +105,23 @@ inline void RenderModelExt::setVertexArrayObject(GLuint newVao, unsigned int new
 	enabled = newElementCount > 0;
 }
 
+inline GLuint RenderModelExt::getVertexArrayObject() const
+{
+	return vao;
+}
+
+inline void RenderModelExt::setCenter(float x, float y, float z)
+{
+	center[0] = x;
+	center[1] = y;
+	center[2] = z;
+}
+
+inline const float * RenderModelExt::getCenter() const
+{
+	return center;
+}
+
 inline void RenderModelExt::clearTextureCache()
 {
 	perPassTextureCache.clear();
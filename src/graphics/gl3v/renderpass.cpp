@@ -19,6 +19,7 @@
 
 #include <unordered_set>
 #include <cassert>
+#include <cstring>
 
 #include "utils.h"
 #include "renderpass.h"
@@ -30,6 +31,30 @@
 
 const GLEnums GLEnumHelper;
 
+// Fold the texture set of a model into a 24 bit sort key.
+// Texture handles are small integers, collisions only cost extra state changes.
+static inline uint64_t TextureSetKey(const std::vector <RenderTextureEntry> & textures)
+{
+	uint32_t key = 0;
+	for (const auto & t : textures)
+		key = key * 0x9E3779B1u + t.handle;
+	return (key ^ (key >> 24)) & 0xFFFFFF;
+}
+
+// Distance of the model center in front of the camera as an unsigned integer.
+// Positive IEEE floats keep their order when compared as unsigned integers.
+static inline uint64_t DepthKey(const RenderUniformVector <float> & view, const float * center)
+{
+	// View space z points towards the viewer.
+	float depth = -(view[2] * center[0] + view[6] * center[1] + view[10] * center[2] + view[14]);
+	if (!(depth > 0))
+		return 0;
+
+	uint32_t bits;
+	std::memcpy(&bits, &depth, sizeof(bits));
+	return bits;
+}
+
 RenderPass::RenderPass() :
 	configured(false),
 	enabled(true),
@@ -53,6 +78,7 @@ bool RenderPass::initialize(int passCount, const RealtimeExportPassInfo & config
 	passIndex = passCount;
 
 	passName = stringMap.addStringId(config.name);
+	viewMatrixName = stringMap.addStringId("viewMatrix");
 
 	// Which bitfields to clear when we start the pass.
 	clearMask = 0;
@@ -304,6 +330,18 @@ bool RenderPass::render(GLWrapper & gl, unsigned int w, unsigned int h, StringId
 		gl.applyUniform(u.location, u.data);
 	}
 
+	// Get the view matrix and blend state used to sort the external models.
+	const RenderUniform * viewMatrix = NULL;
+	auto viewMatrixIter = variableNameToUniformLocation.find(viewMatrixName);
+	if (viewMatrixIter != variableNameToUniformLocation.end() &&
+		viewMatrixIter->second < defaultUniforms.size())
+	{
+		viewMatrix = defaultUniforms[viewMatrixIter->second];
+		if (viewMatrix && viewMatrix->data.size() != 16)
+			viewMatrix = NULL;
+	}
+	const bool blended = gl.getBlendEnabled();
+
 	// Apply samplers.
 	for (GLuint tu = 0; tu < samplers.size(); tu++)
 	{
@@ -381,10 +419,12 @@ bool RenderPass::render(GLWrapper & gl, unsigned int w, unsigned int h, StringId
 	}
 
 	// For each external model.
-	for (auto drawGroup : externalModels)
+	sortStats = RenderPassSortStats();
+	drawGroupSorters.resize(externalModels.size());
+	for (unsigned int group = 0; group < externalModels.size(); group++)
 	{
-		// Loop through all models in the draw group.
-		for (auto m : *drawGroup)
+		// Loop through all models in the draw group in sorted order.
+		for (auto m : sortDrawGroup(group, *externalModels[group], viewMatrix, blended))
 		{
 			assert(m);
 
@@ -527,6 +567,69 @@ bool RenderPass::render(GLWrapper & gl, unsigned int w, unsigned int h, StringId
 	return changed;
 }
 
+const std::vector <RenderModelExt*> & RenderPass::sortDrawGroup(unsigned int group, const std::vector <RenderModelExt*> & drawGroup, const RenderUniform * viewMatrix, bool blended)
+{
+	assert(group < drawGroupSorters.size());
+
+	// Generate the sort keys.
+	// Opaque key layout, MSB to LSB: texture set (24 bits), vertex array (16 bits), front to back depth (24 bits).
+	// Blended key layout, MSB to LSB: back to front depth (32 bits), texture set (16 bits), vertex array (16 bits).
+	// The shader program is fixed per pass, so it doesn't need to be part of the key.
+	sortKeys.resize(drawGroup.size());
+	for (unsigned int i = 0; i < drawGroup.size(); i++)
+	{
+		const RenderModelExt & m = *drawGroup[i];
+		const uint64_t texture = TextureSetKey(m.textures);
+		const uint64_t vao = m.getVertexArrayObject() & 0xFFFF;
+		const uint64_t depth = viewMatrix ? DepthKey(viewMatrix->data, m.getCenter()) : 0;
+		if (blended)
+			sortKeys[i] = ((~depth & 0xFFFFFFFF) << 32) | ((texture & 0xFFFF) << 16) | vao;
+		else
+			sortKeys[i] = (texture << 40) | (vao << 24) | (depth >> 8);
+	}
+
+	// Screen space draw groups have no view matrix, their submission order is their draw order.
+	const std::vector <RenderModelExt*> * models = &drawGroup;
+	if (viewMatrix && drawGroup.size() > 1)
+	{
+		Radix & sorter = drawGroupSorters[group];
+		sorter.sort(sortKeys);
+
+		const std::vector <unsigned> & ranks = sorter.getRanks();
+		sortedModels.resize(drawGroup.size());
+		for (unsigned int i = 0; i < drawGroup.size(); i++)
+			sortedModels[i] = drawGroup[ranks[i]];
+		models = &sortedModels;
+	}
+
+	// Count texture and vertex array changes with and without sorting.
+	unsigned int textureChanges[2] = {0, 0};
+	unsigned int vaoChanges[2] = {0, 0};
+	const RenderModelExt * last[2] = {NULL, NULL};
+	for (unsigned int i = 0; i < drawGroup.size(); i++)
+	{
+		const RenderModelExt * current[2] = {drawGroup[i], (*models)[i]};
+		for (int n = 0; n < 2; n++)
+		{
+			if (!current[n]->drawEnabled())
+				continue;
+			if (!last[n] || TextureSetKey(last[n]->textures) != TextureSetKey(current[n]->textures))
+				textureChanges[n]++;
+			if (!last[n] || last[n]->getVertexArrayObject() != current[n]->getVertexArrayObject())
+				vaoChanges[n]++;
+			last[n] = current[n];
+		}
+		if (current[0]->drawEnabled())
+			sortStats.draws++;
+	}
+	sortStats.textureChanges += textureChanges[1];
+	sortStats.textureChangesSaved += int(textureChanges[0]) - int(textureChanges[1]);
+	sortStats.vaoChanges += vaoChanges[1];
+	sortStats.vaoChangesSaved += int(vaoChanges[0]) - int(vaoChanges[1]);
+
+	return *models;
+}
+
 void RenderPass::addModel(const RenderModelEntry & entry, RenderModelHandle handle)
 {
 	// Simply add a new model based on the entry, then remember the association with the handle.
@@ -994,6 +1097,11 @@ const std::map <std::string, std::string> & RenderPass::getUserDefinedFields() c
 	return originalConfiguration.userDefinedFields;
 }
 
+const RenderPassSortStats & RenderPass::getSortStats() const
+{
+	return sortStats;
+}
+
 float RenderPass::getLastTime() const
 {
 	return lastTime;
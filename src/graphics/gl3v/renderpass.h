@@ -36,6 +36,7 @@
 #include "renderuniformentry.h"
 #include "renderstatusverbosity.h"
 #include "rendermodelext.h"
+#include "radix.h"
 
 #include <unordered_map>
 #include <vector>
@@ -47,6 +48,19 @@
 typedef std::unordered_map <StringId, RenderTextureEntry, StringId::hash> NameTexMap;
 typedef std::unordered_map <StringId, unsigned int, StringId::hash> NameIdMap;
 
+/// Draw call state change counts of the last rendered frame.
+/// The saved counts are relative to the unsorted submission order.
+struct RenderPassSortStats
+{
+	unsigned int draws;
+	unsigned int textureChanges;
+	int textureChangesSaved;
+	unsigned int vaoChanges;
+	int vaoChangesSaved;
+
+	RenderPassSortStats() : draws(0), textureChanges(0), textureChangesSaved(0), vaoChanges(0), vaoChangesSaved(0) {}
+};
+
 class RenderPass
 {
 public:
@@ -103,6 +117,8 @@ public:
 
 	float getLastTime() const;
 
+	const RenderPassSortStats & getSortStats() const;
+
 private:
 	/// Returns true on success.
 	bool createFramebufferObject(GLWrapper & gl, unsigned int w, unsigned int h, StringIdMap & stringMap, const NameTexMap & sharedTextures, std::ostream & errorOutput);
@@ -112,6 +128,11 @@ private:
 	bool createShaderProgram(GLWrapper & gl, const std::vector <std::string> & shaderAttributeBindings, const RenderShader & vertexShader, const RenderShader & fragmentShader, const std::map <std::string, RealtimeExportPassInfo::RenderTargetInfo> & renderTargets, std::ostream & errorOutput);
 	void deleteShaderProgram(GLWrapper & gl);
 
+	/// Returns the external models of a draw group in submission order.
+	/// Models are sorted by state to minimize texture and vertex array rebinds, blended models are sorted back to front.
+	/// Draw groups are only sorted if the pass has a view matrix, screen space draw groups keep their order.
+	const std::vector <RenderModelExt*> & sortDrawGroup(unsigned int group, const std::vector <RenderModelExt*> & drawGroup, const RenderUniform * viewMatrix, bool blended);
+
 	/// Switches to the texture's TU and binds the texture.
 	void applyTexture(GLWrapper & gl, const RenderTexture & texture);
 	/// Switches to the texture's TU and binds the texture.
@@ -182,6 +203,15 @@ private:
 	GLuint timerQuery;
 	/// Timing query object.
 	float lastTime;
+
+	/// View matrix uniform name, used to calculate model depth.
+	StringId viewMatrixName;
+
+	// Draw call sorting, sorters are indexed by draw group for temporal coherence.
+	std::vector <Radix> drawGroupSorters;
+	std::vector <uint64_t> sortKeys;
+	std::vector <RenderModelExt*> sortedModels;
+	RenderPassSortStats sortStats;
 };
 
 #endif
@@ -28,6 +28,7 @@
 #include <vector>
 
 class SceneNode;
+class VertexArray;
 
 /// an abstract base class that defines the graphics interface
 /// expects a valid OpenGL context with initialized extension entry points (glewInit)
@@ -53,7 +54,7 @@ public:
 
 	virtual void Deinit() = 0;
 
-	virtual void BindDynamicVertexData(std::vector<SceneNode*> nodes) = 0;
+	virtual void BindDynamicVertexData(SceneNode * nodes[], unsigned count) = 0;
 
 	virtual void BindStaticVertexData(std::vector<SceneNode*> nodes) = 0;
 
@@ -65,6 +66,9 @@ public:
 
 	virtual void ClearStaticDrawables() = 0;
 
+	/// optional occlusion culling interface, set world space occluder triangles
+	virtual void SetOccluders(const VertexArray & /*occluders*/) {};
+
 	/// Prepare scene for drawing. All non gpu setup happens here: culling, sorting etc
 	/// Vertex data and node binds should have happened before.
 	virtual void SetupScene(
@@ -365,9 +365,9 @@ void GraphicsGL2::Deinit()
 	}
 }
 
-void GraphicsGL2::BindDynamicVertexData(std::vector<SceneNode*> nodes)
+void GraphicsGL2::BindDynamicVertexData(SceneNode * nodes[], unsigned count)
 {
-	vertex_buffer.SetDynamicVertexData(nodes.data(), nodes.size(), &screen_quad, 1);
+	vertex_buffer.SetDynamicVertexData(nodes, count, &screen_quad, 1);
 }
 
 void GraphicsGL2::BindStaticVertexData(std::vector<SceneNode*> nodes)
@@ -396,6 +396,12 @@ void GraphicsGL2::ClearDynamicDrawables()
 void GraphicsGL2::ClearStaticDrawables()
 {
 	static_draw_lists.clear();
+	occlusion.SetOccluders(VertexArray());
+}
+
+void GraphicsGL2::SetOccluders(const VertexArray & occluders)
+{
+	occlusion.SetOccluders(occluders);
 }
 
 void GraphicsGL2::SetupScene(
@@ -407,6 +413,10 @@ void GraphicsGL2::SetupScene(
 {
 	SetupCameras(fov, new_view_distance, cam_position, cam_rotation, dynamic_reflection_sample_pos);
 
+	// occluders are rasterized for the default camera
+	const GraphicsCamera & cam = cameras["default"];
+	occlusion.Update(GetViewMatrix(cam).Multiply(GetProjMatrix(cam)));
+
 	// sort the two dimentional drawlist so we get correct ordering
 	std::sort(dynamic_draw_lists.twodim.begin(), dynamic_draw_lists.twodim.end(), &SortDraworder);
 
@@ -1075,6 +1085,7 @@ void GraphicsGL2::CullScenePass(
 
 		Frustum frustum;
 		frustum.Extract(GetProjMatrix(*cam).GetArray(), GetViewMatrix(*cam).GetArray());
+		const bool default_cam = (cam == &cameras["default"]);
 
 		for (unsigned i = 0; i < pass.static_draw_lists.size(); i++)
 		{
@@ -1101,6 +1112,31 @@ void GraphicsGL2::CullScenePass(
 						if (!cull(drawable->GetCenter(), drawable->GetRadius()))
 							draw_list.drawables.push_back(drawable);
 					}
+
+					// cull drawables hidden by occluders
+					if (default_cam && occlusion.GetEnabled())
+					{
+						auto & drawables = draw_list.drawables;
+						size_t n = 0;
+						for (const auto & drawable : drawables)
+						{
+							if (occlusion.IsVisible(drawable->GetCenter(), drawable->GetRadius()))
+								drawables[n++] = drawable;
+						}
+						drawables.resize(n);
+					}
+
+					// select level of detail of visible drawables
+					// the level is shared by all passes, so only the default camera selects it
+					if (default_cam)
+					{
+						float lt[Drawable::max_lods - 1];
+						Drawable::GetLodThresholds(height, fov, lt);
+						for (const auto & drawable : draw_list.drawables)
+						{
+							drawable->SelectLod(cam->pos, lt);
+						}
+					}
 				}
 				else
 				{
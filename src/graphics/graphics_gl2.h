@@ -30,6 +30,7 @@
 #include "render_input_scene.h"
 #include "render_output.h"
 #include "vertexarray.h"
+#include "occlusionculler.h"
 #include "vertexbuffer.h"
 
 #include <memory>
@@ -60,7 +61,7 @@ public:
 
 	void Deinit() override;
 
-	void BindDynamicVertexData(std::vector<SceneNode*> nodes) override;
+	void BindDynamicVertexData(SceneNode * nodes[], unsigned count) override;
 
 	void BindStaticVertexData(std::vector<SceneNode*> nodes) override;
 
@@ -72,6 +73,8 @@ public:
 
 	void ClearStaticDrawables() override;
 
+	void SetOccluders(const VertexArray & occluders) override;
+
 	void SetupScene(
 		float fov, float new_view_distance,
 		const Vec3 cam_position,
@@ -196,6 +199,9 @@ private:
 	typedef std::map <std::string, GraphicsCamera> CameraMap;
 	CameraMap cameras;
 
+	// occlusion culling of the default camera
+	OcclusionCuller occlusion;
+
 	// scene passes
 	struct GraphicsPass
 	{
@@ -23,6 +23,7 @@
 #include "frustumcull.h"
 #include "model.h"
 #include "utils.h"
+#include "framearena.h"
 
 #include <unordered_map>
 #include <sstream>
@@ -145,9 +146,9 @@ void GraphicsGL3::Deinit()
 	renderer.clear();
 }
 
-void GraphicsGL3::BindDynamicVertexData(std::vector<SceneNode*> nodes)
+void GraphicsGL3::BindDynamicVertexData(SceneNode * nodes[], unsigned count)
 {
-	vertex_buffer.SetDynamicVertexData(nodes.data(), nodes.size(), &fullscreenquad, 1);
+	vertex_buffer.SetDynamicVertexData(nodes, count, &fullscreenquad, 1);
 }
 
 void GraphicsGL3::BindStaticVertexData(std::vector<SceneNode*> nodes)
@@ -176,6 +177,12 @@ void GraphicsGL3::ClearDynamicDrawables()
 void GraphicsGL3::ClearStaticDrawables()
 {
 	static_drawlist.clear();
+	occlusion.SetOccluders(VertexArray());
+}
+
+void GraphicsGL3::SetOccluders(const VertexArray & occluders)
+{
+	occlusion.SetOccluders(occluders);
 }
 
 GraphicsGL3::CameraMatrices & GraphicsGL3::setCameraPerspective(const std::string & name,
@@ -244,7 +251,7 @@ void GraphicsGL3::SetupScene(
 
 	const float nearDistance = 0.1;
 
-	setCameraPerspective("default",
+	const CameraMatrices & cam = setCameraPerspective("default",
 		cam_position,
 		cam_rotation,
 		fov,
@@ -253,6 +260,8 @@ void GraphicsGL3::SetupScene(
 		w,
 		h);
 
+	occlusion.Update(cam.viewMatrix.Multiply(cam.projectionMatrix));
+
 	Vec3 skyboxCamPosition(0,0,0);
 	if (fixed_skybox)
 		skyboxCamPosition[2] = cam_position[2];
@@ -426,16 +435,23 @@ static bool SortDraworder(Drawable * d1, Drawable * d2)
 }
 
 // if frustum is NULL, don't do frustum or contribution culling
-void GraphicsGL3::AssembleDrawList(const std::vector <Drawable*> & drawables, std::vector <RenderModelExt*> & out, Frustum * frustum, const Vec3 & camPos)
+// if occlusionCuller is not NULL, also cull drawables hidden by occluders
+void GraphicsGL3::AssembleDrawList(const std::vector <Drawable*> & drawables, std::vector <RenderModelExt*> & out, Frustum * frustum, const Vec3 & camPos, const OcclusionCuller * occlusionCuller)
 {
 	if (frustum)
 	{
 		float ct = ContributionCullThreshold(float(h));
+		float lt[Drawable::max_lods - 1];
+		Drawable::GetLodThresholds(float(h), float(M_PI_2), lt);
 		auto cull = MakeFrustumCullerPersp(frustum->frustum, camPos, ct);
 		for (auto d : drawables)
 		{
-			if (!cull(d->GetCenter(), d->GetRadius()))
+			if (!cull(d->GetCenter(), d->GetRadius()) &&
+				(!occlusionCuller || occlusionCuller->IsVisible(d->GetCenter(), d->GetRadius())))
+			{
+				d->SelectLod(camPos, lt);
 				out.push_back(&d->GenRenderModelData(drawAttribs));
+			}
 		}
 	}
 	else
@@ -448,7 +464,8 @@ void GraphicsGL3::AssembleDrawList(const std::vector <Drawable*> & drawables, st
 }
 
 // if frustum is NULL, don't do frustum or contribution culling
-void GraphicsGL3::AssembleDrawList(const AabbTreeNodeAdapter <Drawable> & adapter, std::vector <RenderModelExt*> & out, Frustum * frustum, const Vec3 & camPos)
+// if occlusionCuller is not NULL, also cull drawables hidden by occluders
+void GraphicsGL3::AssembleDrawList(const AabbTreeNodeAdapter <Drawable> & adapter, std::vector <RenderModelExt*> & out, Frustum * frustum, const Vec3 & camPos, const OcclusionCuller * occlusionCuller)
 {
 	static std::vector <Drawable*> queryResults;
 	queryResults.clear();
@@ -458,6 +475,24 @@ void GraphicsGL3::AssembleDrawList(const AabbTreeNodeAdapter <Drawable> & adapte
 		float ct = ContributionCullThreshold(float(h));
 		auto cull = MakeFrustumCullerPersp(frustum->frustum, camPos, ct);
 		adapter.Query(cull, queryResults);
+
+		if (occlusionCuller && occlusionCuller->GetEnabled())
+		{
+			size_t n = 0;
+			for (auto d : queryResults)
+			{
+				if (occlusionCuller->IsVisible(d->GetCenter(), d->GetRadius()))
+					queryResults[n++] = d;
+			}
+			queryResults.resize(n);
+		}
+
+		float lt[Drawable::max_lods - 1];
+		Drawable::GetLodThresholds(float(h), float(M_PI_2), lt);
+		for (auto d : queryResults)
+		{
+			d->SelectLod(camPos, lt);
+		}
 	}
 	else
 	{
@@ -487,8 +522,8 @@ void GraphicsGL3::AssembleDrawMap(std::ostream & /*error_output*/)
 	}
 
 	// because the cameraDrawGroupDrawLists are cached, this is how we keep track of which combinations
-	// we have already generated
-	std::set <std::string> cameraDrawGroupCombinationsGenerated;
+	// we have already generated, there are only a few per frame
+	FrameVector <const std::vector <RenderModelExt*> *> cameraDrawGroupCombinationsGenerated;
 
 	// for each pass, do culling of the dynamic and static drawlists and put the results into the cameraDrawGroupDrawLists
 	for (auto passName : renderer.getPassNames())
@@ -503,15 +538,20 @@ void GraphicsGL3::AssembleDrawMap(std::ostream & /*error_output*/)
 				auto & outDrawList = cameraDrawGroupDrawLists[cameraDrawGroupKey];
 
 				// see if we have already generated this combination
-				if (cameraDrawGroupCombinationsGenerated.find(cameraDrawGroupKey) == cameraDrawGroupCombinationsGenerated.end())
+				if (std::find(cameraDrawGroupCombinationsGenerated.begin(), cameraDrawGroupCombinationsGenerated.end(), &outDrawList) == cameraDrawGroupCombinationsGenerated.end())
 				{
 					// we need to generate this combination
 
 					// extract frustum information
 					Frustum frustum;
 					Frustum * frustumPtr = NULL;
+					const OcclusionCuller * occlusionPtr = NULL;
 					if (!getCameraForPass(passName).empty())
 					{
+						// occluders are rasterized for the default camera only
+						if (getCameraForPass(passName) == "default")
+							occlusionPtr = &occlusion;
+
 						RenderUniform proj, view;
 						if (renderer.getPassUniform(passName, stringMap.addStringId("viewMatrix"), view) &&
 							renderer.getPassUniform(passName, stringMap.addStringId("projectionMatrix"), proj))
@@ -524,26 +564,24 @@ void GraphicsGL3::AssembleDrawMap(std::ostream & /*error_output*/)
 					// assemble dynamic entries
 					auto dynamicDrawablesPtr = dynamic_drawlist.GetByName(drawGroupString);
 					if (dynamicDrawablesPtr)
-						AssembleDrawList(*dynamicDrawablesPtr, outDrawList, frustumPtr, lastCameraPosition);
+						AssembleDrawList(*dynamicDrawablesPtr, outDrawList, frustumPtr, lastCameraPosition, occlusionPtr);
 
 					// assemble static entries
 					auto staticDrawablesPtr = static_drawlist.GetByName(drawGroupString);
 					if (staticDrawablesPtr)
-						AssembleDrawList(*staticDrawablesPtr, outDrawList, frustumPtr, lastCameraPosition);
+						AssembleDrawList(*staticDrawablesPtr, outDrawList, frustumPtr, lastCameraPosition, occlusionPtr);
 
 					// if it's requesting the full screen rect draw group, feed it our special drawable
 					if (drawGroupString == "full screen rect")
 					{
-						std::vector <Drawable*> rect;
-						rect.push_back(&fullscreenquad);
-						AssembleDrawList(rect, outDrawList, NULL, lastCameraPosition);
+						outDrawList.push_back(&fullscreenquad.GenRenderModelData(drawAttribs));
 					}
 				}
 
 				// use the generated combination in our drawMap
 				drawMap[passName][drawGroupId] = &outDrawList;
 
-				cameraDrawGroupCombinationsGenerated.insert(cameraDrawGroupKey);
+				cameraDrawGroupCombinationsGenerated.push_back(&outDrawList);
 			}
 		}
 	}
@@ -26,6 +26,7 @@
 #include "matrix4.h"
 #include "texture.h"
 #include "vertexarray.h"
+#include "occlusionculler.h"
 #include "frustum.h"
 #include "graphics_config_condition.h"
 #include "gl3v/glwrapper.h"
@@ -63,7 +64,7 @@ public:
 
 	void Deinit() override;
 
-	void BindDynamicVertexData(std::vector<SceneNode*> nodes) override;
+	void BindDynamicVertexData(SceneNode * nodes[], unsigned count) override;
 
 	void BindStaticVertexData(std::vector<SceneNode*> nodes) override;
 
@@ -75,6 +76,8 @@ public:
 
 	void ClearStaticDrawables() override;
 
+	void SetOccluders(const VertexArray & occluders) override;
+
 	void SetupScene(
 		float fov, float new_view_distance,
 		const Vec3 cam_position,
@@ -117,6 +120,7 @@ private:
 	bool fixed_skybox;
 	Vec3 lastCameraPosition;
 	Vec3 light_direction;
+	OcclusionCuller occlusion;
 
 	struct CameraMatrices
 	{
@@ -164,8 +168,8 @@ private:
 	std::map <StringId, std::map <StringId, std::vector <RenderModelExt*> *> > drawMap;
 
 	// drawlist assembly functions
-	void AssembleDrawList(const std::vector <Drawable*> & drawables, std::vector <RenderModelExt*> & out, Frustum * frustum, const Vec3 & camPos);
-	void AssembleDrawList(const AabbTreeNodeAdapter <Drawable> & adapter, std::vector <RenderModelExt*> & out, Frustum * frustum, const Vec3 & camPos);
+	void AssembleDrawList(const std::vector <Drawable*> & drawables, std::vector <RenderModelExt*> & out, Frustum * frustum, const Vec3 & camPos, const OcclusionCuller * occlusionCuller = NULL);
+	void AssembleDrawList(const AabbTreeNodeAdapter <Drawable> & adapter, std::vector <RenderModelExt*> & out, Frustum * frustum, const Vec3 & camPos, const OcclusionCuller * occlusionCuller = NULL);
 	void AssembleDrawMap(std::ostream & error_output);
 
 	// a map that stores which camera each pass uses
@@ -0,0 +1,274 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "occlusionbuffer.h"
+#include "vertexarray.h"
+#include "unittest.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+// minimum w of rasterized and tested geometry, roughly the near plane
+static const float min_w = 0.1f;
+
+OcclusionBuffer::OcclusionBuffer(unsigned width, unsigned height) :
+	depth(((width + 3) & ~3u) * height, 0.0f),
+	width((width + 3) & ~3u),
+	height(height)
+{
+	// ctor
+}
+
+void OcclusionBuffer::SetMatrix(const Mat4 & viewproj)
+{
+	matrix = viewproj;
+}
+
+void OcclusionBuffer::Clear()
+{
+	std::fill(depth.begin(), depth.end(), 0.0f);
+}
+
+void OcclusionBuffer::Project(const float v[3], float out[4]) const
+{
+	const float * m = matrix.GetArray();
+	const float x = m[0] * v[0] + m[4] * v[1] + m[8] * v[2] + m[12];
+	const float y = m[1] * v[0] + m[5] * v[1] + m[9] * v[2] + m[13];
+	const float w = m[3] * v[0] + m[7] * v[1] + m[11] * v[2] + m[15];
+	const float iw = 1 / w;
+	out[0] = (x * iw * 0.5f + 0.5f) * width;
+	out[1] = (y * iw * 0.5f + 0.5f) * height;
+	out[2] = iw;
+	out[3] = w;
+}
+
+void OcclusionBuffer::Rasterize(const VertexArray & va)
+{
+	const float * verts = 0;
+	const unsigned * faces = 0;
+	unsigned vn, fn;
+	va.GetVertices(verts, vn);
+	va.GetFaces(faces, fn);
+	Rasterize(verts, faces, fn / 3);
+}
+
+void OcclusionBuffer::Rasterize(const float vertices[], const unsigned faces[], unsigned face_count)
+{
+	for (unsigned i = 0; i < face_count; ++i)
+	{
+		float v[3][4];
+		bool clipped = false;
+		for (unsigned j = 0; j < 3; ++j)
+		{
+			Project(&vertices[faces[i * 3 + j] * 3], v[j]);
+			clipped |= (v[j][3] < min_w);
+		}
+
+		// skip triangles crossing the near plane, less occlusion but conservative
+		if (!clipped)
+			RasterizeTriangle(v[0], v[1], v[2]);
+	}
+}
+
+void OcclusionBuffer::RasterizeTriangle(const float a[4], const float b[4], const float c[4])
+{
+	// twice the signed triangle area, accept both windings
+	float area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+	if (std::abs(area) < 1E-6f)
+		return;
+	const float s = area > 0 ? 1.0f : -1.0f;
+
+	// screen bounds, x aligned to 4 pixels
+	int xmin = std::max(int(std::floor(std::min(a[0], std::min(b[0], c[0])))), 0) & ~3;
+	int xmax = std::min(int(std::ceil(std::max(a[0], std::max(b[0], c[0])))), int(width));
+	int ymin = std::max(int(std::floor(std::min(a[1], std::min(b[1], c[1])))), 0);
+	int ymax = std::min(int(std::ceil(std::max(a[1], std::max(b[1], c[1])))), int(height));
+	if (xmin >= xmax || ymin >= ymax)
+		return;
+
+	// edge functions e(x, y) = e0 + ex * x + ey * y, positive inside
+	const float * v[3] = {a, b, c};
+	float e0[3], ex[3], ey[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		const float * p = v[(i + 1) % 3];
+		const float * q = v[(i + 2) % 3];
+		ex[i] = -(q[1] - p[1]) * s;
+		ey[i] = (q[0] - p[0]) * s;
+		e0[i] = -(ex[i] * p[0] + ey[i] * p[1]);
+
+		// conservative, test the pixel corner furthest inside instead of its center
+		// so only pixels fully covered by the triangle are written
+		e0[i] -= 0.5f * (std::abs(ex[i]) + std::abs(ey[i]));
+	}
+
+	// depth plane z(x, y) = z0 + zx * x + zy * y
+	const float ia = 1 / area;
+	const float zx = ((b[2] - a[2]) * (c[1] - a[1]) - (c[2] - a[2]) * (b[1] - a[1])) * ia;
+	const float zy = ((c[2] - a[2]) * (b[0] - a[0]) - (b[2] - a[2]) * (c[0] - a[0])) * ia;
+	// farthest depth within the pixel
+	const float z0 = a[2] - zx * a[0] - zy * a[1] - 0.5f * (std::abs(zx) + std::abs(zy));
+
+	for (int y = ymin; y < ymax; ++y)
+	{
+		const float py = y + 0.5f;
+		float * row = &depth[y * width];
+#ifdef OCCLUSION_SSE
+		const __m128 step = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+		const __m128 zero = _mm_setzero_ps();
+		for (int x = xmin; x < xmax; x += 4)
+		{
+			const __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), step);
+			__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_set1_ps(e0[0] + ey[0] * py), _mm_mul_ps(_mm_set1_ps(ex[0]), px)), zero);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_set1_ps(e0[1] + ey[1] * py), _mm_mul_ps(_mm_set1_ps(ex[1]), px)), zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_set1_ps(e0[2] + ey[2] * py), _mm_mul_ps(_mm_set1_ps(ex[2]), px)), zero));
+			if (_mm_movemask_ps(inside) == 0)
+				continue;
+
+			const __m128 z = _mm_add_ps(_mm_set1_ps(z0 + zy * py), _mm_mul_ps(_mm_set1_ps(zx), px));
+			const __m128 old = _mm_loadu_ps(row + x);
+			const __m128 closer = _mm_max_ps(old, z);
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, old)));
+		}
+#else
+		for (int x = xmin; x < xmax; ++x)
+		{
+			const float px = x + 0.5f;
+			if (e0[0] + ex[0] * px + ey[0] * py >= 0 &&
+				e0[1] + ex[1] * px + ey[1] * py >= 0 &&
+				e0[2] + ex[2] * px + ey[2] * py >= 0)
+			{
+				const float z = z0 + zx * px + zy * py;
+				row[x] = std::max(row[x], z);
+			}
+		}
+#endif
+	}
+}
+
+bool OcclusionBuffer::IsVisible(const Vec3 & center, const Vec3 & extent) const
+{
+	// project box corners, the closest box point is a corner as w is linear
+	float xmin = width, xmax = 0, ymin = height, ymax = 0, zmax = 0;
+	for (int i = 0; i < 8; ++i)
+	{
+		const float v[3] = {
+			center[0] + ((i & 1) ? extent[0] : -extent[0]),
+			center[1] + ((i & 2) ? extent[1] : -extent[1]),
+			center[2] + ((i & 4) ? extent[2] : -extent[2])};
+		float p[4];
+		Project(v, p);
+		if (p[3] < min_w)
+			return true;
+		xmin = std::min(xmin, p[0]);
+		xmax = std::max(xmax, p[0]);
+		ymin = std::min(ymin, p[1]);
+		ymax = std::max(ymax, p[1]);
+		zmax = std::max(zmax, p[2]);
+	}
+
+	// covered pixels, leave off screen boxes to frustum culling
+	const int x0 = std::max(int(std::floor(xmin)), 0);
+	const int x1 = std::min(int(std::ceil(xmax)), int(width));
+	const int y0 = std::max(int(std::floor(ymin)), 0);
+	const int y1 = std::min(int(std::ceil(ymax)), int(height));
+	if (x0 >= x1 || y0 >= y1)
+		return true;
+
+	// visible if any covered pixel is not closer than the box
+	for (int y = y0; y < y1; ++y)
+	{
+		const float * row = &depth[y * width];
+#ifdef OCCLUSION_SSE
+		const __m128 z = _mm_set1_ps(zmax);
+		const __m128 lo = _mm_set1_ps(float(x0));
+		const __m128 hi = _mm_set1_ps(float(x1));
+		const __m128 step = _mm_set_ps(3, 2, 1, 0);
+		for (int x = x0 & ~3; x < x1; x += 4)
+		{
+			const __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), step);
+			const __m128 covered = _mm_and_ps(_mm_cmpge_ps(px, lo), _mm_cmplt_ps(px, hi));
+			const __m128 open = _mm_and_ps(covered, _mm_cmple_ps(_mm_loadu_ps(row + x), z));
+			if (_mm_movemask_ps(open))
+				return true;
+		}
+#else
+		for (int x = x0; x < x1; ++x)
+		{
+			if (row[x] <= zmax)
+				return true;
+		}
+#endif
+	}
+	return false;
+}
+
+QT_TEST(occlusionbuffer_test)
+{
+	Mat4 proj;
+	proj.Perspective(90, 2, 0.1, 1000);
+
+	OcclusionBuffer buffer(64, 32);
+	QT_CHECK_EQUAL(buffer.GetWidth(), 64u);
+	buffer.SetMatrix(proj);
+	buffer.Clear();
+
+	// nothing rasterized, everything is visible
+	QT_CHECK(buffer.IsVisible(Vec3(0, 0, -20), Vec3(1)));
+
+	// occluder wall at distance 10 covering the left half of the view
+	const float verts[] = {-100, -100, -10,  0, -100, -10,  0, 100, -10,  -100, 100, -10};
+	const unsigned faces[] = {0, 1, 2,  0, 2, 3};
+	buffer.Rasterize(verts, faces, 2);
+	QT_CHECK_CLOSE(buffer.GetDepth(8, 16), 0.1f, 1E-4f);
+	QT_CHECK_EQUAL(buffer.GetDepth(56, 16), 0.0f);
+
+	// box behind the wall is hidden
+	QT_CHECK(!buffer.IsVisible(Vec3(-10, 0, -20), Vec3(1)));
+
+	// box in front of the wall is visible
+	QT_CHECK(buffer.IsVisible(Vec3(-3, 0, -5), Vec3(1)));
+
+	// box behind the wall, but partially uncovered is visible
+	QT_CHECK(buffer.IsVisible(Vec3(0, 0, -20), Vec3(2)));
+
+	// box crossing the near plane is visible
+	QT_CHECK(buffer.IsVisible(Vec3(-10, 0, 0), Vec3(1)));
+
+	// clear resets occlusion
+	buffer.Clear();
+	QT_CHECK(buffer.IsVisible(Vec3(-10, 0, -20), Vec3(1)));
+
+	// an occluder thinner than a pixel covers no pixel completely and hides nothing,
+	// though it covers the pixel center
+	const float thin[] = {0.2f, -100, -10,  0.4f, -100, -10,  0.4f, 100, -10,  0.2f, 100, -10};
+	buffer.Rasterize(thin, faces, 2);
+	QT_CHECK(buffer.IsVisible(Vec3(0.6f, 0, -20), Vec3(0.02f)));
+	buffer.Clear();
+
+	// rasterization is independent of winding
+	const unsigned faces_ccw[] = {0, 2, 1,  0, 3, 2};
+	buffer.Rasterize(verts, faces_ccw, 2);
+	QT_CHECK(!buffer.IsVisible(Vec3(-10, 0, -20), Vec3(1)));
+}
@@ -0,0 +1,97 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _OCCLUSIONBUFFER_H
+#define _OCCLUSIONBUFFER_H
+
+#include "mathvector.h"
+#include "matrix4.h"
+
+#include <vector>
+
+class VertexArray;
+
+/// Low resolution software depth buffer for occlusion culling.
+/// Occluder triangles are rasterized on the cpu, bounding boxes are tested
+/// against the buffer afterwards. Rasterization is conservative, only pixels
+/// fully covered by a triangle receive its farthest depth within the pixel. Depth is stored as 1 / w, 0 is infinitely
+/// far away. Tests are conservative, boxes crossing the near plane or
+/// covering pixels without occluders are always visible.
+class OcclusionBuffer
+{
+public:
+	/// width is rounded up to a multiple of 4
+	OcclusionBuffer(unsigned width = 256, unsigned height = 128);
+
+	unsigned GetWidth() const;
+
+	unsigned GetHeight() const;
+
+	/// view projection matrix used for rasterization and tests
+	const Mat4 & GetMatrix() const;
+	void SetMatrix(const Mat4 & viewproj);
+
+	/// reset depth to infinitely far away
+	void Clear();
+
+	/// rasterize world space occluder triangles
+	void Rasterize(const VertexArray & va);
+
+	/// rasterize world space occluder triangles
+	/// vertices are xyz triples, faces are vertex index triples
+	void Rasterize(const float vertices[], const unsigned faces[], unsigned face_count);
+
+	/// returns false if the world space box is hidden behind occluders
+	bool IsVisible(const Vec3 & center, const Vec3 & extent) const;
+
+	/// depth value (1 / w) at pixel x, y
+	float GetDepth(unsigned x, unsigned y) const;
+
+private:
+	std::vector<float> depth;
+	Mat4 matrix;
+	unsigned width;
+	unsigned height;
+
+	void Project(const float v[3], float out[4]) const;
+
+	void RasterizeTriangle(const float v0[4], const float v1[4], const float v2[4]);
+};
+
+inline unsigned OcclusionBuffer::GetWidth() const
+{
+	return width;
+}
+
+inline unsigned OcclusionBuffer::GetHeight() const
+{
+	return height;
+}
+
+inline const Mat4 & OcclusionBuffer::GetMatrix() const
+{
+	return matrix;
+}
+
+inline float OcclusionBuffer::GetDepth(unsigned x, unsigned y) const
+{
+	return depth[y * width + x];
+}
+
+#endif // _OCCLUSIONBUFFER_H
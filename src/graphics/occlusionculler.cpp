@@ -0,0 +1,43 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "occlusionculler.h"
+
+OcclusionCuller::OcclusionCuller() :
+	enabled(false)
+{
+	// ctor
+}
+
+void OcclusionCuller::SetOccluders(const VertexArray & new_occluders)
+{
+	occluders = new_occluders;
+	enabled = false;
+}
+
+void OcclusionCuller::Update(const Mat4 & viewproj)
+{
+	enabled = occluders.GetNumIndices() > 0;
+	if (!enabled)
+		return;
+
+	buffer.SetMatrix(viewproj);
+	buffer.Clear();
+	buffer.Rasterize(occluders);
+}
@@ -0,0 +1,63 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _OCCLUSIONCULLER_H
+#define _OCCLUSIONCULLER_H
+
+#include "occlusionbuffer.h"
+#include "vertexarray.h"
+
+/// Rasterizes occluders into an occlusion buffer with the view projection of
+/// the current frame, so culling never lags behind the camera. Culling follows
+/// right after the camera setup, a worker thread would have nothing to overlap
+/// with, so rasterization runs inline.
+class OcclusionCuller
+{
+public:
+	OcclusionCuller();
+
+	/// copy world space occluder triangles, empty array disables culling
+	void SetOccluders(const VertexArray & occluders);
+
+	/// rasterize occluders with this frame view projection
+	void Update(const Mat4 & viewproj);
+
+	/// returns true if culling is possible this frame
+	bool GetEnabled() const;
+
+	/// returns false if the bounding sphere is hidden behind occluders
+	bool IsVisible(const Vec3 & center, float radius) const;
+
+private:
+	OcclusionBuffer buffer;
+	VertexArray occluders;
+	bool enabled;
+};
+
+inline bool OcclusionCuller::GetEnabled() const
+{
+	return enabled;
+}
+
+inline bool OcclusionCuller::IsVisible(const Vec3 & center, float radius) const
+{
+	return !enabled || buffer.IsVisible(center, Vec3(radius));
+}
+
+#endif // _OCCLUSIONCULLER_H
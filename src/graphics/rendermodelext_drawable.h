@@ -33,6 +33,11 @@ public:
 		gl.GetVertexBuffer().Draw(gl.GetActiveVertexArray(), *vsegment);
 	}
 
+	GLuint getVertexArrayObject() const override
+	{
+		return vsegment ? vsegment->vbuffer : 0;
+	}
+
 	void SetVertData(const VertexBuffer::Segment & vs)
 	{
 		vsegment = &vs;
@@ -0,0 +1,187 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "ringbuffer.h"
+#include "unittest.h"
+
+#include <cassert>
+#include <cstring>
+
+RingBuffer::RingBuffer(unsigned int regions, unsigned int min_size, unsigned int element_size) :
+	region_count(regions),
+	region_size(min_size),
+	element_size(element_size),
+	region(0),
+	allocations(0)
+{
+	assert(regions > 0 && regions <= max_regions);
+	assert(element_size > 0);
+	for (unsigned int i = 0; i < max_regions; ++i)
+		fences[i] = 0;
+}
+
+bool RingBuffer::Update(BufferSink & sink, const void * data, unsigned int size)
+{
+	// keep current region if data hasn't changed
+	if (allocations && size == shadow.size() &&
+		(size == 0 || std::memcmp(data, shadow.data(), size) == 0))
+		return false;
+
+	if (allocations == 0 || size > region_size)
+	{
+		// grow regions, all regions content is discarded
+		Reset(sink);
+		while (region_size < size)
+			region_size = region_size ? region_size * 2 : 1024;
+		region_size = (region_size + element_size - 1) / element_size * element_size;
+		sink.Allocate(region_size * region_count);
+		allocations++;
+	}
+	else if (region_count > 1)
+	{
+		// fence current region, wait for the next one
+		fences[region] = sink.Fence();
+		region = (region + 1) % region_count;
+		if (fences[region])
+		{
+			sink.Wait(fences[region]);
+			fences[region] = 0;
+		}
+	}
+
+	if (size)
+		sink.Write(region * region_size, data, size);
+
+	shadow.assign((const char *)data, (const char *)data + size);
+	return true;
+}
+
+void RingBuffer::Reset(BufferSink & sink)
+{
+	for (unsigned int i = 0; i < max_regions; ++i)
+	{
+		if (fences[i])
+		{
+			sink.Wait(fences[i]);
+			fences[i] = 0;
+		}
+	}
+	shadow.clear();
+	region = 0;
+}
+
+// Memory buffer sink recording writes and fences
+struct TestBufferSink : BufferSink
+{
+	std::vector<char> data;
+	int fence_count;
+	int write_count;
+	int wait_count;
+
+	TestBufferSink() : fence_count(0), write_count(0), wait_count(0) {}
+
+	void Allocate(unsigned int size)
+	{
+		data.assign(size, 0);
+	}
+
+	void Write(unsigned int offset, const void * src, unsigned int size)
+	{
+		assert(offset + size <= data.size());
+		std::memcpy(&data[offset], src, size);
+		write_count++;
+	}
+
+	void * Fence()
+	{
+		return (void *)(size_t)++fence_count;
+	}
+
+	void Wait(void * fence)
+	{
+		assert(fence != 0);
+		wait_count++;
+	}
+};
+
+QT_TEST(ringbuffer_test)
+{
+	TestBufferSink sink;
+	RingBuffer ring(3, 64);
+
+	std::vector<float> a(8, 1.0f), b(8, 2.0f);
+
+	// first write allocates all regions
+	QT_CHECK(ring.Update(sink, a.data(), a.size() * sizeof(float)));
+	QT_CHECK_EQUAL(ring.GetAllocations(), 1u);
+	QT_CHECK_EQUAL(ring.GetOffset(), 0u);
+	QT_CHECK_EQUAL(sink.data.size(), 3 * 64u);
+	QT_CHECK(std::memcmp(&sink.data[0], a.data(), 32) == 0);
+
+	// unchanged data is not written
+	QT_CHECK(!ring.Update(sink, a.data(), a.size() * sizeof(float)));
+	QT_CHECK_EQUAL(sink.write_count, 1);
+	QT_CHECK_EQUAL(ring.GetOffset(), 0u);
+
+	// changed data is written into the next region, previous one fenced
+	QT_CHECK(ring.Update(sink, b.data(), b.size() * sizeof(float)));
+	QT_CHECK_EQUAL(ring.GetOffset(), 64u);
+	QT_CHECK_EQUAL(sink.fence_count, 1);
+	QT_CHECK_EQUAL(sink.wait_count, 0);
+	QT_CHECK(std::memcmp(&sink.data[64], b.data(), 32) == 0);
+	QT_CHECK(std::memcmp(&sink.data[0], a.data(), 32) == 0);
+
+	// regions are reused round robin after waiting for their fence
+	QT_CHECK(ring.Update(sink, a.data(), a.size() * sizeof(float)));
+	QT_CHECK_EQUAL(ring.GetOffset(), 128u);
+	QT_CHECK(ring.Update(sink, b.data(), b.size() * sizeof(float)));
+	QT_CHECK_EQUAL(ring.GetOffset(), 0u);
+	QT_CHECK_EQUAL(sink.wait_count, 1);
+	QT_CHECK_EQUAL(ring.GetAllocations(), 1u);
+
+	// smaller updates don't reallocate
+	QT_CHECK(ring.Update(sink, a.data(), 4 * sizeof(float)));
+	QT_CHECK_EQUAL(ring.GetAllocations(), 1u);
+
+	// larger updates grow the regions
+	std::vector<float> c(32, 3.0f);
+	QT_CHECK(ring.Update(sink, c.data(), c.size() * sizeof(float)));
+	QT_CHECK_EQUAL(ring.GetAllocations(), 2u);
+	QT_CHECK_EQUAL(ring.GetRegionSize(), 128u);
+	QT_CHECK_EQUAL(ring.GetOffset(), 0u);
+	QT_CHECK_EQUAL(sink.data.size(), 3 * 128u);
+
+	// single region ring always writes at the start
+	TestBufferSink sink1;
+	RingBuffer ring1(1);
+	QT_CHECK(ring1.Update(sink1, a.data(), a.size() * sizeof(float)));
+	QT_CHECK(ring1.Update(sink1, b.data(), b.size() * sizeof(float)));
+	QT_CHECK_EQUAL(ring1.GetOffset(), 0u);
+	QT_CHECK_EQUAL(ring1.GetRegionCount(), 1u);
+	QT_CHECK_EQUAL(sink1.fence_count, 0);
+	QT_CHECK_EQUAL(ring1.GetRegionSize(), 1024u);
+
+	// region size is a multiple of the element size
+	TestBufferSink sink3;
+	RingBuffer ring3(3, 64, 12);
+	QT_CHECK(ring3.Update(sink3, a.data(), a.size() * sizeof(float)));
+	QT_CHECK(ring3.Update(sink3, b.data(), b.size() * sizeof(float)));
+	QT_CHECK_EQUAL(ring3.GetRegionSize(), 72u);
+	QT_CHECK_EQUAL(ring3.GetOffset() % 12, 0u);
+}
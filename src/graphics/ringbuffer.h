@@ -0,0 +1,113 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _RINGBUFFER_H
+#define _RINGBUFFER_H
+
+#include <vector>
+
+/// \class BufferSink
+/// \brief Destination of ring buffer writes, implemented on top of gpu
+/// buffer objects by the vertex buffer, and on plain memory for testing
+class BufferSink
+{
+public:
+	virtual ~BufferSink() {}
+
+	/// \brief Allocate buffer storage, previous content is discarded
+	virtual void Allocate(unsigned int size) = 0;
+
+	/// \brief Write data into buffer range, the range is not in use by the gpu
+	virtual void Write(unsigned int offset, const void * data, unsigned int size) = 0;
+
+	/// \brief Insert a fence after all previously issued gpu commands
+	/// \return fence handle, null if fences are not supported
+	virtual void * Fence() = 0;
+
+	/// \brief Wait until the fence has been signaled, then delete it
+	virtual void Wait(void * fence) = 0;
+};
+
+/// \class RingBuffer
+/// \brief Splits a buffer into equally sized regions, written round robin.
+/// Each region is fenced when the ring moves past it and waited for before
+/// it is written again, so writes never touch data the gpu is still reading.
+/// Unchanged data is not written again, the current region is kept instead.
+class RingBuffer
+{
+public:
+	/// \brief Maximum number of regions
+	static const unsigned int max_regions = 3;
+
+	/// \param regions is the number of regions, a single region has to
+	/// rely on the buffer sink to synchronize writes
+	/// \param min_size is the minimum region size in bytes
+	/// \param element_size is the region size granularity in bytes
+	RingBuffer(unsigned int regions = max_regions, unsigned int min_size = 0, unsigned int element_size = 1);
+
+	/// \brief Write data into the next region, region size is grown to fit
+	/// \return false if the data is unchanged and nothing has been written
+	bool Update(BufferSink & sink, const void * data, unsigned int size);
+
+	/// \brief Wait for pending fences and release buffer storage
+	void Reset(BufferSink & sink);
+
+	/// \brief Byte offset of the current region
+	unsigned int GetOffset() const;
+
+	/// \brief Region size in bytes
+	unsigned int GetRegionSize() const;
+
+	/// \brief Number of regions
+	unsigned int GetRegionCount() const;
+
+	/// \brief Number of buffer storage allocations
+	unsigned int GetAllocations() const;
+
+private:
+	std::vector<char> shadow; ///< last written data
+	void * fences[max_regions];
+	unsigned int region_count;
+	unsigned int region_size;
+	unsigned int element_size;
+	unsigned int region;
+	unsigned int allocations;
+};
+
+inline unsigned int RingBuffer::GetOffset() const
+{
+	return region * region_size;
+}
+
+inline unsigned int RingBuffer::GetRegionSize() const
+{
+	return region_size;
+}
+
+inline unsigned int RingBuffer::GetRegionCount() const
+{
+	return region_count;
+}
+
+inline unsigned int RingBuffer::GetAllocations() const
+{
+	return allocations;
+}
+
+#endif // _RINGBUFFER_H
@@ -0,0 +1,228 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "staticbatch.h"
+#include "model.h"
+#include "unittest.h"
+
+#include <cmath>
+#include <sstream>
+
+bool StaticBatch::Key::operator<(const Key & other) const
+{
+	if (dlist != other.dlist) return dlist < other.dlist;
+	for (int i = 0; i < 3; ++i)
+		if (tex[i] != other.tex[i]) return tex[i] < other.tex[i];
+	if (vformat != other.vformat) return vformat < other.vformat;
+	for (int i = 0; i < 3; ++i)
+		if (chunk[i] != other.chunk[i]) return chunk[i] < other.chunk[i];
+	for (int i = 0; i < 4; ++i)
+		if (color[i] != other.color[i]) return color[i] < other.color[i];
+	if (draw_order != other.draw_order) return draw_order < other.draw_order;
+	return cull < other.cull;
+}
+
+StaticBatch::StaticBatch(float chunk_size, unsigned max_vertices) :
+	chunk_size(chunk_size),
+	max_vertices(max_vertices),
+	count(0)
+{
+	// ctor
+}
+
+bool StaticBatch::Add(
+	DrawList & dlist,
+	const Drawable & drawable,
+	const Quat & rotation,
+	const Vec3 & translation)
+{
+	// blended drawables have to stay separate for depth sorting,
+	// dynamic vertex data and detail levels can't be merged
+	const Model * model = drawable.GetModel();
+	if (!model || drawable.GetVertArray() || drawable.GetDecal() ||
+		drawable.GetLodCount() > 1 || !drawable.GetTransform().IsIdentity())
+		return false;
+
+	const VertexArray & va = model->GetVertexArray();
+	if (va.GetNumVertices() == 0 || va.GetNumVertices() > max_vertices)
+		return false;
+
+	Vec3 center = model->GetAabb().GetCenter();
+	rotation.RotateVector(center);
+	center = center + translation;
+
+	Key key;
+	key.dlist = &dlist;
+	key.tex[0] = drawable.GetTexture0();
+	key.tex[1] = drawable.GetTexture1();
+	key.tex[2] = drawable.GetTexture2();
+	key.vformat = va.GetVertexFormat();
+	for (int i = 0; i < 3; ++i)
+		key.chunk[i] = int(std::floor(center[i] / chunk_size));
+	key.color = drawable.GetColor();
+	key.draw_order = drawable.GetDrawOrder();
+	key.cull = drawable.GetCull();
+
+	GroupMap::iterator ig = groups.find(key);
+	if (ig == groups.end())
+	{
+		ig = groups.insert(std::make_pair(key, Group())).first;
+		ig->second.prototype = drawable;
+	}
+
+	Instance instance;
+	instance.model = model;
+	instance.rotation = rotation;
+	instance.translation = translation;
+	ig->second.instances.push_back(instance);
+	count++;
+
+	return true;
+}
+
+void StaticBatch::Build(std::vector<Batch> & batches)
+{
+	std::ostringstream error;
+	for (auto & ig : groups)
+	{
+		Group & group = ig.second;
+		const Quat identity;
+
+		// pass single untransformed drawables through
+		if (group.instances.size() == 1 &&
+			group.instances[0].rotation == identity &&
+			group.instances[0].translation == Vec3())
+		{
+			Batch batch;
+			batch.dlist = ig.first.dlist;
+			batch.drawable = group.prototype;
+			batch.count = 1;
+			batches.push_back(batch);
+			continue;
+		}
+
+		auto i = group.instances.begin();
+		while (i != group.instances.end())
+		{
+			// merge instances up to the vertex count limit
+			VertexArray merged;
+			unsigned merged_count = 0;
+			while (i != group.instances.end() &&
+				merged.GetNumVertices() + i->model->GetVertexArray().GetNumVertices() <= max_vertices)
+			{
+				VertexArray va = i->model->GetVertexArray();
+				if (!(i->rotation == identity))
+					va.Rotate(i->rotation);
+				if (!(i->translation == Vec3()))
+					va.Translate(i->translation[0], i->translation[1], i->translation[2]);
+				merged += va;
+				merged_count++;
+				++i;
+			}
+			assert(merged_count > 0);
+
+			Batch batch;
+			batch.dlist = ig.first.dlist;
+			batch.model = std::make_shared<Model>();
+			batch.model->Load(merged, error);
+			batch.drawable = group.prototype;
+			batch.drawable.SetModel(*batch.model);
+			batch.count = merged_count;
+			batches.push_back(batch);
+		}
+	}
+
+	groups.clear();
+	count = 0;
+}
+
+QT_TEST(staticbatch_test)
+{
+	VertexArray cube;
+	cube.SetToUnitCube();
+	Model model;
+	std::ostringstream error;
+	model.Load(cube, error);
+
+	StaticBatch::DrawList dlist;
+	Drawable drawable;
+	drawable.SetModel(model);
+	drawable.SetTextures(1, 2, 3);
+
+	Drawable drawable_tex;
+	drawable_tex.SetModel(model);
+	drawable_tex.SetTextures(4, 2, 3);
+
+	Drawable drawable_blend;
+	drawable_blend.SetModel(model);
+	drawable_blend.SetDecal(true);
+
+	StaticBatch batcher(64);
+	QT_CHECK(batcher.Add(dlist, drawable, Quat(), Vec3(2, 0, 0)));
+	QT_CHECK(batcher.Add(dlist, drawable, Quat(), Vec3(10, 0, 0)));
+	QT_CHECK(batcher.Add(dlist, drawable, Quat(), Vec3(100, 0, 0)));
+	QT_CHECK(batcher.Add(dlist, drawable_tex));
+	QT_CHECK(!batcher.Add(dlist, drawable_blend));
+	QT_CHECK_EQUAL(batcher.GetCount(), 4u);
+
+	std::vector<StaticBatch::Batch> batches;
+	batcher.Build(batches);
+	QT_CHECK_EQUAL(batcher.GetCount(), 0u);
+	QT_CHECK_EQUAL(batches.size(), 3u);
+
+	unsigned merged = 0, passed = 0, single = 0;
+	for (const auto & b : batches)
+	{
+		QT_CHECK(b.dlist == &dlist);
+		if (b.count == 2)
+		{
+			// two cubes in the first chunk
+			merged++;
+			QT_CHECK(b.model);
+			QT_CHECK_EQUAL(b.model->GetVertexArray().GetNumVertices(), 2 * cube.GetNumVertices());
+			QT_CHECK_EQUAL(b.model->GetVertexArray().GetNumIndices(), 2 * cube.GetNumIndices());
+			QT_CHECK_EQUAL(b.drawable.GetTexture0(), 1u);
+			QT_CHECK_CLOSE(b.drawable.GetCenter()[0], 6.0f, 1E-4f);
+		}
+		else if (!b.model)
+		{
+			// untransformed single drawable passed through
+			passed++;
+			QT_CHECK_EQUAL(b.drawable.GetTexture0(), 4u);
+			QT_CHECK(b.drawable.GetModel() == &model);
+		}
+		else
+		{
+			// transformed single drawable in its own chunk
+			single++;
+			QT_CHECK_CLOSE(b.drawable.GetCenter()[0], 100.0f, 1E-4f);
+		}
+	}
+	QT_CHECK_EQUAL(merged, 1u);
+	QT_CHECK_EQUAL(passed, 1u);
+	QT_CHECK_EQUAL(single, 1u);
+
+	// vertex count limit splits batches
+	StaticBatch limited(64, cube.GetNumVertices() * 2);
+	for (int i = 0; i < 5; ++i)
+		limited.Add(dlist, drawable, Quat(), Vec3(i, 0, 0));
+	batches.clear();
+	limited.Build(batches);
+	QT_CHECK_EQUAL(batches.size(), 3u);
+}
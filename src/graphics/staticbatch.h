@@ -0,0 +1,112 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _STATICBATCH_H
+#define _STATICBATCH_H
+
+#include "drawable.h"
+#include "keyed_container.h"
+#include "quaternion.h"
+#include "mathvector.h"
+
+#include <memory>
+#include <vector>
+#include <map>
+
+class Model;
+
+/// Merges static drawables sharing textures, render state and draw list
+/// into combined models, one per grid chunk, to reduce draw call count.
+/// The chunk size should be close to the static aabb tree leaf size,
+/// so that batches are culled at about the same granularity as before.
+class StaticBatch
+{
+public:
+	typedef keyed_container<Drawable> DrawList;
+
+	/// combined drawable and its draw list, model is null if the
+	/// drawable model has been passed through unchanged
+	struct Batch
+	{
+		DrawList * dlist;
+		Drawable drawable;
+		std::shared_ptr<Model> model;
+		unsigned count;
+	};
+
+	/// chunk_size is the grid cell edge length used to split batches
+	/// max_vertices is the vertex count limit of a combined model
+	StaticBatch(float chunk_size = 64, unsigned max_vertices = 65536);
+
+	/// Queue drawable for batching, the drawable model vertices are
+	/// transformed by rotation and translation into the batch space.
+	/// Returns false if the drawable can not be batched, the caller
+	/// has to add it to the draw list itself in this case.
+	bool Add(
+		DrawList & dlist,
+		const Drawable & drawable,
+		const Quat & rotation = Quat(),
+		const Vec3 & translation = Vec3());
+
+	/// Merge queued drawables into batches, clears the queue.
+	void Build(std::vector<Batch> & batches);
+
+	/// number of queued drawables
+	unsigned GetCount() const;
+
+private:
+	struct Key
+	{
+		DrawList * dlist;
+		unsigned tex[3];
+		int vformat;
+		int chunk[3];
+		Vec4 color;
+		float draw_order;
+		bool cull;
+
+		bool operator<(const Key & other) const;
+	};
+
+	struct Instance
+	{
+		const Model * model;
+		Quat rotation;
+		Vec3 translation;
+	};
+
+	struct Group
+	{
+		Drawable prototype;
+		std::vector<Instance> instances;
+	};
+
+	typedef std::map<Key, Group> GroupMap;
+	GroupMap groups;
+	float chunk_size;
+	unsigned max_vertices;
+	unsigned count;
+};
+
+inline unsigned StaticBatch::GetCount() const
+{
+	return count;
+}
+
+#endif // _STATICBATCH_H
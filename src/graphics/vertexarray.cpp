@@ -21,8 +21,14 @@
 #include "quaternion.h"
 #include "unittest.h"
 
+#include <algorithm>
 #include <cstring> // std::memcpy
+#include <cstdint>
+#include <cmath>
 #include <map>
+#include <set>
+#include <tuple>
+#include <unordered_map>
 
 VertexArray::VertexArray() :
 	format(VertexFormat::P3)
@@ -72,6 +78,26 @@ VertexArray VertexArray::operator+ (const VertexArray & v) const
 	return out;
 }
 
+VertexArray & VertexArray::operator+= (const VertexArray & v)
+{
+	assert(format == v.format || vertices.empty());
+	format = v.format;
+
+	const unsigned offset = vertices.size() / 3;
+	faces.reserve(faces.size() + v.faces.size());
+	for (unsigned face : v.faces)
+	{
+		faces.push_back(face + offset);
+	}
+
+	colors.insert(colors.end(), v.colors.begin(), v.colors.end());
+	texcoords.insert(texcoords.end(), v.texcoords.begin(), v.texcoords.end());
+	normals.insert(normals.end(), v.normals.begin(), v.normals.end());
+	vertices.insert(vertices.end(), v.vertices.begin(), v.vertices.end());
+
+	return *this;
+}
+
 void VertexArray::GetColors(const unsigned char * & output_array_pointer, unsigned & output_array_num) const
 {
 	output_array_num = colors.size();
@@ -540,7 +566,11 @@ void VertexArray::Rotate(float a, float x, float y, float z)
 {
 	Quat q;
 	q.SetAxisAngle(a, x, y, z);
+	Rotate(q);
+}
 
+void VertexArray::Rotate(const Quat & q)
+{
 	assert(vertices.size() % 3 == 0);
 	for (auto i = vertices.begin(); i != vertices.end(); i += 3)
 	{
@@ -635,6 +665,197 @@ void VertexArray::FixWindingOrder()
 	}
 }
 
+// vertices of a cell merge if their attributes are this close, separating
+// unconnected surfaces, vertices on seams only merge with identical ones
+static const float simplify_texcoord_delta = 0.5f;
+static const float simplify_normal_cos = 0.5f; // 60 degrees
+static const float simplify_seam_delta = 1E-5f;
+
+void VertexArray::Simplify(float cell_size, VertexArray & output) const
+{
+	if (cell_size <= 0 || faces.empty())
+	{
+		output = *this;
+		return;
+	}
+
+	// grid origin
+	const unsigned vcount = vertices.size() / 3;
+	float origin[3] = {vertices[0], vertices[1], vertices[2]};
+	for (unsigned i = 1; i < vcount; ++i)
+	{
+		for (unsigned j = 0; j < 3; ++j)
+			origin[j] = std::min(origin[j], vertices[i * 3 + j]);
+	}
+
+	// attributes of vertex a and b within tolerance
+	auto match = [this](unsigned a, unsigned b, float tco_delta, float normal_cos)
+	{
+		if (!normals.empty())
+		{
+			const float * na = &normals[a * 3];
+			const float * nb = &normals[b * 3];
+			if (na[0] * nb[0] + na[1] * nb[1] + na[2] * nb[2] < normal_cos)
+				return false;
+		}
+		if (!texcoords.empty())
+		{
+			if (std::abs(texcoords[a * 2 + 0] - texcoords[b * 2 + 0]) > tco_delta ||
+				std::abs(texcoords[a * 2 + 1] - texcoords[b * 2 + 1]) > tco_delta)
+				return false;
+		}
+		return colors.empty() || std::memcmp(&colors[a * 4], &colors[b * 4], 4) == 0;
+	};
+
+	// seam vertices share their position with vertices of different attributes
+	std::vector<bool> seam(vcount, false);
+	std::map<std::tuple<float, float, float>, unsigned> positions;
+	for (unsigned i = 0; i < vcount; ++i)
+	{
+		const float * v = &vertices[i * 3];
+		auto result = positions.emplace(std::make_tuple(v[0], v[1], v[2]), i);
+		const unsigned first = result.first->second;
+		if (!result.second && !match(i, first, simplify_seam_delta, 1 - simplify_seam_delta))
+			seam[i] = seam[first] = true;
+	}
+
+	// assign vertices to cells, cells to clusters of matching attributes
+	// the first vertex of a cluster is its representative
+	const float cell_scale = 1 / cell_size;
+	std::unordered_map<uint64_t, unsigned> cells;
+	std::vector<unsigned> cell(vcount);
+	std::vector<float> position_sum;
+	std::vector<unsigned> cell_count;
+	std::vector<unsigned> cell_clusters; // first cluster of a cell
+	std::vector<unsigned> cluster(vcount);
+	std::vector<unsigned> cluster_next; // next cluster of the same cell
+	std::vector<unsigned> representative;
+	std::vector<float> normal_sum;
+	std::vector<float> texcoord_sum;
+	std::vector<unsigned> count;
+	for (unsigned i = 0; i < vcount; ++i)
+	{
+		uint64_t key = 0;
+		for (unsigned j = 0; j < 3; ++j)
+		{
+			uint64_t c = uint64_t((vertices[i * 3 + j] - origin[j]) * cell_scale);
+			key |= (c & 0x1FFFFF) << (21 * j);
+		}
+
+		auto result = cells.emplace(key, cell_count.size());
+		const unsigned c = result.first->second;
+		if (result.second)
+		{
+			position_sum.resize(position_sum.size() + 3, 0.0f);
+			cell_count.push_back(0);
+			cell_clusters.push_back(~0u);
+		}
+		cell[i] = c;
+		cell_count[c]++;
+		for (unsigned j = 0; j < 3; ++j)
+			position_sum[c * 3 + j] += vertices[i * 3 + j];
+
+		// find a cluster of the cell with matching attributes
+		unsigned * link = &cell_clusters[c];
+		while (*link != ~0u)
+		{
+			const unsigned r = representative[*link];
+			const bool exact = seam[i] || seam[r];
+			if (exact ? match(i, r, simplify_seam_delta, 1 - simplify_seam_delta) :
+				match(i, r, simplify_texcoord_delta, simplify_normal_cos))
+				break;
+			link = &cluster_next[*link];
+		}
+		unsigned n = *link;
+		if (n == ~0u)
+		{
+			n = *link = representative.size();
+			representative.push_back(i);
+			cluster_next.push_back(~0u);
+			normal_sum.resize(normal_sum.size() + 3, 0.0f);
+			texcoord_sum.resize(texcoord_sum.size() + 2, 0.0f);
+			count.push_back(0);
+		}
+
+		cluster[i] = n;
+		count[n]++;
+		if (!normals.empty())
+		{
+			for (unsigned j = 0; j < 3; ++j)
+				normal_sum[n * 3 + j] += normals[i * 3 + j];
+		}
+		if (!texcoords.empty())
+		{
+			for (unsigned j = 0; j < 2; ++j)
+				texcoord_sum[n * 2 + j] += texcoords[i * 2 + j];
+		}
+	}
+
+	// remap faces, dropping faces collapsed to a point or line,
+	// clusters of the same cell share their position
+	std::vector<unsigned> remap(representative.size(), ~0u);
+	unsigned ccount = 0;
+	output.Clear();
+	output.format = format;
+	output.faces.reserve(faces.size());
+	for (unsigned i = 0; i + 2 < faces.size(); i += 3)
+	{
+		const unsigned a = faces[i + 0];
+		const unsigned b = faces[i + 1];
+		const unsigned c = faces[i + 2];
+		if (cell[a] == cell[b] || cell[b] == cell[c] || cell[c] == cell[a])
+			continue;
+
+		for (unsigned v : {a, b, c})
+		{
+			unsigned & r = remap[cluster[v]];
+			if (r == ~0u)
+				r = ccount++;
+			output.faces.push_back(r);
+		}
+	}
+
+	// build vertices of the referenced clusters
+	output.vertices.resize(ccount * 3);
+	if (!normals.empty())
+		output.normals.resize(ccount * 3);
+	if (!texcoords.empty())
+		output.texcoords.resize(ccount * 2);
+	if (!colors.empty())
+		output.colors.resize(ccount * 4);
+	for (unsigned n = 0; n < representative.size(); ++n)
+	{
+		const unsigned o = remap[n];
+		if (o == ~0u)
+			continue;
+
+		const unsigned r = representative[n];
+		const unsigned c = cell[r];
+		for (unsigned j = 0; j < 3; ++j)
+			output.vertices[o * 3 + j] = position_sum[c * 3 + j] / cell_count[c];
+
+		if (!normals.empty())
+		{
+			const float * ns = &normal_sum[n * 3];
+			const float len = std::sqrt(ns[0] * ns[0] + ns[1] * ns[1] + ns[2] * ns[2]);
+			const float * nr = (len > 1E-6f) ? ns : &normals[r * 3];
+			const float scale = (len > 1E-6f) ? 1 / len : 1;
+			for (unsigned j = 0; j < 3; ++j)
+				output.normals[o * 3 + j] = nr[j] * scale;
+		}
+		if (!texcoords.empty())
+		{
+			for (unsigned j = 0; j < 2; ++j)
+				output.texcoords[o * 2 + j] = texcoord_sum[n * 2 + j] / count[n];
+		}
+		if (!colors.empty())
+		{
+			for (unsigned j = 0; j < 4; ++j)
+				output.colors[o * 4 + j] = colors[r * 4 + j];
+		}
+	}
+}
+
 /* fixme
 QT_TEST(vertexarray_test)
 {
@@ -779,3 +1000,124 @@ QT_TEST(vertexarray_buldfromfaces_test)
 	QT_CHECK_EQUAL(tempnum,36);
 }
 
+
+QT_TEST(vertexarray_simplify_test)
+{
+	// 8 x 8 quad grid
+	VertexArray grid;
+	std::vector<float> verts;
+	std::vector<float> norms;
+	std::vector<float> tcos;
+	std::vector<unsigned> faces;
+	const unsigned n = 8;
+	for (unsigned y = 0; y <= n; ++y)
+	{
+		for (unsigned x = 0; x <= n; ++x)
+		{
+			verts.push_back(x);
+			verts.push_back(y);
+			verts.push_back(0);
+			norms.push_back(0);
+			norms.push_back(0);
+			norms.push_back(1);
+			tcos.push_back(x / float(n));
+			tcos.push_back(y / float(n));
+		}
+	}
+	for (unsigned y = 0; y < n; ++y)
+	{
+		for (unsigned x = 0; x < n; ++x)
+		{
+			const unsigned i = y * (n + 1) + x;
+			const unsigned quad[6] = {i, i + 1, i + n + 2, i, i + n + 2, i + n + 1};
+			faces.insert(faces.end(), quad, quad + 6);
+		}
+	}
+	grid.Add(&faces[0], faces.size(), &verts[0], verts.size(), &tcos[0], tcos.size(), &norms[0], norms.size());
+
+	// cells smaller than the vertex spacing keep the mesh intact
+	VertexArray same;
+	grid.Simplify(0.5f, same);
+	QT_CHECK_EQUAL(same.GetNumVertices(), grid.GetNumVertices());
+	QT_CHECK_EQUAL(same.GetNumIndices(), grid.GetNumIndices());
+	QT_CHECK_EQUAL(same.GetVertexFormat(), grid.GetVertexFormat());
+
+	// 2 unit cells reduce the grid to a 5 x 5 vertex grid
+	VertexArray coarse;
+	grid.Simplify(2.0f, coarse);
+	QT_CHECK_EQUAL(coarse.GetNumVertices(), 25u);
+	QT_CHECK_LESS(coarse.GetNumIndices(), grid.GetNumIndices());
+	QT_CHECK_GREATER(coarse.GetNumIndices(), 0u);
+
+	// normals stay normalized, faces stay valid
+	const float * cn;
+	unsigned cnn;
+	coarse.GetNormals(cn, cnn);
+	QT_CHECK_EQUAL(cnn, 25u * 3);
+	QT_CHECK_CLOSE(cn[2], 1.0f, 1E-6f);
+	const unsigned * cf;
+	unsigned cfn;
+	coarse.GetFaces(cf, cfn);
+	for (unsigned i = 0; i < cfn; ++i)
+		QT_CHECK_LESS(cf[i], 25u);
+
+	// a cell covering everything collapses all faces
+	VertexArray empty;
+	grid.Simplify(100.0f, empty);
+	QT_CHECK_EQUAL(empty.GetNumIndices(), 0u);
+
+	// texture seam at x = 4, right half shifted by 0.3 in u
+	VertexArray seamed;
+	for (unsigned y = 0; y <= n; ++y)
+	{
+		const unsigned i = y * (n + 1) + n / 2;
+		verts.insert(verts.end(), &verts[i * 3], &verts[i * 3] + 3);
+		norms.insert(norms.end(), &norms[i * 3], &norms[i * 3] + 3);
+		tcos.push_back(tcos[i * 2] + 0.3f);
+		tcos.push_back(tcos[i * 2 + 1]);
+	}
+	for (unsigned i = 0; i < (n + 1) * (n + 1); ++i)
+	{
+		if (i % (n + 1) > n / 2)
+			tcos[i * 2] += 0.3f;
+	}
+	for (unsigned i = 0; i < faces.size(); i += 6)
+	{
+		if ((i / 6) % n < n / 2)
+			continue;
+		for (unsigned j = i; j < i + 6; ++j)
+		{
+			if (faces[j] % (n + 1) == n / 2)
+				faces[j] = (n + 1) * (n + 1) + faces[j] / (n + 1);
+		}
+	}
+	seamed.Add(&faces[0], faces.size(), &verts[0], verts.size(), &tcos[0], tcos.size(), &norms[0], norms.size());
+
+	// faces stay on their side of the seam, seam positions stay shared
+	VertexArray coarse_seamed;
+	seamed.Simplify(2.0f, coarse_seamed);
+	QT_CHECK_GREATER(coarse_seamed.GetNumIndices(), 0u);
+	const float * sv;
+	unsigned svn;
+	coarse_seamed.GetVertices(sv, svn);
+	const float * st;
+	unsigned stn;
+	coarse_seamed.GetTexCoords(st, stn);
+	const unsigned * sf;
+	unsigned sfn;
+	coarse_seamed.GetFaces(sf, sfn);
+	for (unsigned i = 0; i < sfn; i += 3)
+	{
+		const bool left = st[sf[i] * 2] < 0.65f;
+		for (unsigned j = i; j < i + 3; ++j)
+		{
+			const float u = st[sf[j] * 2];
+			QT_CHECK(left ? u < 0.5f + 1E-4f : u > 0.8f - 1E-4f);
+		}
+	}
+	std::set<std::pair<float, float> > positions;
+	for (unsigned i = 0; i < svn; i += 3)
+		positions.insert(std::make_pair(sv[i], sv[i + 1]));
+	QT_CHECK_EQUAL(positions.size(), 25u);
+	QT_CHECK_GREATER(svn / 3, 25u);
+}
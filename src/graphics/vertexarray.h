@@ -26,6 +26,7 @@
 #include <vector>
 
 class ModelObj;
+template <typename T> class Quaternion;
 
 class VertexArray
 {
@@ -38,6 +39,8 @@ public:
 
 	VertexArray operator+ (const VertexArray & v) const;
 
+	VertexArray & operator+= (const VertexArray & v);
+
 	void GetColors(const unsigned char * & output_array_pointer, unsigned & output_array_num) const;
 
 	void GetTexCoords(const float * & output_array_pointer, unsigned & output_array_num) const;
@@ -147,6 +150,8 @@ public:
 
 	void Rotate(float a, float x, float y, float z);
 
+	void Rotate(const Quaternion<float> & q);
+
 	void Scale(float x, float y, float z);
 
 	// scale normals by -1
@@ -158,6 +163,13 @@ public:
 	// set winding order to match normal direction, used by scale
 	void FixWindingOrder();
 
+	// generate simplified vertex array by clustering vertices on a uniform grid
+	// vertices of a cell share their position, but only merge if texture coordinates,
+	// normals and colors are close, vertices on texture seams and hard edges only merge
+	// with identical ones, degenerate faces and unused vertices are removed,
+	// cell_size is the grid cell edge length
+	void Simplify(float cell_size, VertexArray & output) const;
+
 	template <class Serializer>
 	bool Serialize(Serializer & s)
 	{
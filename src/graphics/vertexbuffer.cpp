@@ -20,11 +20,69 @@
 #include "vertexbuffer.h"
 #include "scenenode.h"
 #include "model.h"
+#include "unittest.h"
 
 static const unsigned int max_buffer_size = 4 * 1024 * 1024;
 static const unsigned int min_dynamic_vertex_buffer_size = 64 * 1024;
 static const unsigned int min_dynamic_index_buffer_size = 4 * 1024;
 
+// Dynamic buffer object sink. With fences available regions are written
+// by unsynchronized buffer mapping, the ring buffer makes sure the gpu is
+// done reading them. Falls back to buffer sub data updates otherwise.
+class GLBufferSink : public BufferSink
+{
+public:
+	GLBufferSink(GLenum target, GLuint buffer, bool unsynchronized) :
+		target(target),
+		buffer(buffer),
+		unsynchronized(unsynchronized && glFenceSync && glMapBufferRange)
+	{
+		// ctor
+	}
+
+	void Allocate(unsigned int size) override
+	{
+		glBindBuffer(target, buffer);
+		glBufferData(target, size, NULL, GL_STREAM_DRAW);
+	}
+
+	void Write(unsigned int offset, const void * data, unsigned int size) override
+	{
+		glBindBuffer(target, buffer);
+		if (unsynchronized)
+		{
+			void * ptr = glMapBufferRange(target, offset, size,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			if (ptr)
+			{
+				std::memcpy(ptr, data, size);
+				if (glUnmapBuffer(target) == GL_TRUE)
+					return;
+			}
+		}
+		glBufferSubData(target, offset, size, data);
+	}
+
+	void * Fence() override
+	{
+		if (!unsynchronized)
+			return 0;
+		return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	void Wait(void * fence) override
+	{
+		GLsync sync = (GLsync)fence;
+		glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		glDeleteSync(sync);
+	}
+
+private:
+	GLenum target;
+	GLuint buffer;
+	bool unsynchronized;
+};
+
 template <typename Functor>
 struct Wrapper
 {
@@ -121,7 +179,8 @@ struct VertexBuffer::BindDynamicVertexData
 			const unsigned int vbmin = min_dynamic_vertex_buffer_size / sizeof(float);
 			vertex_buffer.resize(std::max(vbn, vbmin));
 		}
-		ob.icount = WriteIndices(va, ob.icount, ob.vcount, index_buffer);
+		const unsigned int ioffset = GLC_ARB_draw_elements_base_vertex ? 0 : ob.vcount;
+		ob.icount = WriteIndices(va, ob.icount, ioffset, index_buffer);
 		ob.vcount = WriteVertices(va, ob.vcount, vsize, vertex_buffer);
 	}
 };
@@ -142,18 +201,25 @@ struct VertexBuffer::BindStaticVertexData
 
 	void operator() (Drawable & drawable)
 	{
-		Model * mo = drawable.GetModel();
-		assert(mo);
+		assert(drawable.GetModel());
 
-		// early out if model already bound
-		Segment & sg = mo->GetVertexBufferSegment();
-		if (sg.age == ctx.age_static)
+		// bind all detail levels
+		for (unsigned i = 0; i < drawable.GetLodCount(); ++i)
 		{
-			drawable.SetVertexBufferSegment(sg);
-			return;
+			Model * mo = drawable.GetLodModel(i);
+			assert(mo);
+			drawable.SetVertexBufferSegment(i, Bind(*mo));
 		}
+	}
 
-		const VertexArray & va = mo->GetVertexArray();
+	const Segment & Bind(Model & model)
+	{
+		// early out if model already bound
+		Segment & sg = model.GetVertexBufferSegment();
+		if (sg.age == ctx.age_static)
+			return sg;
+
+		const VertexArray & va = model.GetVertexArray();
 		const VertexFormat::Enum vf = va.GetVertexFormat();
 		const unsigned int vsize = VertexFormat::Get(vf).stride;
 		const unsigned int vcount = va.GetNumVertices();
@@ -193,12 +259,13 @@ struct VertexBuffer::BindStaticVertexData
 		sg.vformat = vf;
 		sg.object = obindex;
 		sg.age = ctx.age_static;
-		drawable.SetVertexBufferSegment(sg);
 
 		// store va for vertex data upload and update buffer counts
 		varrays[vf].push_back(&va);
 		ob.icount += icount;
 		ob.vcount += vcount;
+
+		return sg;
 	}
 };
 
@@ -233,6 +300,8 @@ VertexBuffer::Object::Object() :
 	ibuffer(0),
 	vbuffer(0),
 	varray(0),
+	ibase(0),
+	vbase(0),
 	vformat(VertexFormat::LastFormat)
 {
 	// ctor
@@ -258,6 +327,11 @@ void VertexBuffer::Clear()
 
 	for (unsigned int n = 0; n <= VertexFormat::LastFormat; ++n)
 	{
+		// release dynamic ring buffer fences
+		GLBufferSink sink(GL_ARRAY_BUFFER, 0, true);
+		dynamic_index_ring[n].Reset(sink);
+		dynamic_vertex_ring[n].Reset(sink);
+
 		for (const auto & ob : objects[n])
 		{
 			if (ob.varray)
@@ -291,7 +365,7 @@ void VertexBuffer::SetDynamicVertexData(SceneNode * nodes[], unsigned int ncount
 
 	for (unsigned int i = 0; i <= VertexFormat::LastFormat; ++i)
 	{
-		UploadDynamicVertexData(objects[i], staging_index_buffer[i], staging_vertex_buffer[i]);
+		UploadDynamicVertexData(VertexFormat::Enum(i));
 	}
 }
 
@@ -345,24 +419,34 @@ void VertexBuffer::Draw(unsigned int & vbuffer, const Segment & s) const
 		return;
 	}
 
+	// dynamic segments are relative to the current ring buffer region
+	unsigned int ioffset = s.ioffset;
+	unsigned int voffset = s.voffset;
+	if (s.object == 0)
+	{
+		const Object & ob = objects[s.vformat][0];
+		ioffset += ob.ibase;
+		voffset += ob.vbase;
+	}
+
 	if (s.icount != 0)
 	{
 		if (GLC_ARB_draw_elements_base_vertex)
 		{
 			glDrawRangeElementsBaseVertex(
 				GL_TRIANGLES, 0, s.vcount - 1, s.icount,
-				GL_UNSIGNED_INT, (const void *)(size_t)s.ioffset, s.voffset);
+				GL_UNSIGNED_INT, (const void *)(size_t)ioffset, voffset);
 		}
 		else
 		{
 			glDrawRangeElements(
-				GL_TRIANGLES, s.voffset, s.voffset + s.vcount - 1, s.icount,
-				GL_UNSIGNED_INT, (const void *)(size_t)s.ioffset);
+				GL_TRIANGLES, voffset, voffset + s.vcount - 1, s.icount,
+				GL_UNSIGNED_INT, (const void *)(size_t)ioffset);
 		}
 	}
 	else
 	{
-		glDrawArrays(GL_LINES, s.voffset, s.vcount);
+		glDrawArrays(GL_LINES, voffset, s.vcount);
 	}
 }
 
@@ -406,23 +490,55 @@ void VertexBuffer::InitDynamicBufferObjects()
 			ob.icapacity = min_dynamic_index_buffer_size;
 			ob.vcapacity = min_dynamic_vertex_buffer_size;
 			obs.push_back(ob);
+
+			// indices are relative to the region base vertex, regions
+			// can only be used with base vertex draw call support
+			const unsigned int regions = GLC_ARB_draw_elements_base_vertex ? RingBuffer::max_regions : 1;
+			const unsigned int vsize = VertexFormat::Get(VertexFormat::Enum(i)).stride;
+			dynamic_index_ring[i] = RingBuffer(regions, ob.icapacity, sizeof(unsigned int));
+			dynamic_vertex_ring[i] = RingBuffer(regions, ob.vcapacity, vsize);
 		}
 		obs[0].icount = 0;
 		obs[0].vcount = 0;
 	}
 }
 
-void VertexBuffer::UploadDynamicVertexData(
-	std::vector<Object> & objects,
-	const std::vector<unsigned int> & index_buffer,
-	const std::vector<float> & vertex_buffer)
+void VertexBuffer::UploadDynamicVertexData(VertexFormat::Enum vf)
 {
-	assert(!objects.empty());
-	Object & ob = objects[0];
-	if (ob.vcount)
-	{
-		UploadBuffers(ob, index_buffer, vertex_buffer);
-	}
+	assert(!objects[vf].empty());
+	Object & ob = objects[vf][0];
+	if (ob.vcount == 0)
+		return;
+
+	const VertexFormat & vformat = VertexFormat::Get(vf);
+	RingBuffer & iring = dynamic_index_ring[vf];
+	RingBuffer & vring = dynamic_vertex_ring[vf];
+	const unsigned int vallocations = vring.GetAllocations();
+
+	if (ob.varray)
+		glBindVertexArray(ob.varray);
+
+	// only changed data is written, into the next ring region
+	// unsynchronized writes are only safe with fenced regions, a single region
+	// is overwritten every frame and left to the driver to synchronize
+	GLBufferSink isink(GL_ELEMENT_ARRAY_BUFFER, ob.ibuffer, iring.GetRegionCount() > 1);
+	GLBufferSink vsink(GL_ARRAY_BUFFER, ob.vbuffer, vring.GetRegionCount() > 1);
+	iring.Update(isink, &staging_index_buffer[vf][0], ob.icount * sizeof(unsigned int));
+	vring.Update(vsink, &staging_vertex_buffer[vf][0], ob.vcount * vformat.stride);
+	ob.ibase = iring.GetOffset();
+	ob.vbase = vring.GetOffset() / vformat.stride;
+	ob.icapacity = iring.GetRegionSize();
+	ob.vcapacity = vring.GetRegionSize();
+
+	// vertex array object attributes are set once per buffer allocation
+	if (ob.varray && vring.GetAllocations() != vallocations)
+		SetVertexFormat(vformat);
+
+	// reset buffer state
+	if (ob.varray)
+		glBindVertexArray(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void VertexBuffer::UploadStaticVertexData(
@@ -448,7 +564,8 @@ void VertexBuffer::UploadStaticVertexData(
 			assert(varray_index < varrays.size());
 			const VertexArray & va = *varrays[varray_index];
 
-			icount = WriteIndices(va, icount, vcount, index_buffer);
+			const unsigned int ioffset = GLC_ARB_draw_elements_base_vertex ? 0 : vcount;
+			icount = WriteIndices(va, icount, ioffset, index_buffer);
 			vcount = WriteVertices(va, vcount, vertex_size, vertex_buffer);
 			varray_index++;
 		}
@@ -462,7 +579,7 @@ void VertexBuffer::UploadStaticVertexData(
 unsigned int VertexBuffer::WriteIndices(
 	const VertexArray & va,
 	const unsigned int icount,
-	const unsigned int vcount,
+	const unsigned int ioffset,
 	std::vector<unsigned int> & index_buffer)
 {
 	const unsigned int * faces = 0;
@@ -471,14 +588,14 @@ unsigned int VertexBuffer::WriteIndices(
 
 	assert(icount + fn <= index_buffer.size());
 	unsigned int * ib = &index_buffer[icount];
-	if (GLC_ARB_draw_elements_base_vertex)
+	if (ioffset == 0)
 	{
 		std::memcpy(ib, faces, fn * sizeof(unsigned int));
 	}
 	else
 	{
 		for (unsigned int j = 0; j < fn; ++j)
-			ib[j] = faces[j] + vcount;
+			ib[j] = faces[j] + ioffset;
 	}
 
 	return icount + fn;
@@ -596,3 +713,35 @@ void VertexBuffer::SetVertexFormat(const VertexFormat & vf)
 		glDisableVertexAttribArray(vf.attribs[n].index);
 	}
 }
+
+QT_TEST(vertexbuffer_write_test)
+{
+	VertexArray va;
+	const float verts[] = {0, 0, 0,  1, 0, 0,  0, 1, 0};
+	const float norms[] = {0, 0, 1,  0, 0, 1,  0, 0, 1};
+	const float uvs[] = {0, 0,  1, 0,  0, 1};
+	const unsigned int faces[] = {0, 1, 2};
+	va.Add(faces, 3, verts, 9, uvs, 6, norms, 9);
+	QT_CHECK_EQUAL(va.GetVertexFormat(), VertexFormat::PNT332);
+
+	// indices are written at icount with ioffset added
+	std::vector<unsigned int> index_buffer(6);
+	unsigned int icount = VertexBuffer::WriteIndices(va, 0, 0, index_buffer);
+	icount = VertexBuffer::WriteIndices(va, icount, 3, index_buffer);
+	QT_CHECK_EQUAL(icount, 6u);
+	QT_CHECK_EQUAL(index_buffer[2], 2u);
+	QT_CHECK_EQUAL(index_buffer[3], 3u);
+	QT_CHECK_EQUAL(index_buffer[5], 5u);
+
+	// vertices are interleaved at vcount
+	const unsigned int vsize = VertexFormat::Get(VertexFormat::PNT332).stride / sizeof(float);
+	std::vector<float> vertex_buffer(6 * vsize);
+	unsigned int vcount = VertexBuffer::WriteVertices(va, 0, vsize, vertex_buffer);
+	vcount = VertexBuffer::WriteVertices(va, vcount, vsize, vertex_buffer);
+	QT_CHECK_EQUAL(vcount, 6u);
+	const float * v = &vertex_buffer[4 * vsize];
+	QT_CHECK_EQUAL(v[0], 1.0f);
+	QT_CHECK_EQUAL(v[5], 1.0f);
+	QT_CHECK_EQUAL(v[6], 1.0f);
+	QT_CHECK_EQUAL(v[7], 0.0f);
+}
@@ -21,6 +21,7 @@
 #define _VERTEX_BUFFER_H
 
 #include "vertexformat.h"
+#include "ringbuffer.h"
 #include <vector>
 
 class Drawable;
@@ -71,6 +72,26 @@ public:
 	/// \param segment is the segment to be drawn
 	void Draw(unsigned int & vbuffer, const Segment & segment) const;
 
+	/// \brief Write vertex array indices into staging buffer
+	/// \param icount is the staging buffer index count, write offset
+	/// \param ioffset is the value added to written indices
+	/// \return new staging buffer index count
+	static unsigned int WriteIndices(
+		const VertexArray & va,
+		const unsigned int icount,
+		const unsigned int ioffset,
+		std::vector<unsigned int> & index_buffer);
+
+	/// \brief Write vertex array vertices into staging buffer
+	/// \param vcount is the staging buffer vertex count, write offset
+	/// \param vertex_size is the vertex size in floats
+	/// \return new staging buffer vertex count
+	static unsigned int WriteVertices(
+		const VertexArray & va,
+		const unsigned int vcount,
+		const unsigned int vertex_size,
+		std::vector<float> & vertex_buffer);
+
 private:
 	/// \brief Buffer objects store gpu buffer state
 	struct Object
@@ -82,6 +103,8 @@ private:
 		unsigned int ibuffer;		///< index buffer object
 		unsigned int vbuffer;		///< vertex buffer object
 		unsigned int varray;		///< vertex array object
+		unsigned int ibase;			///< index ring region offset in bytes
+		unsigned int vbase;			///< vertex ring region element index
 		VertexFormat::Enum vformat;	///< vertex format
 		Object();
 	};
@@ -91,6 +114,10 @@ private:
 	std::vector<unsigned int> staging_index_buffer[VertexFormat::LastFormat + 1];
 	std::vector<float> staging_vertex_buffer[VertexFormat::LastFormat + 1];
 
+	/// Dynamic vertex data ring buffers, written at region offsets
+	RingBuffer dynamic_index_ring[VertexFormat::LastFormat + 1];
+	RingBuffer dynamic_vertex_ring[VertexFormat::LastFormat + 1];
+
 	/// Buffer age counters used for debugging
 	unsigned short age_dynamic;
 	unsigned short age_static;
@@ -109,11 +136,8 @@ private:
 	/// \brief Init dynamic vertex data objects
 	void InitDynamicBufferObjects();
 
-	/// \brief Upload dynamic vertex data to gpu
-	static void UploadDynamicVertexData(
-		std::vector<Object> & objects,
-		const std::vector<unsigned int> & index_buffer,
-		const std::vector<float> & vertex_buffer);
+	/// \brief Write dynamic vertex data into ring buffer regions
+	void UploadDynamicVertexData(VertexFormat::Enum vf);
 
 	/// \brief Upload static vertex data to gpu
 	static void UploadStaticVertexData(
@@ -122,20 +146,6 @@ private:
 		std::vector<unsigned int> & index_buffer,
 		std::vector<float> & vertex_buffer);
 
-	/// \brief Write vertex array indices into staging buffer
-	static unsigned int WriteIndices(
-		const VertexArray & va,
-		const unsigned int icount,
-		const unsigned int vcount,
-		std::vector<unsigned int> & index_buffer);
-
-	/// \brief Write vertex array vertices into staging buffer
-	static unsigned int WriteVertices(
-		const VertexArray & va,
-		const unsigned int vcount,
-		const unsigned int vertex_size,
-		std::vector<float> & vertex_buffer);
-
 	/// \brief Upload staging data into object vbo/ibo
 	static void UploadBuffers(
 		Object & object,
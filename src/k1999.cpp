@@ -30,11 +30,15 @@
 #include "roadstrip.h"
 
 #include <cassert>
+#include <cmath>
+#include <istream>
+#include <ostream>
 
 #define SecurityR   100.0 // Security radius
 #define SideDistExt 2.0 // Security distance wrt outside
 #define SideDistInt 1.0 // Security distance wrt inside
 #define Iterations  100 // Number of smoothing operations
+#define StepSize    128 // Initial smoothing step
 #define Mag(x,y) sqrt((x)*(x)+(y)*(y))
 #define Min(X,Y) ((X)<(Y)?(X):(Y))
 #define Max(X,Y) ((X)>(Y)?(X):(Y))
@@ -42,10 +46,10 @@
 /////////////////////////////////////////////////////////////////////////////
 // Update tx and ty arrays
 /////////////////////////////////////////////////////////////////////////////
-void K1999::UpdateTxTy(int i)
+void K1999::UpdateTxTy(Division & d)
 {
-	tx[i] = tLane[i] * txRight[i] + (1 - tLane[i]) * txLeft[i];
-	ty[i] = tLane[i] * tyRight[i] + (1 - tLane[i]) * tyLeft[i];
+	d.x = d.lane * d.right_x + (1 - d.lane) * d.left_x;
+	d.y = d.lane * d.right_y + (1 - d.lane) * d.left_y;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -56,11 +60,11 @@ void K1999::DrawPath(std::ostream &out)
 {
 	for (int i = 0; i <= Divs; i++)
 	{
-		int j = i % Divs;
-		out << txLeft[j] << ' ' << tyLeft[j] << ' ';
-		out << tx[j] << ' ' << ty[j] << ' ';
-		out << txRight[j] << ' ' << tyRight[j] << ' ';
-		out << tLane[j] << ' ' << tRInverse[j] << '\n';
+		const Division & d = divs[i % Divs];
+		out << d.left_x << ' ' << d.left_y << ' ';
+		out << d.x << ' ' << d.y << ' ';
+		out << d.right_x << ' ' << d.right_y << ' ';
+		out << d.lane << ' ' << d.rinverse << '\n';
 	}
 	out << '\n';
 }
@@ -69,14 +73,17 @@ void K1999::DrawPath(std::ostream &out)
 /////////////////////////////////////////////////////////////////////////////
 // Compute the inverse of the radius
 /////////////////////////////////////////////////////////////////////////////
-double K1999::GetRInverse(int prev, double x, double y, int next)
+double K1999::GetRInverse(int prev, double x, double y, int next) const
 {
-	double x1 = tx[next] - x;
-	double y1 = ty[next] - y;
-	double x2 = tx[prev] - x;
-	double y2 = ty[prev] - y;
-	double x3 = tx[next] - tx[prev];
-	double y3 = ty[next] - ty[prev];
+	const Division & p = divs[prev];
+	const Division & n = divs[next];
+
+	double x1 = n.x - x;
+	double y1 = n.y - y;
+	double x2 = p.x - x;
+	double y2 = p.y - y;
+	double x3 = n.x - p.x;
+	double y3 = n.y - p.y;
 
 	double det = x1 * y2 - x2 * y1;
 	double n1 = x1 * x1 + y1 * y1;
@@ -93,44 +100,48 @@ double K1999::GetRInverse(int prev, double x, double y, int next)
 /////////////////////////////////////////////////////////////////////////////
 void K1999::AdjustRadius(int prev, int i, int next, double TargetRInverse, double Security)
 {
-	double OldLane = tLane[i];
+	Division & d = divs[i];
+	const Division & p = divs[prev];
+	const Division & n = divs[next];
+
+	double OldLane = d.lane;
 
-	double Width = Mag((txLeft[i]-txRight[i]),(tyLeft[i]-tyRight[i]));
+	double Width = d.width;
 
 	//
 	// Start by aligning points for a reasonable initial lane
 	//
-	tLane[i] = (-(ty[next] - ty[prev]) * (txLeft[i] - tx[prev]) +
-			(tx[next] - tx[prev]) * (tyLeft[i] - ty[prev])) /
-			( (ty[next] - ty[prev]) * (txRight[i] - txLeft[i]) -
-			(tx[next] - tx[prev]) * (tyRight[i] - tyLeft[i]));
+	d.lane = (-(n.y - p.y) * (d.left_x - p.x) +
+			(n.x - p.x) * (d.left_y - p.y)) /
+			( (n.y - p.y) * d.lane_x -
+			(n.x - p.x) * d.lane_y);
 
 	// the original algorithm allows going outside the track
 	/*
-	if (tLane[i] < -0.2)
-		tLane[i] = -0.2;
-	else if (tLane[i] > 1.2)
-		tLane[i] = 1.2;*/
-	if (tLane[i] < 0.0)
-		tLane[i] = 0.0;
-	else if (tLane[i] > 1.0)
-		tLane[i] = 1.0;
+	if (d.lane < -0.2)
+		d.lane = -0.2;
+	else if (d.lane > 1.2)
+		d.lane = 1.2;*/
+	if (d.lane < 0.0)
+		d.lane = 0.0;
+	else if (d.lane > 1.0)
+		d.lane = 1.0;
 
-	UpdateTxTy(i);
+	UpdateTxTy(d);
 
 	//
 	// Newton-like resolution method
 	//
 	const double dLane = 0.0001;
 
-	double dx = dLane * (txRight[i] - txLeft[i]);
-	double dy = dLane * (tyRight[i] - tyLeft[i]);
+	double dx = dLane * d.lane_x;
+	double dy = dLane * d.lane_y;
 
-	double dRInverse = GetRInverse(prev, tx[i] + dx, ty[i] + dy, next);
+	double dRInverse = GetRInverse(prev, d.x + dx, d.y + dy, next);
 
 	if (dRInverse > 0.000000001)
 	{
-		tLane[i] += (dLane / dRInverse) * TargetRInverse;
+		d.lane += (dLane / dRInverse) * TargetRInverse;
 
 		double ExtLane = (SideDistExt + Security) / Width;
 		double IntLane = (SideDistInt + Security) / Width;
@@ -141,31 +152,31 @@ void K1999::AdjustRadius(int prev, int i, int next, double TargetRInverse, doubl
 
 		if (TargetRInverse >= 0.0)
 		{
-			if (tLane[i] < IntLane)
-				tLane[i] = IntLane;
-			if (1 - tLane[i] < ExtLane)
+			if (d.lane < IntLane)
+				d.lane = IntLane;
+			if (1 - d.lane < ExtLane)
 			{
 				if (1 - OldLane < ExtLane)
-					tLane[i] = Min(OldLane, tLane[i]);
+					d.lane = Min(OldLane, d.lane);
 				else
-					tLane[i] = 1 - ExtLane;
+					d.lane = 1 - ExtLane;
 			}
 		}
 		else
 		{
-			if (tLane[i] < ExtLane)
+			if (d.lane < ExtLane)
 			{
 				if (OldLane < ExtLane)
-					tLane[i] = Max(OldLane, tLane[i]);
+					d.lane = Max(OldLane, d.lane);
 				else
-					tLane[i] = ExtLane;
+					d.lane = ExtLane;
 			}
-			if (1 - tLane[i] < IntLane)
-				tLane[i] = 1 - IntLane;
+			if (1 - d.lane < IntLane)
+				d.lane = 1 - IntLane;
 		}
 	}
 
-	UpdateTxTy(i);
+	UpdateTxTy(d);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -179,18 +190,19 @@ void K1999::Smooth(int Step)
 	int nextnext = next + Step;
 
 	assert(prev >= 0);
-	//std::cout << Divs << ", " << Step << ", " << prev << ", " << tx.size() << std::endl;
-	assert(prev < (int)tx.size());
-	assert(prev < (int)ty.size());
-	assert(next < (int)tx.size());
-	assert(next < (int)ty.size());
+	assert(prev < (int)divs.size());
+	assert(next < (int)divs.size());
 
 	for (int i = 0; i <= Divs - Step; i += Step)
 	{
-	 	double ri0 = GetRInverse(prevprev, tx[prev], ty[prev], i);
-		double ri1 = GetRInverse(i, tx[next], ty[next], nextnext);
-		double lPrev = Mag(tx[i] - tx[prev], ty[i] - ty[prev]);
-		double lNext = Mag(tx[i] - tx[next], ty[i] - ty[next]);
+		const Division & d = divs[i];
+		const Division & p = divs[prev];
+		const Division & n = divs[next];
+
+	 	double ri0 = GetRInverse(prevprev, p.x, p.y, i);
+		double ri1 = GetRInverse(i, n.x, n.y, nextnext);
+		double lPrev = Mag(d.x - p.x, d.y - p.y);
+		double lNext = Mag(d.x - n.x, d.y - n.y);
 
 		double TargetRInverse = (lNext * ri0 + lPrev * ri1) / (lNext + lPrev);
 
@@ -219,8 +231,10 @@ void K1999::StepInterpolate(int iMin, int iMax, int Step)
 	if (prev > Divs - Step)
 		prev -= Step;
 
-	double ir0 = GetRInverse(prev, tx[iMin], ty[iMin], iMax % Divs);
-	double ir1 = GetRInverse(iMin, tx[iMax % Divs], ty[iMax % Divs], next);
+	const Division & dmin = divs[iMin];
+	const Division & dmax = divs[iMax % Divs];
+	double ir0 = GetRInverse(prev, dmin.x, dmin.y, iMax % Divs);
+	double ir1 = GetRInverse(iMin, dmax.x, dmax.y, next);
 	for (int k = iMax; --k > iMin;)
 	{
 		double x = double(k - iMin) / double(iMax - iMin);
@@ -245,16 +259,14 @@ void K1999::Interpolate(int Step)
 
 void K1999::CalcRaceLine()
 {
-	const unsigned int stepsize = 128;
-
 	//abort if the track isn't long enough
-	if (tx.size() < stepsize)
+	if (divs.size() < StepSize)
 		return;
 
 	//
 	// Smoothing loop
 	//
-	for (int Step = stepsize; (Step /= 2) > 0;)
+	for (int Step = StepSize; (Step /= 2) > 0;)
 	{
 		for (int i = Iterations * int(std::sqrt(float(Step))); --i >= 0;)
 			Smooth(Step);
@@ -269,8 +281,7 @@ void K1999::CalcRaceLine()
 		int next = (i + 1) % Divs;
 		int prev = (i - 1 + Divs) % Divs;
 
-		double rInverse = GetRInverse(prev, tx[i], ty[i], next);
-		tRInverse[i] = rInverse;
+		divs[i].rinverse = GetRInverse(prev, divs[i].x, divs[i].y, next);
 	}
 
 #ifdef DRAWPATH
@@ -286,63 +297,84 @@ void K1999::CalcRaceLine()
 
 void K1999::LoadData(const RoadStrip & road)
 {
-	tx.clear();
-	ty.clear();
-	tRInverse.clear();
-	txLeft.clear();
-	tyLeft.clear();
-	txRight.clear();
-	tyRight.clear();
-	tLane.clear();
-
 	const std::vector<RoadPatch> & patchlist = road.GetPatches();
 	Divs = patchlist.size();
 
-	tx.reserve(Divs);
-	ty.reserve(Divs);
-	tRInverse.reserve(Divs);
-	txLeft.reserve(Divs);
-	tyLeft.reserve(Divs);
-	txRight.reserve(Divs);
-	tyRight.reserve(Divs);
-	tLane.reserve(Divs);
-
-	int count = 0;
+	divs.clear();
+	divs.reserve(Divs);
 	for (const auto & p : patchlist)
 	{
-		txLeft.push_back(p.GetPoint(3,0)[1]);
-		tyLeft.push_back(-p.GetPoint(3,0)[0]);
-		txRight.push_back(p.GetPoint(3,3)[1]);
-		tyRight.push_back(-p.GetPoint(3,3)[0]);
-		tLane.push_back(0.5);
-		tx.push_back(0.0);
-		ty.push_back(0.0);
-		tRInverse.push_back(0.0);
-		UpdateTxTy(count);
-
-		count++;
+		Division d;
+		d.left_x = p.GetPoint(3,0)[1];
+		d.left_y = -p.GetPoint(3,0)[0];
+		d.right_x = p.GetPoint(3,3)[1];
+		d.right_y = -p.GetPoint(3,3)[0];
+		d.lane_x = d.right_x - d.left_x;
+		d.lane_y = d.right_y - d.left_y;
+		d.width = Mag((d.left_x - d.right_x), (d.left_y - d.right_y));
+		d.lane = 0.5;
+		d.rinverse = 0.0;
+		UpdateTxTy(d);
+		divs.push_back(d);
 	}
 }
 
 void K1999::UpdateRoadStrip(RoadStrip & road)
 {
 	std::vector<RoadPatch> & patchlist = road.GetPatches();
-	int count = 0;
+	assert(patchlist.size() == divs.size());
 
+	int count = 0;
 	for (auto & p : patchlist)
 	{
-		auto point = p.GetPoint(3,0)*(1.0-tLane[count]) + p.GetPoint(3,3)*(tLane[count]);
-		p.SetRacingLine(point, tRInverse[count]);
-		//std::cout << point << std::endl;
+		const Division & d = divs[count];
+		auto point = p.GetPoint(3,0)*(1.0-d.lane) + p.GetPoint(3,3)*(d.lane);
+		p.SetRacingLine(point, d.rinverse);
 		count++;
 	}
 
-	tx.clear();
-	ty.clear();
-	tRInverse.clear();
-	txLeft.clear();
-	tyLeft.clear();
-	txRight.clear();
-	tyRight.clear();
-	tLane.clear();
+	divs.clear();
+}
+
+bool K1999::ReadFrom(std::istream & in)
+{
+	unsigned count = 0;
+	in.read((char*)&count, sizeof(count));
+	if (!in || count != divs.size())
+		return false;
+
+	for (auto & d : divs)
+	{
+		in.read((char*)&d.lane, sizeof(d.lane));
+		in.read((char*)&d.rinverse, sizeof(d.rinverse));
+		UpdateTxTy(d);
+	}
+	return bool(in);
+}
+
+void K1999::WriteTo(std::ostream & out) const
+{
+	const unsigned count = divs.size();
+	out.write((const char*)&count, sizeof(count));
+	for (const auto & d : divs)
+	{
+		out.write((const char*)&d.lane, sizeof(d.lane));
+		out.write((const char*)&d.rinverse, sizeof(d.rinverse));
+	}
+}
+
+unsigned K1999::GetParametersHash()
+{
+	// bump version on algorithm changes
+	const double params[] = {1, SecurityR, SideDistExt, SideDistInt, Iterations, StepSize};
+
+	// FNV-1a
+	unsigned hash = 2166136261u;
+	const unsigned char * data = (const unsigned char *)params;
+	for (unsigned i = 0; i < sizeof(params); ++i)
+	{
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
 }
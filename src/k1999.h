@@ -37,18 +37,22 @@ class RoadStrip;
 class K1999
 {
 private:
-	std::vector <double> tx;
-	std::vector <double> ty;
-	std::vector <double> tRInverse;
-	std::vector <double> txLeft;
-	std::vector <double> tyLeft;
-	std::vector <double> txRight;
-	std::vector <double> tyRight;
-	std::vector <double> tLane;
+	/// per division state, kept together for cache locality in the smoothing passes
+	struct Division
+	{
+		double x, y;
+		double left_x, left_y;
+		double right_x, right_y;
+		double lane_x, lane_y; ///< right - left
+		double width;
+		double lane;
+		double rinverse;
+	};
+	std::vector <Division> divs;
 	int Divs;
 
-	void UpdateTxTy(int i);
-	double GetRInverse(int prev, double x, double y, int next);
+	void UpdateTxTy(Division & d);
+	double GetRInverse(int prev, double x, double y, int next) const;
 	void AdjustRadius(int prev, int i, int next, double TargetRInverse, double Security = 0);
 	void Smooth(int Step);
 	void StepInterpolate(int iMin, int iMax, int Step);
@@ -63,6 +67,13 @@ public:
 	void LoadData(const RoadStrip & road);
 	void CalcRaceLine();
 	void UpdateRoadStrip(RoadStrip & road);
+
+	/// read/write calculated race line (binary), call after LoadData
+	bool ReadFrom(std::istream & in);
+	void WriteTo(std::ostream & out) const;
+
+	/// hash of the algorithm parameters, to validate stored race lines
+	static unsigned GetParametersHash();
 };
 
 #endif //_K1999_H
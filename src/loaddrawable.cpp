@@ -23,9 +23,66 @@
 #include "graphics/model.h"
 #include "cfg/ptree.h"
 
+#include <sstream>
 #include <string>
 #include <vector>
 
+// minimum face count of models to be simplified
+static const unsigned lod_min_faces = 128;
+
+unsigned LoadLodModels(
+	ContentManager & content,
+	const std::string & path,
+	const std::string & name,
+	std::set<std::shared_ptr<Model> > & models,
+	Drawable & drawable)
+{
+	const Model * model = drawable.GetModel();
+	assert(model);
+
+	const VertexArray & va = model->GetVertexArray();
+	unsigned faces = va.GetNumIndices() / 3;
+	if (faces < lod_min_faces)
+		return 0;
+
+	const float radius = model->GetAabb().GetRadius();
+	unsigned count = 0;
+	for (unsigned level = 1; level < Drawable::max_lods; ++level)
+	{
+		std::shared_ptr<Model> lodmodel;
+		const std::string lodname = name.empty() ? name : name + "_lod" + char('0' + level);
+		if (lodname.empty() || !content.get(lodmodel, path, lodname))
+		{
+			// cell size for a 2 pixel error at the level transition
+			const float cell_size = radius * 4 / Drawable::lod_pixel_size[level - 1];
+
+			VertexArray lodva;
+			va.Simplify(cell_size, lodva);
+
+			// drop levels that don't reduce the face count significantly
+			const unsigned lodfaces = lodva.GetNumIndices() / 3;
+			if (lodfaces == 0 || lodfaces * 4 > faces * 3)
+				break;
+
+			if (lodname.empty())
+			{
+				std::ostringstream error;
+				lodmodel = std::make_shared<Model>();
+				lodmodel->Load(lodva, error);
+			}
+			else
+			{
+				content.load(lodmodel, path, lodname, lodva);
+			}
+		}
+		faces = lodmodel->GetVertexArray().GetNumIndices() / 3;
+		drawable.AddLodModel(*lodmodel);
+		models.insert(lodmodel);
+		count++;
+	}
+	return count;
+}
+
 LoadDrawable::LoadDrawable(
 	const std::string & path,
 	const int anisotropy,
@@ -124,6 +181,13 @@ bool LoadDrawable::operator()(
 	drawable.SetModel(*mesh);
 	models.insert(mesh);
 
+	bool lod = true;
+	cfg.get("lod", lod);
+	if (lod)
+	{
+		LoadLodModels(content, path, meshname + scalestr, models, drawable);
+	}
+
 	// set color
 	Vec4 col(1);
 	if (cfg.get("color", col))
@@ -31,6 +31,19 @@ class ContentManager;
 class Texture;
 class Model;
 class PTree;
+class Drawable;
+
+// Add level of detail models to drawable, drawable model has to be set.
+// Detail levels are generated by vertex clustering of the drawable model
+// and cached in content manager as name_lod1, name_lod2, if name is not empty.
+// Models below lod_min_faces faces are not simplified.
+// Returns number of added detail levels.
+unsigned LoadLodModels(
+	ContentManager & content,
+	const std::string & path,
+	const std::string & name,
+	std::set<std::shared_ptr<Model> > & models,
+	Drawable & drawable);
 
 // Load drawable functor, returns false on error.
 //
@@ -42,6 +55,7 @@ class PTree;
 // scale = -1, 1, 1								#optional
 // color = 0.8, 0.1, 0.1						#optional color rgb
 // draw = transparent							#optional type (transparent, emissive)
+// lod = false									#optional disable level of detail
 //
 struct LoadDrawable
 {
@@ -23,14 +23,28 @@
 #include "minmax.h"
 #include "unittest.h"
 
-template <typename T>
-static inline T Lerp(T x, T y, T s)
-{
-	return x + Clamp(s, T(0), T(1)) * (y - x);
-}
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PARTICLE_SSE
+#endif
+
+// particle ceiling, bounded by the vertex data size
+static const unsigned max_particle_count = 1 << 16;
+
+// frustum culling disabled
+static const float no_fov = 1E6f;
+
+// billboard extents relative to its half width
+static const float billboard_bottom = 2 / 3.0f;
+static const float billboard_top = 4 / 3.0f;
+static const float billboard_radius = 5 / 3.0f;
 
 ParticleSystem::ParticleSystem() :
-	max_particles(512),
+	count(0),
+	max_particles(0),
 	texture_tiles(9),
 	cur_texture_tile(0),
 	transparency_range(0.5,1),
@@ -39,7 +53,12 @@ ParticleSystem::ParticleSystem() :
 	size_range(0.5,1),
 	direction(0,1,0)
 {
-	// ctor
+	SetParameters(512,
+		transparency_range.first, transparency_range.second,
+		longevity_range.first, longevity_range.second,
+		speed_range.first, speed_range.second,
+		size_range.first, size_range.second,
+		direction);
 }
 
 void ParticleSystem::Load(
@@ -63,33 +82,49 @@ void ParticleSystem::Load(
 void ParticleSystem::Update(float dt)
 {
 	//  update particles
-	for (auto & p : particles)
+	float * time = particles.time.data();
+	for (unsigned i = 0; i < count; ++i)
 	{
-		p.time += dt;
+		time[i] += dt;
 	}
 
 	// remove expired particles
-	for (size_t i = 0; i < particles.size(); i++)
+	for (unsigned i = 0; i < count; )
 	{
-		if (particles[i].time > particles[i].longevity)
-		{
-			//only bother to swap if it's not already at the end
-			size_t last = particles.size() - 1;
-			if (i != last)
-				particles[i] = particles[last];
-
-			particles.pop_back();
-		}
+		if (particles.time[i] > particles.longevity[i])
+			Remove(i);
+		else
+			++i;
 	}
 }
 
+void ParticleSystem::Remove(unsigned i)
+{
+	// move the last particle into the gap
+	const unsigned last = --count;
+	if (i == last)
+		return;
+
+	Particles & p = particles;
+	p.x[i] = p.x[last];
+	p.y[i] = p.y[last];
+	p.z[i] = p.z[last];
+	p.vx[i] = p.vx[last];
+	p.vy[i] = p.vy[last];
+	p.vz[i] = p.vz[last];
+	p.transparency[i] = p.transparency[last];
+	p.longevity[i] = p.longevity[last];
+	p.time[i] = p.time[last];
+	p.tid[i] = p.tid[last];
+}
+
 void ParticleSystem::UpdateGraphics(
 	const Quat & camdir,
 	const Vec3 & campos,
 	float znear,
 	float zfar,
-	float /*fovy*/,
-	float /*fovz*/)
+	float fovy,
+	float aspect)
 {
 	if (max_particles == 0)
 		return;
@@ -97,87 +132,211 @@ void ParticleSystem::UpdateGraphics(
 	node.GetTransform().SetTranslation(campos);
 	node.GetTransform().SetRotation(-camdir);
 
-	// get particle position in camera space
-	distance_from_cam.clear();
-	for (auto & p : particles)
+	const float tanfovy = fovy > 0 ? std::tan(fovy * float(M_PI / 360.0)) : no_fov;
+	const float tanfovx = fovy > 0 ? tanfovy * aspect : no_fov;
+	Cull(camdir, campos, znear, zfar, tanfovy, tanfovx);
+
+	Expand();
+
+	GetDrawList(node).get(draw).SetDrawEnable(varray.GetNumIndices() > 0);
+}
+
+#ifdef PARTICLE_SSE
+static inline __m128 Abs(__m128 v)
+{
+	return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+#endif
+
+void ParticleSystem::Cull(
+	const Quat & camdir,
+	const Vec3 & campos,
+	float znear,
+	float zfar,
+	float tanfovy,
+	float tanfovx)
+{
+	// camera rotation matrix columns
+	Vec3 cx(1, 0, 0), cy(0, 1, 0), cz(0, 0, 1);
+	camdir.RotateVector(cx);
+	camdir.RotateVector(cy);
+	camdir.RotateVector(cz);
+
+	// frustum side planes vs sphere, scale of the radius
+	const float ky = std::sqrt(1 + tanfovy * tanfovy);
+	const float kx = std::sqrt(1 + tanfovx * tanfovx);
+
+	Visible & v = visible;
+	v.x.clear();
+	v.y.clear();
+	v.z.clear();
+	v.depth.clear();
+	v.scale.clear();
+	v.alpha.clear();
+	v.tid.clear();
+
+	const Particles & p = particles;
+	unsigned i = 0;
+#ifdef PARTICLE_SSE
+	const __m128 c00 = _mm_set1_ps(cx[0]), c01 = _mm_set1_ps(cy[0]), c02 = _mm_set1_ps(cz[0]);
+	const __m128 c10 = _mm_set1_ps(cx[1]), c11 = _mm_set1_ps(cy[1]), c12 = _mm_set1_ps(cz[1]);
+	const __m128 c20 = _mm_set1_ps(cx[2]), c21 = _mm_set1_ps(cy[2]), c22 = _mm_set1_ps(cz[2]);
+	const __m128 px = _mm_set1_ps(campos[0]), py = _mm_set1_ps(campos[1]), pz = _mm_set1_ps(campos[2]);
+	const __m128 zn = _mm_set1_ps(znear), zf = _mm_set1_ps(zfar);
+	const __m128 tx = _mm_set1_ps(tanfovx), ty = _mm_set1_ps(tanfovy);
+	const __m128 rx = _mm_set1_ps(kx * billboard_radius), ry = _mm_set1_ps(ky * billboard_radius);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	const __m128 sa = _mm_set1_ps(0.2f), sb = _mm_set1_ps(0.4f);
+	for (; i + 4 <= count; i += 4)
 	{
-		Vec3 pos = p.start_position;
-		pos = pos + p.direction * p.time * p.speed - campos;
-		camdir.RotateVector(pos);
+		// world position relative to camera
+		const __m128 t = _mm_loadu_ps(&p.time[i]);
+		const __m128 wx = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(&p.x[i]), _mm_mul_ps(_mm_loadu_ps(&p.vx[i]), t)), px);
+		const __m128 wy = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(&p.y[i]), _mm_mul_ps(_mm_loadu_ps(&p.vy[i]), t)), py);
+		const __m128 wz = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(&p.z[i]), _mm_mul_ps(_mm_loadu_ps(&p.vz[i]), t)), pz);
+
+		// camera space position
+		const __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, c00), _mm_mul_ps(wy, c01)), _mm_mul_ps(wz, c02));
+		const __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, c10), _mm_mul_ps(wy, c11)), _mm_mul_ps(wz, c12));
+		const __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, c20), _mm_mul_ps(wy, c21)), _mm_mul_ps(wz, c22));
+		const __m128 d = _mm_sub_ps(zero, z);
+
+		// billboard size grows with age
+		const __m128 age = _mm_div_ps(t, _mm_loadu_ps(&p.longevity[i]));
+		const __m128 s = _mm_add_ps(_mm_mul_ps(age, sa), sb);
+
+		__m128 in = _mm_and_ps(_mm_cmpge_ps(d, zn), _mm_cmple_ps(d, zf));
+		in = _mm_and_ps(in, _mm_cmple_ps(Abs(x), _mm_add_ps(_mm_mul_ps(d, tx), _mm_mul_ps(s, rx))));
+		in = _mm_and_ps(in, _mm_cmple_ps(Abs(y), _mm_add_ps(_mm_mul_ps(d, ty), _mm_mul_ps(s, ry))));
+		int mask = _mm_movemask_ps(in);
+		if (!mask)
+			continue;
 
-		// signed distance along z-axis in camera space
-		distance_from_cam.push_back(-pos[2]);
+		// fade out with (1 - age)^4
+		__m128 f = _mm_sub_ps(one, age);
+		f = _mm_mul_ps(f, f);
+		f = _mm_mul_ps(_mm_mul_ps(f, f), _mm_loadu_ps(&p.transparency[i]));
+		f = _mm_min_ps(_mm_max_ps(f, zero), one);
 
-		// store camera space position
-		p.position = pos;
+		alignas(16) float xs[4], ys[4], zs[4], ds[4], ss[4], fs[4];
+		_mm_store_ps(xs, x);
+		_mm_store_ps(ys, y);
+		_mm_store_ps(zs, z);
+		_mm_store_ps(ds, d);
+		_mm_store_ps(ss, s);
+		_mm_store_ps(fs, f);
+		for (unsigned k = 0; mask; ++k, mask >>= 1)
+		{
+			if (!(mask & 1))
+				continue;
+			v.x.push_back(xs[k]);
+			v.y.push_back(ys[k]);
+			v.z.push_back(zs[k]);
+			v.depth.push_back(ds[k]);
+			v.scale.push_back(ss[k]);
+			v.alpha.push_back(fs[k]);
+			v.tid.push_back(p.tid[i + k]);
+		}
 	}
+#endif
+	for (; i < count; ++i)
+	{
+		const float t = p.time[i];
+		const float wx = p.x[i] + p.vx[i] * t - campos[0];
+		const float wy = p.y[i] + p.vy[i] * t - campos[1];
+		const float wz = p.z[i] + p.vz[i] * t - campos[2];
+		const float x = wx * cx[0] + wy * cy[0] + wz * cz[0];
+		const float y = wx * cx[1] + wy * cy[1] + wz * cz[1];
+		const float z = wx * cx[2] + wy * cy[2] + wz * cz[2];
+		const float d = -z;
 
-	// sort particles by distance to camera
+		const float age = t / p.longevity[i];
+		const float s = 0.2f * age + 0.4f;
+
+		if (d < znear || d > zfar ||
+			std::abs(x) > d * tanfovx + s * kx * billboard_radius ||
+			std::abs(y) > d * tanfovy + s * ky * billboard_radius)
+			continue;
+
+		float f = 1 - age;
+		f = f * f;
+		f = Clamp(f * f * p.transparency[i], 0.0f, 1.0f);
+
+		v.x.push_back(x);
+		v.y.push_back(y);
+		v.z.push_back(z);
+		v.depth.push_back(d);
+		v.scale.push_back(s);
+		v.alpha.push_back(f);
+		v.tid.push_back(p.tid[i]);
+	}
+}
 
-	// update vertex data
+void ParticleSystem::Expand()
+{
 	varray.Clear();
-	for (size_t i = 0; i < particles.size(); ++i)
+
+	const unsigned n = visible.depth.size();
+	if (n == 0)
+		return;
+
+	// visible particles are in front of the near plane
+	depth_sort.sort(visible.depth, true);
+	const std::vector<unsigned> & ranks = depth_sort.getRanks();
+
+	// texture atlas tile coordinates, assume 9 tiles in 3 rows
+	float tile_uvs[9][8];
+	for (unsigned t = 0; t < 9; ++t)
 	{
-		// cull particles outside of [znear, zfar]
-		// todo: cull particles outside of view frustum
-		if (distance_from_cam[i] < znear || distance_from_cam[i] > zfar)
-			continue;
+		const unsigned vi = t / 3;
+		const unsigned ui = t - vi * 3;
+		const float u1 = ui / 3.0f;
+		const float v1 = vi / 3.0f;
+		const float u2 = u1 + 1 / 3.0f;
+		const float v2 = v1 + 1 / 3.0f;
+		const float uv[8] = {u1, v1, u2, v1, u2, v2, u1, v2};
+		std::memcpy(tile_uvs[t], uv, sizeof(uv));
+	}
 
-		Particle & p = particles[i];
-		Vec3 pos = p.position;
-
-		float trans = p.transparency * std::pow((1.0f - p.time / p.longevity), 4.0f);
-		trans = Clamp(trans, 0.0f, 1.0f);
-
-		float sizescale = 0.2f * (p.time / p.longevity) + 0.4f;
-/*
-		// scale the alpha by the closeness to the camera. if we get too close, don't draw
-		// this prevents major slowdown when there are a lot of particles right next to the camera
-		float camdist = pos.Magnitude();
-		const float camdist_off = 3.0;
-		const float camdist_full = 4.0;
-		trans = Lerp(0.f, trans, (camdist - camdist_off) / (camdist_full - camdist_off));
-*/
-		// assume 9 tiles in texture atlas
-		int vi = p.tid / 3;
-		int ui = p.tid - vi * 3;
-		float u1 = ui * 1 / 3.0f;
-		float v1 = vi * 1 / 3.0f;
-		float u2 = u1 + 1 / 3.0f;
-		float v2 = v1 + 1 / 3.0f;
-		float x1 = -sizescale;
-		float y1 = -sizescale * 2 / 3.0f;
-		float x2 = sizescale;
-		float y2 = sizescale * 4 / 3.0f;
-		unsigned char alpha = trans * 255;
-
-		const unsigned int faces[6] = {
-			0, 2, 1,
-			0, 3, 2,
-		};
-		const float uvs[8] = {
-			u1, v1,
-			u2, v1,
-			u2, v2,
-			u1, v2,
-		};
-		const float verts[12] = {
-			pos[0] + x1, pos[1] + y1, pos[2],
-			pos[0] + x2, pos[1] + y1, pos[2],
-			pos[0] + x2, pos[1] + y2, pos[2],
-			pos[0] + x1, pos[1] + y2, pos[2],
+	// back to front for blending
+	const Visible & v = visible;
+	float * vert = verts.data();
+	float * uv = uvs.data();
+	unsigned char * col = colors.data();
+	for (unsigned k = n; k-- > 0; )
+	{
+		const unsigned i = ranks[k];
+		const float x = v.x[i];
+		const float y = v.y[i];
+		const float z = v.z[i];
+		const float x1 = x - v.scale[i];
+		const float x2 = x + v.scale[i];
+		const float y1 = y - v.scale[i] * billboard_bottom;
+		const float y2 = y + v.scale[i] * billboard_top;
+		const float quad[12] = {
+			x1, y1, z,
+			x2, y1, z,
+			x2, y2, z,
+			x1, y2, z,
 		};
-		const unsigned char cols[16] = {
+		std::memcpy(vert, quad, sizeof(quad));
+		vert += 12;
+
+		std::memcpy(uv, tile_uvs[v.tid[i]], sizeof(tile_uvs[0]));
+		uv += 8;
+
+		const unsigned char alpha = v.alpha[i] * 255;
+		const unsigned char rgba[16] = {
 			255, 255, 255, alpha,
 			255, 255, 255, alpha,
 			255, 255, 255, alpha,
 			255, 255, 255, alpha,
 		};
-
-		varray.Add(faces, 6, verts, 12, uvs, 8, 0, 0, cols, 16);
+		std::memcpy(col, rgba, sizeof(rgba));
+		col += 16;
 	}
 
-	GetDrawList(node).get(draw).SetDrawEnable(varray.GetNumIndices() > 0);
+	varray.Add(faces.data(), n * 6, verts.data(), n * 12, uvs.data(), n * 8, 0, 0, colors.data(), n * 16);
 }
 
 void ParticleSystem::AddParticle(
@@ -187,26 +346,30 @@ void ParticleSystem::AddParticle(
 	if (max_particles == 0)
 		return;
 
-	while (particles.size() >= max_particles)
-		particles.pop_back();
+	// replace the last particle if full
+	if (count >= max_particles)
+		count = max_particles - 1;
 
-	particles.push_back(Particle());
-	Particle & p = particles.back();
-	p.start_position = position;
-	p.direction = direction;
-	p.transparency = transparency_range.first + newspeed * (transparency_range.second - transparency_range.first);
-	p.speed = speed_range.first + newspeed * (speed_range.second - speed_range.first);
-	p.size = size_range.first + newspeed * (size_range.second - size_range.first);
-	p.longevity = longevity_range.first + newspeed * (longevity_range.second - longevity_range.first);
-	p.time = 0;
-	p.tid = cur_texture_tile;
+	const float speed = speed_range.first + newspeed * (speed_range.second - speed_range.first);
+	const unsigned i = count++;
+	Particles & p = particles;
+	p.x[i] = position[0];
+	p.y[i] = position[1];
+	p.z[i] = position[2];
+	p.vx[i] = direction[0] * speed;
+	p.vy[i] = direction[1] * speed;
+	p.vz[i] = direction[2] * speed;
+	p.transparency[i] = transparency_range.first + newspeed * (transparency_range.second - transparency_range.first);
+	p.longevity[i] = longevity_range.first + newspeed * (longevity_range.second - longevity_range.first);
+	p.time[i] = 0;
+	p.tid[i] = cur_texture_tile;
 
 	cur_texture_tile = (cur_texture_tile + 1) % texture_tiles;
 }
 
 void ParticleSystem::Clear()
 {
-	particles.clear();
+	count = 0;
 }
 
 void ParticleSystem::SetParameters(
@@ -221,9 +384,34 @@ void ParticleSystem::SetParameters(
 	float sizemax,
 	Vec3 newdir)
 {
-	max_particles = maxparticles < 0 ? 0 : (maxparticles > 1024 ? 1024 : maxparticles);
-	particles.reserve(max_particles);
-	distance_from_cam.reserve(max_particles);
+	const unsigned n = maxparticles < 0 ? 0 : Min(unsigned(maxparticles), max_particle_count);
+	if (n != max_particles)
+	{
+		max_particles = n;
+		count = Min(count, n);
+
+		// preallocate particle and vertex data
+		Particles & p = particles;
+		for (auto c : {&p.x, &p.y, &p.z, &p.vx, &p.vy, &p.vz, &p.transparency, &p.longevity, &p.time})
+			c->resize(n);
+		p.tid.resize(n);
+
+		Visible & v = visible;
+		for (auto c : {&v.x, &v.y, &v.z, &v.depth, &v.scale, &v.alpha})
+			c->reserve(n);
+		v.tid.reserve(n);
+
+		verts.resize(n * 12);
+		uvs.resize(n * 8);
+		colors.resize(n * 16);
+		faces.resize(n * 6);
+		for (unsigned i = 0; i < n; ++i)
+		{
+			const unsigned quad[6] = {0, 2, 1, 0, 3, 2};
+			for (unsigned j = 0; j < 6; ++j)
+				faces[i * 6 + j] = quad[j] + i * 4;
+		}
+	}
 
 	transparency_range.first = transmin;
 	transparency_range.second = transmax;
@@ -256,4 +444,25 @@ QT_TEST(particle_test)
 	QT_CHECK_EQUAL(s.NumParticles(),1);
 	s.Update(0.50);
 	QT_CHECK_EQUAL(s.NumParticles(),0);
+
+	//test frustum culling and back to front order, camera looking down -z
+	s.SetParameters(8,1.0,1.0,10.0,10.0,0.0,0.0,1.0,1.0,Vec3(0,1,0));
+	s.AddParticle(Vec3(0,0,-10),0);
+	s.AddParticle(Vec3(0,0,-20),0);
+	s.AddParticle(Vec3(50,0,-5),0);
+	s.AddParticle(Vec3(0,0,-5),0);
+	s.AddParticle(Vec3(0,0,5),0);
+	s.UpdateGraphics(Quat(), Vec3(0,0,0), 0.1, 100, 90, 1);
+	QT_CHECK_EQUAL(s.NumVisibleParticles(),3);
+
+	const float * verts = 0;
+	unsigned vcount = 0;
+	s.GetNode().GetDrawList().particle.begin()->GetVertArray()->GetVertices(verts, vcount);
+	QT_CHECK_EQUAL(vcount,3*12);
+	if (vcount == 3*12)
+	{
+		QT_CHECK_EQUAL(verts[2],-20);
+		QT_CHECK_EQUAL(verts[12+2],-10);
+		QT_CHECK_EQUAL(verts[24+2],-5);
+	}
 }
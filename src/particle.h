@@ -24,6 +24,7 @@
 #include "graphics/vertexarray.h"
 #include "mathvector.h"
 #include "quaternion.h"
+#include "radix.h"
 
 #include <memory>
 #include <string>
@@ -33,6 +34,10 @@
 class ContentManager;
 class Texture;
 
+/// Camera facing smoke particles.
+/// Particle state is kept as structure of arrays. Each frame the particles are
+/// transformed into camera space, frustum culled and faded four at a time,
+/// radix sorted by depth and expanded back to front into one vertex array.
 class ParticleSystem
 {
 public:
@@ -54,15 +59,17 @@ public:
 	void Update(float dt);
 
 	/// Partcles graphics update based on last physics state.
-	/// Call once per frame.
+	/// Call once per frame. fovy is the vertical field of view in degrees,
+	/// particles are culled by [znear, zfar] only if it is zero.
 	void UpdateGraphics(
 		const Quat & camdir,
 		const Vec3 & campos,
 		float znear, float zfar,
-		float fovy = 0, float fovz = 0);
+		float fovy = 0, float aspect = 1);
 
 	void Clear();
 
+	/// maxparticles is clamped to [0, 65536]
 	void SetParameters(
 		int maxparticles,
 		float transmin,
@@ -75,25 +82,37 @@ public:
 		float sizemax,
 		Vec3 newdir);
 
-	unsigned NumParticles() { return particles.size(); }
+	unsigned NumParticles() { return count; }
+
+	/// Particles drawn by the last graphics update.
+	unsigned NumVisibleParticles() { return visible.depth.size(); }
 
 	SceneNode & GetNode() { return node; }
 
 private:
-	struct Particle
+	struct Particles
+	{
+		std::vector<float> x, y, z;			///< start position in world space
+		std::vector<float> vx, vy, vz;		///< velocity in world space
+		std::vector<float> transparency;	///< transparency factor
+		std::vector<float> longevity;		///< particle age limit
+		std::vector<float> time;			///< particle age, time since the particle was created
+		std::vector<unsigned char> tid;		///< particle texture atlas tile id 0-8
+	};
+
+	struct Visible
 	{
-		Vec3 start_position; ///< start position in world space
-		Vec3 direction;		///< direction in world space
-		Vec3 position;		///< position in camera space
-		float transparency; ///< transparency factor
-		float speed;		///< initial velocity along direction
-		float size;			///< initial size
-		float longevity;	///< particle age limit
-		float time;			///< particle age, time since the particle was created
-		int tid;			///< particle texture atlas tile id 0-8
+		std::vector<float> x, y, z;			///< position in camera space
+		std::vector<float> depth;			///< distance along view direction
+		std::vector<float> scale;			///< billboard half width
+		std::vector<float> alpha;			///< faded transparency
+		std::vector<unsigned char> tid;
 	};
-	std::vector<Particle> particles;
-	std::vector<float> distance_from_cam;
+
+	Particles particles;
+	Visible visible;
+	Radix depth_sort;
+	unsigned count;
 	unsigned max_particles;
 	unsigned texture_tiles;
 	unsigned cur_texture_tile;
@@ -104,11 +123,27 @@ private:
 	std::pair<float,float> size_range;
 	Vec3 direction;
 
+	// vertex data staging, quad faces are static
+	std::vector<unsigned> faces;
+	std::vector<float> verts;
+	std::vector<float> uvs;
+	std::vector<unsigned char> colors;
+
 	SceneNode::DrawableHandle draw;
 	std::shared_ptr<Texture> texture;
 	VertexArray varray;
 	SceneNode node;
 
+	void Remove(unsigned i);
+
+	void Cull(
+		const Quat & camdir,
+		const Vec3 & campos,
+		float znear, float zfar,
+		float tanfovy, float tanfovx);
+
+	void Expand();
+
 	static keyed_container<Drawable> & GetDrawList(SceneNode & node)
 	{
 		return node.GetDrawList().particle;
@@ -101,6 +101,7 @@ void PathManager::Init(std::ostream & info_output, std::ostream & error_output)
 
 	MakeDir(settings_path);
 	MakeDir(GetTrackRecordsPath());
+	MakeDir(GetTrackCachePath());
 	MakeDir(GetReplayPath());
 	MakeDir(GetScreenshotPath());
 	MakeDir(GetTemporaryFolder());
@@ -257,6 +258,11 @@ std::string PathManager::GetTrackRecordsPath() const
 	return settings_path+"/records"+profile_suffix;
 }
 
+std::string PathManager::GetTrackCachePath() const
+{
+	return settings_path+"/cache";
+}
+
 std::string PathManager::GetSettingsFile() const
 {
 	return settings_path+"/VDrift.config"+profile_suffix;
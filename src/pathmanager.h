@@ -47,6 +47,7 @@ public:
 	std::string GetTrackPartsPath() const;
 	std::string GetStartupFile() const;
 	std::string GetTrackRecordsPath() const;
+	std::string GetTrackCachePath() const;
 	std::string GetSettingsFile() const;
 	std::string GetLogFile() const;
 	std::string GetTracksPath(const std::string & carname) const;
@@ -29,6 +29,7 @@
 #include "cfg/ptree.h"
 #include "fastmath.h"
 #include "minmax.h"
+#include "profiler.h"
 
 #include "BulletCollision/CollisionShapes/btCompoundShape.h"
 #include "BulletCollision/CollisionShapes/btCylinderShape.h"
@@ -1181,6 +1182,8 @@ void CarDynamics::UpdateSuspension(int i, btScalar dt)
 // executed as last function(after integration) in bullet singlestepsimulation
 void CarDynamics::updateAction(btCollisionWorld * /*collisionWorld*/, btScalar dt)
 {
+	PROFILE_SCOPE("car dynamics");
+
 	// reset body transform
 	body->setCenterOfMassTransform(transform);
 
@@ -1451,6 +1454,8 @@ void CarDynamics::UpdateWheelConstraints(WheelConstraint wheel_constraint[WHEEL_
 
 void CarDynamics::UpdateDriveline(btScalar dt)
 {
+	PROFILE_SCOPE("driveline");
+
 	const int solver_iterations = 4;
 	const btScalar rdt = 1 / dt;
 	const btScalar sdt = dt * rsubsteps;
@@ -1483,6 +1488,8 @@ void CarDynamics::UpdateDriveline(btScalar dt)
 	// solve driveline
 	for (int n = 0; n < substeps; ++n)
 	{
+		PROFILE_SCOPE("driveline substep");
+
 		UpdateWheelConstraints(wheel_constraint, rdt, sdt);
 
 		driveline.clearImpulses();
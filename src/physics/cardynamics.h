@@ -143,6 +143,8 @@ public:
 
 	const CarSuspension & GetSuspension(WheelPosition pos) const {return suspension[pos];}
 
+	const CarTireState & GetTireState(WheelPosition pos) const {return tire_state[pos];}
+
 	const btVector3 & GetCenterOfMassOffset() const;
 
 	btVector3 GetTotalAero() const;
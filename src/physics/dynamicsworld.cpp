@@ -87,6 +87,27 @@ struct MyRayResultCallback : public btCollisionWorld::RayResultCallback
 	}
 };
 
+// closest hit fraction only
+struct DistanceRayResultCallback : public btCollisionWorld::RayResultCallback
+{
+	DistanceRayResultCallback(const btCollisionObject * exclude) :
+		m_exclude(exclude)
+	{
+		// ctor
+	}
+
+	const btCollisionObject * m_exclude;
+
+	btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult, bool /*normalInWorldSpace*/) override
+	{
+		if (rayResult.m_collisionObject == m_exclude) return 1.0;
+
+		m_closestHitFraction = rayResult.m_hitFraction;
+		m_collisionObject = rayResult.m_collisionObject;
+		return rayResult.m_hitFraction;
+	}
+};
+
 DynamicsWorld::DynamicsWorld(
 	btDispatcher* dispatcher,
 	btBroadphaseInterface* broadphase,
@@ -113,6 +134,13 @@ const RoadPatch * DynamicsWorld::GetSectorPatch(int i)
 	return track->GetSectorPatch(i);
 }
 
+const RoadPatch * DynamicsWorld::GetNearestPatch(const btVector3 & position) const
+{
+	if (!track)
+		return 0;
+	return track->GetRoadIndex().GetNearest(Vec3(position[0], position[1], position[2]));
+}
+
 bool DynamicsWorld::castRay(
 	const btVector3 & origin,
 	const btVector3 & direction,
@@ -183,6 +211,18 @@ bool DynamicsWorld::castRay(
 	return false;
 }
 
+void DynamicsWorld::castRays(const RayQuery rays[], btScalar distances[], int count) const
+{
+	for (int i = 0; i < count; ++i)
+	{
+		const RayQuery & r = rays[i];
+		const btVector3 to = r.origin + r.direction * r.length;
+		DistanceRayResultCallback ray(r.caster);
+		rayTest(r.origin, to, ray);
+		distances[i] = ray.m_closestHitFraction * r.length;
+	}
+}
+
 void DynamicsWorld::update(btScalar dt)
 {
 	stepSimulation(dt, maxSubSteps, timeStep);
@@ -50,6 +50,24 @@ public:
 
 	const RoadPatch * GetSectorPatch(int i);
 
+	const Track * GetTrack() const { return track; }
+
+	// nearest road patch to position, null if there is no road
+	const RoadPatch * GetNearestPatch(const btVector3 & position) const;
+
+	// distance only ray query, caster is excluded from hits
+	struct RayQuery
+	{
+		btVector3 origin;
+		btVector3 direction;
+		btScalar length;
+		const btCollisionObject * caster;
+	};
+
+	// cast a batch of rays into collision world, output distance to the first hit or ray length
+	// cheaper than castRay, skips surface lookup and road patch refinement
+	void castRays(const RayQuery rays[], btScalar distances[], int count) const;
+
 	// cast ray into collision world, returns first hit, caster is excluded fom hits
 	bool castRay(
 		const btVector3 & position,
@@ -0,0 +1,543 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// events per thread and frame, excess zones are skipped
+static const unsigned event_buffer_size = 1 << 16;
+
+// smoothing factor of the average frame statistics
+static const double avg_smoothing = 1.0 / 20;
+
+struct ProfileNode
+{
+	unsigned zone;
+	unsigned parent;
+	std::vector<unsigned> children;
+
+	// current frame
+	Profiler::Ticks frame_time;
+	Profiler::Ticks frame_self;
+	unsigned frame_calls;
+
+	// last collected frame
+	Profiler::Ticks last_time;
+	unsigned last_calls;
+
+	// smoothed per frame
+	double avg_time;
+	double avg_self;
+	double avg_calls;
+
+	// since init
+	Profiler::Ticks total_time;
+	Profiler::Ticks total_self;
+	unsigned long long total_calls;
+
+	ProfileNode(unsigned zone, unsigned parent) :
+		zone(zone), parent(parent),
+		frame_time(0), frame_self(0), frame_calls(0),
+		last_time(0), last_calls(0),
+		avg_time(0), avg_self(0), avg_calls(0),
+		total_time(0), total_self(0), total_calls(0)
+	{
+		// ctor
+	}
+};
+
+struct ProfileFrame
+{
+	unsigned node;
+	Profiler::Ticks begin;
+	Profiler::Ticks children;
+};
+
+struct ProfilerThread
+{
+	// producer side
+	SpscQueue<Profiler::Event> events;
+	unsigned depth;
+	unsigned skip_depth;
+
+	// collector side, node 0 is the root
+	unsigned id;
+	std::string name;
+	std::vector<ProfileNode> nodes;
+	std::vector<ProfileFrame> stack;
+	unsigned long long skipped;
+	std::atomic<unsigned> skipped_frame;
+	std::atomic<bool> released;
+
+	ProfilerThread(unsigned id) :
+		events(event_buffer_size),
+		depth(0),
+		skip_depth(0),
+		id(id),
+		nodes(1, ProfileNode(0, 0)),
+		skipped(0),
+		skipped_frame(0),
+		released(false)
+	{
+		// ctor
+	}
+};
+
+// marks the buffer of an exiting thread for reuse
+struct ThreadRelease
+{
+	std::atomic<bool> * released;
+
+	ThreadRelease() : released(0) {}
+
+	~ThreadRelease()
+	{
+		if (released)
+			released->store(true, std::memory_order_release);
+	}
+};
+
+static std::mutex profiler_mutex;
+static std::vector<const char *> zone_names;
+static std::deque<ProfilerThread> thread_buffers;
+static double ticks_per_second = 1E9;
+static Profiler::Ticks init_ticks = 0;
+static Profiler::Ticks frame_ticks = 0;
+static double avg_frame_ticks = 0;
+
+// chrome trace event output
+static std::ofstream trace_file;
+static bool trace_first = true;
+static unsigned trace_frame = 0;
+
+static void WriteTraceEvent(const char * name, unsigned tid, Profiler::Ticks begin, Profiler::Ticks time)
+{
+	// timestamps in microseconds
+	const double scale = 1E6 / ticks_per_second;
+	if (!trace_first)
+		trace_file << ",\n";
+	trace_first = false;
+	trace_file << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+		<< ",\"ts\":" << (begin - init_ticks) * scale << ",\"dur\":" << time * scale << "}";
+}
+
+std::atomic<bool> Profiler::enabled(false);
+thread_local ProfilerThread * Profiler::thread_buffer = 0;
+thread_local unsigned Profiler::current_zone = Profiler::NoZone;
+
+void Profiler::Init()
+{
+#ifdef PROFILER_RDTSC
+	// calibrate against the steady clock
+	const auto clock_begin = std::chrono::steady_clock::now();
+	const Ticks ticks_begin = Now();
+	auto clock_end = clock_begin;
+	while (clock_end - clock_begin < std::chrono::milliseconds(10))
+		clock_end = std::chrono::steady_clock::now();
+	const Ticks ticks_end = Now();
+	ticks_per_second = (ticks_end - ticks_begin) /
+		std::chrono::duration<double>(clock_end - clock_begin).count();
+#else
+	typedef std::chrono::steady_clock::period Period;
+	ticks_per_second = double(Period::den) / Period::num;
+#endif
+
+	init_ticks = frame_ticks = Now();
+	enabled.store(true, std::memory_order_relaxed);
+	SetThreadName("main");
+}
+
+void Profiler::Shutdown()
+{
+	if (!Enabled())
+		return;
+
+	EndTrace();
+	enabled.store(false, std::memory_order_relaxed);
+
+	// the calling thread has no open zones
+	current_zone = NoZone;
+	if (thread_buffer)
+	{
+		thread_buffer->depth = 0;
+		thread_buffer->skip_depth = 0;
+	}
+
+	std::lock_guard<std::mutex> lock(profiler_mutex);
+	for (auto & buffer : thread_buffers)
+	{
+		Event event;
+		while (buffer.events.pop(event))
+			continue;
+
+		buffer.nodes.assign(1, ProfileNode(0, 0));
+		buffer.stack.clear();
+		buffer.skipped = 0;
+		buffer.skipped_frame.store(0, std::memory_order_relaxed);
+	}
+	avg_frame_ticks = 0;
+}
+
+unsigned Profiler::RegisterZone(const char * name)
+{
+	std::lock_guard<std::mutex> lock(profiler_mutex);
+	for (unsigned i = 0; i < zone_names.size(); ++i)
+	{
+		if (std::strcmp(zone_names[i], name) == 0)
+			return i;
+	}
+	zone_names.push_back(name);
+	return zone_names.size() - 1;
+}
+
+const char * Profiler::GetZoneName(unsigned zone)
+{
+	std::lock_guard<std::mutex> lock(profiler_mutex);
+	return zone < zone_names.size() ? zone_names[zone] : "";
+}
+
+void Profiler::SetThreadName(const char * name)
+{
+	if (!Enabled())
+		return;
+
+	ProfilerThread * buffer = thread_buffer;
+	if (!buffer)
+		buffer = RegisterThread();
+
+	std::lock_guard<std::mutex> lock(profiler_mutex);
+	buffer->name = name;
+}
+
+double Profiler::GetTicksPerSecond()
+{
+	return ticks_per_second;
+}
+
+ProfilerThread * Profiler::RegisterThread()
+{
+	// released on thread exit, constructed by the first call per thread
+	thread_local ThreadRelease release;
+
+	std::lock_guard<std::mutex> lock(profiler_mutex);
+
+	// reuse the drained buffer of an exited thread
+	ProfilerThread * buffer = 0;
+	for (auto & b : thread_buffers)
+	{
+		if (b.released.load(std::memory_order_acquire) && b.events.empty())
+		{
+			buffer = &b;
+			buffer->released.store(false, std::memory_order_relaxed);
+			buffer->depth = 0;
+			buffer->skip_depth = 0;
+			buffer->stack.clear();
+			break;
+		}
+	}
+	if (!buffer)
+	{
+		thread_buffers.emplace_back(thread_buffers.size());
+		buffer = &thread_buffers.back();
+		buffer->name = "thread " + std::to_string(buffer->id);
+	}
+
+	release.released = &buffer->released;
+	thread_buffer = buffer;
+	return buffer;
+}
+
+void Profiler::Record(ProfilerThread & buffer, unsigned zone, bool end)
+{
+	if (!end)
+	{
+		// keep room for the end events of all open zones
+		if (buffer.skip_depth || buffer.events.capacity() - buffer.events.size() <= buffer.depth + 1)
+		{
+			if (!buffer.skip_depth)
+				buffer.skipped_frame.fetch_add(1, std::memory_order_relaxed);
+			buffer.skip_depth++;
+			return;
+		}
+		buffer.depth++;
+	}
+	else
+	{
+		if (buffer.skip_depth)
+		{
+			buffer.skip_depth--;
+			return;
+		}
+		if (!buffer.depth)
+			return;
+		buffer.depth--;
+	}
+
+	Event event;
+	event.time = Now();
+	event.zone = zone;
+	event.end = end;
+	buffer.events.push(event);
+}
+
+static void ProcessEvent(ProfilerThread & buffer, const Profiler::Event & event);
+
+void Profiler::EndFrame()
+{
+	if (!Enabled())
+		return;
+
+	const Ticks now = Now();
+	const Ticks frame = now - frame_ticks;
+	avg_frame_ticks += (frame - avg_frame_ticks) * avg_smoothing;
+
+	std::lock_guard<std::mutex> lock(profiler_mutex);
+
+	// frames on the main thread track
+	if (trace_file.is_open())
+	{
+		WriteTraceEvent("frame", 0, frame_ticks, frame);
+		trace_frame++;
+	}
+	frame_ticks = now;
+	for (auto & buffer : thread_buffers)
+	{
+		// only drain events pushed before this frame ended
+		Event event;
+		unsigned count = buffer.events.size();
+		while (count-- && buffer.events.pop(event))
+			ProcessEvent(buffer, event);
+
+		buffer.skipped += buffer.skipped_frame.exchange(0, std::memory_order_relaxed);
+
+		for (auto & node : buffer.nodes)
+		{
+			node.avg_time += (node.frame_time - node.avg_time) * avg_smoothing;
+			node.avg_self += (node.frame_self - node.avg_self) * avg_smoothing;
+			node.avg_calls += (node.frame_calls - node.avg_calls) * avg_smoothing;
+			node.total_time += node.frame_time;
+			node.total_self += node.frame_self;
+			node.total_calls += node.frame_calls;
+			node.last_time = node.frame_time;
+			node.last_calls = node.frame_calls;
+			node.frame_time = 0;
+			node.frame_self = 0;
+			node.frame_calls = 0;
+		}
+	}
+}
+
+static void ProcessEvent(ProfilerThread & buffer, const Profiler::Event & event)
+{
+	auto & nodes = buffer.nodes;
+	auto & stack = buffer.stack;
+	if (!event.end)
+	{
+		const unsigned parent = stack.empty() ? 0 : stack.back().node;
+
+		unsigned node = 0;
+		for (unsigned child : nodes[parent].children)
+		{
+			if (nodes[child].zone == event.zone)
+			{
+				node = child;
+				break;
+			}
+		}
+		if (!node)
+		{
+			node = nodes.size();
+			nodes.push_back(ProfileNode(event.zone, parent));
+			nodes[parent].children.push_back(node);
+		}
+
+		ProfileFrame frame;
+		frame.node = node;
+		frame.begin = event.time;
+		frame.children = 0;
+		stack.push_back(frame);
+	}
+	else if (!stack.empty())
+	{
+		const ProfileFrame frame = stack.back();
+		stack.pop_back();
+
+		const Profiler::Ticks time = event.time - frame.begin;
+		ProfileNode & node = nodes[frame.node];
+		node.frame_time += time;
+		node.frame_self += time > frame.children ? time - frame.children : 0;
+		node.frame_calls++;
+
+		if (trace_file.is_open())
+			WriteTraceEvent(zone_names[node.zone], buffer.id, frame.begin, time);
+
+		if (!stack.empty())
+			stack.back().children += time;
+	}
+}
+
+static void GetNodeTimes(
+	const std::vector<ProfileNode> & nodes,
+	unsigned index,
+	unsigned depth,
+	unsigned max_depth,
+	std::vector<Profiler::ZoneTime> & zones)
+{
+	const ProfileNode & node = nodes[index];
+	if (index)
+	{
+		if (!node.last_calls)
+			return;
+
+		Profiler::ZoneTime zone;
+		zone.name = zone_names[node.zone];
+		zone.depth = depth;
+		zone.seconds = node.last_time / ticks_per_second;
+		zone.calls = node.last_calls;
+		zones.push_back(zone);
+
+		if (++depth > max_depth)
+			return;
+	}
+
+	for (unsigned child : node.children)
+		GetNodeTimes(nodes, child, depth, max_depth, zones);
+}
+
+void Profiler::GetFrameZones(std::vector<ZoneTime> & zones, unsigned max_depth)
+{
+	zones.clear();
+
+	std::lock_guard<std::mutex> lock(profiler_mutex);
+	if (!thread_buffers.empty())
+		GetNodeTimes(thread_buffers.front().nodes, 0, 0, max_depth, zones);
+}
+
+static void PrintNode(
+	std::ostream & out,
+	const std::vector<ProfileNode> & nodes,
+	unsigned index,
+	unsigned depth,
+	double scale,
+	bool avg)
+{
+	const ProfileNode & node = nodes[index];
+	if (index)
+	{
+		const double time = avg ? node.avg_time : node.total_time;
+		const double self = avg ? node.avg_self : node.total_self;
+		out << std::string(depth * 2, ' ') << zone_names[node.zone] << ": "
+			<< std::fixed << std::setprecision(avg ? 0 : 1) << time * scale
+			<< " (self " << self * scale << ")";
+		if (avg)
+			out << " x" << std::setprecision(1) << node.avg_calls;
+		else
+			out << " x" << node.total_calls;
+		out << "\n";
+		depth++;
+	}
+
+	// order siblings by time
+	std::vector<unsigned> children = node.children;
+	std::sort(children.begin(), children.end(), [&](unsigned a, unsigned b) {
+		return avg ? nodes[a].avg_time > nodes[b].avg_time : nodes[a].total_time > nodes[b].total_time;
+	});
+	for (unsigned child : children)
+		PrintNode(out, nodes, child, depth, scale, avg);
+}
+
+void Profiler::PrintAvgSummary(std::ostream & out)
+{
+	const double scale = 1E6 / GetTicksPerSecond();
+
+	std::lock_guard<std::mutex> lock(profiler_mutex);
+	const std::ios::fmtflags flags = out.flags();
+	out << "frame: " << std::fixed << std::setprecision(0) << avg_frame_ticks * scale << " us\n";
+	for (const auto & buffer : thread_buffers)
+	{
+		if (buffer.nodes.size() < 2)
+			continue;
+		out << "[" << buffer.name << "]\n";
+		PrintNode(out, buffer.nodes, 0, 1, scale, true);
+	}
+	out.flags(flags);
+}
+
+void Profiler::PrintSummary(std::ostream & out)
+{
+	const double elapsed = Now() - init_ticks;
+	const double scale = elapsed > 0 ? 100 / elapsed : 0;
+
+	std::lock_guard<std::mutex> lock(profiler_mutex);
+	const std::ios::fmtflags flags = out.flags();
+	out << "time in % of " << std::fixed << std::setprecision(1)
+		<< elapsed / GetTicksPerSecond() << " s, calls\n";
+	for (const auto & buffer : thread_buffers)
+	{
+		if (buffer.nodes.size() < 2)
+			continue;
+		out << "[" << buffer.name << "]";
+		if (buffer.skipped)
+			out << " " << buffer.skipped << " zones skipped, buffer full";
+		out << "\n";
+		PrintNode(out, buffer.nodes, 0, 1, scale, false);
+	}
+	out.flags(flags);
+}
+
+bool Profiler::BeginTrace(const std::string & path)
+{
+	std::lock_guard<std::mutex> lock(profiler_mutex);
+	trace_file.open(path.c_str());
+	if (!trace_file)
+		return false;
+
+	trace_file << std::fixed << std::setprecision(3);
+	trace_file << "{\"traceEvents\":[\n";
+	trace_first = true;
+	trace_frame = 0;
+	return true;
+}
+
+void Profiler::EndTrace()
+{
+	std::lock_guard<std::mutex> lock(profiler_mutex);
+	if (!trace_file.is_open())
+		return;
+
+	for (const auto & buffer : thread_buffers)
+	{
+		if (!trace_first)
+			trace_file << ",\n";
+		trace_first = false;
+		trace_file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.id
+			<< ",\"args\":{\"name\":\"" << buffer.name << "\"}}";
+	}
+	trace_file << "\n],\"otherData\":{\"frames\":" << trace_frame << "}}\n";
+	trace_file.close();
+}
@@ -0,0 +1,208 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include "spscqueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PROFILER_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILER_RDTSC
+#endif
+
+struct ProfilerThread;
+
+/// Hierarchical profiler with scoped zones.
+/// Zones are interned once per call site. Begin/end events are recorded into
+/// per thread lock-free buffers and collected by the main thread once per frame.
+/// Disabled zones cost a load and a branch.
+///
+/// void Foo()
+/// {
+///     PROFILE_SCOPE("foo");
+///     ...
+/// }
+class Profiler
+{
+public:
+	typedef unsigned long long Ticks;
+
+	struct Event
+	{
+		Ticks time;
+		unsigned zone;
+		bool end;
+	};
+
+	struct ZoneTime
+	{
+		const char * name;
+		unsigned depth;
+		double seconds;
+		unsigned calls;
+	};
+
+	/// Enable profiling, the calling thread becomes the main thread.
+	static void Init();
+
+	/// Disable profiling and discard collected data, call outside of zones.
+	static void Shutdown();
+
+	static bool Enabled();
+
+	/// Returns the zone id of the named zone.
+	static unsigned RegisterZone(const char * name);
+
+	static const char * GetZoneName(unsigned zone);
+
+	/// Name the calling thread in summaries, ignored before Init.
+	static void SetThreadName(const char * name);
+
+	/// Timestamp, rdtsc where available.
+	static Ticks Now();
+
+	static double GetTicksPerSecond();
+
+	/// Open zone, returns the enclosing zone to be passed to End.
+	static unsigned Begin(unsigned zone);
+
+	static void End(unsigned zone, unsigned parent);
+
+	/// Innermost open zone of the calling thread or NoZone.
+	static unsigned GetCurrentZone();
+
+	static const unsigned NoZone = ~0u;
+
+	/// Collect events of all threads, called by the main thread once per frame.
+	static void EndFrame();
+
+	/// Main thread zones of the last collected frame in depth first order.
+	static void GetFrameZones(std::vector<ZoneTime> & zones, unsigned max_depth);
+
+	/// Smoothed per frame zone times in microseconds.
+	static void PrintAvgSummary(std::ostream & out);
+
+	/// Total zone times in percent of the time since Init.
+	static void PrintSummary(std::ostream & out);
+
+	/// Stream all zones and frames to a Chrome trace event file from now on.
+	/// Returns false if the file can't be created.
+	static bool BeginTrace(const std::string & path);
+
+	/// Write thread names and close the trace file.
+	static void EndTrace();
+
+private:
+	static std::atomic<bool> enabled;
+	static thread_local ProfilerThread * thread_buffer;
+	static thread_local unsigned current_zone;
+
+	static ProfilerThread * RegisterThread();
+
+	static void Record(ProfilerThread & buffer, unsigned zone, bool end);
+};
+
+/// Times the enclosing scope.
+class ProfileScope
+{
+public:
+	ProfileScope(unsigned zone) : zone(zone), parent(Profiler::Begin(zone))
+	{
+		// ctor
+	}
+
+	~ProfileScope()
+	{
+		Profiler::End(zone, parent);
+	}
+
+private:
+	const unsigned zone;
+	const unsigned parent;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+/// Profile the enclosing scope as zone name, name has to be a string literal.
+#define PROFILE_SCOPE(name) \
+	static const unsigned PROFILE_CONCAT(profile_zone_, __LINE__) = Profiler::RegisterZone(name); \
+	ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(PROFILE_CONCAT(profile_zone_, __LINE__))
+
+
+inline bool Profiler::Enabled()
+{
+	return enabled.load(std::memory_order_relaxed);
+}
+
+inline Profiler::Ticks Profiler::Now()
+{
+#ifdef PROFILER_RDTSC
+	return __rdtsc();
+#else
+	return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+inline unsigned Profiler::Begin(unsigned zone)
+{
+	if (!Enabled())
+		return NoZone;
+
+	ProfilerThread * buffer = thread_buffer;
+	if (!buffer)
+		buffer = RegisterThread();
+
+	Record(*buffer, zone, false);
+
+	const unsigned parent = current_zone;
+	current_zone = zone;
+	return parent;
+}
+
+inline void Profiler::End(unsigned zone, unsigned parent)
+{
+	if (!Enabled())
+		return;
+
+	current_zone = parent;
+
+	ProfilerThread * buffer = thread_buffer;
+	if (!buffer)
+		return;
+
+	Record(*buffer, zone, true);
+}
+
+inline unsigned Profiler::GetCurrentZone()
+{
+	return current_zone;
+}
+
+#endif // _PROFILER_H
@@ -20,22 +20,26 @@
 #include "radix.h"
 #include <cassert>
 
+// Accumulate a counter for each byte of a value, LSB to MSB.
+template <typename T>
+static inline void AccumCounters(unsigned counters[], const unsigned char *& bytes)
+{
+	for (unsigned i = 0; i < sizeof(T); ++i)
+	{
+		counters[i * 256 + *bytes++]++;
+	}
+}
+
 // Return false if the list is already sorted.
 template <typename T>
 static inline bool ComputeCounters(
-	unsigned counters[1024],
+	unsigned counters[],
 	const std::vector<T> & input,
 	std::vector<unsigned> & ranks,
 	bool ranks_valid)
 {
-	assert(sizeof(T) == 4);
-
 	const unsigned char * bytes = (const unsigned char *)input.data();
-	const unsigned char * bytes_end = bytes + 4 * input.size();
-	unsigned * c0 = &counters[0];
-	unsigned * c1 = &counters[256];
-	unsigned * c2 = &counters[512];
-	unsigned * c3 = &counters[768];
+	const unsigned char * bytes_end = bytes + sizeof(T) * input.size();
 
 	bool sorted = true;
 	if (!ranks_valid)
@@ -55,10 +59,7 @@ static inline bool ComputeCounters(
 			vprev = v;
 
 			// Accumulate counters.
-			c0[*bytes++]++;
-			c1[*bytes++]++;
-			c2[*bytes++]++;
-			c3[*bytes++]++;
+			AccumCounters<T>(counters, bytes);
 		}
 
 		// If input values are already sorted, leave the list unchanged.
@@ -88,10 +89,7 @@ static inline bool ComputeCounters(
 			vprev = v;
 
 			// Accumulate counters.
-			c0[*bytes++]++;
-			c1[*bytes++]++;
-			c2[*bytes++]++;
-			c3[*bytes++]++;
+			AccumCounters<T>(counters, bytes);
 		}
 
 		// If input values are already sorted, return.
@@ -104,10 +102,7 @@ static inline bool ComputeCounters(
 	// Finish counters accumulation.
 	while (bytes != bytes_end)
 	{
-		c0[*bytes++]++;
-		c1[*bytes++]++;
-		c2[*bytes++]++;
-		c3[*bytes++]++;
+		AccumCounters<T>(counters, bytes);
 	}
 
 	return true;
@@ -146,7 +141,7 @@ inline static void RadixPassPos(
 	{
 		for (unsigned i = 0; i < num; ++i)
 		{
-			*offsets[binput[i * 4]]++ = i;
+			*offsets[binput[i * sizeof(Type)]]++ = i;
 		}
 		ranks_valid = true;
 	}
@@ -155,7 +150,7 @@ inline static void RadixPassPos(
 		for (unsigned i = 0; i < num; ++i)
 		{
 			const unsigned id = ranks0[i];
-			*offsets[binput[id * 4]]++ = id;
+			*offsets[binput[id * sizeof(Type)]]++ = id;
 		}
 	}
 
@@ -326,6 +321,46 @@ bool Radix::sort(const std::vector<float> & input, bool greater_than_zero)
 	return true;
 }
 
+bool Radix::sort(const std::vector<uint64_t> & input)
+{
+	unsigned counters[256 * 8] = {};
+	unsigned * offsets[256] = {};
+
+	unsigned num = input.size();
+	bool ranks_valid = m_ranks[0].size() == num;
+	if (!ranks_valid)
+	{
+		m_ranks[0].resize(num);
+		m_ranks[1].resize(num);
+		m_ranks_id = 0;
+	}
+
+	// Nothing to sort, make sure ranks are an identity list
+	if (num < 2)
+	{
+		if (num)
+			m_ranks[m_ranks_id][0] = 0;
+		return false;
+	}
+
+	// Compute counters and early out if input is already/still sorted
+	if (!ComputeCounters(counters, input, m_ranks[m_ranks_id], ranks_valid))
+		return false;
+
+	// Radix sort, 8 passes LSB to MSB, keys are unsigned
+	unsigned * ranks0 = &m_ranks[m_ranks_id][0];
+	unsigned * ranks1 = &m_ranks[(m_ranks_id + 1) & 1][0];
+	for (unsigned pass = 0; pass < 8; ++pass)
+	{
+		RadixPassPos(pass, num, &input[0], counters, offsets, ranks0, ranks1, ranks_valid);
+	}
+
+	// Set sorted indices list.
+	m_ranks_id = (ranks0 == &m_ranks[0][0]) ? 0 : 1;
+
+	return true;
+}
+
 
 #include "unittest.h"
 #include <cstdlib>
@@ -374,3 +409,53 @@ QT_TEST(radix_test)
 		v0 = v1;
 	}
 }
+
+QT_TEST(radix_test_uint64)
+{
+	Radix rsort;
+
+	// keys spanning all bytes, with duplicates to check equal key order
+	std::vector<uint64_t> input(64);
+	for (unsigned i = 0; i < input.size(); ++i)
+	{
+		input[i] = (uint64_t(rand() % 4) << 56) | (uint64_t(rand() % 3) << 24) | (i % 5);
+	}
+
+	bool resort = rsort.sort(input);
+	QT_CHECK(resort);
+
+	// verify sort result, a first sort keeps input order of equal keys
+	const std::vector<unsigned> & ranks = rsort.getRanks();
+	QT_CHECK_EQUAL(ranks.size(), input.size());
+	for (unsigned i = 1; i < ranks.size(); ++i)
+	{
+		QT_CHECK_LESS_OR_EQUAL(input[ranks[i - 1]], input[ranks[i]]);
+		if (input[ranks[i - 1]] == input[ranks[i]])
+			QT_CHECK_LESS(ranks[i - 1], ranks[i]);
+	}
+
+	// check temporal coherence
+	resort = rsort.sort(input);
+	QT_CHECK(!resort);
+
+	// equal keys keep their previous order, not their input order
+	const std::vector<unsigned> previous = rsort.getRanks();
+	std::vector<uint64_t> equal(input.size(), 0);
+	equal[previous[0]] = 1;
+	resort = rsort.sort(equal);
+	QT_CHECK(resort);
+	for (unsigned i = 0; i + 1 < previous.size(); ++i)
+	{
+		QT_CHECK_EQUAL(rsort.getRanks()[i], previous[i + 1]);
+	}
+
+	// already sorted input keeps identity order
+	Radix rsort2;
+	std::vector<uint64_t> sorted(8, 7);
+	resort = rsort2.sort(sorted);
+	QT_CHECK(!resort);
+	for (unsigned i = 0; i < sorted.size(); ++i)
+	{
+		QT_CHECK_EQUAL(rsort2.getRanks()[i], i);
+	}
+}
@@ -21,10 +21,11 @@
 #define _RADIX_H
 
 #include <vector>
+#include <cstdint>
 
 /// 4 bytes signed/unsigned radix sort with temporal coherence
 /// Based on Pierre Terdimans "Radix Sort Revisited".
-/// Only floats sort implemented currently.
+/// Floats and unsigned 64 bit keys sort implemented currently.
 /// Signed sort will fail in big endian machines (fixme).
 class Radix
 {
@@ -36,6 +37,12 @@ public:
 	/// greater_than_zero: hint that input values are greater than zero.
 	bool sort(const std::vector<float> & input, bool greater_than_zero = false);
 
+	/// Process unsigned 64 bit keys list and gen a sorted input indices list.
+	/// Equal keys keep their order of the previous sort result of a list of
+	/// the same size, so their order is temporally coherent but not stable.
+	/// Returns false if the list is already/still sorted.
+	bool sort(const std::vector<uint64_t> & input);
+
 	/// Sort result as indices of input list in sorted order.
 	const std::vector<unsigned> & getRanks() const { return m_ranks[m_ranks_id]; }
 
@@ -23,6 +23,7 @@
 #include "physics/carinput.h"
 #include "physics/cardynamics.h"
 #include "joeserialize.h"
+#include "framearena.h"
 
 #include <sstream>
 #include <fstream>
@@ -144,11 +145,12 @@ void Replay::CarState::RecordFrame(const std::vector <float> & inputs, CarDynami
 	// record every 30th state, input frame
 	if (frame % 30 == 0)
 	{
-		std::ostringstream statestream;
+		FrameOutputStream statestream;
 		joeserialize::BinaryOutputSerializer serialize_output(statestream);
 		car.Serialize(serialize_output);
+		const FrameString state = statestream.str();
 		stateframes.push_back(StateFrame(frame));
-		stateframes.back().SetBinaryStateData(statestream.str());
+		stateframes.back().SetBinaryStateData(state.data(), state.size());
 		stateframes.back().SetInputSnapshot(inputs);
 	}
 
@@ -199,7 +201,8 @@ void Replay::CarState::ProcessPlayStateFrame(const StateFrame & frame, CarDynami
 	}
 
 	// process binary car state
-	std::istringstream statestream(frame.GetBinaryStateData());
+	const std::string & state = frame.GetBinaryStateData();
+	FrameInputStream statestream(FrameString(state.data(), state.size()));
 	joeserialize::BinaryInputSerializer serialize_input(statestream);
 	car.Serialize(serialize_input);
 }
@@ -342,9 +345,9 @@ Replay::StateFrame::StateFrame(unsigned newframe) :
 	// ctor
 }
 
-void Replay::StateFrame::SetBinaryStateData(const std::string & value)
+void Replay::StateFrame::SetBinaryStateData(const char * data, unsigned size)
 {
-	binary_state_data = value;
+	binary_state_data.assign(data, size);
 }
 
 unsigned Replay::StateFrame::GetFrame() const
@@ -126,7 +126,7 @@ private:
 		template <class Serializer>
 		bool Serialize(Serializer & s);
 
-		void SetBinaryStateData(const std::string & value);
+		void SetBinaryStateData(const char * data, unsigned size);
 
 		unsigned GetFrame() const;
 
@@ -0,0 +1,259 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "roadpatchindex.h"
+#include "roadstrip.h"
+#include "unittest.h"
+
+#include <algorithm>
+#include <cmath>
+
+static Vec3 GetCenter(const RoadPatch & patch)
+{
+	return (patch.GetFL() + patch.GetFR() + patch.GetBL() + patch.GetBR()) * 0.25f;
+}
+
+RoadPatchIndex::RoadPatchIndex() :
+	min_x(0),
+	min_y(0),
+	cell_size_inv(1),
+	cell_size(1),
+	size_x(0),
+	size_y(0)
+{
+	// ctor
+}
+
+void RoadPatchIndex::Build(const std::vector<RoadStrip> & roads)
+{
+	Clear();
+
+	std::vector<Item> unsorted;
+	for (const auto & road : roads)
+	{
+		for (const auto & patch : road.GetPatches())
+		{
+			Item item;
+			item.center = GetCenter(patch);
+			item.patch = &patch;
+			unsorted.push_back(item);
+		}
+	}
+	if (unsorted.empty())
+		return;
+
+	float max_x, max_y;
+	min_x = max_x = unsorted[0].center[0];
+	min_y = max_y = unsorted[0].center[1];
+	for (const auto & item : unsorted)
+	{
+		min_x = std::min(min_x, item.center[0]);
+		max_x = std::max(max_x, item.center[0]);
+		min_y = std::min(min_y, item.center[1]);
+		max_y = std::max(max_y, item.center[1]);
+	}
+
+	// about two patches per cell, cell count bounded by patch count
+	const float extent_x = std::max(max_x - min_x, 1.0f);
+	const float extent_y = std::max(max_y - min_y, 1.0f);
+	cell_size = std::sqrt(2 * extent_x * extent_y / unsorted.size());
+	cell_size = std::max(cell_size, std::max(extent_x, extent_y) / unsorted.size());
+	cell_size_inv = 1 / cell_size;
+	size_x = int(extent_x * cell_size_inv) + 1;
+	size_y = int(extent_y * cell_size_inv) + 1;
+
+	// counting sort items into cells
+	cells.resize(size_x * size_y + 1, 0);
+	std::vector<unsigned> item_cells(unsorted.size());
+	for (size_t i = 0; i < unsorted.size(); ++i)
+	{
+		const Vec3 & c = unsorted[i].center;
+		item_cells[i] = GetCellY(c[1]) * size_x + GetCellX(c[0]);
+		cells[item_cells[i] + 1]++;
+	}
+	for (size_t i = 1; i < cells.size(); ++i)
+	{
+		cells[i] += cells[i - 1];
+	}
+	items.resize(unsorted.size());
+	std::vector<unsigned> offsets(cells.begin(), cells.end() - 1);
+	for (size_t i = 0; i < unsorted.size(); ++i)
+	{
+		items[offsets[item_cells[i]]++] = unsorted[i];
+	}
+}
+
+void RoadPatchIndex::Clear()
+{
+	items.clear();
+	cells.clear();
+	min_x = min_y = 0;
+	cell_size = cell_size_inv = 1;
+	size_x = size_y = 0;
+}
+
+const RoadPatch * RoadPatchIndex::GetNearest(const Vec3 & position) const
+{
+	if (items.empty())
+		return 0;
+
+	const int cx = GetCellX(position[0]);
+	const int cy = GetCellY(position[1]);
+	const int rmax = std::max(size_x, size_y);
+
+	const RoadPatch * nearest = 0;
+	float nearest_dist2 = 0;
+	for (int r = 0; r <= rmax; ++r)
+	{
+		// visit cells on the ring r around (cx, cy)
+		const int y0 = std::max(cy - r, 0);
+		const int y1 = std::min(cy + r, size_y - 1);
+		for (int y = y0; y <= y1; ++y)
+		{
+			const bool edge = (y == cy - r || y == cy + r);
+			const int xstep = edge ? 1 : 2 * r;
+			for (int x = cx - r; x <= cx + r; x += xstep)
+			{
+				if (x < 0 || x >= size_x)
+					continue;
+
+				const int cell = y * size_x + x;
+				for (unsigned i = cells[cell]; i < cells[cell + 1]; ++i)
+				{
+					const float dist2 = (items[i].center - position).MagnitudeSquared();
+					if (!nearest || dist2 < nearest_dist2)
+					{
+						nearest_dist2 = dist2;
+						nearest = items[i].patch;
+					}
+				}
+			}
+		}
+
+		// patches outside of the visited rings are at least r cells away
+		const float bound = r * cell_size;
+		if (nearest && nearest_dist2 <= bound * bound)
+			break;
+	}
+	return nearest;
+}
+
+void RoadPatchIndex::GetInRadius(
+	const Vec3 & position,
+	float radius,
+	std::vector<const RoadPatch *> & patches) const
+{
+	if (items.empty())
+		return;
+
+	const int x0 = GetCellX(position[0] - radius);
+	const int x1 = GetCellX(position[0] + radius);
+	const int y0 = GetCellY(position[1] - radius);
+	const int y1 = GetCellY(position[1] + radius);
+	const float radius2 = radius * radius;
+	for (int y = y0; y <= y1; ++y)
+	{
+		for (int x = x0; x <= x1; ++x)
+		{
+			const int cell = y * size_x + x;
+			for (unsigned i = cells[cell]; i < cells[cell + 1]; ++i)
+			{
+				if ((items[i].center - position).MagnitudeSquared() <= radius2)
+					patches.push_back(items[i].patch);
+			}
+		}
+	}
+}
+
+int RoadPatchIndex::GetCellX(float x) const
+{
+	const int i = int((x - min_x) * cell_size_inv);
+	return std::max(0, std::min(i, size_x - 1));
+}
+
+int RoadPatchIndex::GetCellY(float y) const
+{
+	const int i = int((y - min_y) * cell_size_inv);
+	return std::max(0, std::min(i, size_y - 1));
+}
+
+QT_TEST(roadpatchindex_test)
+{
+	// closed ring road of 64 patches
+	std::vector<RoadStrip> roads(1);
+	std::vector<RoadPatch> & patches = roads[0].GetPatches();
+	const int count = 64;
+	const float r0 = 90, r1 = 100;
+	for (int i = 0; i < count; ++i)
+	{
+		const float a0 = 6.2831853f * i / count;
+		const float a1 = 6.2831853f * (i + 1) / count;
+		Vec3 fl(r0 * std::cos(a1), r0 * std::sin(a1), 0);
+		Vec3 fr(r1 * std::cos(a1), r1 * std::sin(a1), 0);
+		Vec3 bl(r0 * std::cos(a0), r0 * std::sin(a0), 0);
+		Vec3 br(r1 * std::cos(a0), r1 * std::sin(a0), 0);
+		patches.push_back(RoadPatch());
+		patches.back().SetFromCorners(fl, fr, bl, br);
+	}
+
+	RoadPatchIndex index;
+	QT_CHECK(index.GetNearest(Vec3(0, 0, 0)) == 0);
+
+	index.Build(roads);
+	QT_CHECK(!index.Empty());
+
+	// compare against linear scan, inside, on and outside of the track
+	bool nearest_ok = true;
+	bool radius_ok = true;
+	for (int i = 0; i < 200; ++i)
+	{
+		const float a = 0.1f * i;
+		const float r = 10.0f + i;
+		const Vec3 pos(r * std::cos(a), r * std::sin(a), 0.05f * i);
+
+		const RoadPatch * nearest = 0;
+		float nearest_dist2 = 0;
+		unsigned inside = 0;
+		for (const auto & patch : patches)
+		{
+			const float dist2 = (GetCenter(patch) - pos).MagnitudeSquared();
+			if (!nearest || dist2 < nearest_dist2)
+			{
+				nearest_dist2 = dist2;
+				nearest = &patch;
+			}
+			if (dist2 <= 30.0f * 30.0f)
+				inside++;
+		}
+		const RoadPatch * found = index.GetNearest(pos);
+		if (!found || (GetCenter(*found) - pos).MagnitudeSquared() != nearest_dist2)
+			nearest_ok = false;
+
+		std::vector<const RoadPatch *> found_patches;
+		index.GetInRadius(pos, 30.0f, found_patches);
+		if (found_patches.size() != inside)
+			radius_ok = false;
+	}
+	QT_CHECK(nearest_ok);
+	QT_CHECK(radius_ok);
+
+	index.Clear();
+	QT_CHECK(index.Empty());
+	QT_CHECK(index.GetNearest(Vec3(0, 0, 0)) == 0);
+}
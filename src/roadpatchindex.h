@@ -0,0 +1,74 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _ROADPATCHINDEX_H
+#define _ROADPATCHINDEX_H
+
+#include "mathvector.h"
+
+#include <vector>
+
+class RoadPatch;
+class RoadStrip;
+
+/// Uniform 2d grid over the road patch centers (world x, y).
+/// Built once per track, answers nearest patch and patches in radius queries.
+class RoadPatchIndex
+{
+public:
+	RoadPatchIndex();
+
+	/// index all patches of the given roads, patch pointers have to stay valid
+	void Build(const std::vector<RoadStrip> & roads);
+
+	void Clear();
+
+	bool Empty() const
+	{
+		return items.empty();
+	}
+
+	/// return patch with the nearest center, null if index is empty
+	const RoadPatch * GetNearest(const Vec3 & position) const;
+
+	/// append patches with center within radius of position to patches
+	void GetInRadius(
+		const Vec3 & position,
+		float radius,
+		std::vector<const RoadPatch *> & patches) const;
+
+private:
+	struct Item
+	{
+		Vec3 center;
+		const RoadPatch * patch;
+	};
+	std::vector<Item> items;	///< items sorted by cell
+	std::vector<unsigned> cells;	///< cell item offsets, cell count + 1
+	float min_x, min_y;
+	float cell_size_inv;
+	float cell_size;
+	int size_x, size_y;
+
+	int GetCellX(float x) const;
+
+	int GetCellY(float y) const;
+};
+
+#endif // _ROADPATCHINDEX_H
@@ -18,7 +18,13 @@
 /************************************************************************/
 
 #include "roadstrip.h"
+#include "alloctracker.h"
+#include "framearena.h"
+#include "profiler.h"
+#include "unittest.h"
+
 #include <algorithm>
+#include <sstream>
 
 RoadStrip::RoadStrip() :
 	closed(false)
@@ -112,6 +118,9 @@ bool RoadStrip::Collide(
 	const RoadPatch * & colpatch,
 	Vec3 & normal) const
 {
+	// zero allocation zone, see Game::SetNoAllocZones
+	PROFILE_SCOPE("road collide");
+
 	if (patch_id >= 0 && patch_id < (int)patches.size())
 	{
 		Vec3 coltri, colnorm;
@@ -125,7 +134,7 @@ bool RoadStrip::Collide(
 	}
 
 	bool col = false;
-	std::vector<int> candidates;
+	FrameVector<int> candidates;
 	aabb_part.Query(Aabb<float>::Ray(origin, direction, seglen), candidates);
 	for (int candidate : candidates)
 	{
@@ -145,3 +154,58 @@ bool RoadStrip::Collide(
 
 	return col;
 }
+
+QT_TEST(roadstrip_test)
+{
+	// two flat patches along x, written in file order y z x
+	std::stringstream s;
+	s << 2 << "\n";
+	for (int k = 0; k < 2; ++k)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			for (int j = 0; j < 4; ++j)
+				s << -2 + j * 4 / 3.0f << " 0 " << (k * 4 + i * 4 / 3.0f) << "\n";
+		}
+	}
+
+	RoadStrip strip;
+	std::ostringstream error;
+	QT_CHECK(strip.ReadFrom(s, false, error));
+	QT_CHECK_EQUAL(strip.GetPatches().size(), 2);
+	QT_CHECK(!strip.GetClosed());
+
+	const Vec3 origin(5, 0, 1), direction(0, 0, -1);
+	Vec3 tri, norm;
+	int patch_id = -1;
+	const RoadPatch * patch = 0;
+	QT_CHECK(strip.Collide(origin, direction, 2, patch_id, tri, patch, norm));
+	QT_CHECK_EQUAL(patch_id, 1);
+	QT_CHECK_EQUAL(patch, &strip.GetPatches()[1]);
+	QT_CHECK_CLOSE(tri[2], 0, 1E-4);
+
+	// restored at the end, so later tests run unaffected
+	const bool profiling = Profiler::Enabled();
+	const bool tracking = AllocTracker::Enabled();
+	if (!profiling)
+		Profiler::Init();
+	AllocTracker::Init();
+
+	// collision tests are allocation free, the frame arena is warm
+	static const unsigned zone = Profiler::RegisterZone("road collide");
+	AllocTracker::SetNoAlloc(zone);
+	const unsigned long long violations = AllocTracker::GetViolations();
+	for (int i = 0; i < 2; ++i)
+	{
+		patch_id = -1;
+		QT_CHECK(strip.Collide(origin + Vec3(-4 * i, 0, 0), direction, 2, patch_id, tri, patch, norm));
+		QT_CHECK_EQUAL(patch_id, 1 - i);
+	}
+	QT_CHECK_EQUAL(AllocTracker::GetViolations(), violations);
+
+	AllocTracker::SetNoAlloc(zone, false);
+	if (!tracking)
+		AllocTracker::Shutdown();
+	if (!profiling)
+		Profiler::Shutdown();
+}
@@ -20,18 +20,22 @@
 #include "sound.h"
 #include "minmax.h"
 #include "coordinatesystem.h"
-#include <SDL2/SDL_audio.h>
+#include "profiler.h"
+#include "unittest.h"
+
+#include <SDL2/SDL.h>
+
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+#include <ostream>
+#include <sstream>
 
 //static std::ofstream logso("logso.txt");
 //static std::ofstream logsa("logsa.txt");
 
-#define FRACTIONBITS (15)
-#define FRACTIONONE  (1<<FRACTIONBITS)
-#define FRACTIONMASK (FRACTIONONE-1)
-#define MAXGAINDELTA (FRACTIONONE * 173 / 44100) // 256 samples from min to max gain
-
 // add item to a compactifying vector
 template <class T>
 static inline size_t AddItem(T & item, std::vector<T> & items, size_t & item_num)
@@ -126,15 +130,10 @@ static inline const T & GetItem(size_t id, const std::vector<T> & items, size_t
 
 bool Sound::SourceActive::operator<(const Sound::SourceActive & other) const
 {
-	// reverse op as partial sort sorts for the smallest elemets
+	// reverse op as nth_element partitions for the smallest elemets
 	return this->gain > other.gain;
 }
 
-bool Sound::SamplersUpdate::empty() const
-{
-	return sset.empty() && sadd.empty() && sremove.empty();
-}
-
 Sound::Sound() :
 	deviceinfo(0, 0, 0, 0),
 	sound_volume(0),
@@ -142,16 +141,18 @@ Sound::Sound() :
 	disable(false),
 	max_active_sources(64),
 	sources_num(0),
-	update_id(0),
 	sources_pause(true),
+	commands_sent(0),
+	commands_dropped(0),
+	queue_depth(0),
+	queue_depth_max(0),
+	commands(1 << 12),
 	samplers_num(0),
 	samplers_pause(true),
 	samplers_fade(false)
 {
-	attenuation[0] =  0.9146065;
-	attenuation[1] =  0.2729276;
-	attenuation[2] = -0.2313740;
-	attenuation[3] = -0.2884304;
+	const float default_attenuation[4] = {0.9146065, 0.2729276, -0.2313740, -0.2884304};
+	SetAttenuation(default_attenuation);
 
 	sources.reserve(64);
 	samplers.reserve(64);
@@ -160,70 +161,40 @@ Sound::Sound() :
 Sound::~Sound()
 {
 	if (initdone)
-		SDL_CloseAudio();
+		output->Close();
+	streamer.Stop();
 }
 
 bool Sound::Init(unsigned short buffersize, std::ostream & info_output, std::ostream & error_output)
+{
+	return Init(std::unique_ptr<SoundOutput>(new SoundOutputSdl()), buffersize, info_output, error_output);
+}
+
+bool Sound::Init(std::unique_ptr<SoundOutput> noutput, unsigned short buffersize, std::ostream & info_output, std::ostream & error_output)
 {
 	if (disable || initdone)
 		return false;
 
-	SDL_AudioSpec desired, obtained;
-
-	desired.freq = 44100;
-	desired.format = AUDIO_S16SYS;
-	desired.samples = Clamp<Uint16>(buffersize, 512, 2048);
-	desired.callback = Sound::CallbackWrapper;
-	desired.userdata = this;
-	desired.channels = 2;
-
-	if (SDL_OpenAudio(&desired, &obtained) < 0)
+	SoundInfo info(Clamp<unsigned short>(buffersize, 512, 2048), 44100, 2, 2);
+	if (!noutput->Open(info, Sound::CallbackWrapper, this, info_output, error_output))
 	{
-		error_output << "Error opening audio device, disabling sound." << std::endl;
+		error_output << "Disabling sound." << std::endl;
 		Disable();
 		return false;
 	}
 
-	unsigned frequency = obtained.freq;
-	unsigned channels = obtained.channels;
-	unsigned samples = obtained.samples;
-	unsigned bytespersample = 1;
-	if (obtained.format == AUDIO_S16SYS)
-	{
-		bytespersample = 2;
-	}
-	else if (obtained.format == AUDIO_F32SYS)
-	{
-		bytespersample = 4;
-	}
-
-	std::ostringstream dout;
-	dout << "Obtained audio device:" << std::endl;
-	dout << "Frequency: " << frequency << std::endl;
-	dout << "Format: " << obtained.format << std::endl;
-	dout << "Bits per sample: " << bytespersample * 8 << std::endl;
-	dout << "Channels: " << channels << std::endl;
-	dout << "Silence: " << (unsigned)obtained.silence << std::endl;
-	dout << "Samples: " << samples << std::endl;
-	dout << "Size: " << obtained.size;
-	info_output << dout.str() << std::endl;
-
-	if (((obtained.format != AUDIO_S16SYS) && (obtained.format != AUDIO_F32SYS)) ||
-		(obtained.channels != desired.channels))
-	{
-		error_output << "Audio device has unsupported format or channel count. Disabling sound." << std::endl;
-		Disable();
-		return false;
-	}
-
-	deviceinfo = SoundInfo(samples, frequency, channels, bytespersample);
-	buffer[0].reserve(samples);
-	buffer[1].reserve(samples);
+	output = std::move(noutput);
+	deviceinfo = info;
+	buffer[0].reserve(info.samples);
+	buffer[1].reserve(info.samples);
 	initdone = true;
 	SetVolume(1);
 
+	// decode streamed buffers
+	streamer.Start();
+
 	// enable sound, run callback
-	SDL_PauseAudio(false);
+	output->Pause(false);
 
 	return true;
 }
@@ -254,6 +225,20 @@ void Sound::SetAttenuation(const float nattenuation[4])
 	attenuation[1] = nattenuation[1];
 	attenuation[2] = nattenuation[2];
 	attenuation[3] = nattenuation[3];
+
+	// distance at which attenuation curve drops to zero gain, y(x) = 0
+	// only decreasing curves with a negative offset reach it
+	audible_distance = 1E9f;
+	if (attenuation[0] > 0 && attenuation[2] < 0 && attenuation[3] < 0)
+		audible_distance = attenuation[1] + powf(-attenuation[3] / attenuation[0], 1 / attenuation[2]);
+	audible_distance2 = audible_distance * audible_distance;
+}
+
+bool Sound::GetAudible(float x, float y, float z, float radius) const
+{
+	Vec3 relvec = Vec3(x, y, z) - listener_pos;
+	float distance = audible_distance + radius;
+	return relvec.MagnitudeSquared() < distance * distance;
 }
 
 size_t Sound::AddSource(std::shared_ptr<SoundBuffer> buffer, float offset, bool is3d, bool loop)
@@ -268,23 +253,60 @@ size_t Sound::AddSource(std::shared_ptr<SoundBuffer> buffer, float offset, bool
 	src.is3d = is3d;
 	src.playing = true;
 	src.loop = loop;
+	src.audible = false;
+	src.set = src.sent = SamplerSet();
+
+	// a redirected source might be moved back into the free slot
+	size_t idl = sources_num;
+	size_t idn = (idl < sources.size()) ? sources[idl].id : idl;
 	size_t id = AddItem(src, sources, sources_num);
+	if (idn != idl && sources[idl].audible)
+		*std::find(sources_audible.begin(), sources_audible.end(), idn) = idl;
+
+	if (buffer->GetStreaming())
+		streamer.Add(buffer);
 
 	// notify sound thread
-	SamplerAdd ns;
-	ns.buffer = buffer.get();
-	ns.offset = offset * FRACTIONONE;
-	ns.loop = loop;
-	ns.id = -1;
-	samplers_update.back().sadd.push_back(ns);
+	SamplerCommand sc = SamplerCommand();
+	sc.type = SamplerCommand::ADD;
+	sc.buffer = buffer.get();
+	sc.offset = offset * FRACTIONONE;
+	sc.loop = loop;
+	sc.id = -1;
+	PushCommand(sc);
 
 	return id;
 }
 
 void Sound::RemoveSource(size_t id)
 {
-	samplers_update.back().sremove.push_back(id);
-	sources_remove.push_back(id);
+	size_t idn = sources[id].id;
+	Source & src = GetItem(id, sources, sources_num);
+	if (src.audible)
+	{
+		auto i = std::find(sources_audible.begin(), sources_audible.end(), idn);
+		*i = sources_audible.back();
+		sources_audible.pop_back();
+	}
+
+	auto & buffer = src.buffer;
+	if (buffer->GetStreaming())
+		streamer.Remove(buffer.get());
+
+	// sound thread might still be using the buffer
+	buffers_release.push_back(buffer);
+
+	RemoveItem(id, sources, sources_num);
+
+	// last source has been moved into the free slot
+	if (idn < sources_num && sources[idn].audible)
+		*std::find(sources_audible.begin(), sources_audible.end(), sources_num) = idn;
+
+	// notify sound thread
+	SamplerCommand sc = SamplerCommand();
+	sc.type = SamplerCommand::REMOVE;
+	sc.id = id;
+	PushCommand(sc);
 }
 
 void Sound::ResetSource(size_t id)
@@ -293,13 +315,19 @@ void Sound::ResetSource(size_t id)
 	Source & src = sources[idn];
 	src.playing = true;
 
+	// sampler is reset to silence, resend state
+	src.sent = SamplerSet();
+	if (src.gain > 0)
+		AddAudibleSource(id);
+
 	// notify sound thread
-	SamplerAdd ns;
-	ns.buffer = src.buffer.get();
-	ns.offset = src.offset * FRACTIONONE;
-	ns.loop = src.loop;
-	ns.id = idn;
-	samplers_update.back().sadd.push_back(ns);
+	SamplerCommand sc = SamplerCommand();
+	sc.type = SamplerCommand::ADD;
+	sc.buffer = src.buffer.get();
+	sc.offset = src.offset * FRACTIONONE;
+	sc.loop = src.loop;
+	sc.id = idn;
+	PushCommand(sc);
 }
 
 bool Sound::GetSourcePlaying(size_t id) const
@@ -325,6 +353,8 @@ void Sound::SetSourcePitch(size_t id, float value)
 void Sound::SetSourceGain(size_t id, float value)
 {
 	GetItem(id, sources, sources_num).gain = value;
+	if (value > 0)
+		AddAudibleSource(id);
 }
 
 void Sound::SetListenerVelocity(float x, float y, float z)
@@ -351,18 +381,64 @@ void Sound::Update(bool pause)
 {
 	if (disable) return;
 
+	bool pause_changed = (sources_pause != pause);
 	sources_pause = pause;
+	commands_sent = 0;
+
+	// sound thread caught up with all removals, release their buffers
+	if (commands_pending.empty() && commands.empty())
+		buffers_release.clear();
+
+	// retry commands that did not fit into the queue
+	FlushCommands();
 
 	// process source stop messages
 	ProcessSourceStop();
 
-	// ProcessSourceAdd is implicit
-
 	// calculate sampler changes from sources
 	ProcessSources();
 
-	// commit sampler changes to sound thread
+	// send sampler changes to sound thread
 	SetSamplerChanges();
+
+	if (pause_changed)
+	{
+		SamplerCommand sc = SamplerCommand();
+		sc.type = SamplerCommand::PAUSE;
+		sc.pause = pause;
+		PushCommand(sc);
+	}
+
+	queue_depth = commands.size();
+	queue_depth_max = Max(queue_depth, queue_depth_max);
+}
+
+void Sound::PrintProfilingInfo(std::ostream & out) const
+{
+	out << "sound: " << sources_num << " sources, "
+		<< sources_audible.size() << " audible, "
+		<< commands_sent << " commands sent, "
+		<< queue_depth << " queued (" << queue_depth_max << " max of " << commands.capacity() << "), "
+		<< commands_pending.size() << " pending, "
+		<< commands_dropped << " dropped" << std::endl;
+}
+
+void Sound::PushCommand(const SamplerCommand & command)
+{
+	// preserve command order, queue behind pending commands
+	if (commands_pending.empty() && commands.push(command))
+		commands_sent++;
+	else
+		commands_pending.push_back(command);
+}
+
+void Sound::FlushCommands()
+{
+	size_t n = 0;
+	while (n < commands_pending.size() && commands.push(commands_pending[n]))
+		n++;
+	commands_pending.erase(commands_pending.begin(), commands_pending.begin() + n);
+	commands_sent += n;
 }
 
 void Sound::ProcessSourceStop()
@@ -385,50 +461,59 @@ void Sound::ProcessSourceStop()
 	sstop.clear();
 }
 
-void Sound::ProcessSourceRemove()
+void Sound::AddAudibleSource(size_t id)
 {
-	for (auto id : sources_remove)
-	{
-		RemoveItem(id, sources, sources_num);
-	}
-	sources_remove.clear();
+	Source & src = GetItem(id, sources, sources_num);
+	if (src.audible)
+		return;
+
+	src.audible = true;
+	sources_audible.push_back(sources[id].id);
 }
 
 void Sound::ProcessSources()
 {
-	auto & sset = samplers_update.back().sset;
-	sset.resize(sources_num);
-
+	// silent sources are not listed, they keep their last sent state
 	sources_active.clear();
-	for (size_t i = 0; i < sources_num; ++i)
+	for (size_t i : sources_audible)
 	{
 		Source & src = sources[i];
-		if (!src.playing) continue;
+		if (!src.playing)
+		{
+			// sampler stopped, nothing to send
+			src.set = src.sent;
+			continue;
+		}
 
 		float gain1 = 0.0, gain2 = 0.0;
 		if (src.gain > 0)
 		{
 			if (src.is3d)
 			{
+				// virtual voice, culled by distance before any attenuation math
 				Vec3 relvec = src.position - listener_pos;
-				float len = relvec.Magnitude();
-				if (len < 1E-6f) len = 1E-6f;
-
-				// distance attenuation
-				// y = a * (x - b)^c + d
-				float cgain = attenuation[0] * powf(len - attenuation[1], attenuation[2]) + attenuation[3];
-				cgain = Clamp(cgain, 0.0f, 1.0f);
-
-				// directional attenuation
-				relvec = relvec * (1.0f / len);
-				(-listener_rot).RotateVector(relvec);
-				float pgain = relvec[Direction::RIGHT] * 0.5f;
-				float pgain1 = Max(0.0f, 0.5f - pgain); // left attenuation
-				float pgain2 = Max(0.0f, 0.5f + pgain); // right attenuation
-
-				float gain = cgain * src.gain;
-				gain1 = gain * pgain1;
-				gain2 = gain * pgain2;
+				float len2 = relvec.MagnitudeSquared();
+				if (len2 < audible_distance2)
+				{
+					float len = std::sqrt(len2);
+					if (len < 1E-6f) len = 1E-6f;
+
+					// distance attenuation
+					// y = a * (x - b)^c + d
+					float cgain = attenuation[0] * powf(len - attenuation[1], attenuation[2]) + attenuation[3];
+					cgain = Clamp(cgain, 0.0f, 1.0f);
+
+					// directional attenuation
+					relvec = relvec * (1.0f / len);
+					(-listener_rot).RotateVector(relvec);
+					float pgain = relvec[Direction::RIGHT] * 0.5f;
+					float pgain1 = Max(0.0f, 0.5f - pgain); // left attenuation
+					float pgain2 = Max(0.0f, 0.5f + pgain); // right attenuation
+
+					float gain = cgain * src.gain;
+					gain1 = gain * pgain1;
+					gain2 = gain * pgain2;
+				}
 			}
 			else
 			{
@@ -448,12 +533,16 @@ void Sound::ProcessSources()
 		// fade sound volume
 		float volume = sources_pause ? 0 : sound_volume;
 
-		sset[i].gain1 = volume * gain1 * FRACTIONONE;
-		sset[i].gain2 = volume * gain2 * FRACTIONONE;
+		src.set.gain1 = volume * gain1 * FRACTIONONE;
+		src.set.gain2 = volume * gain2 * FRACTIONONE;
 
-		auto info = src.buffer->GetInfo();
-		auto base_pitch = FRACTIONONE * info.frequency / deviceinfo.frequency;
-		sset[i].pitch = src.pitch * base_pitch;
+		// silent samplers keep their last pitch
+		if (src.set.gain1 | src.set.gain2)
+		{
+			auto info = src.buffer->GetInfo();
+			auto base_pitch = FRACTIONONE * info.frequency / deviceinfo.frequency;
+			src.set.pitch = src.pitch * base_pitch;
+		}
 	}
 
 	LimitActiveSources();
@@ -465,82 +554,106 @@ void Sound::LimitActiveSources()
 	if (sources_active.size() <= max_active_sources)
 		return;
 
-	// get loudest max_active_sources
-	std::partial_sort(
+	// get loudest max_active_sources, their order is irrelevant
+	std::nth_element(
 		sources_active.begin(),
 		sources_active.begin() + max_active_sources,
 		sources_active.end());
 
 	// mute remaining sources
-	auto & sset = samplers_update.back().sset;
 	for (size_t i = max_active_sources; i < sources_active.size(); ++i)
 	{
-		sset[sources_active[i].id].gain1 = 0;
-		sset[sources_active[i].id].gain2 = 0;
+		sources[sources_active[i].id].set.gain1 = 0;
+		sources[sources_active[i].id].set.gain2 = 0;
 	}
 }
 
 void Sound::SetSamplerChanges()
 {
-	auto & su = samplers_update.back();
-	if (su.empty())
-		return;
-
-	su.pause = sources_pause;
-	su.id = update_id;
-
-	if (samplers_update.swap_back())
+	// send changed sampler state only
+	for (size_t n = 0; n < sources_audible.size();)
 	{
-		ProcessSourceRemove();
-		update_id++;
-	}
-}
+		size_t i = sources_audible[n];
+		Source & src = sources[i];
+		if (src.set.gain1 != src.sent.gain1 ||
+			src.set.gain2 != src.sent.gain2 ||
+			src.set.pitch != src.sent.pitch)
+		{
+			// keep command order, on a full queue drop the change and retry next update
+			SamplerCommand sc = SamplerCommand();
+			sc.type = SamplerCommand::SET;
+			sc.set = src.set;
+			sc.id = i;
+			if (!commands_pending.empty() || !commands.push(sc))
+			{
+				commands_dropped++;
+				++n;
+				continue;
+			}
+			src.sent = src.set;
+			commands_sent++;
+		}
 
-void Sound::GetSamplerChanges()
-{
-	if (samplers_update.swap_front())
-	{
-		auto & su = samplers_update.front();
-		samplers_fade = (samplers_pause != su.pause);
-		samplers_pause = su.pause;
+		// unlist sources once they are silent or stopped
+		if (!src.playing || src.gain <= 0)
+		{
+			src.audible = false;
+			sources_audible[n] = sources_audible.back();
+			sources_audible.pop_back();
+			continue;
+		}
+		++n;
 	}
 }
 
-void Sound::ProcessSamplerUpdate()
+void Sound::ProcessSamplerCommands()
 {
-	auto & sset = samplers_update.front().sset;
-	if (sset.empty())
-		return;
-
-	assert(samplers_num == sset.size());
-	for (size_t i = 0; i < samplers_num; ++i)
+	SamplerCommand sc;
+	while (commands.pop(sc))
 	{
-		samplers[i].gain1 = sset[i].gain1;
-		samplers[i].gain2 = sset[i].gain2;
-		samplers[i].pitch = sset[i].pitch;
+		if (sc.type == SamplerCommand::ADD)
+		{
+			ProcessSamplerAdd(sc);
+		}
+		else if (sc.type == SamplerCommand::REMOVE)
+		{
+			assert(size_t(sc.id) < samplers.size());
+			RemoveItem(sc.id, samplers, samplers_num);
+		}
+		else if (sc.type == SamplerCommand::SET)
+		{
+			assert(size_t(sc.id) < samplers_num);
+			Sampler & smp = samplers[sc.id];
+			smp.gain1 = sc.set.gain1;
+			smp.gain2 = sc.set.gain2;
+			smp.pitch = sc.set.pitch;
+		}
+		else if (sc.type == SamplerCommand::PAUSE)
+		{
+			samplers_fade = (samplers_pause != sc.pause);
+			samplers_pause = sc.pause;
+		}
 	}
-	sset.clear();
 }
 
-template <typename stream_type, typename buffer_type, int vmin, int vmax>
+template <typename stream_type, typename buffer_type>
 void Sound::ProcessSamplers(unsigned char stream[], unsigned len)
 {
-	// clear stream
-	memset(stream, 0, len);
-
 	// pause sampling
 	if (samplers_pause && !samplers_fade)
+	{
+		memset(stream, 0, len);
 		return;
+	}
 
 	auto & sstop = sources_stop.back();
 
-	// init sampling buffers
+	// init accumulation buffers, zero bits are zero for int and float
 	auto samples = len / (2 * sizeof(stream_type));
-	buffer[0].resize(samples);
-	buffer[1].resize(samples);
+	buffer[0].assign(samples, 0);
+	buffer[1].assign(samples, 0);
 
 	// run samplers
-	auto sstream = (stream_type*)stream;
 	auto buffer0 = (buffer_type*)buffer[0].data();
 	auto buffer1 = (buffer_type*)buffer[1].data();
 	for (size_t i = 0; i < samplers_num; ++i)
@@ -549,77 +662,106 @@ void Sound::ProcessSamplers(unsigned char stream[], unsigned len)
 		if (!smp.playing)
 			continue;
 
-		if (smp.gain1 | smp.gain2 | smp.last_gain1 | smp.last_gain2)
+		if (smp.stream && !ProcessSamplerStream(smp, samples))
 		{
-			SampleAndAdvanceWithPitch<stream_type>(smp, buffer0, buffer1, samples);
-
-			for (unsigned n = 0; n < samples; ++n)
-			{
-				unsigned pos = n * 2;
-				buffer_type val1 = sstream[pos] + buffer0[n];
-				buffer_type val2 = sstream[pos + 1] + buffer1[n];
+			if (!smp.playing)
+				sstop.push_back(smp.id);
+			continue;
+		}
 
-				val1 = Clamp<buffer_type>(val1, vmin, vmax);
-				val2 = Clamp<buffer_type>(val2, vmin, vmax);
+		auto sample_pos = smp.sample_pos;
 
-				sstream[pos] = val1;
-				sstream[pos + 1] = val2;
-			}
-		}
+		if (smp.gain1 | smp.gain2 | smp.last_gain1 | smp.last_gain2)
+			SoundMixer::Mix(smp, buffer0, buffer1, samples);
 		else
+			SoundMixer::Advance(smp, samples);
+
+		if (smp.stream)
 		{
-			AdvanceWithPitch(smp, samples);
+			// release played ring buffer frames
+			auto frames = smp.samples_per_channel;
+			auto played = (smp.sample_pos + frames - sample_pos) % frames;
+			smp.playing = smp.stream->StreamConsume(played);
 		}
 
 		if (!smp.playing)
 			sstop.push_back(smp.id);
 	}
+
+	// saturate accumulated samples once
+	SoundMixer::Output(buffer0, buffer1, (stream_type*)stream, samples);
+
+	// pause fade is done after one buffer
+	samplers_fade = false;
 }
 
-void Sound::ProcessSamplerRemove()
+bool Sound::ProcessSamplerStream(Sampler & smp, unsigned samples)
 {
-	auto & sremove = samplers_update.front().sremove;
-	for (auto id : sremove)
+	// playback superseded by a newer one
+	if (!smp.stream->StreamActive(smp.stream_id))
 	{
-		assert(id < samplers.size());
-		RemoveItem(id, samplers, samplers_num);
+		smp.playing = false;
+		return false;
 	}
-	sremove.clear();
-}
 
-void Sound::ProcessSamplerAdd()
-{
-	auto & sadd = samplers_update.front().sadd;
-	for (const auto & sa : sadd)
+	// wait for the decoder to fill the ring buffer
+	if (!smp.stream_ready)
 	{
-		auto info = sa.buffer->GetInfo();
-		auto base_pitch = FRACTIONONE * info.frequency / deviceinfo.frequency;
-		auto samples_per_channel = info.samples / info.channels;
-
-		Sampler smp;
-		smp.buffer = sa.buffer;
-		smp.samples_per_channel = samples_per_channel;
-		smp.sample_pos = sa.offset;
+		unsigned frame;
+		if (!smp.stream->StreamReady(smp.stream_id, frame))
+			return false;
+
+		smp.sample_pos = frame;
 		smp.sample_pos_remainder = 0;
-		smp.pitch = base_pitch;
-		smp.gain1 = 0;
-		smp.gain2 = 0;
-		smp.last_gain1 = 0;
-		smp.last_gain2 = 0;
-		smp.playing = true;
-		smp.loop = sa.loop;
-
-		if (sa.id == -1)
-		{
-			AddItem(smp, samplers, samplers_num);
-		}
-		else
-		{
-			smp.id = samplers[sa.id].id;
-			samplers[sa.id] = smp;
-		}
+		smp.stream_ready = true;
+	}
+
+	// hold playback while the decoder is behind, frames past write are stale
+	// resampling reads up to the frame after the last sample position
+	unsigned long long frames = smp.sample_pos_remainder + (unsigned long long)(samples - 1) * smp.pitch;
+	return smp.stream->StreamAvailable() >= (frames >> FRACTIONBITS) + 2;
+}
+
+void Sound::ProcessSamplerAdd(const SamplerCommand & sc)
+{
+	auto info = sc.buffer->GetInfo();
+	auto base_pitch = FRACTIONONE * info.frequency / deviceinfo.frequency;
+	auto samples_per_channel = info.samples / info.channels;
+
+	Sampler smp;
+	smp.data = sc.buffer->GetRawBuffer();
+	smp.channels = info.channels;
+	smp.samples_per_channel = samples_per_channel;
+	smp.sample_pos = sc.offset;
+	smp.sample_pos_remainder = 0;
+	smp.pitch = base_pitch;
+	smp.gain1 = 0;
+	smp.gain2 = 0;
+	smp.last_gain1 = 0;
+	smp.last_gain2 = 0;
+	smp.playing = true;
+	smp.loop = sc.loop;
+	smp.stream = 0;
+	smp.stream_id = 0;
+	smp.stream_ready = false;
+
+	if (sc.buffer->GetStreaming())
+	{
+		// streamed buffer ring is played in a loop
+		smp.stream = sc.buffer;
+		smp.stream_id = sc.buffer->StreamStart(sc.loop);
+		smp.loop = true;
+	}
+
+	if (sc.id == -1)
+	{
+		AddItem(smp, samplers, samplers_num);
+	}
+	else
+	{
+		smp.id = samplers[sc.id].id;
+		samplers[sc.id] = smp;
 	}
-	sadd.clear();
 }
 
 void Sound::SetSourceChanges()
@@ -630,150 +772,150 @@ void Sound::SetSourceChanges()
 	sources_stop.swap_back();
 }
 
-template <typename stream_type, typename buffer_type, int vmin, int vmax>
+template <typename stream_type, typename buffer_type>
 void Sound::CallbackStereo(void * myself, unsigned char stream[], int len)
 {
 	assert(this == myself);
 	assert(initdone);
 	assert(len > 0);
 
-	GetSamplerChanges();
-
-	ProcessSamplerAdd();
-
-	ProcessSamplerUpdate();
+	ProcessSamplerCommands();
 
-	ProcessSamplers<stream_type, buffer_type, vmin, vmax>(stream, len);
-
-	ProcessSamplerRemove();
+	ProcessSamplers<stream_type, buffer_type>(stream, len);
 
 	SetSourceChanges();
 }
 
 void Sound::CallbackWrapper(void * sound, unsigned char stream[], int len)
 {
+	PROFILE_SCOPE("sound mix");
+
 	auto bytespersample = static_cast<Sound*>(sound)->deviceinfo.bytespersample;
 	if (bytespersample == 2)
 	{
-		static_cast<Sound*>(sound)->CallbackStereo<short, int, -32768, 32767>(sound, stream, len);
+		static_cast<Sound*>(sound)->CallbackStereo<short, int>(sound, stream, len);
 	}
 	else if (bytespersample == 4)
 	{
-		static_cast<Sound*>(sound)->CallbackStereo<float, float, -1, 1>(sound, stream, len);
+		static_cast<Sound*>(sound)->CallbackStereo<float, float>(sound, stream, len);
 	}
 }
 
-template <typename T0, typename T1> T0 Cast(T1 v);
-template <> inline float Cast<float, unsigned>(unsigned v) { return v * (1.0f / FRACTIONONE); }
-template <> inline float Cast<float, int>(int v) { return v * (1.0f / FRACTIONONE); }
-template <> inline unsigned Cast<unsigned, float>(float v) { return v * FRACTIONONE; }
-template <> inline int Cast<int, float>(float v) { return v * FRACTIONONE; }
-template <> inline unsigned Cast<unsigned, int>(int v) { return v; }
-template <> inline int Cast<int, unsigned>(unsigned v) { return v; }
-template <> inline int Cast<int, int>(int v) { return v; }
-
-template <typename T> T Scale(T v, T s);
-template <> inline int Scale<int>(int v, int s) { return v * s / FRACTIONONE; }
-template <> inline float Scale<float>(float v, float s) { return v * s; }
-
-template <typename sample_type, typename buffer_type>
-void Sound::SampleAndAdvanceWithPitch(Sampler & sampler, buffer_type chan1[], buffer_type chan2[], unsigned len)
-{
-	assert(sampler.buffer);
-	assert(sampler.playing);
-
-	// start samlping
-	auto channels = sampler.buffer->GetInfo().channels;
-	auto chaninc = channels - 1;
-	auto samples = sampler.samples_per_channel * channels;
-	auto nr = sampler.sample_pos_remainder;
-	auto ni = sampler.sample_pos;
-
-	auto buf = (const sample_type *)sampler.buffer->GetRawBuffer();
-	auto gain1 = Cast<buffer_type>(sampler.gain1);
-	auto gain2 = Cast<buffer_type>(sampler.gain2);
-	auto last_gain1 = Cast<buffer_type>(sampler.last_gain1);
-	auto last_gain2 = Cast<buffer_type>(sampler.last_gain2);
-	auto max_gain_delta = Cast<buffer_type>(MAXGAINDELTA);
-
-	for (unsigned i = 0; i < len; ++i)
+// decodes constant frames while it has budget, waits for more like a slow decoder
+struct StubDecoder : SoundDecoder
+{
+	std::atomic<unsigned> & budget;
+	std::atomic<float> & value;
+	std::atomic<bool> & quit;
+
+	StubDecoder(std::atomic<unsigned> & nbudget, std::atomic<float> & nvalue, std::atomic<bool> & nquit) :
+		budget(nbudget), value(nvalue), quit(nquit)
 	{
-		// limit gain change rate
-		auto gain_delta1 = gain1 - last_gain1;
-		auto gain_delta2 = gain2 - last_gain2;
-		gain_delta1 = Clamp(gain_delta1, -max_gain_delta, max_gain_delta);
-		gain_delta2 = Clamp(gain_delta2, -max_gain_delta, max_gain_delta);
-		last_gain1 += gain_delta1;
-		last_gain2 += gain_delta2;
-
-		if (ni >= sampler.samples_per_channel && !sampler.loop)
-		{
-			// finish playing the buffer if looping is not enabled
-			chan1[i] = chan2[i] = 0;
-			sampler.playing = false;
-		}
-		else
-		{
-			// the sample to the left of the playback position, channel 0 and 1
-			auto id1 = (ni * channels) % samples;
-			buffer_type samp10 = buf[id1];
-			buffer_type samp11 = buf[id1 + chaninc];
-
-			// the sample to the right of the playback position, channel 0 and 1
-			auto id2 = (id1 + channels) % samples;
-			buffer_type samp20 = buf[id2];
-			buffer_type samp21 = buf[id2 + chaninc];
-
-			// interpolated sample at playback position
-			auto f = Cast<buffer_type>(nr);
-			auto val1 = samp10 + Scale(samp20 - samp10, f);
-			auto val2 = samp11 + Scale(samp21 - samp11, f);
-
-			// fill output buffers
-			chan1[i] = Scale(val1, last_gain1);
-			chan2[i] = Scale(val2, last_gain2);
-
-			// advance playback position
-			nr += sampler.pitch;
-			ni += nr >> FRACTIONBITS;
-			nr &= FRACTIONMASK;
-		}
+		// ctor
 	}
 
-	sampler.last_gain1 = Cast<unsigned>(last_gain1);
-	sampler.last_gain2 = Cast<unsigned>(last_gain2);
-	sampler.sample_pos = ni;
-	sampler.sample_pos_remainder = nr;
-
-	// loop buffer
-	if (!sampler.loop)
+	bool Rewind() override
 	{
-		sampler.playing = (sampler.sample_pos < sampler.samples_per_channel);
+		return true;
 	}
-	else
+
+	unsigned Decode(char buffer[], unsigned frames) override
 	{
-		sampler.sample_pos = sampler.sample_pos % sampler.samples_per_channel;
+		while (budget == 0 && !quit)
+			SDL_Delay(1);
+
+		unsigned decoded = Min(frames, budget.load());
+		budget -= decoded;
+		float * samples = (float *)buffer;
+		std::fill(samples, samples + decoded * 2, value.load());
+		return decoded;
 	}
-}
+};
 
-void Sound::AdvanceWithPitch(Sampler & sampler, unsigned len)
+// pulls float samples directly from the mixer callback
+struct StubOutput : SoundOutput
 {
-	// advance playback position
-	auto nr = sampler.sample_pos_remainder;
-	auto ni = sampler.sample_pos;
-	nr += sampler.pitch * len;
-	ni += nr >> FRACTIONBITS;
-	nr &= FRACTIONMASK;
-	sampler.sample_pos = ni;
-	sampler.sample_pos_remainder = nr;
+	Callback callback;
+	void * userdata;
 
-	// loop buffer
-	if (!sampler.loop)
+	bool Open(SoundInfo & info, Callback ncallback, void * nuserdata, std::ostream &, std::ostream &) override
 	{
-		sampler.playing = (sampler.sample_pos < sampler.samples_per_channel);
+		info.bytespersample = 4;
+		callback = ncallback;
+		userdata = nuserdata;
+		return true;
 	}
-	else
+
+	void Pause(bool) override {}
+
+	void Close() override {}
+
+	// mix frames, return peak amplitude
+	float Pull(unsigned frames)
 	{
-		sampler.sample_pos = sampler.sample_pos % sampler.samples_per_channel;
+		std::vector<float> samples(frames * 2);
+		callback(userdata, (unsigned char *)samples.data(), samples.size() * sizeof(float));
+		float peak = 0;
+		for (float sample : samples)
+			peak = std::max(peak, std::abs(sample));
+		return peak;
 	}
+};
+
+QT_TEST(sound_stream_test)
+{
+	std::atomic<unsigned> budget(SoundBuffer::stream_frames);
+	std::atomic<float> value(0.5f);
+	std::atomic<bool> quit(false);
+	const unsigned frames = 512;
+	const unsigned wait = 1000;
+
+	std::ostringstream log;
+	auto output = new StubOutput();
+	Sound sound;
+	QT_CHECK(sound.Init(std::unique_ptr<SoundOutput>(output), frames, log, log));
+
+	auto buffer = std::make_shared<SoundBuffer>();
+	std::unique_ptr<SoundDecoder> decoder(new StubDecoder(budget, value, quit));
+	QT_CHECK(buffer->Load(std::move(decoder), 44100 * 100, SoundInfo(0, 44100, 2, 4)));
+	size_t id = sound.AddSource(buffer, 0, false, true);
+	sound.SetSourceGain(id, 1);
+	sound.Update(false);
+
+	// playback starts once the ring has been filled
+	float peak = 0;
+	for (unsigned i = 0; i < wait && peak == 0; ++i)
+	{
+		peak = output->Pull(frames);
+		if (peak == 0)
+			SDL_Delay(1);
+	}
+	QT_CHECK_GREATER(peak, 0);
+	const float gain = output->Pull(frames) / 0.5f;
+	QT_CHECK_GREATER(gain, 0);
+
+	// decoder falls behind, stale ring frames must not be replayed
+	unsigned played = 2;
+	while (output->Pull(frames) > 0 && played < wait)
+		played++;
+	QT_CHECK_LESS(played * frames, SoundBuffer::stream_frames + frames);
+	for (unsigned i = 0; i < 4; ++i)
+		QT_CHECK_EQUAL(output->Pull(frames), 0);
+
+	// playback resumes with new frames
+	value = 0.25f;
+	budget = SoundBuffer::stream_frames;
+	peak = 0;
+	for (unsigned i = 0; i < wait && peak == 0; ++i)
+	{
+		peak = output->Pull(frames);
+		if (peak == 0)
+			SDL_Delay(1);
+	}
+	QT_CHECK_GREATER(peak, 0);
+	output->Pull(frames);
+	QT_CHECK_CLOSE(output->Pull(frames), 0.25f * gain, 1E-4f);
+
+	// release decoder thread
+	quit = true;
 }
@@ -22,7 +22,11 @@
 
 #include "soundbuffer.h"
 #include "soundfilter.h"
+#include "soundoutput.h"
+#include "soundmixer.h"
+#include "soundstreamer.h"
 #include "tripplebuffer.h"
+#include "spscqueue.h"
 #include "mathvector.h"
 #include "quaternion.h"
 
@@ -40,6 +44,9 @@ public:
 	// init sound device
 	bool Init(unsigned short buffersize, std::ostream & info, std::ostream & error);
 
+	// init sound using given output backend
+	bool Init(std::unique_ptr<SoundOutput> output, unsigned short buffersize, std::ostream & info, std::ostream & error);
+
 	// get device info
 	const SoundInfo & GetDeviceInfo() const;
 
@@ -55,6 +62,10 @@ public:
 	// attenuation: y = a * (x - b)^c + d
 	void SetAttenuation(const float attenuation[4]);
 
+	// check if a sphere at position is within audible distance of the listener
+	// sources beyond it are kept as virtual voices, without any per source math
+	bool GetAudible(float x, float y, float z, float radius) const;
+
 	size_t AddSource(std::shared_ptr<SoundBuffer> buffer, float offset, bool is3d, bool loop);
 
 	void RemoveSource(size_t id);
@@ -82,12 +93,18 @@ public:
 	// commit state changes
 	void Update(bool pause);
 
+	// print command queue statistics
+	void PrintProfilingInfo(std::ostream & out) const;
+
 private:
+	std::unique_ptr<SoundOutput> output;
 	SoundInfo deviceinfo;
 	Vec3 listener_pos;
 	Vec3 listener_vel;
 	Quat listener_rot;
 	float attenuation[4];
+	float audible_distance;
+	float audible_distance2;
 	float sound_volume;
 	bool initdone;
 	bool disable;
@@ -99,6 +116,11 @@ private:
 		int gain, id;
 	};
 
+	struct SamplerSet
+	{
+		unsigned gain1, gain2, pitch;
+	};
+
 	struct Source
 	{
 		std::shared_ptr<SoundBuffer> buffer;
@@ -110,60 +132,60 @@ private:
 		bool is3d;
 		bool playing;
 		bool loop;
+		bool audible; // in sources_audible
 		size_t id;
-	};
-
-	struct Sampler
-	{
-		const SoundBuffer * buffer;
-		unsigned samples_per_channel;
-		unsigned sample_pos;
-		unsigned sample_pos_remainder;
-		unsigned pitch;
-		unsigned gain1;
-		unsigned gain2;
-		unsigned last_gain1;
-		unsigned last_gain2;
-		bool playing;
-		bool loop;
-		size_t id;
-	};
 
-	// message structs
-	struct SamplerAdd
-	{
-		const SoundBuffer * buffer;
-		unsigned offset;
-		bool loop;
-		int id;
+		// sampler state to be sent and last sent to the sound thread
+		SamplerSet set;
+		SamplerSet sent;
 	};
 
-	struct SamplerSet
+	struct Sampler : SoundMixer::Voice
 	{
-		unsigned gain1, gain2, pitch;
+		const SoundBuffer * stream;
+		unsigned stream_id;
+		bool stream_ready;
+		size_t id;
 	};
 
-	struct SamplersUpdate
+	// sound thread command, sources and samplers are kept in lockstep
+	// by applying adds and removes in the same order on both threads
+	struct SamplerCommand
 	{
-		std::vector<SamplerSet> sset;
-		std::vector<SamplerAdd> sadd;
-		std::vector<size_t> sremove;
-		size_t id;
-		bool pause;
-		bool empty() const;
+		enum Type { ADD, REMOVE, SET, PAUSE } type;
+		const SoundBuffer * buffer; // add
+		unsigned offset; // add
+		SamplerSet set; // set
+		int id; // add: -1 new sampler, else reset sampler, remove, set
+		bool loop; // add
+		bool pause; // pause
 	};
 
 	// sound sources state
 	std::vector<SourceActive> sources_active;
-	std::vector<size_t> sources_remove;
 	std::vector<Source> sources;
+	std::vector<size_t> sources_audible; // sources processed per update
 	size_t max_active_sources;
 	size_t sources_num;
-	size_t update_id;
 	bool sources_pause;
 
+	// commands that did not fit into the queue, sent in order next update
+	std::vector<SamplerCommand> commands_pending;
+
+	// removed source buffers, released once the sound thread caught up
+	std::vector<std::shared_ptr<SoundBuffer> > buffers_release;
+
+	// command queue statistics, sent during last update
+	unsigned commands_sent;
+	unsigned commands_dropped;
+	unsigned queue_depth;
+	unsigned queue_depth_max;
+
+	// streamed sound buffers decoder
+	SoundStreamer streamer;
+
 	// sound thread message system
-	TrippleBuffer<SamplersUpdate> samplers_update;
+	SpscQueue<SamplerCommand> commands;
 	TrippleBuffer<std::vector<size_t> > sources_stop;
 
 	// sound thread state
@@ -174,9 +196,13 @@ private:
 	bool samplers_fade;
 
 	// main thread methods
+	void PushCommand(const SamplerCommand & command);
+
+	void FlushCommands();
+
 	void ProcessSourceStop();
 
-	void ProcessSourceRemove();
+	void AddAudibleSource(size_t id);
 
 	void ProcessSources();
 
@@ -185,28 +211,21 @@ private:
 	void SetSamplerChanges();
 
 	// sound thread methods
-	void GetSamplerChanges();
-
-	void ProcessSamplerUpdate();
+	void ProcessSamplerCommands();
 
-	template <typename stream_type, typename buffer_type, int vmin, int vmax>
-	void ProcessSamplers(unsigned char stream[], unsigned len);
+	void ProcessSamplerAdd(const SamplerCommand & command);
 
-	void ProcessSamplerRemove();
+	bool ProcessSamplerStream(Sampler & sampler, unsigned samples);
 
-	void ProcessSamplerAdd();
+	template <typename stream_type, typename buffer_type>
+	void ProcessSamplers(unsigned char stream[], unsigned len);
 
 	void SetSourceChanges();
 
-	template <typename stream_type, typename buffer_type, int vmin, int vmax>
+	template <typename stream_type, typename buffer_type>
 	void CallbackStereo(void * sound, unsigned char stream[], int len);
 
 	static void CallbackWrapper(void * sound, unsigned char stream[], int len);
-
-	template <typename sample_type, typename buffer_type>
-	static void SampleAndAdvanceWithPitch(Sampler & sampler, buffer_type chan1[], buffer_type chan2[], unsigned len);
-
-	static void AdvanceWithPitch(Sampler & sampler, unsigned len);
 };
 
 #endif
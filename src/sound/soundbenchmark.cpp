@@ -0,0 +1,103 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "soundbenchmark.h"
+#include "sound.h"
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <vector>
+
+// mixing time in seconds per second of audio
+static double MixCost(
+	const std::vector<short> & data,
+	unsigned bytespersample,
+	unsigned voices,
+	unsigned frames,
+	std::ostream & error_output)
+{
+	std::ostringstream info_output;
+	auto output = new SoundOutputFile(std::string(), SoundOutputFile::MANUAL, bytespersample);
+
+	Sound sound;
+	if (!sound.Init(std::unique_ptr<SoundOutput>(output), 512, info_output, error_output))
+		return 0;
+
+	const SoundInfo & deviceinfo = sound.GetDeviceInfo();
+	auto buffer = std::make_shared<SoundBuffer>();
+	buffer->Load(data.data(), SoundInfo(data.size(), 44100, 2, 2), deviceinfo);
+
+	// spread voice offsets and pitches to exercise the resampler
+	sound.SetMaxActiveSources(voices);
+	for (unsigned i = 0; i < voices; ++i)
+	{
+		float offset = (i * 37 % 100) * 0.01f;
+		size_t id = sound.AddSource(buffer, offset, false, true);
+		sound.SetSourceGain(id, 1.0f / voices);
+		sound.SetSourcePitch(id, 0.5f + (i % 16) * 0.1f);
+	}
+	sound.Update(false);
+
+	// add samplers and fade in voices
+	output->Process(deviceinfo.samples * 2);
+
+	auto start = std::chrono::steady_clock::now();
+	output->Process(frames);
+	auto end = std::chrono::steady_clock::now();
+
+	double time = std::chrono::duration<double>(end - start).count();
+	return time * deviceinfo.frequency / frames;
+}
+
+void SoundBenchmark(std::ostream & info_output, std::ostream & error_output)
+{
+	// one second stereo test tone
+	const unsigned frequency = 44100;
+	std::vector<short> data(frequency * 2);
+	for (unsigned i = 0; i < frequency; ++i)
+	{
+		short value = 16000 * std::sin(i * (2 * M_PI * 440 / frequency));
+		data[i * 2] = value;
+		data[i * 2 + 1] = -value;
+	}
+
+	const unsigned frames = frequency * 4;
+	const unsigned voices[] = {1, 16, 64, 256};
+	const unsigned formats[] = {2, 4};
+	for (auto bytespersample : formats)
+	{
+		info_output << "Sound mixer, " << (bytespersample == 4 ? "float" : "16 bit") << " path:" << std::endl;
+		for (auto count : voices)
+		{
+			double cost = MixCost(data, bytespersample, count, frames, error_output);
+			if (cost <= 0)
+				return;
+
+			// microseconds of mixing per voice per millisecond of audio
+			double voice_cost = cost * 1E3 / count;
+			info_output << "  " << count << " voices: " <<
+				cost * 1E3 << " ms per s of audio, " <<
+				voice_cost << " us per voice per ms of audio, " <<
+				unsigned(count / cost) << " voices per core" << std::endl;
+		}
+	}
+}
@@ -0,0 +1,31 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _SOUNDBENCHMARK_H
+#define _SOUNDBENCHMARK_H
+
+#include <iosfwd>
+
+/// Measure mixer throughput for the 16 bit integer and float mixing paths.
+/// Mixes looping voices with varying pitch into the null sound output, no
+/// audio device is needed. Reports the mixing cost per voice and the number
+/// of voices one core can mix in real time.
+void SoundBenchmark(std::ostream & info_output, std::ostream & error_output);
+
+#endif // _SOUNDBENCHMARK_H
@@ -19,6 +19,7 @@
 
 #include "soundbuffer.h"
 #include "endian_utility.h"
+#include "minmax.h"
 
 #ifdef __APPLE__
 #define __MACOSX__
@@ -27,10 +28,69 @@
 #include <vorbis/vorbisfile.h>
 #endif
 
+#include <atomic>
+#include <cassert>
 #include <fstream>
 #include <cstdio>
 #include <cstring>
 
+// Ring buffer positions are absolute frame counts, the ring index is
+// position % ring frames. The decoder writes frames up to read + ring frames,
+// the sound thread reads frames from read up to write and releases them after playing.
+struct SoundBuffer::Stream
+{
+	std::unique_ptr<SoundDecoder> decoder;
+	unsigned long long frames; // stream length
+	unsigned long long start; // first frame of current playback
+	std::atomic<unsigned long long> read;
+	std::atomic<unsigned long long> write;
+	std::atomic<unsigned> request; // playback id requested by sound thread
+	std::atomic<unsigned> served; // playback id the ring has been filled for
+	std::atomic<bool> loop_request;
+	bool loop;
+	bool end;
+
+	Stream() : frames(0), start(0), read(0), write(0), request(0), served(0), loop_request(false), loop(false), end(true) {}
+};
+
+struct OggDecoder : SoundDecoder
+{
+	OggVorbis_File file;
+	unsigned channels;
+	unsigned bytespersample;
+
+	OggDecoder() : channels(0), bytespersample(0) {}
+
+	~OggDecoder() { ov_clear(&file); }
+
+	bool Rewind() override
+	{
+		return ov_pcm_seek(&file, 0) == 0;
+	}
+
+	unsigned Decode(char buffer[], unsigned frames) override
+	{
+		int bitstream;
+		if (bytespersample == 2)
+		{
+			const unsigned framesize = channels * bytespersample;
+			long bytes = ov_read(&file, buffer, frames * framesize, 0, 2, 1, &bitstream);
+			return (bytes > 0) ? bytes / framesize : 0;
+		}
+
+		float ** pcm;
+		long samples = ov_read_float(&file, &pcm, frames, &bitstream);
+		unsigned decoded = (samples > 0) ? samples : 0;
+		float * fbuffer = (float *)buffer;
+		for (unsigned i = 0; i < decoded; ++i)
+		{
+			for (unsigned c = 0; c < channels; ++c)
+				fbuffer[i * channels + c] = pcm[c][i];
+		}
+		return decoded;
+	}
+};
+
 SoundBuffer::SoundBuffer() :
 	info(0, 0, 0, 0),
 	loaded(false),
@@ -57,13 +117,159 @@ bool SoundBuffer::Load(const std::string & filename, const SoundInfo & sound_dev
 	}
 }
 
+bool SoundBuffer::Load(const short data[], const SoundInfo & data_info, const SoundInfo & sound_device_info)
+{
+	if (loaded)
+		Unload();
+
+	name.clear();
+
+	unsigned int samples = data_info.samples;
+	if (sound_device_info.bytespersample == 4)
+	{
+		float * sound_buffer_float = new float[samples];
+		for (unsigned int i = 0; i < samples; i++)
+		{
+			sound_buffer_float[i] = data[i] * (1.0f / 32767);
+		}
+		sound_buffer = (char*)sound_buffer_float;
+	}
+	else
+	{
+		short * sound_buffer_short = new short[samples];
+		memcpy(sound_buffer_short, data, samples * sizeof(short));
+		sound_buffer = (char*)sound_buffer_short;
+	}
+
+	unsigned int bytespersample = (sound_device_info.bytespersample == 4) ? 4 : 2;
+	info = SoundInfo(samples, data_info.frequency, data_info.channels, bytespersample);
+	loaded = true;
+	return true;
+}
+
+bool SoundBuffer::Load(std::unique_ptr<SoundDecoder> decoder, unsigned long long frames, const SoundInfo & decoder_info)
+{
+	if (loaded)
+		Unload();
+
+	name.clear();
+
+	if (decoder_info.bytespersample != 2 && decoder_info.bytespersample != 4)
+		return false;
+
+	info = SoundInfo(stream_frames * decoder_info.channels, decoder_info.frequency, decoder_info.channels, decoder_info.bytespersample);
+	unsigned int size = info.samples * info.bytespersample;
+	sound_buffer = new char[size];
+	memset(sound_buffer, 0, size);
+	stream.reset(new Stream());
+	stream->decoder = std::move(decoder);
+	stream->frames = frames;
+	loaded = true;
+	return true;
+}
+
 void SoundBuffer::Unload()
 {
+	stream.reset();
 	if (loaded && sound_buffer)
 		delete [] sound_buffer;
 	sound_buffer = 0;
 }
 
+unsigned SoundBuffer::StreamStart(bool loop) const
+{
+	assert(stream);
+	stream->loop_request.store(loop, std::memory_order_relaxed);
+	return stream->request.fetch_add(1, std::memory_order_release) + 1;
+}
+
+bool SoundBuffer::StreamActive(unsigned id) const
+{
+	assert(stream);
+	return stream->request.load(std::memory_order_relaxed) == id;
+}
+
+bool SoundBuffer::StreamReady(unsigned id, unsigned & frame) const
+{
+	assert(stream);
+	if (stream->served.load(std::memory_order_acquire) != id)
+		return false;
+
+	frame = stream->start % stream_frames;
+	return true;
+}
+
+unsigned long long SoundBuffer::StreamAvailable() const
+{
+	assert(stream);
+	auto write = stream->write.load(std::memory_order_acquire);
+	return write - stream->read.load(std::memory_order_relaxed);
+}
+
+bool SoundBuffer::StreamConsume(unsigned frames) const
+{
+	assert(stream);
+	auto read = stream->read.load(std::memory_order_relaxed) + frames;
+	assert(read <= stream->write.load(std::memory_order_relaxed));
+	stream->read.store(read, std::memory_order_release);
+	return stream->loop || read < stream->start + stream->frames;
+}
+
+void SoundBuffer::StreamDecode() const
+{
+	assert(stream);
+	Stream & s = *stream;
+	const unsigned framesize = info.channels * info.bytespersample;
+
+	// restart decoding at current read position
+	unsigned request = s.request.load(std::memory_order_acquire);
+	bool restart = (request != s.served.load(std::memory_order_relaxed));
+	if (restart)
+	{
+		s.loop = s.loop_request.load(std::memory_order_relaxed);
+		s.end = !s.decoder->Rewind();
+		s.start = s.read.load(std::memory_order_acquire);
+		s.write.store(s.start, std::memory_order_relaxed);
+	}
+
+	auto write = s.write.load(std::memory_order_relaxed);
+	auto limit = s.read.load(std::memory_order_acquire) + stream_frames;
+	bool rewound = false;
+	while (write < limit)
+	{
+		unsigned pos = write % stream_frames;
+		unsigned count = Min<unsigned long long>(limit - write, stream_frames - pos);
+		char * buffer = sound_buffer + pos * framesize;
+		unsigned decoded = s.end ? 0 : s.decoder->Decode(buffer, count);
+
+		if (decoded == 0)
+		{
+			if (!s.end && s.loop && !rewound)
+			{
+				// continue from the start, once per fill to avoid spinning on empty streams
+				s.end = !s.decoder->Rewind();
+				rewound = true;
+				continue;
+			}
+
+			// pad with silence after the end of the stream
+			s.end = true;
+			memset(buffer, 0, count * framesize);
+			decoded = count;
+		}
+		else
+		{
+			rewound = false;
+		}
+
+		write += decoded;
+		s.write.store(write, std::memory_order_release);
+	}
+
+	if (restart)
+		s.served.store(request, std::memory_order_release);
+}
+
 bool SoundBuffer::LoadWAV(const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output)
 {
 	if (loaded)
@@ -251,11 +457,29 @@ bool SoundBuffer::LoadOGG(const std::string & filename, const SoundInfo & sound_
 		return false;
 	}
 
-	OggVorbis_File oggFile;
-	ov_open_callbacks(fp, &oggFile, NULL, 0, OV_CALLBACKS_DEFAULT);
+	std::unique_ptr<OggDecoder> ogg(new OggDecoder());
+	if (ov_open_callbacks(fp, &ogg->file, NULL, 0, OV_CALLBACKS_DEFAULT) < 0)
+	{
+		error_output << "Can't open ogg stream: " + filename << std::endl;
+		fclose(fp);
+		return false;
+	}
+	OggVorbis_File & oggFile = ogg->file;
 
 	vorbis_info * pInfo = ov_info(&oggFile, -1);
 	unsigned int samples = ov_pcm_total(&oggFile, -1);
+
+	// long files are decoded into a ring buffer while playing
+	if (samples > stream_min_seconds * pInfo->rate)
+	{
+		ogg->channels = pInfo->channels;
+		ogg->bytespersample = bytespersample;
+		SoundInfo ogg_info(0, pInfo->rate, pInfo->channels, bytespersample);
+		Load(std::move(ogg), samples, ogg_info);
+		name = filename;
+		return true;
+	}
+
 	info = SoundInfo(samples * pInfo->channels, pInfo->rate, pInfo->channels, bytespersample);
 
 	// allocate space
@@ -276,7 +500,7 @@ bool SoundBuffer::LoadOGG(const std::string & filename, const SoundInfo & sound_
 			{
 				error_output << "Error decoding " + filename << std::endl;
 				delete [] sound_buffer;
-				ov_clear(&oggFile);
+				sound_buffer = 0;
 				return false;
 			}
 			bufpos += bytes_read;
@@ -295,7 +519,7 @@ bool SoundBuffer::LoadOGG(const std::string & filename, const SoundInfo & sound_
 			{
 				error_output << "Error decoding " + filename << std::endl;
 				delete [] sound_buffer;
-				ov_clear(&oggFile);
+				sound_buffer = 0;
 				return false;
 			}
 
@@ -318,8 +542,7 @@ bool SoundBuffer::LoadOGG(const std::string & filename, const SoundInfo & sound_
 		}
 	}
 
-	// note: no need to call fclose(); ov_clear does it for us
-	ov_clear(&oggFile);
+	// note: no need to call fclose(); ov_clear does it for us, when ogg is released
 
 	loaded = true;
 	return true;
@@ -23,17 +23,44 @@
 #include "soundinfo.h"
 
 #include <iosfwd>
+#include <memory>
 #include <string>
 
+/// Streamed sound source, decodes interleaved frames in the sound buffer format.
+/// Called on the decoder thread only.
+class SoundDecoder
+{
+public:
+	virtual ~SoundDecoder() {}
+
+	/// continue decoding from the first frame, returns false on failure
+	virtual bool Rewind() = 0;
+
+	/// decode up to frames frames into buffer, returns frames decoded, 0 at the end
+	virtual unsigned Decode(char buffer[], unsigned frames) = 0;
+};
+
 class SoundBuffer
 {
 public:
+	/// ogg files longer than this are streamed instead of fully decoded at load
+	static const unsigned stream_min_seconds = 10;
+
+	/// stream ring buffer size in frames (samples per channel)
+	static const unsigned stream_frames = 1 << 15;
+
 	SoundBuffer();
 
 	~SoundBuffer();
 
 	bool Load(const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output);
 
+	/// load interleaved 16 bit samples described by data_info, converted to device format
+	bool Load(const short data[], const SoundInfo & data_info, const SoundInfo & sound_device_info);
+
+	/// stream frames of decoder_info format from decoder, decoder_info samples are ignored
+	bool Load(std::unique_ptr<SoundDecoder> decoder, unsigned long long frames, const SoundInfo & decoder_info);
+
 	void Unload();
 
 	const SoundInfo & GetInfo() const
@@ -61,12 +88,45 @@ public:
 		return loaded;
 	}
 
+	/// streamed buffers are decoded incrementally into a ring buffer
+	/// GetInfo and GetRawBuffer describe the ring buffer then
+	bool GetStreaming() const
+	{
+		return bool(stream);
+	}
+
+	/// Streamed playback, sound thread interface. A buffer has one active
+	/// playback, starting a new one supersedes the previous one.
+	/// Request playback from the start, returns playback id.
+	unsigned StreamStart(bool loop) const;
+
+	/// false if playback has been superseded
+	bool StreamActive(unsigned id) const;
+
+	/// true once the ring has been filled for playback id
+	/// frame is the ring position of the first sample
+	bool StreamReady(unsigned id, unsigned & frame) const;
+
+	/// number of decoded frames ahead of the played ones, frames past them are stale
+	unsigned long long StreamAvailable() const;
+
+	/// release played frames to the decoder
+	/// returns false once a non looping stream has been played
+	bool StreamConsume(unsigned frames) const;
+
+	/// Streamed playback, decoder thread interface.
+	/// Decode into free ring buffer space.
+	void StreamDecode() const;
+
 private:
 	SoundInfo info;
 	bool loaded;
 	char * sound_buffer;
 	std::string name;
 
+	struct Stream;
+	std::unique_ptr<Stream> stream;
+
 	bool LoadWAV(const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output);
 
 	bool LoadOGG(const std::string & filename, const SoundInfo & sound_device_info, std::ostream & error_output);
@@ -0,0 +1,481 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "soundmixer.h"
+#include "minmax.h"
+
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SOUNDMIXER_SSE
+#endif
+
+namespace SoundMixer
+{
+
+template <typename T> T Fraction(unsigned v);
+template <> inline int Fraction<int>(unsigned v) { return v; }
+template <> inline float Fraction<float>(unsigned v) { return v * (1.0f / FRACTIONONE); }
+
+inline unsigned Fixed(int v) { return v; }
+inline unsigned Fixed(float v) { return v * FRACTIONONE; }
+
+inline int Scale(int v, int s) { return v * s / FRACTIONONE; }
+inline float Scale(float v, float s) { return v * s; }
+
+// linear interpolation between samples i1 and i2
+template <typename sample_type, typename buffer_type>
+inline buffer_type Sample(const sample_type buf[], unsigned i1, unsigned i2, unsigned nr)
+{
+	buffer_type s1 = buf[i1];
+	buffer_type s2 = buf[i2];
+	return s1 + Scale(s2 - s1, Fraction<buffer_type>(nr));
+}
+
+inline void Step(unsigned pitch, unsigned & ni, unsigned & nr)
+{
+	nr += pitch;
+	ni += nr >> FRACTIONBITS;
+	nr &= FRACTIONMASK;
+}
+
+// mix n samples with constant gain, frame ni + 1 must not wrap around within the span
+template <typename sample_type, typename buffer_type>
+static void MixSpanScalar(
+	const sample_type buf[], unsigned channels, unsigned pitch,
+	unsigned & ni, unsigned & nr,
+	buffer_type gain1, buffer_type gain2,
+	buffer_type acc1[], buffer_type acc2[], unsigned n)
+{
+	const unsigned chaninc = channels - 1;
+	for (unsigned i = 0; i < n; ++i)
+	{
+		unsigned id1 = ni * channels;
+		unsigned id2 = id1 + channels;
+		acc1[i] += Scale(Sample<sample_type, buffer_type>(buf, id1, id2, nr), gain1);
+		acc2[i] += Scale(Sample<sample_type, buffer_type>(buf, id1 + chaninc, id2 + chaninc, nr), gain2);
+		Step(pitch, ni, nr);
+	}
+}
+
+#ifdef SOUNDMIXER_SSE
+// low 32 bits of the product, sse2 lacks pmulld
+static inline __m128i MulLo(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(
+		_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+		_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// v / FRACTIONONE rounded towards zero, matching integer division
+static inline __m128i DivFraction(__m128i v)
+{
+	__m128i bias = _mm_and_si128(_mm_srai_epi32(v, 31), _mm_set1_epi32(FRACTIONMASK));
+	return _mm_srai_epi32(_mm_add_epi32(v, bias), FRACTIONBITS);
+}
+
+static inline __m128i Sample(__m128i s1, __m128i s2, __m128i f)
+{
+	return _mm_add_epi32(s1, DivFraction(MulLo(_mm_sub_epi32(s2, s1), f)));
+}
+
+static inline __m128 Sample(__m128 s1, __m128 s2, __m128 f)
+{
+	return _mm_add_ps(s1, _mm_mul_ps(_mm_sub_ps(s2, s1), f));
+}
+
+// gather four interpolation sample pairs per channel, positions are advanced scalar
+template <typename sample_type, typename index_type>
+static inline void Gather(
+	const sample_type buf[], unsigned channels, unsigned pitch,
+	unsigned & ni, unsigned & nr,
+	index_type s10[4], index_type s20[4], index_type s11[4], index_type s21[4], int f[4])
+{
+	const unsigned chaninc = channels - 1;
+	for (unsigned k = 0; k < 4; ++k)
+	{
+		const sample_type * s = buf + ni * channels;
+		s10[k] = s[0];
+		s20[k] = s[channels];
+		s11[k] = s[chaninc];
+		s21[k] = s[channels + chaninc];
+		f[k] = nr;
+		Step(pitch, ni, nr);
+	}
+}
+#endif
+
+static void MixSpan(
+	const short buf[], unsigned channels, unsigned pitch,
+	unsigned & ni, unsigned & nr,
+	int gain1, int gain2,
+	int acc1[], int acc2[], unsigned n)
+{
+	unsigned i = 0;
+#ifdef SOUNDMIXER_SSE
+	const __m128i g1 = _mm_set1_epi32(gain1);
+	const __m128i g2 = _mm_set1_epi32(gain2);
+	for (; i + 4 <= n; i += 4)
+	{
+		alignas(16) int s10[4], s20[4], s11[4], s21[4], f[4];
+		Gather(buf, channels, pitch, ni, nr, s10, s20, s11, s21, f);
+
+		const __m128i fr = _mm_load_si128((const __m128i *)f);
+		__m128i v1 = Sample(_mm_load_si128((const __m128i *)s10), _mm_load_si128((const __m128i *)s20), fr);
+		__m128i v2 = Sample(_mm_load_si128((const __m128i *)s11), _mm_load_si128((const __m128i *)s21), fr);
+		v1 = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(acc1 + i)), DivFraction(MulLo(v1, g1)));
+		v2 = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(acc2 + i)), DivFraction(MulLo(v2, g2)));
+		_mm_storeu_si128((__m128i *)(acc1 + i), v1);
+		_mm_storeu_si128((__m128i *)(acc2 + i), v2);
+	}
+#endif
+	MixSpanScalar(buf, channels, pitch, ni, nr, gain1, gain2, acc1 + i, acc2 + i, n - i);
+}
+
+static void MixSpan(
+	const float buf[], unsigned channels, unsigned pitch,
+	unsigned & ni, unsigned & nr,
+	float gain1, float gain2,
+	float acc1[], float acc2[], unsigned n)
+{
+	unsigned i = 0;
+#ifdef SOUNDMIXER_SSE
+	const __m128 g1 = _mm_set1_ps(gain1);
+	const __m128 g2 = _mm_set1_ps(gain2);
+	const __m128 fs = _mm_set1_ps(1.0f / FRACTIONONE);
+	for (; i + 4 <= n; i += 4)
+	{
+		alignas(16) float s10[4], s20[4], s11[4], s21[4];
+		alignas(16) int f[4];
+		Gather(buf, channels, pitch, ni, nr, s10, s20, s11, s21, f);
+
+		const __m128 fr = _mm_mul_ps(_mm_cvtepi32_ps(_mm_load_si128((const __m128i *)f)), fs);
+		__m128 v1 = Sample(_mm_load_ps(s10), _mm_load_ps(s20), fr);
+		__m128 v2 = Sample(_mm_load_ps(s11), _mm_load_ps(s21), fr);
+		_mm_storeu_ps(acc1 + i, _mm_add_ps(_mm_loadu_ps(acc1 + i), _mm_mul_ps(v1, g1)));
+		_mm_storeu_ps(acc2 + i, _mm_add_ps(_mm_loadu_ps(acc2 + i), _mm_mul_ps(v2, g2)));
+	}
+#endif
+	MixSpanScalar(buf, channels, pitch, ni, nr, gain1, gain2, acc1 + i, acc2 + i, n - i);
+}
+
+template <typename sample_type, typename buffer_type>
+static void MixVoice(Voice & voice, buffer_type acc1[], buffer_type acc2[], unsigned len)
+{
+	assert(voice.data);
+	assert(voice.playing);
+	assert(voice.samples_per_channel > 0);
+
+	const auto buf = (const sample_type *)voice.data;
+	const unsigned channels = voice.channels;
+	const unsigned chaninc = channels - 1;
+	const unsigned frames = voice.samples_per_channel;
+	const unsigned pitch = voice.pitch;
+	const unsigned long long end = (unsigned long long)(frames - 1) << FRACTIONBITS;
+	unsigned ni = voice.sample_pos;
+	unsigned nr = voice.sample_pos_remainder;
+
+	const auto gain1 = Fraction<buffer_type>(voice.gain1);
+	const auto gain2 = Fraction<buffer_type>(voice.gain2);
+	const auto max_gain_delta = Fraction<buffer_type>(MAXGAINDELTA);
+	auto last_gain1 = Fraction<buffer_type>(voice.last_gain1);
+	auto last_gain2 = Fraction<buffer_type>(voice.last_gain2);
+
+	unsigned i = 0;
+	while (i < len)
+	{
+		if (ni >= frames)
+		{
+			// finish playing the buffer if looping is not enabled
+			if (!voice.loop)
+				break;
+			ni = ni % frames;
+		}
+
+		// number of samples before the right interpolation frame wraps around
+		unsigned long long pos = ((unsigned long long)ni << FRACTIONBITS) + nr;
+		unsigned n = 0;
+		if (pos < end)
+			n = (pitch > 0) ? Min<unsigned long long>(len - i, (end - pos + pitch - 1) / pitch) : len - i;
+
+		if (n > 0 && last_gain1 == gain1 && last_gain2 == gain2)
+		{
+			MixSpan(buf, channels, pitch, ni, nr, gain1, gain2, acc1 + i, acc2 + i, n);
+			i += n;
+			continue;
+		}
+
+		// limit gain change rate
+		last_gain1 += Clamp(gain1 - last_gain1, -max_gain_delta, max_gain_delta);
+		last_gain2 += Clamp(gain2 - last_gain2, -max_gain_delta, max_gain_delta);
+
+		// wrap around or gain slewing, one sample at a time
+		unsigned id1 = ni * channels;
+		unsigned id2 = ((ni + 1) % frames) * channels;
+		acc1[i] += Scale(Sample<sample_type, buffer_type>(buf, id1, id2, nr), last_gain1);
+		acc2[i] += Scale(Sample<sample_type, buffer_type>(buf, id1 + chaninc, id2 + chaninc, nr), last_gain2);
+		Step(pitch, ni, nr);
+		++i;
+	}
+
+	// keep slewing gain after the end of the buffer
+	for (; i < len; ++i)
+	{
+		last_gain1 += Clamp(gain1 - last_gain1, -max_gain_delta, max_gain_delta);
+		last_gain2 += Clamp(gain2 - last_gain2, -max_gain_delta, max_gain_delta);
+	}
+
+	voice.last_gain1 = Fixed(last_gain1);
+	voice.last_gain2 = Fixed(last_gain2);
+	voice.sample_pos = ni;
+	voice.sample_pos_remainder = nr;
+
+	// loop buffer
+	if (!voice.loop)
+	{
+		voice.playing = (voice.sample_pos < voice.samples_per_channel);
+	}
+	else
+	{
+		voice.sample_pos = voice.sample_pos % voice.samples_per_channel;
+	}
+}
+
+void Mix(Voice & voice, int acc1[], int acc2[], unsigned len)
+{
+	MixVoice<short>(voice, acc1, acc2, len);
+}
+
+void Mix(Voice & voice, float acc1[], float acc2[], unsigned len)
+{
+	MixVoice<float>(voice, acc1, acc2, len);
+}
+
+void Advance(Voice & voice, unsigned len)
+{
+	// advance playback position
+	auto nr = voice.sample_pos_remainder;
+	auto ni = voice.sample_pos;
+	nr += voice.pitch * len;
+	ni += nr >> FRACTIONBITS;
+	nr &= FRACTIONMASK;
+	voice.sample_pos = ni;
+	voice.sample_pos_remainder = nr;
+
+	// loop buffer
+	if (!voice.loop)
+	{
+		voice.playing = (voice.sample_pos < voice.samples_per_channel);
+	}
+	else
+	{
+		voice.sample_pos = voice.sample_pos % voice.samples_per_channel;
+	}
+}
+
+void Output(const int acc1[], const int acc2[], short stream[], unsigned len)
+{
+	unsigned i = 0;
+#ifdef SOUNDMIXER_SSE
+	for (; i + 4 <= len; i += 4)
+	{
+		// saturate to 16 bit and interleave channels
+		__m128i a = _mm_loadu_si128((const __m128i *)(acc1 + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(acc2 + i));
+		__m128i s = _mm_unpacklo_epi16(_mm_packs_epi32(a, a), _mm_packs_epi32(b, b));
+		_mm_storeu_si128((__m128i *)(stream + i * 2), s);
+	}
+#endif
+	for (; i < len; ++i)
+	{
+		stream[i * 2] = Clamp(acc1[i], -32768, 32767);
+		stream[i * 2 + 1] = Clamp(acc2[i], -32768, 32767);
+	}
+}
+
+void Output(const float acc1[], const float acc2[], float stream[], unsigned len)
+{
+	unsigned i = 0;
+#ifdef SOUNDMIXER_SSE
+	const __m128 vmin = _mm_set1_ps(-1.0f);
+	const __m128 vmax = _mm_set1_ps(1.0f);
+	for (; i + 4 <= len; i += 4)
+	{
+		__m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(acc1 + i), vmin), vmax);
+		__m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(acc2 + i), vmin), vmax);
+		_mm_storeu_ps(stream + i * 2, _mm_unpacklo_ps(a, b));
+		_mm_storeu_ps(stream + i * 2 + 4, _mm_unpackhi_ps(a, b));
+	}
+#endif
+	for (; i < len; ++i)
+	{
+		stream[i * 2] = Clamp(acc1[i], -1.0f, 1.0f);
+		stream[i * 2 + 1] = Clamp(acc2[i], -1.0f, 1.0f);
+	}
+}
+
+}
+
+#include "unittest.h"
+
+#include <cstdlib>
+#include <vector>
+
+// per sample scalar resampler the mixer kernels are tested against
+template <typename sample_type, typename buffer_type>
+static void MixReference(SoundMixer::Voice & voice, buffer_type acc1[], buffer_type acc2[], unsigned len)
+{
+	using namespace SoundMixer;
+	auto channels = voice.channels;
+	auto chaninc = channels - 1;
+	auto samples = voice.samples_per_channel * channels;
+	auto nr = voice.sample_pos_remainder;
+	auto ni = voice.sample_pos;
+
+	auto buf = (const sample_type *)voice.data;
+	auto gain1 = Fraction<buffer_type>(voice.gain1);
+	auto gain2 = Fraction<buffer_type>(voice.gain2);
+	auto last_gain1 = Fraction<buffer_type>(voice.last_gain1);
+	auto last_gain2 = Fraction<buffer_type>(voice.last_gain2);
+	auto max_gain_delta = Fraction<buffer_type>(MAXGAINDELTA);
+
+	for (unsigned i = 0; i < len; ++i)
+	{
+		last_gain1 += Clamp(gain1 - last_gain1, -max_gain_delta, max_gain_delta);
+		last_gain2 += Clamp(gain2 - last_gain2, -max_gain_delta, max_gain_delta);
+		if (ni >= voice.samples_per_channel && !voice.loop)
+			continue;
+
+		auto id1 = (ni * channels) % samples;
+		auto id2 = (id1 + channels) % samples;
+		acc1[i] += Scale(Sample<sample_type, buffer_type>(buf, id1, id2, nr), last_gain1);
+		acc2[i] += Scale(Sample<sample_type, buffer_type>(buf, id1 + chaninc, id2 + chaninc, nr), last_gain2);
+		Step(voice.pitch, ni, nr);
+	}
+
+	voice.last_gain1 = Fixed(last_gain1);
+	voice.last_gain2 = Fixed(last_gain2);
+	voice.sample_pos = ni;
+	voice.sample_pos_remainder = nr;
+	if (!voice.loop)
+		voice.playing = (voice.sample_pos < voice.samples_per_channel);
+	else
+		voice.sample_pos = voice.sample_pos % voice.samples_per_channel;
+}
+
+// returns max absolute output difference, -1 if voice states diverge
+template <typename sample_type, typename buffer_type>
+static double MixTest(const std::vector<sample_type> & data, double scale)
+{
+	const unsigned channels[] = {1, 2};
+	const unsigned pitches[] = {0, 1, 12345, 32768, 40000, 3 * 32768 + 7};
+	const unsigned positions[] = {0, 200, 499, 997};
+	const unsigned len = 133;
+	double max_error = 0;
+	for (auto ch : channels)
+	{
+		for (auto pitch : pitches)
+		{
+			for (auto pos : positions)
+			{
+				for (int loop = 0; loop < 2; ++loop)
+				{
+					SoundMixer::Voice v;
+					v.data = data.data();
+					v.channels = ch;
+					v.samples_per_channel = data.size() / ch;
+					v.sample_pos = pos % v.samples_per_channel;
+					v.sample_pos_remainder = 1234;
+					v.pitch = pitch;
+					v.gain1 = 20000;
+					v.gain2 = 30000;
+					v.last_gain1 = 0;
+					v.last_gain2 = 30000;
+					v.playing = true;
+					v.loop = loop;
+					SoundMixer::Voice r = v;
+
+					std::vector<buffer_type> a(len * 2, 0), b(len * 2, 0);
+					for (int n = 0; n < 8 && v.playing; ++n)
+					{
+						SoundMixer::Mix(v, &a[0], &a[len], len);
+						MixReference<sample_type>(r, &b[0], &b[len], len);
+						for (unsigned i = 0; i < len * 2; ++i)
+							max_error = std::max(max_error, std::abs(double(a[i]) - double(b[i])) * scale);
+
+						if (v.sample_pos != r.sample_pos ||
+							v.sample_pos_remainder != r.sample_pos_remainder ||
+							v.last_gain1 != r.last_gain1 ||
+							v.last_gain2 != r.last_gain2 ||
+							v.playing != r.playing)
+							return -1;
+					}
+				}
+			}
+		}
+	}
+	return max_error;
+}
+
+QT_TEST(soundmixer_test)
+{
+	std::vector<short> data16(1000);
+	std::vector<float> dataf(1000);
+	std::srand(1);
+	for (unsigned i = 0; i < data16.size(); ++i)
+	{
+		data16[i] = (std::rand() % 65536) - 32768;
+		dataf[i] = data16[i] * (1.0f / 32767);
+	}
+
+	// 16 bit path, errors in LSB
+	double error16 = MixTest<short, int>(data16, 1.0);
+	QT_CHECK(error16 >= 0 && error16 <= 1);
+
+	// float path, errors scaled to 16 bit LSB
+	double errorf = MixTest<float, float>(dataf, 32767.0);
+	QT_CHECK(errorf >= 0 && errorf <= 1);
+
+	// saturation and interleaving
+	{
+		int acc1[5] = {40000, -40000, 5, -5, 32767};
+		int acc2[5] = {-32769, 32768, 7, -7, -32768};
+		short out[10];
+		SoundMixer::Output(acc1, acc2, out, 5);
+		const short expect[10] = {32767, -32768, -32768, 32767, 5, 7, -5, -7, 32767, -32768};
+		bool match = true;
+		for (int i = 0; i < 10; ++i)
+			match = match && (out[i] == expect[i]);
+		QT_CHECK(match);
+	}
+	{
+		float acc1[5] = {2, -2, 0.5f, -0.5f, 1};
+		float acc2[5] = {-1.5f, 1.5f, 0.25f, -0.25f, -1};
+		float out[10];
+		SoundMixer::Output(acc1, acc2, out, 5);
+		const float expect[10] = {1, -1, -1, 1, 0.5f, 0.25f, -0.5f, -0.25f, 1, -1};
+		bool match = true;
+		for (int i = 0; i < 10; ++i)
+			match = match && (out[i] == expect[i]);
+		QT_CHECK(match);
+	}
+}
@@ -0,0 +1,69 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _SOUNDMIXER_H
+#define _SOUNDMIXER_H
+
+// playback position, pitch and gain fixed point format
+#define FRACTIONBITS (15)
+#define FRACTIONONE  (1<<FRACTIONBITS)
+#define FRACTIONMASK (FRACTIONONE-1)
+#define MAXGAINDELTA (FRACTIONONE * 173 / 44100) // 256 samples from min to max gain
+
+/// Resampling mixer kernels. Voices are linearly interpolated at their pitch,
+/// scaled by a rate limited gain and accumulated into per channel buffers,
+/// which are saturated once into the interleaved output stream.
+/// Uses SSE2 if available, output matches the scalar path within 1 LSB.
+namespace SoundMixer
+{
+
+struct Voice
+{
+	const void * data; ///< interleaved samples, 16 bit integer or float
+	unsigned channels; ///< 1 or 2
+	unsigned samples_per_channel;
+	unsigned sample_pos;
+	unsigned sample_pos_remainder;
+	unsigned pitch;
+	unsigned gain1;
+	unsigned gain2;
+	unsigned last_gain1;
+	unsigned last_gain2;
+	bool playing;
+	bool loop;
+};
+
+/// resample 16 bit voice, add len samples to channel accumulators and advance playback
+void Mix(Voice & voice, int acc1[], int acc2[], unsigned len);
+
+/// resample float voice, add len samples to channel accumulators and advance playback
+void Mix(Voice & voice, float acc1[], float acc2[], unsigned len);
+
+/// advance playback by len samples without mixing
+void Advance(Voice & voice, unsigned len);
+
+/// saturate channel accumulators into interleaved stereo stream
+void Output(const int acc1[], const int acc2[], short stream[], unsigned len);
+
+/// saturate channel accumulators into interleaved stereo stream
+void Output(const float acc1[], const float acc2[], float stream[], unsigned len);
+
+}
+
+#endif // _SOUNDMIXER_H
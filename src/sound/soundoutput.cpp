@@ -0,0 +1,391 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "soundoutput.h"
+#include "minmax.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_audio.h>
+#include <SDL2/SDL_thread.h>
+
+#include <cassert>
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+
+SoundOutputSdl::SoundOutputSdl() :
+	open(false)
+{
+	// ctor
+}
+
+SoundOutputSdl::~SoundOutputSdl()
+{
+	Close();
+}
+
+bool SoundOutputSdl::Open(
+	SoundInfo & info,
+	Callback callback,
+	void * userdata,
+	std::ostream & info_output,
+	std::ostream & error_output)
+{
+	assert(!open);
+
+	SDL_AudioSpec desired, obtained;
+
+	desired.freq = info.frequency;
+	desired.format = (info.bytespersample == 4) ? AUDIO_F32SYS : AUDIO_S16SYS;
+	desired.samples = info.samples;
+	desired.callback = callback;
+	desired.userdata = userdata;
+	desired.channels = info.channels;
+
+	if (SDL_OpenAudio(&desired, &obtained) < 0)
+	{
+		error_output << "Error opening audio device." << std::endl;
+		return false;
+	}
+	open = true;
+
+	unsigned frequency = obtained.freq;
+	unsigned channels = obtained.channels;
+	unsigned samples = obtained.samples;
+	unsigned bytespersample = 1;
+	if (obtained.format == AUDIO_S16SYS)
+	{
+		bytespersample = 2;
+	}
+	else if (obtained.format == AUDIO_F32SYS)
+	{
+		bytespersample = 4;
+	}
+
+	std::ostringstream dout;
+	dout << "Obtained audio device:" << std::endl;
+	dout << "Frequency: " << frequency << std::endl;
+	dout << "Format: " << obtained.format << std::endl;
+	dout << "Bits per sample: " << bytespersample * 8 << std::endl;
+	dout << "Channels: " << channels << std::endl;
+	dout << "Silence: " << (unsigned)obtained.silence << std::endl;
+	dout << "Samples: " << samples << std::endl;
+	dout << "Size: " << obtained.size;
+	info_output << dout.str() << std::endl;
+
+	if (((obtained.format != AUDIO_S16SYS) && (obtained.format != AUDIO_F32SYS)) ||
+		(obtained.channels != desired.channels))
+	{
+		error_output << "Audio device has unsupported format or channel count." << std::endl;
+		Close();
+		return false;
+	}
+
+	info = SoundInfo(samples, frequency, channels, bytespersample);
+	return true;
+}
+
+void SoundOutputSdl::Pause(bool value)
+{
+	if (open)
+		SDL_PauseAudio(value);
+}
+
+void SoundOutputSdl::Close()
+{
+	if (open)
+		SDL_CloseAudio();
+	open = false;
+}
+
+SoundOutputFile::SoundOutputFile(const std::string & filename, Mode mode, unsigned bytespersample) :
+	filename(filename),
+	mode(mode),
+	bytespersample(bytespersample),
+	file(0),
+	callback(0),
+	userdata(0),
+	info(0, 0, 0, 0),
+	frames(0),
+	data_size(0),
+	thread(0),
+	paused(true),
+	quit(false)
+{
+	// ctor
+}
+
+SoundOutputFile::~SoundOutputFile()
+{
+	Close();
+}
+
+bool SoundOutputFile::Open(
+	SoundInfo & ninfo,
+	Callback ncallback,
+	void * nuserdata,
+	std::ostream & info_output,
+	std::ostream & error_output)
+{
+	assert(!callback);
+
+	if (bytespersample != 2 && bytespersample != 4)
+	{
+		error_output << "Sound output with " << bytespersample << " bytes per sample not supported." << std::endl;
+		return false;
+	}
+
+	if (ninfo.samples == 0)
+	{
+		error_output << "Sound output buffer size of 0 frames not supported." << std::endl;
+		return false;
+	}
+
+	info = SoundInfo(ninfo.samples, ninfo.frequency, 2, bytespersample);
+	data_size = 0;
+	if (!filename.empty())
+	{
+		file = std::fopen(filename.c_str(), "wb");
+		if (!file)
+		{
+			error_output << "Error opening sound output file " << filename << std::endl;
+			return false;
+		}
+		WriteHeader();
+	}
+
+	ninfo = info;
+	callback = ncallback;
+	userdata = nuserdata;
+	buffer.resize(info.samples * info.channels * info.bytespersample);
+	frames = 0;
+	paused = true;
+	quit = false;
+
+	if (mode != MANUAL)
+		thread = SDL_CreateThread(Dispatch, "SoundOutput", this);
+
+	info_output << "Opened " << (file ? filename : "null") << " sound output: " <<
+		info.frequency << " Hz, " << info.bytespersample * 8 << " bits per sample" << std::endl;
+
+	return true;
+}
+
+void SoundOutputFile::Pause(bool value)
+{
+	paused = value;
+}
+
+void SoundOutputFile::Close()
+{
+	if (thread)
+	{
+		quit = true;
+		SDL_WaitThread(thread, NULL);
+		thread = 0;
+	}
+
+	if (file)
+	{
+		// patch data size
+		std::fseek(file, 0, SEEK_SET);
+		WriteHeader();
+		std::fclose(file);
+		file = 0;
+	}
+
+	callback = 0;
+}
+
+void SoundOutputFile::Process(unsigned nframes)
+{
+	assert(mode == MANUAL);
+	assert(callback);
+
+	while (nframes > 0)
+	{
+		unsigned n = Min(nframes, info.samples);
+		Pull(n);
+		nframes -= n;
+	}
+}
+
+unsigned long long SoundOutputFile::GetFrames() const
+{
+	return frames;
+}
+
+void SoundOutputFile::Pull(unsigned nframes)
+{
+	unsigned size = nframes * info.channels * info.bytespersample;
+	callback(userdata, buffer.data(), size);
+
+	if (file)
+	{
+		std::fwrite(buffer.data(), 1, size, file);
+		data_size += size;
+	}
+	frames += nframes;
+}
+
+void SoundOutputFile::Run()
+{
+	unsigned long long start_frames = 0;
+	unsigned start_ticks = 0;
+	bool restart = true;
+	while (!quit)
+	{
+		if (paused)
+		{
+			SDL_Delay(10);
+			restart = true;
+			continue;
+		}
+
+		if (mode == REALTIME)
+		{
+			if (restart)
+			{
+				start_frames = frames;
+				start_ticks = SDL_GetTicks();
+				restart = false;
+			}
+
+			// stay one buffer ahead of the wall clock
+			unsigned long long ticks = SDL_GetTicks() - start_ticks;
+			unsigned long long due = start_frames + ticks * info.frequency / 1000 + info.samples;
+			if (frames >= due)
+			{
+				SDL_Delay(1);
+				continue;
+			}
+		}
+
+		Pull(info.samples);
+	}
+}
+
+int SoundOutputFile::Dispatch(void * data)
+{
+	static_cast<SoundOutputFile*>(data)->Run();
+	return 0;
+}
+
+static void Write16(std::FILE * file, uint16_t value)
+{
+	unsigned char b[2] = {(unsigned char)value, (unsigned char)(value >> 8)};
+	std::fwrite(b, 1, 2, file);
+}
+
+static void Write32(std::FILE * file, uint32_t value)
+{
+	Write16(file, value & 0xffff);
+	Write16(file, value >> 16);
+}
+
+void SoundOutputFile::WriteHeader()
+{
+	// wave header, 1 = pcm, 3 = ieee float
+	// non pcm formats need a fmt extension size and a fact chunk
+	const bool pcm = (bytespersample == 2);
+	const uint32_t fmt_size = pcm ? 16 : 18;
+	const uint32_t fact_size = pcm ? 0 : 12;
+	const uint32_t header_size = 4 + 8 + fmt_size + fact_size + 8;
+	uint32_t size = Min<unsigned long long>(data_size, 0xffffffff - header_size);
+	uint16_t format = pcm ? 1 : 3;
+	uint16_t channels = 2;
+	uint16_t block_align = channels * bytespersample;
+	std::fwrite("RIFF", 1, 4, file);
+	Write32(file, header_size + size);
+	std::fwrite("WAVEfmt ", 1, 8, file);
+	Write32(file, fmt_size);
+	Write16(file, format);
+	Write16(file, channels);
+	Write32(file, info.frequency);
+	Write32(file, info.frequency * block_align);
+	Write16(file, block_align);
+	Write16(file, bytespersample * 8);
+	if (!pcm)
+	{
+		Write16(file, 0);
+		std::fwrite("fact", 1, 4, file);
+		Write32(file, 4);
+		Write32(file, size / block_align);
+	}
+	std::fwrite("data", 1, 4, file);
+	Write32(file, size);
+}
+
+#include "unittest.h"
+#include <cstring>
+#include <vector>
+
+static void SoundOutputTestCallback(void *, unsigned char stream[], int len)
+{
+	std::memset(stream, 0, len);
+}
+
+static uint32_t Read32(const unsigned char data[])
+{
+	return data[0] | (data[1] << 8) | (data[2] << 16) | (uint32_t(data[3]) << 24);
+}
+
+QT_TEST(soundoutput_test)
+{
+	std::ostringstream log;
+
+	// zero sized buffers are rejected
+	SoundOutputFile null_output(std::string(), SoundOutputFile::MANUAL, 2);
+	SoundInfo info(0, 44100, 2, 2);
+	QT_CHECK(!null_output.Open(info, SoundOutputTestCallback, 0, log, log));
+
+	// float wave file has a fmt extension and a fact chunk
+	const char * filename = "soundoutput_test.wav";
+	{
+		SoundOutputFile output(filename, SoundOutputFile::MANUAL, 4);
+		info = SoundInfo(512, 44100, 2, 4);
+		QT_CHECK(output.Open(info, SoundOutputTestCallback, 0, log, log));
+		output.Process(1000);
+		output.Close();
+	}
+	std::vector<unsigned char> data(16384);
+	std::FILE * file = std::fopen(filename, "rb");
+	QT_CHECK(file);
+	if (!file)
+		return;
+	data.resize(std::fread(data.data(), 1, data.size(), file));
+	std::fclose(file);
+	std::remove(filename);
+
+	const unsigned frame_size = 2 * 4;
+	QT_CHECK_EQUAL(data.size(), 58 + 1000 * frame_size);
+	if (data.size() < 58)
+		return;
+	QT_CHECK(!std::memcmp(&data[0], "RIFF", 4));
+	QT_CHECK_EQUAL(Read32(&data[4]), data.size() - 8);
+	QT_CHECK(!std::memcmp(&data[8], "WAVEfmt ", 8));
+	QT_CHECK_EQUAL(Read32(&data[16]), 18u);
+	QT_CHECK_EQUAL(data[20], 3);
+	QT_CHECK_EQUAL(data[36] | (data[37] << 8), 0);
+	QT_CHECK(!std::memcmp(&data[38], "fact", 4));
+	QT_CHECK_EQUAL(Read32(&data[42]), 4u);
+	QT_CHECK_EQUAL(Read32(&data[46]), 1000u);
+	QT_CHECK(!std::memcmp(&data[50], "data", 4));
+	QT_CHECK_EQUAL(Read32(&data[54]), 1000u * frame_size);
+}
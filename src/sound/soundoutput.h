@@ -0,0 +1,141 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _SOUNDOUTPUT_H
+#define _SOUNDOUTPUT_H
+
+#include "soundinfo.h"
+
+#include <atomic>
+#include <cstdio>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+struct SDL_Thread;
+
+/// Audio output backend, pulls interleaved stereo samples from a mixer callback.
+/// Supported sample formats are 16 bit integer and 32 bit float.
+class SoundOutput
+{
+public:
+	typedef void (*Callback)(void * userdata, unsigned char stream[], int len);
+
+	virtual ~SoundOutput() {}
+
+	/// info holds the desired format on input, the obtained format on output
+	/// the callback is not called before the output is unpaused
+	virtual bool Open(
+		SoundInfo & info,
+		Callback callback,
+		void * userdata,
+		std::ostream & info_output,
+		std::ostream & error_output) = 0;
+
+	/// start or stop pulling samples, output is paused after open
+	virtual void Pause(bool value) = 0;
+
+	virtual void Close() = 0;
+};
+
+/// SDL audio device output
+class SoundOutputSdl : public SoundOutput
+{
+public:
+	SoundOutputSdl();
+
+	~SoundOutputSdl();
+
+	bool Open(
+		SoundInfo & info,
+		Callback callback,
+		void * userdata,
+		std::ostream & info_output,
+		std::ostream & error_output) override;
+
+	void Pause(bool value) override;
+
+	void Close() override;
+
+private:
+	bool open;
+};
+
+/// Offline output, does not need an audio device. Samples are pulled on a
+/// worker thread in real time or as fast as possible, or on demand by the
+/// caller. Pulled samples are written into a WAV file if a filename is set.
+class SoundOutputFile : public SoundOutput
+{
+public:
+	enum Mode
+	{
+		MANUAL,		///< samples are pulled by calling Process only
+		REALTIME,	///< pull samples at device frequency
+		FAST		///< pull samples as fast as possible
+	};
+
+	/// empty filename discards samples (null output)
+	/// bytespersample selects the 16 bit integer (2) or float (4) mixing path
+	SoundOutputFile(const std::string & filename, Mode mode, unsigned bytespersample = 2);
+
+	~SoundOutputFile();
+
+	bool Open(
+		SoundInfo & info,
+		Callback callback,
+		void * userdata,
+		std::ostream & info_output,
+		std::ostream & error_output) override;
+
+	void Pause(bool value) override;
+
+	void Close() override;
+
+	/// pull given number of stereo sample frames in device buffer sized chunks
+	/// not thread safe, in MANUAL mode only
+	void Process(unsigned frames);
+
+	/// number of stereo sample frames pulled since open
+	unsigned long long GetFrames() const;
+
+private:
+	std::string filename;
+	Mode mode;
+	unsigned bytespersample;
+	std::FILE * file;
+	Callback callback;
+	void * userdata;
+	SoundInfo info;
+	std::vector<unsigned char> buffer;
+	std::atomic<unsigned long long> frames;
+	unsigned long long data_size;
+	SDL_Thread * thread;
+	std::atomic<bool> paused;
+	std::atomic<bool> quit;
+
+	void Pull(unsigned frames);
+
+	void Run();
+
+	static int Dispatch(void * data);
+
+	void WriteHeader();
+};
+
+#endif // _SOUNDOUTPUT_H
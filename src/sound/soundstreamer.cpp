@@ -0,0 +1,106 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "soundstreamer.h"
+#include "soundbuffer.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+
+#include <algorithm>
+#include <cassert>
+
+SoundStreamer::SoundStreamer() :
+	mutex(SDL_CreateMutex()),
+	thread(0),
+	quit(false)
+{
+	// ctor
+}
+
+SoundStreamer::~SoundStreamer()
+{
+	Stop();
+	SDL_DestroyMutex(mutex);
+}
+
+void SoundStreamer::Start()
+{
+	assert(!thread);
+	quit = false;
+	thread = SDL_CreateThread(Dispatch, "SoundStreamer", this);
+}
+
+void SoundStreamer::Stop()
+{
+	if (!thread)
+		return;
+
+	quit = true;
+	SDL_WaitThread(thread, NULL);
+	thread = 0;
+}
+
+void SoundStreamer::Add(const std::shared_ptr<SoundBuffer> & buffer)
+{
+	assert(buffer->GetStreaming());
+	SDL_LockMutex(mutex);
+	buffers.push_back(buffer);
+	SDL_UnlockMutex(mutex);
+}
+
+void SoundStreamer::Remove(const SoundBuffer * buffer)
+{
+	SDL_LockMutex(mutex);
+	auto i = std::find_if(buffers.begin(), buffers.end(),
+		[buffer](const std::shared_ptr<SoundBuffer> & b) { return b.get() == buffer; });
+	if (i != buffers.end())
+	{
+		*i = buffers.back();
+		buffers.pop_back();
+	}
+	SDL_UnlockMutex(mutex);
+}
+
+void SoundStreamer::Run()
+{
+	while (!quit)
+	{
+		// decode outside of the lock, references keep buffers alive
+		SDL_LockMutex(mutex);
+		decode = buffers;
+		SDL_UnlockMutex(mutex);
+
+		for (const auto & buffer : decode)
+		{
+			buffer->StreamDecode();
+		}
+		decode.clear();
+
+		// a ring buffer holds about 0.7 seconds of sound
+		SDL_Delay(10);
+	}
+}
+
+int SoundStreamer::Dispatch(void * data)
+{
+	static_cast<SoundStreamer*>(data)->Run();
+	return 0;
+}
@@ -0,0 +1,63 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _SOUNDSTREAMER_H
+#define _SOUNDSTREAMER_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class SoundBuffer;
+struct SDL_Thread;
+struct SDL_mutex;
+
+/// Background thread decoding streamed sound buffers into their ring buffers.
+class SoundStreamer
+{
+public:
+	SoundStreamer();
+
+	~SoundStreamer();
+
+	/// start decoder thread
+	void Start();
+
+	/// stop decoder thread
+	void Stop();
+
+	/// add streamed buffer reference, buffers are decoded while referenced
+	void Add(const std::shared_ptr<SoundBuffer> & buffer);
+
+	/// remove streamed buffer reference
+	void Remove(const SoundBuffer * buffer);
+
+private:
+	std::vector<std::shared_ptr<SoundBuffer> > buffers;
+	std::vector<std::shared_ptr<SoundBuffer> > decode;
+	SDL_mutex * mutex;
+	SDL_Thread * thread;
+	std::atomic<bool> quit;
+
+	void Run();
+
+	static int Dispatch(void * data);
+};
+
+#endif // _SOUNDSTREAMER_H
@@ -0,0 +1,125 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _SPSCQUEUE_H
+#define _SPSCQUEUE_H
+
+#include <atomic>
+#include <cassert>
+#include <vector>
+
+// lock-free single producer single consumer ring buffer
+template <class T>
+class SpscQueue
+{
+public:
+	// capacity has to be a power of two
+	SpscQueue(unsigned capacity);
+
+	// consumer interface
+
+	// get next item, return false if queue is empty
+	bool pop(T & item);
+
+
+	// producer interface
+
+	// append item, return false if queue is full
+	bool push(const T & item);
+
+	// number of queued items, consumer may pop concurrently
+	unsigned size() const;
+
+	bool empty() const;
+
+	unsigned capacity() const;
+
+private:
+	// keep head and tail on separate cache lines, padded instead of alignas
+	// as c++14 allocation ignores over-alignment of heap allocated queues
+	static const unsigned cache_line = 64;
+
+	std::vector<T> buffer;
+	unsigned mask;
+	char pad0[cache_line];
+
+	// consumer writes head
+	std::atomic<unsigned> head;
+	char pad1[cache_line - sizeof(std::atomic<unsigned>)];
+
+	// producer writes tail
+	std::atomic<unsigned> tail;
+	char pad2[cache_line - sizeof(std::atomic<unsigned>)];
+};
+
+
+template <class T>
+inline SpscQueue<T>::SpscQueue(unsigned capacity) :
+	buffer(capacity),
+	mask(capacity - 1),
+	head(0),
+	tail(0)
+{
+	assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+}
+
+template <class T>
+inline bool SpscQueue<T>::pop(T & item)
+{
+	// head and tail are free running counters, wrapped by mask on access
+	auto head_cur = head.load(std::memory_order_relaxed);
+	if (tail.load(std::memory_order_acquire) == head_cur)
+		return false;
+
+	item = buffer[head_cur & mask];
+	head.store(head_cur + 1, std::memory_order_release);
+	return true;
+}
+
+template <class T>
+inline bool SpscQueue<T>::push(const T & item)
+{
+	auto tail_cur = tail.load(std::memory_order_relaxed);
+	if (tail_cur - head.load(std::memory_order_acquire) > mask)
+		return false;
+
+	buffer[tail_cur & mask] = item;
+	tail.store(tail_cur + 1, std::memory_order_release);
+	return true;
+}
+
+template <class T>
+inline unsigned SpscQueue<T>::size() const
+{
+	return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire);
+}
+
+template <class T>
+inline bool SpscQueue<T>::empty() const
+{
+	return size() == 0;
+}
+
+template <class T>
+inline unsigned SpscQueue<T>::capacity() const
+{
+	return mask + 1;
+}
+
+#endif
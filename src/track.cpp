@@ -45,6 +45,7 @@ bool Track::DeferredLoad(
 	const std::string & trackdir,
 	const std::string & texturedir,
 	const std::string & sharedobjectpath,
+	const std::string & cachepath,
 	const int anisotropy,
 	const bool reverse,
 	const bool dynamicobjects,
@@ -61,6 +62,7 @@ bool Track::DeferredLoad(
 			info_output, error_output,
 			trackpath, trackdir,
 			texturedir,	sharedobjectpath,
+			cachepath,
 			anisotropy, reverse,
 			dynamicobjects,
 			dynamicshadows));
@@ -113,12 +115,14 @@ void Track::Clear()
 	data.meshes.clear();
 
 	data.static_node.Clear();
+	data.occluders.Clear();
 	data.surfaces.clear();
 	data.models.clear();
 	data.dynamic_node.Clear();
 	data.body_nodes.clear();
 	data.body_transforms.clear();
 	data.lap.clear();
+	data.road_index.Clear();
 	data.roads.clear();
 	data.start_positions.clear();
 	data.racingline_node.Clear();
@@ -21,9 +21,11 @@
 #define _TRACK_H
 
 #include "roadstrip.h"
+#include "roadpatchindex.h"
 #include "mathvector.h"
 #include "quaternion.h"
 #include "graphics/scenenode.h"
+#include "graphics/vertexarray.h"
 #include "physics/motionstate.h"
 #include "physics/tracksurface.h"
 
@@ -62,6 +64,7 @@ public:
 		const std::string & trackdir,
 		const std::string & effects_texturepath,
 		const std::string & sharedobjectpath,
+		const std::string & cachepath,
 		const int anisotropy,
 		const bool reverse,
 		const bool dynamicobjects,
@@ -107,6 +110,12 @@ public:
 		return data.roads;
 	}
 
+	/// spatial index over all road patches
+	const RoadPatchIndex & GetRoadIndex() const
+	{
+		return data.road_index;
+	}
+
 	unsigned int GetSectors() const
 	{
 		return data.lap.size();
@@ -156,6 +165,12 @@ public:
 		return data.static_node;
 	}
 
+	/// world space triangles of static geometry marked as occluder
+	const VertexArray & GetOccluders() const
+	{
+		return data.occluders;
+	}
+
 	SceneNode & GetBodyNode()
 	{
 		return data.dynamic_node;
@@ -172,6 +187,7 @@ private:
 
 		// static track objects
 		SceneNode static_node;
+		VertexArray occluders;
 		std::vector<TrackSurface> surfaces;
 		std::vector<btStridingMeshInterface*> meshes;
 		std::vector<btCollisionShape*> shapes;
@@ -185,6 +201,7 @@ private:
 		// road information
 		std::vector<const RoadPatch*> lap;
 		std::vector<RoadStrip> roads;
+		RoadPatchIndex road_index;
 		std::vector<std::pair<Vec3, Quat > > start_positions;
 
 		SceneNode racingline_node;
@@ -23,7 +23,10 @@
 #include "coordinatesystem.h"
 #include "tobullet.h"
 #include "k1999.h"
+#include "parallel_task.h"
+#include "profiler.h"
 #include "minmax.h"
+#include "loaddrawable.h"
 #include "content/contentmanager.h"
 #include "graphics/texture.h"
 #include "graphics/model.h"
@@ -34,6 +37,11 @@
 #include "BulletCollision/CollisionShapes/btTriangleIndexVertexArray.h"
 #include "BulletDynamics/Dynamics/btRigidBody.h"
 
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
 #define EXTBULLET
 
 static const float deg2rad = M_PI / 180;
@@ -87,6 +95,7 @@ static btIndexedMesh GetIndexedMesh(const Model & model)
 struct Track::Loader::Object
 {
 	std::shared_ptr<Model> model;
+	std::string model_name;
 	std::string texture;
 	int transparent_blend;
 	int clamptexture;
@@ -108,6 +117,7 @@ Track::Loader::Loader(
 	const std::string & trackdir,
 	const std::string & texturedir,
 	const std::string & sharedobjectpath,
+	const std::string & cachepath,
 	const int anisotropy,
 	const bool reverse,
 	const bool dynamic_objects,
@@ -121,6 +131,7 @@ Track::Loader::Loader(
 	trackdir(trackdir),
 	texturedir(texturedir),
 	sharedobjectpath(sharedobjectpath),
+	cachepath(cachepath),
 	anisotropy(anisotropy),
 	dynamic_objects(dynamic_objects),
 	dynamic_shadows(dynamic_shadows),
@@ -154,6 +165,8 @@ void Track::Loader::Clear()
 
 bool Track::Loader::BeginLoad()
 {
+	PROFILE_SCOPE("track begin load");
+
 	Clear();
 
 	info_output << "Loading track from path: " << trackpath << std::endl;
@@ -174,6 +187,8 @@ bool Track::Loader::BeginLoad()
 		return false;
 	}
 
+	data.road_index.Build(data.roads);
+
 	// load info
 	std::string info_path = trackpath + "/track.txt";
 	std::ifstream file(info_path.c_str());
@@ -223,6 +238,8 @@ bool Track::Loader::BeginLoad()
 
 bool Track::Loader::ContinueLoad()
 {
+	PROFILE_SCOPE("track continue load");
+
 	if (data.loaded)
 	{
 		return true;
@@ -245,6 +262,7 @@ bool Track::Loader::ContinueLoad()
 		data.shapes.push_back(track_shape);
 		track_shape = 0;
 #endif
+		BuildBatches();
 		data.loaded = true;
 		Clear();
 	}
@@ -389,6 +407,7 @@ Track::Loader::body_iterator Track::Loader::LoadBody(const PTree & cfg)
 	bool alphablend = false;
 	bool doublesided = false;
 	bool isashadow = false;
+	bool lod = true;
 
 	cfg.get("texture", texture_str, error_output);
 	cfg.get("model", model_name, error_output);
@@ -399,6 +418,8 @@ Track::Loader::body_iterator Track::Loader::LoadBody(const PTree & cfg)
 	cfg.get("isashadow", isashadow);
 	cfg.get("skybox", body.skybox);
 	cfg.get("nolighting", body.nolighting);
+	cfg.get("lod", lod);
+	cfg.get("occluder", body.occluder);
 
 	std::vector<std::string> texture_names(3);
 	std::istringstream s(texture_str);
@@ -485,10 +506,25 @@ Track::Loader::body_iterator Track::Loader::LoadBody(const PTree & cfg)
 	drawable.SetDecal(alphablend);
 	drawable.SetCull(data.cull && !doublesided);
 
+	// skyboxes are always far away, skip level of detail
+	// detail levels prevent batching, so only unbatched instances load them
+	body.model_name = model_name;
+	body.lod = lod && !body.skybox;
+
 	return bodies.emplace(name, body).first;
 }
 
-void Track::Loader::AddBody(SceneNode & scene, const Body & body)
+void Track::Loader::AddBody(SceneNode & scene, Body & body)
+{
+	if (body.lod)
+	{
+		LoadLodModels(content, objectdir, body.model_name, data.models, body.drawable);
+		body.lod = false;
+	}
+	GetDrawList(scene, body).insert(body.drawable);
+}
+
+keyed_container<Drawable> & Track::Loader::GetDrawList(SceneNode & scene, const Body & body)
 {
 	bool nolighting = body.nolighting;
 	bool alphablend = body.drawable.GetDecal();
@@ -515,11 +551,37 @@ void Track::Loader::AddBody(SceneNode & scene, const Body & body)
 			dlist = &scene.GetDrawList().normal_noblend_nolighting;
 		}
 	}
-	dlist->insert(body.drawable);
+	return *dlist;
+}
+
+void Track::Loader::BuildBatches()
+{
+	PROFILE_SCOPE("track batches");
+
+	const unsigned count = batch.GetCount();
+	if (count == 0)
+		return;
+
+	std::vector<StaticBatch::Batch> batches;
+	batch.Build(batches);
+	for (auto & b : batches)
+	{
+		// combined models are unique to this track load, don't cache them
+		if (b.model)
+			data.models.insert(b.model);
+
+		// batched drawables are added without detail levels
+		LoadLodModels(content, objectdir, std::string(), data.models, b.drawable);
+		b.dlist->insert(b.drawable);
+	}
+
+	info_output << "Batched " << count << " static objects into " << batches.size() << " drawables" << std::endl;
 }
 
 bool Track::Loader::LoadNode(const PTree & sec)
 {
+	PROFILE_SCOPE("track object");
+
 	const PTree * sec_body;
 	if (!sec.get("body", sec_body, error_output))
 	{
@@ -537,11 +599,16 @@ bool Track::Loader::LoadNode(const PTree & sec)
 	bool has_transform = sec.get("position",  position) | sec.get("rotation", angle);
 	Quat rotation(angle[0] * deg2rad, angle[1] * deg2rad, angle[2] * deg2rad);
 
-	const Body & body = ib->second;
+	Body & body = ib->second;
 	if (body.mass < 1E-3f)
 	{
 		// static geometry
-		if (has_transform)
+		if (!body.skybox &&
+			batch.Add(GetDrawList(data.static_node, body), body.drawable, rotation, position))
+		{
+			// static geometry batched
+		}
+		else if (has_transform)
 		{
 			// static geometry instanced
 			SceneNode::Handle h = data.static_node.AddNode();
@@ -556,6 +623,29 @@ bool Track::Loader::LoadNode(const PTree & sec)
 			AddBody(data.static_node, body);
 		}
 
+		if (body.occluder && !body.skybox)
+		{
+			// the rasterizer only reads positions and faces
+			const VertexArray & va = body.drawable.GetModel()->GetVertexArray();
+			const float * verts;
+			const unsigned * faces;
+			unsigned vcount, fcount;
+			va.GetVertices(verts, vcount);
+			va.GetFaces(faces, fcount);
+
+			std::vector<float> world(verts, verts + vcount);
+			for (unsigned i = 0; i < vcount; i += 3)
+			{
+				float * vert = &world[i];
+				rotation.RotateVector(vert);
+				vert[0] += position[0];
+				vert[1] += position[1];
+				vert[2] += position[2];
+			}
+			if (fcount)
+				data.occluders.Add(faces, fcount, world.data(), vcount);
+		}
+
 		if (body.collidable)
 		{
 			// static geometry collidable
@@ -696,6 +786,8 @@ bool Track::Loader::BeginOld()
 
 bool Track::Loader::AddObject(const Object & object)
 {
+	PROFILE_SCOPE("track object");
+
 	data.models.insert(object.model);
 
 	TextureInfo texinfo;
@@ -759,13 +851,22 @@ bool Track::Loader::AddObject(const Object & object)
 			dlist = &data.static_node.GetDrawList().skybox_noblend;
 		}
 	}
-	SceneNode::DrawableHandle dref = dlist->insert(Drawable());
-	Drawable & drawable = dlist->get(dref);
+	Drawable drawable;
 	drawable.SetModel(*object.model);
 	drawable.SetTextures(texture0->GetId(), texture1->GetId(), texture2->GetId());
 	drawable.SetDecal(transparent);
 	drawable.SetCull(data.cull && (object.transparent_blend != 2));
 
+	// batches get detail levels of the merged model
+	if (object.skybox || !batch.Add(*dlist, drawable))
+	{
+		if (!object.skybox)
+		{
+			LoadLodModels(content, objectdir, object.model_name, data.models, drawable);
+		}
+		dlist->insert(drawable);
+	}
+
 	if (object.collideable)
 	{
 		btTriangleIndexVertexArray * mesh = new btTriangleIndexVertexArray();
@@ -830,6 +931,7 @@ std::pair<bool, bool> Track::Loader::ContinueOld()
 		return std::make_pair(false, true);
 	}
 
+	object.model_name = model_name;
 	if (packload)
 	{
 		content.load(object.model, objectdir, model_name, pack);
@@ -858,6 +960,8 @@ std::pair<bool, bool> Track::Loader::ContinueOld()
 
 bool Track::Loader::LoadSurfaces()
 {
+	PROFILE_SCOPE("track surfaces");
+
 	std::string path = trackpath + "/surfaces.txt";
 	std::ifstream file(path.c_str());
 	if (!file.good())
@@ -914,6 +1018,8 @@ bool Track::Loader::LoadSurfaces()
 
 bool Track::Loader::LoadRoads()
 {
+	PROFILE_SCOPE("track roads");
+
 	data.roads.clear();
 
 	std::string roadpath = trackpath + "/roads.trk";
@@ -936,19 +1042,162 @@ bool Track::Loader::LoadRoads()
 	return true;
 }
 
+// racing line calculation shared by the loader and its workers
+struct RacingLineJobs
+{
+	std::vector<K1999> solvers;
+	std::atomic<unsigned> next;
+
+	RacingLineJobs(unsigned count) : solvers(count), next(0) {}
+
+	void Run()
+	{
+		unsigned i;
+		while ((i = next++) < solvers.size())
+		{
+			PROFILE_SCOPE("racing line");
+			solvers[i].CalcRaceLine();
+		}
+	}
+};
+
+class RacingLineWorker : public Parallel::Task
+{
+public:
+	RacingLineWorker(RacingLineJobs & jobs) : jobs(jobs)
+	{
+		// wait for the worker thread to be ready
+		Init();
+		End();
+	}
+
+	void Setup() override
+	{
+		Profiler::SetThreadName("racing line worker");
+	}
+
+	void Execute() override
+	{
+		jobs.Run();
+	}
+
+private:
+	RacingLineJobs & jobs;
+};
+
+static bool ReadRacingLines(std::istream & in, unsigned key, std::vector<K1999> & solvers)
+{
+	unsigned in_key = 0, in_count = 0;
+	in.read((char*)&in_key, sizeof(in_key));
+	in.read((char*)&in_count, sizeof(in_count));
+	if (!in || in_key != key || in_count != solvers.size())
+		return false;
+
+	for (auto & solver : solvers)
+	{
+		if (!solver.ReadFrom(in))
+			return false;
+	}
+	return true;
+}
+
+static void WriteRacingLines(std::ostream & out, unsigned key, const std::vector<K1999> & solvers)
+{
+	const unsigned count = solvers.size();
+	out.write((const char*)&key, sizeof(key));
+	out.write((const char*)&count, sizeof(count));
+	for (const auto & solver : solvers)
+	{
+		solver.WriteTo(out);
+	}
+}
+
+unsigned Track::Loader::GetRacingLineKey() const
+{
+	std::ifstream file((trackpath + "/roads.trk").c_str(), std::ios::binary);
+	const std::string roads(
+		(std::istreambuf_iterator<char>(file)),
+		std::istreambuf_iterator<char>());
+
+	// FNV-1a over roads file, seeded with racing line parameters
+	unsigned hash = K1999::GetParametersHash();
+	hash = (hash ^ unsigned(data.reverse)) * 16777619u;
+	for (unsigned char c : roads)
+	{
+		hash = (hash ^ c) * 16777619u;
+	}
+	return hash;
+}
+
 bool Track::Loader::CreateRacingLines()
 {
-	K1999 k1999;
+	PROFILE_SCOPE("track racing lines");
+
+	// K1999 requires a closed circuit
+	std::vector<RoadStrip *> roads;
 	for (auto & road : data.roads)
 	{
-		// K1999 requires a closed circuit
 		if (road.GetClosed())
+			roads.push_back(&road);
+	}
+	if (roads.empty())
+		return true;
+
+	RacingLineJobs jobs(roads.size());
+	for (size_t i = 0; i < roads.size(); ++i)
+	{
+		jobs.solvers[i].LoadData(*roads[i]);
+	}
+
+	// racing lines are cached per track and direction
+	const std::string trackname = trackpath.substr(trackpath.find_last_of("/\\") + 1);
+	const std::string cachefile = cachepath + "/" + trackname +
+		(data.reverse ? "_reverse" : "") + ".racingline";
+	const unsigned key = GetRacingLineKey();
+
+	std::ifstream cachein(cachefile.c_str(), std::ios::binary);
+	if (cachein && ReadRacingLines(cachein, key, jobs.solvers))
+	{
+		info_output << "Loaded racing line from cache: " << cachefile << std::endl;
+	}
+	else
+	{
+		cachein.close();
+
+		// reset solvers, a partially read cache could have modified them
+		for (size_t i = 0; i < roads.size(); ++i)
+		{
+			jobs.solvers[i].LoadData(*roads[i]);
+		}
+
+		// independent roads are calculated concurrently
+		const unsigned workers_num = Min(
+			unsigned(roads.size() - 1),
+			unsigned(Max(SDL_GetCPUCount() - 1, 0)));
+		std::vector<std::unique_ptr<RacingLineWorker> > workers;
+		for (unsigned i = 0; i < workers_num; ++i)
+		{
+			workers.emplace_back(new RacingLineWorker(jobs));
+			workers.back()->Start();
+		}
+
+		jobs.Run();
+
+		for (auto & worker : workers)
 		{
-			k1999.LoadData(road);
-			k1999.CalcRaceLine();
-			k1999.UpdateRoadStrip(road);
-			CreateRacingLine(road);
+			worker->End();
 		}
+
+		std::ofstream cacheout(cachefile.c_str(), std::ios::binary);
+		WriteRacingLines(cacheout, key, jobs.solvers);
+		if (!cacheout)
+			error_output << "Failed to write racing line cache: " << cachefile << std::endl;
+	}
+
+	for (size_t i = 0; i < roads.size(); ++i)
+	{
+		jobs.solvers[i].UpdateRoadStrip(*roads[i]);
+		CreateRacingLine(*roads[i]);
 	}
 	return true;
 }
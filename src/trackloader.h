@@ -23,6 +23,7 @@
 #include "track.h"
 #include "cfg/ptree.h"
 #include "joepack.h"
+#include "graphics/staticbatch.h"
 
 /*
 [object.foo]
@@ -38,6 +39,8 @@ model = body.joe
 #nolighting = false
 #alphablend = false
 #doublesided = false
+#lod = true
+#occluder = false # hide other objects during occlusion culling
 #isashadow = false
 #collideable = true
 #surface = 0
@@ -65,6 +68,7 @@ public:
 		const std::string & trackdir,
 		const std::string & texturedir,
 		const std::string & sharedobjectpath,
+		const std::string & cachepath,
 		const int anisotropy,
 		const bool reverse,
 		const bool dynamic_shadows,
@@ -91,6 +95,7 @@ private:
 	const std::string & trackdir;
 	const std::string & texturedir;
 	const std::string & sharedobjectpath;
+	const std::string cachepath;
 	const int anisotropy;
 	const bool dynamic_objects;
 	const bool dynamic_shadows;
@@ -111,14 +116,16 @@ private:
 	// pod for references
 	struct Body
 	{
-		Body() : nolighting(false), skybox(false), mesh(0), shape(0),
-			mass(0), surface(0), collidable(false)
+		Body() : nolighting(false), skybox(false), occluder(false), mesh(0), shape(0),
+			mass(0), surface(0), collidable(false), lod(false)
 		{
 			// ctor
 		}
 		Drawable drawable;
+		std::string model_name;
 		bool nolighting;
 		bool skybox;
+		bool occluder;
 		btStridingMeshInterface * mesh;
 		btCollisionShape * shape;
 		btVector3 inertia;
@@ -126,8 +133,9 @@ private:
 		float mass;
 		int surface;
 		bool collidable;
+		bool lod; ///< level of detail models still to be loaded
 	};
-	typedef std::map<std::string, Body>::const_iterator body_iterator;
+	typedef std::map<std::string, Body>::iterator body_iterator;
 	std::map<std::string, Body> bodies;
 
 	// compound track shape
@@ -138,12 +146,19 @@ private:
 	const PTree * nodes;
 	PTree::const_iterator node_it;
 
+	// static geometry batching
+	StaticBatch batch;
+
 	bool LoadSurfaces();
 
 	bool LoadRoads();
 
+	/// calculate racing lines of closed roads, reuse cached ones if roads are unchanged
 	bool CreateRacingLines();
 
+	/// racing line cache key, hash of the roads file and racing line parameters
+	unsigned GetRacingLineKey() const;
+
 	void CreateRacingLine(const RoadStrip & strip);
 
 	bool LoadStartPositions(const PTree & info);
@@ -170,7 +185,12 @@ private:
 
 	body_iterator LoadBody(const PTree & cfg);
 
-	void AddBody(SceneNode & scene, const Body & body);
+	/// add unbatched body instance, loads the body level of detail models
+	void AddBody(SceneNode & scene, Body & body);
+
+	keyed_container<Drawable> & GetDrawList(SceneNode & scene, const Body & body);
+
+	void BuildBatches();
 
 	struct Object;
 	bool AddObject(const Object & object);
@@ -23,6 +23,7 @@
 
 #include <fstream>
 #include <cassert>
+#include <cstdio>
 
 namespace Utils
 {
@@ -149,6 +150,37 @@ std::vector <std::string> explode(const std::string & toExplode, const std::stri
 	return out;
 }
 
+std::string jsonstr(const std::string & str)
+{
+	std::string out;
+	out.reserve(str.size() + 2);
+	out.push_back('"');
+	for (char c : str)
+	{
+		switch (c)
+		{
+			case '"': out.append("\\\""); break;
+			case '\\': out.append("\\\\"); break;
+			case '\n': out.append("\\n"); break;
+			case '\r': out.append("\\r"); break;
+			case '\t': out.append("\\t"); break;
+			default:
+				if ((unsigned char)c < 0x20)
+				{
+					char code[8];
+					std::snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+					out.append(code);
+				}
+				else
+				{
+					out.push_back(c);
+				}
+		}
+	}
+	out.push_back('"');
+	return out;
+}
+
 }
 
 QT_TEST(utils_test)
@@ -182,4 +214,11 @@ QT_TEST(utils_test)
 		if (exploded.size() > 3) QT_CHECK_EQUAL(exploded[3], "code");
 		if (exploded.size() > 4) QT_CHECK_EQUAL(exploded[4], "test.hog");
 	}
+
+	{
+		QT_CHECK_EQUAL(Utils::jsonstr(""), "\"\"");
+		QT_CHECK_EQUAL(Utils::jsonstr("track/car"), "\"track/car\"");
+		QT_CHECK_EQUAL(Utils::jsonstr("a \"b\" c:\\d"), "\"a \\\"b\\\" c:\\\\d\"");
+		QT_CHECK_EQUAL(Utils::jsonstr("1\n2\t3\x01"), "\"1\\n2\\t3\\u0001\"");
+	}
 }
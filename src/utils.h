@@ -89,6 +89,9 @@ std::string implode(const T & toImplode, const std::string & sep)
 
 std::vector <std::string> explode(const std::string & toExplode, const std::string & sep);
 
+/// return str as a quoted json string, escaping quotes, backslashes and control characters
+std::string jsonstr(const std::string & str);
+
 /// print all elements in the vector to the provided ostream
 template <typename T>
 void print_vector(const std::vector <T> & v, std::ostream & o, const std::string delim = ", ")